@@ -6,12 +6,48 @@
  * personally or commercially, just give credit if you do.
  */
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include "memstream.h"
 #include "pal.h"
+#include "util.h"
+#include "ssi-ctx.h"
 
 #ifndef IMG_BMP
 #define IMG_BMP
 
+// state for reading a 16 colour BMP file one line at a time
+typedef struct {
+    mapped_file_t map;       // the BMP file when memory mapped
+    FILE        *fp;         // the open BMP file when it can't be mapped
+    uint16_t    width;       // image width in pixels
+    uint16_t    height;      // image height in pixels
+    uint32_t    stride;      // bytes per line in the file, padded to 32 bits
+    bool        topdown;     // true if lines are stored top to bottom (negative height)
+    uint16_t    lines;       // number of lines read so far
+    uint8_t     *buf;        // line buffer when reading from fp, or for an RLE line once packed
+    ssi_ctx_t   *ctx;        // context the line buffer came from, NULL if malloc'd
+    uint32_t    compression; // 0 for uncompressed, otherwise RLE8 (1) or RLE4 (2)
+    const uint8_t *rle;      // RLE compressed pixel data, in the mapping or rle_buf
+    size_t      rle_len;     // size of the compressed data
+    size_t      rle_pos;     // offset of the next line's codes
+    uint16_t    rle_skip;    // blank lines still to come from a delta
+    uint16_t    rle_x;       // where a delta left the next line to start
+    bool        rle_done;    // end of bitmap seen, the remaining lines are blank
+    uint8_t     *rle_buf;    // compressed data when reading from fp
+    uint8_t     *lin;        // RLE line at 1 byte per pixel, before packing
+} bmp4_reader_t;
+
+// state for writing a 16 colour BMP file one line at a time
+typedef struct {
+    FILE        *fp;         // the open BMP file
+    uint16_t    width;       // image width in pixels
+    uint16_t    height;      // image height in pixels
+    uint32_t    stride;      // bytes per line in the file, padded to 32 bits
+    bool        topdown;     // true if lines are written top to bottom (negative height)
+    uint16_t    lines;       // number of lines written so far
+} bmp4_writer_t;
+
 /// @brief saves the image pointed to by src as a BMP, assumes 256 colour 1 byte per pixel image data
 /// @param fn name of the file to create and write to
 /// @param src memstream buffer pointer to the source image data
@@ -21,6 +57,10 @@
 /// @return 0 on success, otherwise an error code
 int save_bmp8(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal);
 
+/// @brief as save_bmp8() with the line buffer allocated from a conversion context
+/// @param ctx context to allocate from, or NULL to use malloc
+int save_bmp8_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal);
+
 /// @brief saves the image pointed to by src as a BMP, assumes 16 colour 1 byte per pixel image data
 /// @param fn name of the file to create and write to
 /// @param src memstream buffer pointer to the source image data
@@ -30,8 +70,87 @@ int save_bmp8(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t hei
 /// @return 0 on success, otherwise an error code
 int save_bmp4(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal);
 
+/// @brief as save_bmp4() with the line buffer allocated from a conversion context
+/// @param ctx context to allocate from, or NULL to use malloc
+int save_bmp4_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal);
+
+/// @brief saves 16 colour pixel data that is already packed as BMP expects, 2 pixels per byte
+///        with lines bottom up and padded to 32 bits, see pln2bmp4()
+/// @param fn name of the file to create and write to
+/// @param src memstream buffer pointer to the packed pixel data
+/// @param width  width of the image in pixels
+/// @param height height of the image in pixels or lines
+/// @param pal pointe to 16 entry palette
+/// @return 0 on success, otherwise an error code
+int save_bmp4_packed(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal);
+
+/// @brief saves the image pointed to by src as a run length encoded (RLE8) BMP, assumes 256 colour
+///        1 byte per pixel image data
+/// @param fn name of the file to create and write to
+/// @param src memstream buffer pointer to the source image data
+/// @param width  width of the image in pixels
+/// @param height height of the image in pixels or lines
+/// @param pal pointer to 256 entry RGB palette
+/// @return 0 on success, otherwise an error code
+int save_bmp8_rle(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal);
+
+/// @brief as save_bmp8_rle() with the line buffer allocated from a conversion context
+/// @param ctx context to allocate from, or NULL to use malloc
+int save_bmp8_rle_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal);
+
+/// @brief saves the image pointed to by src as a run length encoded (RLE4) BMP, assumes 16 colour
+///        1 byte per pixel image data
+/// @param fn name of the file to create and write to
+/// @param src memstream buffer pointer to the source image data
+/// @param width  width of the image in pixels
+/// @param height height of the image in pixels or lines
+/// @param pal pointer to 16 entry palette
+/// @return 0 on success, otherwise an error code
+int save_bmp4_rle(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal);
+
+/// @brief as save_bmp4_rle() with the line buffer allocated from a conversion context
+/// @param ctx context to allocate from, or NULL to use malloc
+int save_bmp4_rle_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal);
+
+/// @brief saves true colour pixel data as a 24 bit BMP, see img_decode_rgb()
+/// @param fn name of the file to create and write to
+/// @param src memstream buffer pointer to the pixels, 3 bytes per pixel in B, G, R order (RGB_BGR24),
+///        top line first and lines not padded
+/// @param width  width of the image in pixels
+/// @param height height of the image in pixels or lines
+/// @return 0 on success, otherwise an error code
+int save_bmp24(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height);
+
+/// @brief saves true colour pixel data as a 32 bit BMP, as save_bmp24() with 4 bytes per pixel
+///        in B, G, R, A order (RGB_BGRA32)
+int save_bmp32(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height);
+
+/// @brief creates a 16 colour BMP file to be written one line at a time, the header and
+///        palette are written immediately
+/// @param wr pointer to the writer state to set up
+/// @param fn name of the file to create and write to
+/// @param width  width of the image in pixels
+/// @param height height of the image in pixels or lines
+/// @param topdown if true lines are written top to bottom (negative height BMP), otherwise
+///        they must be written bottom to top
+/// @param pal pointe to 16 entry palette
+/// @return 0 on success, otherwise an error code
+int bmp4_create(bmp4_writer_t *wr, const char *fn, uint16_t width, uint16_t height, bool topdown, pal_entry_t *xpal);
+
+/// @brief writes the next line of pixel data, in file order
+/// @param wr pointer to an open writer
+/// @param line pointer to the line, 2 pixels per byte left most in the high nibble, (width + 1) / 2 bytes
+/// @return 0 on success, otherwise an error code
+int bmp4_write_line(bmp4_writer_t *wr, const uint8_t *line);
+
+/// @brief closes the BMP file
+/// @param wr pointer to the writer
+/// @return 0 on success, -5 if fewer lines than the height were written, -4 on a write error
+int bmp4_finish(bmp4_writer_t *wr);
+
 /// @brief loads the BMP image from a file, assumes 16 colour image. palette is ignored, assumed to follow 
-///        CGA/EGA/VGA standard palette
+///        CGA/EGA/VGA standard palette. RLE4 and RLE8 compressed images are decoded straight into
+///        the image buffer, RLE8 images may only use the first 16 colours
 /// @param dst pointer to a empty memstream buffer struct. load_bmp will allocate the buffer, image will be stored as 1 byte per pixel
 /// @param fn name of file to load
 /// @param width  pointer to width of the image in pixels set on return
@@ -39,4 +158,35 @@ int save_bmp4(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t hei
 /// @return  0 on success, otherwise an error code
 int load_bmp4(memstream_buf_t *dst, const char *fn, uint16_t *width, uint16_t *height);
 
+/// @brief as load_bmp4() with the image buffer allocated from a conversion context, the buffer
+///        then belongs to the context and is reclaimed when it is reset
+/// @param ctx context to allocate from, or NULL to use malloc
+int load_bmp4_ctx(ssi_ctx_t *ctx, memstream_buf_t *dst, const char *fn, uint16_t *width, uint16_t *height);
+
+/// @brief opens a 16 colour BMP file for reading one line at a time, the header is checked
+///        and the reader positioned at the first line of pixel data. palette is ignored.
+///        RLE4 and RLE8 compressed images are accepted, and decoded a line at a time
+/// @param rd pointer to the reader state to set up
+/// @param fn name of file to open
+/// @return  0 on success, otherwise an error code (as load_bmp4)
+int bmp4_open(bmp4_reader_t *rd, const char *fn);
+
+/// @brief as bmp4_open() with any line buffer allocated from a conversion context
+/// @param ctx context to allocate from, or NULL to use malloc
+int bmp4_open_ctx(ssi_ctx_t *ctx, bmp4_reader_t *rd, const char *fn);
+
+/// @brief reads the next line of pixel data in file order, 2 pixels per byte left most in the
+///        high nibble, padded to 32 bits
+/// @param rd pointer to an open reader
+/// @param line set on return to point to the line data, valid until the next read (or until
+///        the reader is closed when the file is mapped)
+/// @param y set on return to the image line, 0 being the top
+/// @return  0 on success, otherwise an error code, -7 if an RLE8 image uses a colour past the
+///          first 16
+int bmp4_read_line(bmp4_reader_t *rd, uint8_t **line, uint16_t *y);
+
+/// @brief closes the BMP file and releases the reader resources
+/// @param rd pointer to the reader
+void bmp4_close(bmp4_reader_t *rd);
+
 #endif
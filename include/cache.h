@@ -0,0 +1,64 @@
+/*
+ * cache.h
+ * interface definitions for the conversion cache, which keeps the output of
+ * each conversion keyed by a hash of the input and the conversion, so
+ * rebuilding a set of files only converts the ones that have changed
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "ssi-ctx.h"
+#include "convert.h"
+
+#ifndef SSI_CACHE
+#define SSI_CACHE
+
+#define CACHE_VERSION (2)                   // bump when the converters' output changes
+#define CACHE_CAP_DEFAULT (1024ull << 20)   // 1GiB
+
+// a conversion cache, a directory of outputs named by their key
+typedef struct {
+    char        *dir;   // cache directory (malloc'd)
+    uint64_t    cap;    // most bytes to keep once trimmed, 0 for no limit
+    bool        link;   // hard link cached outputs into place rather than copy them
+} conv_cache_t;
+
+/// @brief sets up a cache, creating its directory if need be
+/// @param c pointer to the cache to set up
+/// @param dir cache directory
+/// @param cap most bytes to keep once trimmed, 0 for no limit
+/// @param link if true cached outputs are hard linked into place where the platform allows.
+///        Faster, but the output and the cache then share the one file, so outputs must be
+///        replaced rather than edited in place
+/// @return 0 on success, -1 if out of memory, -2 if the directory can't be created
+int cache_open(conv_cache_t *c, const char *dir, uint64_t cap, bool link);
+
+/// @brief releases a cache, the directory is left as is
+/// @param c pointer to the cache
+void cache_close(conv_cache_t *c);
+
+/// @brief converts a whole file as convert_file(), unless the same input has been converted
+///        the same way before, in which case the earlier output is used. Safe to call from many
+///        threads at once with the same cache
+/// @param ctx context to allocate from, the caller resets it between files
+/// @param c the cache
+/// @param spec conversion to perform
+/// @param fi name of the input file
+/// @param fo name of the output file
+/// @param bytes set on return to the size of the input file, may be NULL
+/// @param hit set on return to true if the output came from the cache, may be NULL
+/// @return 0 on success, otherwise an error code as convert_file()
+int convert_file_cached(ssi_ctx_t *ctx, const conv_cache_t *c, const conv_spec_t *spec,
+                        const char *fi, const char *fo, size_t *bytes, bool *hit);
+
+/// @brief evicts the least recently used outputs until the cache is within its cap. Not safe
+///        to call while conversions are using the cache
+/// @param c the cache
+/// @param kept set on return to the bytes left in the cache, may be NULL
+/// @param evicted set on return to the number of outputs evicted, may be NULL
+/// @return 0 on success, -1 if out of memory, -2 if the directory can't be read
+int cache_trim(const conv_cache_t *c, uint64_t *kept, size_t *evicted);
+
+#endif
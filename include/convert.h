@@ -0,0 +1,65 @@
+/*
+ * convert.h
+ * whole file conversions between SSI-IMG and Windows BMP, shared by the
+ * single file tools and the batch converter
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "ssi-img.h"
+#include "ssi-ctx.h"
+#include "pal.h"
+
+#ifndef SSI_CONVERT
+#define SSI_CONVERT
+
+// a conversion to perform, as given on the command line
+typedef struct {
+    bool            to_bmp;      // true for IMG to BMP, false for BMP to IMG
+    img_format_t    format;      // image data layout of the IMG side
+    uint16_t        width;       // image width, IMG to BMP only as BMPs carry their own
+    uint16_t        height;      // image height, IMG to BMP only
+    uint8_t         pal_sel;     // which CGA palette to use for CGA images
+} conv_spec_t;
+
+/// @brief fills in the 16 colour palette used when writing a BMP
+/// @param pal 16 entry palette to fill in, 8 bits per component
+/// @param is_cga if true only the first 4 entries are used, set from the selected CGA palette
+/// @param pal_sel which of the 6 CGA palettes to use, 0-5
+void make_palette(pal_entry_t *pal, bool is_cga, uint8_t pal_sel);
+
+/// @brief parses a conversion spec. A resolution as img2bmp takes it, eg '320x200c1', converts
+///        IMG to BMP. 'ega', 'cga' or 'bin' converts BMP to that IMG variant
+/// @param spec pointer to the spec to fill in
+/// @param str spec string
+/// @return 0 on success, -1 if the spec is invalid
+int parse_spec(conv_spec_t *spec, const char *str);
+
+/// @brief returns the extension of the files the conversion creates, eg ".BMP"
+const char *spec_extension(const conv_spec_t *spec);
+
+/// @brief converts a whole file, all memory comes from the context
+/// @param ctx context to allocate from, the caller resets it between files
+/// @param spec conversion to perform
+/// @param fi name of the input file
+/// @param fo name of the output file
+/// @param bytes set on return to the size of the input file, may be NULL
+/// @return 0 on success, -1 on bad parameters, -2 if the input can't be read, -3 if the input
+///         doesn't match the spec or isn't a usable BMP, -4 if out of memory, -5 if the output
+///         can't be written
+int convert_file(ssi_ctx_t *ctx, const conv_spec_t *spec, const char *fi, const char *fo, size_t *bytes);
+
+/// @brief converts an IMG already in memory, such as an archive entry, to a 16 colour BMP
+/// @param ctx context to allocate from
+/// @param spec conversion to perform, must be IMG to BMP
+/// @param src the IMG file contents
+/// @param fo name of the output file
+/// @return 0 on success, or an error code as convert_file()
+int convert_img_buf(ssi_ctx_t *ctx, const conv_spec_t *spec, memstream_buf_t *src, const char *fo);
+
+/// @brief describes an error code from convert_file()
+const char *convert_error(int rval);
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * deflate.h
+ * interface definitions for a small streaming zlib/deflate compressor, as
+ * used for PNG image data and archive entries, and the matching decompressor
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef IMG_DEFLATE
+#define IMG_DEFLATE
+
+#define DEFLATE_WSIZE (32768)           // LZ77 window, the most deflate allows
+#define DEFLATE_HASH_SIZE (32768)       // hash chain heads
+#define DEFLATE_SYMS (16384)            // symbols buffered per block
+#define DEFLATE_OUT_SZ (16384)          // compressed bytes buffered before being emitted
+#define DEFLATE_MAX_MATCH (258)
+
+/// @brief called with each run of compressed output
+/// @param arg the argument given to deflate_init()
+/// @param data compressed bytes
+/// @param len number of bytes
+/// @return 0 on success, non zero to fail the compression
+typedef int (*deflate_emit_fn)(void *arg, const uint8_t *data, size_t len);
+
+// compressor state, large (around 260K) so best allocated rather than on the stack
+typedef struct deflate_state {
+    // LZ77 matching
+    uint8_t         window[DEFLATE_WSIZE * 2 + DEFLATE_MAX_MATCH + 8]; // slack for over reading compares
+    uint16_t        head[DEFLATE_HASH_SIZE]; // most recent position for each hash, 0 for none
+    uint16_t        prev[DEFLATE_WSIZE];     // previous position with the same hash
+    size_t          strstart;    // window position being matched
+    size_t          lookahead;   // bytes in the window from strstart on
+    size_t          block_start; // window position the current block starts at
+    size_t          match_start; // window position of the last match found
+    size_t          match_len;   // length of the last match found
+    int             match_available; // a literal is pending while looking for a better match
+    // speed level settings
+    int             level;
+    int             max_chain;   // hash chain entries to try per match
+    int             nice_len;    // stop looking once a match is this long
+    int             lazy;        // true to check the next position for a better match before taking one
+    int             max_lazy;    // lazy, don't look for a better match than this. greedy, the
+                                 // longest match to index all the strings of
+    // symbols of the current block
+    uint16_t        sym_lit[DEFLATE_SYMS];   // literal byte, or match length
+    uint16_t        sym_dist[DEFLATE_SYMS];  // match distance, 0 for a literal
+    size_t          sym_count;
+    uint32_t        lit_freq[286];
+    uint32_t        dist_freq[30];
+    // output
+    uint64_t        bits;        // bits waiting to be written, LSB first
+    int             bit_count;
+    uint8_t         out[DEFLATE_OUT_SZ + 16];
+    size_t          out_len;
+    uint32_t        adler;       // checksum of the uncompressed data
+    deflate_emit_fn emit;
+    void            *arg;
+    int             err;
+} deflate_t;
+
+/// @brief sets up the compressor and writes the zlib header
+/// @param z pointer to the state to set up
+/// @param level 0 to store the data, 1 fastest to 9 smallest, 6 is a good default
+/// @param emit called with each run of compressed output
+/// @param arg passed on to emit
+void deflate_init(deflate_t *z, int level, deflate_emit_fn emit, void *arg);
+
+/// @brief compresses more data, the output isn't emitted until enough has built up
+/// @param z pointer to the compressor
+/// @param data bytes to compress
+/// @param len number of bytes
+/// @return 0 on success, otherwise the error emit returned
+int deflate_write(deflate_t *z, const uint8_t *data, size_t len);
+
+/// @brief compresses anything that's left, and emits the final block and zlib checksum
+/// @param z pointer to the compressor
+/// @return 0 on success, otherwise the error emit returned
+int deflate_finish(deflate_t *z);
+
+/// @brief decompresses a whole zlib stream held in memory, checking it against its checksum
+/// @param dst output buffer
+/// @param dst_len size of the output buffer
+/// @param src the zlib stream
+/// @param src_len size of the stream
+/// @param out set on return to the number of bytes decompressed, may be NULL
+/// @return 0 on success, -1 if the stream is corrupt, -2 if it doesn't fit in dst
+int inflate_zlib(uint8_t *dst, size_t dst_len, const uint8_t *src, size_t src_len, size_t *out);
+
+#endif
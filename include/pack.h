@@ -0,0 +1,150 @@
+/*
+ * pack.h
+ * interface definitions for SSI image archives, many images in one file with
+ * a fixed index up front. Archives are memory mapped once and the images handed
+ * out as views of the mapping, ready for the decoders
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include "memstream.h"
+#include "ssi-img.h"
+#include "ssi-ctx.h"
+#include "util.h"
+
+#ifndef SSI_PACK
+#define SSI_PACK
+
+#define PACK_MAGIC "SSIP"
+#define PACK_VERSION (1)
+#define PACK_NAME_MAX (40)          // entry name, including the terminator
+#define PACK_ALIGN_DEFAULT (4096)   // payloads start on a page boundary
+
+// how an entry's payload is stored
+typedef enum {
+    PACK_STORED = 0,    // as is, so it can be used straight from the mapping
+    PACK_ZLIB = 1       // zlib compressed
+} pack_method_t;
+
+// file header, 32 bytes, followed by the index
+typedef struct {
+    char        magic[4];       // "SSIP"
+    uint16_t    version;        // PACK_VERSION
+    uint16_t    entry_size;     // size of an index entry, sizeof(pack_entry_t)
+    uint32_t    count;          // number of entries in the index
+    uint32_t    align;          // payload alignment, a power of 2
+    uint8_t     reserved[16];   // always 0
+} pack_header_t;
+
+// index entry, 64 bytes. The index is sorted by name
+typedef struct {
+    char        name[PACK_NAME_MAX]; // file name the image was packed from, 0 padded
+    uint8_t     format;         // img_format_t
+    uint8_t     method;         // pack_method_t
+    uint16_t    width;          // image width in pixels
+    uint16_t    height;         // image height in pixels
+    uint8_t     pal_sel;        // CGA palette it was packed for, 0-5
+    uint8_t     reserved;       // always 0
+    uint64_t    offset;         // file offset of the payload
+    uint32_t    size;           // size of the payload in the archive
+    uint32_t    raw_size;       // size of the image file, the same as size when stored
+} pack_entry_t;
+
+// an open archive
+typedef struct {
+    mapped_file_t       map;    // the whole archive
+    const pack_header_t *hdr;   // header, in the mapping
+    const pack_entry_t  *index; // index, in the mapping
+    uint32_t            count;  // number of entries
+} pack_reader_t;
+
+// state for writing an archive
+typedef struct {
+    FILE                *fp;    // the archive being written
+    pack_entry_t        *index; // index, written out once all the entries are in
+    uint32_t            count;  // number of entries the index has room for
+    uint32_t            added;  // number of entries added so far
+    uint32_t            align;  // payload alignment
+    uint64_t            pos;    // file offset of the end of the last payload
+    int                 level;  // compression level, 0 to store everything
+    struct deflate_state *z;    // compressor, when compressing
+    uint8_t             *zbuf;  // compressed payload
+    size_t              zcap;   // size of zbuf
+    size_t              zlen;   // bytes in zbuf
+    ssi_ctx_t           *ctx;   // context the buffers came from, NULL if malloc'd
+} pack_writer_t;
+
+/// @brief opens an archive, mapping it and checking the header and index
+/// @param pk pointer to the reader to set up
+/// @param fn name of the archive
+/// @return 0 on success, -1 on bad parameters, -2 if the file can't be read, -3 if it isn't
+///         a valid archive
+int pack_open(pack_reader_t *pk, const char *fn);
+
+/// @brief closes an archive, any views of it are no longer valid
+/// @param pk pointer to the reader
+void pack_close(pack_reader_t *pk);
+
+/// @brief looks up an entry by name
+/// @param pk pointer to an open reader
+/// @param name name of the entry
+/// @return the entry, or NULL if there is no such entry
+const pack_entry_t *pack_find(const pack_reader_t *pk, const char *name);
+
+/// @brief sets up a view of a stored entry's image, nothing is copied
+/// @param pk pointer to an open reader
+/// @param e entry from the index
+/// @param view set on return to point at the image in the mapping, valid until the archive is closed
+/// @return 0 on success, -1 if the entry is compressed
+int pack_view(const pack_reader_t *pk, const pack_entry_t *e, memstream_buf_t *view);
+
+/// @brief gets an entry's image, a view of the mapping when stored, otherwise decompressed
+///        into memory from the context
+/// @param ctx context to allocate from, or NULL to use malloc
+/// @param pk pointer to an open reader
+/// @param e entry from the index
+/// @param buf set on return to describe the image, give it back with pack_release()
+/// @return 0 on success, -3 if the entry is corrupt, -4 if out of memory
+int pack_load(ssi_ctx_t *ctx, const pack_reader_t *pk, const pack_entry_t *e, memstream_buf_t *buf);
+
+/// @brief gives back an image from pack_load(), freeing it if it was decompressed
+/// @param ctx context it was loaded with
+/// @param e entry it was loaded from
+/// @param buf the image
+void pack_release(ssi_ctx_t *ctx, const pack_entry_t *e, memstream_buf_t *buf);
+
+/// @brief returns a short name for an image format, eg "ega"
+const char *pack_format_name(uint8_t format);
+
+/// @brief creates an archive to add a known number of entries to
+/// @param ctx context to allocate from, or NULL to use malloc
+/// @param pw pointer to the writer to set up
+/// @param fn name of the archive to create
+/// @param count number of entries that will be added
+/// @param align payload alignment, a power of 2, 0 for PACK_ALIGN_DEFAULT
+/// @param level compression level, 0 to store the entries, 1 fastest to 9 smallest. Entries
+///        that don't get smaller are stored regardless
+/// @return 0 on success, -1 on bad parameters, -2 if the file can't be created, -3 if out of memory
+int pack_create(ssi_ctx_t *ctx, pack_writer_t *pw, const char *fn, uint32_t count, uint32_t align, int level);
+
+/// @brief adds an image to the archive
+/// @param pw pointer to the writer
+/// @param name name to store it under, less than PACK_NAME_MAX characters
+/// @param format image data layout
+/// @param width  image width in pixels
+/// @param height image height in pixels
+/// @param pal_sel CGA palette to show the image with, 0-5, ignored for other formats
+/// @param img the image file contents
+/// @return 0 on success, -1 on bad parameters or if the archive is full, -4 on a write error
+int pack_add(pack_writer_t *pw, const char *name, img_format_t format, uint16_t width, uint16_t height,
+             uint8_t pal_sel, const memstream_buf_t *img);
+
+/// @brief sorts and writes out the index, and closes the archive
+/// @param pw pointer to the writer
+/// @return 0 on success, -4 on a write error, -5 if fewer entries were added than the count,
+///         -6 if two entries have the same name
+int pack_finish(pack_writer_t *pw);
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * patch.h
+ * interface definitions for incremental BMP to IMG conversion. A sidecar file
+ * next to the IMG keeps a hash of every line of the BMP it was made from, so
+ * when the BMP is edited only the lines that changed are re-encoded and
+ * written into the existing IMG
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "ssi-img.h"
+#include "ssi-ctx.h"
+
+#ifndef SSI_PATCH
+#define SSI_PATCH
+
+#define ROWS_MAGIC "SSIR"
+#define ROWS_VERSION (2)
+#define ROWS_EXTENSION ".rows"  // added to the IMG file name to name its sidecar
+
+// sidecar header, 32 bytes, followed by a 64 bit hash of each BMP line, top line first
+typedef struct {
+    char        magic[4];   // "SSIR"
+    uint16_t    version;    // ROWS_VERSION
+    uint8_t     format;     // img_format_t of the IMG
+    uint8_t     reserved;   // always 0
+    uint16_t    width;      // image width in pixels
+    uint16_t    height;     // image height in pixels, the number of hashes
+    uint32_t    reserved2;  // always 0
+    uint64_t    img_size;   // size of the IMG when the sidecar was written
+    uint64_t    img_hash;   // hash64() of the whole IMG when the sidecar was written
+} rows_header_t;
+
+// what an incremental conversion did
+typedef struct {
+    uint16_t    rows;       // lines in the image
+    uint16_t    changed;    // lines re-encoded and written
+    bool        full;       // true if the whole IMG was written, as there was no usable sidecar
+} patch_stats_t;
+
+/// @brief converts a 16 colour BMP to an IMG, only re-encoding the lines that have changed
+///        since the last time. The whole IMG is written if it or its sidecar are missing, or
+///        the IMG has been changed by anything else since, which is found from a hash of it
+/// @param ctx context to allocate from, or NULL to use malloc
+/// @param format IMG_EGA or IMG_BIN, the IMG variant to write
+/// @param fi name of the BMP
+/// @param fo name of the IMG, its sidecar is named the same with ROWS_EXTENSION added
+/// @param st set on return to what was done, may be NULL
+/// @return 0 on success, -1 on bad parameters, -2 if the BMP can't be read, -3 if it isn't a
+///         usable BMP, -4 if out of memory, -5 if the IMG or sidecar can't be written
+int patch_img(ssi_ctx_t *ctx, img_format_t format, const char *fi, const char *fo, patch_stats_t *st);
+
+#endif
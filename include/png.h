@@ -0,0 +1,77 @@
+/*
+ * png.h
+ * interface definitions for writing an indexed colour PNG file, with its own
+ * deflate compressor so there are no outside dependencies
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include "memstream.h"
+#include "pal.h"
+#include "ssi-ctx.h"
+
+#ifndef IMG_PNG
+#define IMG_PNG
+
+#define PNG_LEVEL_DEFAULT (6) // compression level balancing speed and size
+
+struct deflate_state;
+
+// state for writing an indexed PNG file one line at a time
+typedef struct {
+    FILE        *fp;         // the open PNG file
+    uint16_t    width;       // image width in pixels
+    uint16_t    height;      // image height in pixels
+    uint8_t     bits;        // bits per pixel, 1, 2 or 4
+    uint32_t    stride;      // bytes per line, not counting the filter type
+    uint16_t    lines;       // number of lines written so far
+    struct deflate_state *z; // compressor for the image data
+    ssi_ctx_t   *ctx;        // context the compressor came from, NULL if malloc'd
+} png_writer_t;
+
+/// @brief creates an indexed PNG file to be written one line at a time, the header and palette
+///        are written immediately and the lines compressed as they are written
+/// @param wr pointer to the writer state to set up
+/// @param fn name of the file to create and write to
+/// @param width  width of the image in pixels
+/// @param height height of the image in pixels or lines
+/// @param bits bits per pixel, 1, 2 or 4
+/// @param xpal pointer to RGB palette of (1 << bits) entries
+/// @param level compression level, 0 to store the data, 1 fastest to 9 smallest
+/// @return 0 on success, otherwise an error code
+int png_create(png_writer_t *wr, const char *fn, uint16_t width, uint16_t height, uint8_t bits, pal_entry_t *xpal, int level);
+
+/// @brief as png_create() with the compressor state allocated from a conversion context
+/// @param ctx context to allocate from, or NULL to use malloc
+int png_create_ctx(ssi_ctx_t *ctx, png_writer_t *wr, const char *fn, uint16_t width, uint16_t height, uint8_t bits, pal_entry_t *xpal, int level);
+
+/// @brief compresses the next line of pixel data, top to bottom
+/// @param wr pointer to an open writer
+/// @param line pointer to the line, pixels packed left most in the high bits, (width * bits + 7) / 8 bytes.
+///        At 4 bits this is the same as a BMP line
+/// @return 0 on success, otherwise an error code
+int png_write_line(png_writer_t *wr, const uint8_t *line);
+
+/// @brief completes and closes the PNG file, and releases the compressor
+/// @param wr pointer to the writer
+/// @return 0 on success, -5 if fewer lines than the height were written, -4 on a write error
+int png_finish(png_writer_t *wr);
+
+/// @brief saves the image pointed to by src as an indexed PNG, assumes 1 byte per pixel image data
+/// @param fn name of the file to create and write to
+/// @param src memstream buffer pointer to the source image data
+/// @param width  width of the image in pixels
+/// @param height height of the image in pixels or lines
+/// @param bits bits per pixel to write, 1, 2 or 4
+/// @param xpal pointer to RGB palette of (1 << bits) entries
+/// @param level compression level, 0 to store the data, 1 fastest to 9 smallest
+/// @return 0 on success, otherwise an error code
+int save_png(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, uint8_t bits, pal_entry_t *xpal, int level);
+
+/// @brief as save_png() with the line buffer and compressor allocated from a conversion context
+/// @param ctx context to allocate from, or NULL to use malloc
+int save_png_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, uint8_t bits, pal_entry_t *xpal, int level);
+
+#endif
@@ -7,6 +7,8 @@
  */
 #include <stdint.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include "memstream.h"
 
 #ifndef CA_UTILS
 #define CA_UTILS
@@ -25,6 +27,63 @@ void drop_extension(char *fn);
 /// @return a pointer to the filename portion of the path string
 char *filename(char *path);
 
+// a read only view of a whole file, memory mapped where the platform allows
+typedef struct {
+    memstream_buf_t buf;     // the file contents, buf.data points into the mapping
+    bool            mapped;  // true if memory mapped, false if read into a heap buffer
+} mapped_file_t;
+
+/// @brief 64 bit hash of a block of data, the xxHash64 algorithm
+/// @param data bytes to hash
+/// @param len number of bytes
+/// @param seed starting value, different seeds give unrelated hashes
+/// @return the hash
+uint64_t hash64(const void *data, size_t len, uint64_t seed);
+
+/// @brief maps a whole file into memory for reading, hinting that it will be read sequentially.
+///        Where mapping isn't possible the file can instead be read into a heap buffer
+/// @param mf pointer to the mapped file to set up, mf->buf describes the contents on return
+/// @param fn name of the file to map
+/// @param fallback if true, read the file into a heap buffer when it can't be mapped
+/// @return 0 on success, -1 on bad parameters, -2 if the file can't be opened, -3 if it can't
+///         be read, -4 if out of memory, -5 if it can't be mapped and fallback is false
+int map_file(mapped_file_t *mf, const char *fn, bool fallback);
+
+/// @brief maps a whole file into memory for reading as map_file(), but for random access to
+///        small parts of it, such as the entries of an archive, so nothing is read ahead
+/// @return 0 on success, otherwise an error code as map_file()
+int map_file_random(mapped_file_t *mf, const char *fn, bool fallback);
+
+/// @brief releases a file mapped with map_file
+/// @param mf pointer to the mapped file
+void unmap_file(mapped_file_t *mf);
+
+/// @brief returns a monotonic time, for measuring intervals
+/// @return time in seconds from an arbitrary starting point
+double mono_time(void);
+
+/// @brief asks the OS to drop a file from the page cache, so the next read comes from disk.
+///        Any unwritten changes are flushed first
+/// @param fn name of the file
+/// @return 0 on success, -1 if the file can't be opened, -2 if the platform can't do it
+int drop_cache(const char *fn);
+
+/// @brief creates a directory, it is not an error for it to exist already
+/// @param path name of the directory
+/// @return 0 on success, -1 if it can't be created
+int make_dir(const char *path);
+
+/// @brief pulls the tracing options, "--stats" and "--trace <file>", out of the command line,
+///        wherever they are, and starts tracing if either was given
+/// @param argc pointer to the argument count, reduced by the options taken out
+/// @param argv the arguments, the ones left are moved down to fill the gaps
+/// @return 0 on success, -1 if --trace is missing its file name
+int trace_args(int *argc, char *argv[]);
+
+/// @brief prints the stage totals for --stats and appends the spans to the --trace file,
+///        then releases what was collected. Does nothing if neither option was given
+void trace_report(void);
+
 // convenience "safe" resource release functons
 #define fclose_s(A) if(A) fclose(A); A=NULL
 #define free_s(A) if(A) free(A); A=NULL
@@ -4,16 +4,88 @@
 #include "bmp_int.h"
 #include "bmp.h"
 #include "util.h"
+#include "ssi-trace.h"
 #include <stdbool.h>
 
-// allocate a header buffer large enough for all 3 parts, plus 16 bit padding at the start to 
-// maintian 32 bit alignment after the 16 bit signature.
+// size of the signature and headers as written to the file
 #define HDRBUFSZ (sizeof(bmp_signature_t) + sizeof(bmp_header_t))
 
+/// @brief writes the BMP signature, headers and palette
+/// @param fp file to write to, positioned at the start
+/// @param width  width of the image in pixels
+/// @param height height of the image in pixels, negative for top down line order
+/// @param bpp bits per pixel, 4 or 8, or 24 or 32 for true colour
+/// @param compression BMP_RGB, or BMP_RLE8/BMP_RLE4 for run length encoded images
+/// @param bmp_img_sz size of the pixel data in the file
+/// @param xpal pointer to RGB palette of (1 << bpp) entries, unused for true colour
+/// @return 0 on success, otherwise an error code
+static int write_bmp_header(FILE *fp, uint16_t width, int32_t height, uint16_t bpp, uint32_t compression,
+                            uint32_t bmp_img_sz, pal_entry_t *xpal) {
+    // 16 bit padding at the start to maintian 32 bit alignment after the 16 bit signature.
+    struct {
+        uint16_t         pad;
+        bmp_signature_t  sig;
+        bmp_header_t     bmp;
+    } hdr;
+    memset(&hdr, 0, sizeof(hdr));
+
+    uint32_t colours = (bpp <= 8) ? (1 << bpp) : 0; // true colour has no palette
+
+    // setup the signature and DIB header fields
+    hdr.sig = BMPFILESIG;
+    size_t palsz = sizeof(bmp_palette_entry_t) * colours;
+    hdr.bmp.dib.image_offset = HDRBUFSZ + palsz;
+    hdr.bmp.dib.file_size = hdr.bmp.dib.image_offset + bmp_img_sz;
+
+    // setup the bmi header fields
+    hdr.bmp.bmi.header_size = sizeof(bmi_header_t);
+    hdr.bmp.bmi.image_width = width;
+    hdr.bmp.bmi.image_height = height;
+    hdr.bmp.bmi.num_planes = 1;           // always 1
+    hdr.bmp.bmi.bits_per_pixel = bpp;     // 16 or 256 colour, or true colour image
+    hdr.bmp.bmi.compression = compression;
+    hdr.bmp.bmi.bitmap_size = bmp_img_sz;
+    hdr.bmp.bmi.horiz_res = BMP96DPI;
+    hdr.bmp.bmi.vert_res = BMP96DPI;
+    hdr.bmp.bmi.num_colors = colours;     // palette size
+    hdr.bmp.bmi.important_colors = 0;     // all colours are important
+
+    // write out the header
+    int nr = fwrite(&hdr.sig, HDRBUFSZ, 1, fp);
+    if(1 != nr) {
+        return -4;  // unable to write file
+    }
+    if(0 == colours) {
+        return 0;
+    }
+
+    // at most 1K, so the palette is built on the stack
+    bmp_palette_entry_t pal[256];
+    memset(pal, 0, palsz);
+
+    // copy the external RGB palette to the BMP BGRA palette
+    for(uint32_t i = 0; i < colours; i++) {
+        pal[i].r = xpal[i].r;
+        pal[i].g = xpal[i].g;
+        pal[i].b = xpal[i].b;
+    }
+
+    // write out the palette
+    nr = fwrite(pal, palsz, 1, fp);
+    if(1 != nr) {
+        return -4;  // can't write file
+    }
+    return 0;
+}
+
 int save_bmp8(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal) {
+    return save_bmp8_ctx(NULL, fn, src, width, height, xpal);
+}
+
+int save_bmp8_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal) {
     int rval = 0;
     FILE *fp = NULL;
-    uint8_t *buf = NULL; // line buffer, also holds header info
+    uint8_t *buf = NULL; // line buffer
 
     // do some basic error checking on the inputs
     if((NULL == fn) || (NULL == src) || (NULL == src->data)) {
@@ -30,70 +102,17 @@ int save_bmp8(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t hei
     // stride is the bytes per line in the BMP file, which are padded
     // out to 32 bit boundaries
     uint32_t stride = ((width + 3) & (~0x0003)); 
-    uint32_t bmp_img_sz = (stride) * height;
-
-    // allocate a buffer to hold the header and a single scanline of data
-    // this could be optimized if necessary to only allocate the larger of
-    // the line buffer, or the header + padding as they are used at mutually
-    // exclusive times
-    if(NULL == (buf = calloc(1, HDRBUFSZ + stride + 2))) {
-        rval = -3;  // unable to allocate mem
-        goto bmp_cleanup;
-    }
-
-    // signature starts after padding to maintain 32bit alignment for the rest of the header
-    bmp_signature_t *sig = (bmp_signature_t *)&buf[stride + 2];
-
-    // bmp header starts after signature
-    bmp_header_t *bmp = (bmp_header_t *)&buf[stride + 2 + sizeof(bmp_signature_t)];
-
-    // setup the signature and DIB header fields
-    *sig = BMPFILESIG;
-    size_t palsz = sizeof(bmp_palette_entry_t) * 256;
-    bmp->dib.image_offset = HDRBUFSZ + palsz;
-    bmp->dib.file_size = bmp->dib.image_offset + bmp_img_sz;
-
-    // setup the bmi header fields
-    bmp->bmi.header_size = sizeof(bmi_header_t);
-    bmp->bmi.image_width = width;
-    bmp->bmi.image_height = height;
-    bmp->bmi.num_planes = 1;           // always 1
-    bmp->bmi.bits_per_pixel = 8;       // 256 colour image
-    bmp->bmi.compression = 0;          // uncompressed
-    bmp->bmi.bitmap_size = bmp_img_sz;
-    bmp->bmi.horiz_res = BMP96DPI;
-    bmp->bmi.vert_res = BMP96DPI;
-    bmp->bmi.num_colors = 256;         // palette has 256 colours
-    bmp->bmi.important_colors = 0;     // all colours are important
 
-    // write out the header
-    int nr = fwrite(sig, HDRBUFSZ, 1, fp);
-    if(1 != nr) {
-        rval = -4;  // unable to write file
-        goto bmp_cleanup;
-    }
-
-    bmp_palette_entry_t *pal = calloc(256, sizeof(bmp_palette_entry_t));
-    if(NULL == pal) {
+    // allocate a buffer to hold a single scanline of data
+    if(NULL == (buf = ssi_alloc(ctx, stride))) {
         rval = -3;  // unable to allocate mem
         goto bmp_cleanup;
     }
 
-    // copy the external RGB palette to the BMP BGRA palette
-    for(int i = 0; i < 256; i++) {
-        pal[i].r = xpal[i].r;
-        pal[i].g = xpal[i].g;
-        pal[i].b = xpal[i].b;
-    }
-
-    // write out the palette
-    nr = fwrite(pal, palsz, 1, fp);
-    if(1 != nr) {
-        rval = -4;  // can't write file
+    rval = write_bmp_header(fp, width, height, 8, BMP_RGB, stride * height, xpal);
+    if(0 != rval) {
         goto bmp_cleanup;
     }
-    // we can free the palette now as we don't need it anymore
-    free(pal);
 
     // now we need to output the image scanlines. For maximum
     // compatibility we do so in the natural order for BMP
@@ -107,7 +126,7 @@ int save_bmp8(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t hei
         for(int x = 0; x < width; x++) {
             buf[x] = *px++;
         }
-        nr = fwrite(buf, stride, 1, fp); // write out the line
+        int nr = fwrite(buf, stride, 1, fp); // write out the line
         if(1 != nr) {
             rval = -4;  // unable to write file
             goto bmp_cleanup;
@@ -117,14 +136,19 @@ int save_bmp8(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t hei
 
 bmp_cleanup:
     fclose_s(fp);
-    free_s(buf);
+    ssi_release(ctx, buf);
     return rval;
 }
 
 int save_bmp4(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal) {
+    return save_bmp4_ctx(NULL, fn, src, width, height, xpal);
+}
+
+int save_bmp4_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal) {
     int rval = 0;
     FILE *fp = NULL;
-    uint8_t *buf = NULL; // line buffer, also holds header info
+    uint8_t *buf = NULL; // line buffer
+    uint64_t t0 = TRACE_BEGIN();
 
     // do some basic error checking on the inputs
     if((NULL == fn) || (NULL == src) || (NULL == src->data)) {
@@ -141,70 +165,17 @@ int save_bmp4(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t hei
     // stride is the bytes per line in the BMP file, which are padded
     // out to 32 bit boundaries
     uint32_t stride = ((((width + 1) / 2) + 3) & (~0x0003)); // we get 2 pixels per byte for being 16 colour
-    uint32_t bmp_img_sz = (stride) * height;
-
-    // allocate a buffer to hold the header and a single scanline of data
-    // this could be optimized if necessary to only allocate the larger of
-    // the line buffer, or the header + padding as they are used at mutually
-    // exclusive times
-    if(NULL == (buf = calloc(1, HDRBUFSZ + stride + 2))) {
-        rval = -3;  // unable to allocate mem
-        goto bmp_cleanup;
-    }
-
-    // signature starts after padding to maintain 32bit alignment for the rest of the header
-    bmp_signature_t *sig = (bmp_signature_t *)&buf[stride + 2];
-
-    // bmp header starts after signature
-    bmp_header_t *bmp = (bmp_header_t *)&buf[stride + 2 + sizeof(bmp_signature_t)];
-
-    // setup the signature and DIB header fields
-    *sig = BMPFILESIG;
-    size_t palsz = sizeof(bmp_palette_entry_t) * 16;
-    bmp->dib.image_offset = HDRBUFSZ + palsz;
-    bmp->dib.file_size = bmp->dib.image_offset + bmp_img_sz;
-
-    // setup the bmi header fields
-    bmp->bmi.header_size = sizeof(bmi_header_t);
-    bmp->bmi.image_width = width;
-    bmp->bmi.image_height = height;
-    bmp->bmi.num_planes = 1;           // always 1
-    bmp->bmi.bits_per_pixel = 4;       // 16 colour image
-    bmp->bmi.compression = 0;          // uncompressed
-    bmp->bmi.bitmap_size = bmp_img_sz;
-    bmp->bmi.horiz_res = BMP96DPI;
-    bmp->bmi.vert_res = BMP96DPI;
-    bmp->bmi.num_colors = 16;          // palette has 16 colours
-    bmp->bmi.important_colors = 0;     // all colours are important
-
-    // write out the header
-    int nr = fwrite(sig, HDRBUFSZ, 1, fp);
-    if(1 != nr) {
-        rval = -4;  // unable to write file
-        goto bmp_cleanup;
-    }
 
-    bmp_palette_entry_t *pal = calloc(16, sizeof(bmp_palette_entry_t));
-    if(NULL == pal) {
+    // allocate a buffer to hold a single scanline of data
+    if(NULL == (buf = ssi_alloc(ctx, stride))) {
         rval = -3;  // unable to allocate mem
         goto bmp_cleanup;
     }
 
-    // copy the external RGB palette to the BMP BGRA palette
-    for(int i = 0; i < 16; i++) {
-        pal[i].r = xpal[i].r;
-        pal[i].g = xpal[i].g;
-        pal[i].b = xpal[i].b;
-    }
-
-    // write out the palette
-    nr = fwrite(pal, palsz, 1, fp);
-    if(1 != nr) {
-        rval = -4;  // can't write file
+    rval = write_bmp_header(fp, width, height, 4, BMP_RGB, stride * height, xpal);
+    if(0 != rval) {
         goto bmp_cleanup;
     }
-    // we can free the palette now as we don't need it anymore
-    free(pal);
 
     // now we need to output the image scanlines. For maximum
     // compatibility we do so in the natural order for BMP
@@ -226,7 +197,7 @@ int save_bmp4(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t hei
             }
             buf[x] = sp;                 // write it to the line buffer
         }
-        nr = fwrite(buf, stride, 1, fp); // write out the line
+        int nr = fwrite(buf, stride, 1, fp); // write out the line
         if(1 != nr) {
             rval = -4;  // unable to write file
             goto bmp_cleanup;
@@ -236,113 +207,721 @@ int save_bmp4(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t hei
 
 bmp_cleanup:
     fclose_s(fp);
-    free_s(buf);
+    ssi_release(ctx, buf);
+    TRACE_END(TRACE_SAVE_BMP4, t0);
     return rval;
 }
 
-int load_bmp4(memstream_buf_t *dst, const char *fn, uint16_t *width, uint16_t *height) {
+int save_bmp4_packed(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal) {
     int rval = 0;
     FILE *fp = NULL;
-    uint8_t *buf = NULL; // line buffer
-    bmp_header_t *bmp = NULL;
+    uint64_t t0 = TRACE_BEGIN();
+
+    // stride is the bytes per line in the BMP file, which are padded
+    // out to 32 bit boundaries
+    uint32_t stride = ((((width + 1) / 2) + 3) & (~0x0003)); // we get 2 pixels per byte for being 16 colour
 
     // do some basic error checking on the inputs
-    if((NULL == fn) || (NULL == dst) || (NULL == width) || (NULL == height)) {
+    if((NULL == fn) || (NULL == src) || (NULL == src->data)) {
         rval = -1;  // NULL pointer error
         goto bmp_cleanup;
     }
+    if(src->len < (stride * height)) {
+        rval = -1;  // not enough image data
+        goto bmp_cleanup;
+    }
 
-    // try to open input file
-    if(NULL == (fp = fopen(fn,"rb"))) {
-        rval = -2;  // can't open input file
+    // try to open/create output file
+    if(NULL == (fp = fopen(fn,"wb"))) {
+        rval = -2;  // can't open/create output file
         goto bmp_cleanup;
     }
 
-    bmp_signature_t sig = 0;
-    int nr = fread(&sig, sizeof(bmp_signature_t), 1, fp);
+    rval = write_bmp_header(fp, width, height, 4, BMP_RGB, stride * height, xpal);
+    if(0 != rval) {
+        goto bmp_cleanup;
+    }
+
+    // the pixel data is already laid out as the BMP file expects, so
+    // it can go out in one go
+    uint64_t t1 = TRACE_BEGIN();
+    int nr = fwrite(src->data, stride * height, 1, fp);
+    TRACE_END(TRACE_FWRITE, t1);
     if(1 != nr) {
-        rval = -3;  // unable to read file
+        rval = -4;  // unable to write file
         goto bmp_cleanup;
     }
-    if(BMPFILESIG != sig) {
-        rval = -4; // not a BMP file
+
+bmp_cleanup:
+    fclose_s(fp);
+    TRACE_END(TRACE_SAVE_BMP4, t0);
+    return rval;
+}
+
+/// @brief saves true colour pixels, lines bottom up and padded as BMP expects
+/// @param bpp bytes per pixel, 3 or 4
+static int save_bmp_rgb(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, uint32_t bpp) {
+    int rval = 0;
+    FILE *fp = NULL;
+    static const uint8_t pad[4] = {0};
+
+    // stride is the bytes per line in the BMP file, which are padded
+    // out to 32 bit boundaries
+    uint32_t line = width * bpp;
+    uint32_t stride = (line + 3) & (~0x0003);
+
+    // do some basic error checking on the inputs
+    if((NULL == fn) || (NULL == src) || (NULL == src->data)) {
+        rval = -1;  // NULL pointer error
+        goto bmp_cleanup;
+    }
+    if(src->len < ((size_t)line * height)) {
+        rval = -1;  // not enough image data
         goto bmp_cleanup;
     }
 
-    // allocate a buffer to hold the header 
-    if(NULL == (bmp = calloc(1, sizeof(bmp_header_t)))) {
-        rval = -5;  // unable to allocate mem
+    // try to open/create output file
+    if(NULL == (fp = fopen(fn,"wb"))) {
+        rval = -2;  // can't open/create output file
         goto bmp_cleanup;
     }
-    nr = fread(bmp, sizeof(bmp_header_t), 1, fp);
-    if(1 != nr) {
-        rval = -3;  // unable to read file
+
+    rval = write_bmp_header(fp, width, height, bpp * 8, BMP_RGB, stride * height, NULL);
+    if(0 != rval) {
+        goto bmp_cleanup;
+    }
+
+    // the lines go out bottom to top, straight from the source with any padding after
+    for(int y = height - 1; y >= 0; y--) {
+        if(1 != fwrite(&src->data[(size_t)line * y], line, 1, fp)) {
+            rval = -4;  // unable to write file
+            goto bmp_cleanup;
+        }
+        if((stride > line) && (1 != fwrite(pad, stride - line, 1, fp))) {
+            rval = -4;  // unable to write file
+            goto bmp_cleanup;
+        }
+    }
+
+bmp_cleanup:
+    fclose_s(fp);
+    return rval;
+}
+
+int save_bmp24(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height) {
+    return save_bmp_rgb(fn, src, width, height, 3);
+}
+
+int save_bmp32(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height) {
+    return save_bmp_rgb(fn, src, width, height, 4);
+}
+
+// RLE lines never take more than 2 bytes per pixel, plus the end of line
+#define RLE_LINE_MAX(W) (((size_t)(W) * 2) + 8)
+
+/// @brief measures the run starting at px, a repeating single pixel for RLE8 or a repeating
+///        pair of pixels for RLE4. Whole words are compared while they match
+/// @param px first pixel of the run, 1 byte per pixel
+/// @param n most pixels the run can cover, at least period
+/// @param period 1 for RLE8, 2 for RLE4
+/// @return length of the run in pixels
+static size_t rle_run(const uint8_t *px, size_t n, int period) {
+    uint8_t pat[8];
+    uint64_t word;
+    size_t r = 0;
+
+    // 8 is a multiple of the period, so every word of the run looks the same
+    for(int i = 0; i < 8; i++) {
+        pat[i] = px[i % period];
+    }
+    memcpy(&word, pat, sizeof(word));
+    while(r + 8 <= n) {
+        uint64_t v;
+        memcpy(&v, &px[r], sizeof(v));
+        if(v != word) break;
+        r += 8;
+    }
+    while((r < n) && (px[r] == pat[r % period])) {
+        r++;
+    }
+    return r;
+}
+
+/// @brief writes pixels that don't form a run, in absolute mode if there are enough of them
+/// @param out output for the codes
+/// @param px pixels, 1 byte per pixel
+/// @param n number of pixels, at most 255
+/// @param period 1 for RLE8, 2 for RLE4
+/// @return number of bytes written
+static size_t rle_literal(uint8_t *out, const uint8_t *px, size_t n, int period) {
+    size_t o = 0;
+
+    if(n < 3) { // absolute mode needs at least 3 pixels, so these go as short runs
+        if((2 == period) && (2 == n)) {
+            out[o++] = 2;
+            out[o++] = ((px[0] & 0x0f) << 4) | (px[1] & 0x0f);
+        } else {
+            for(size_t i = 0; i < n; i++) {
+                out[o++] = 1;
+                out[o++] = (2 == period) ? ((px[i] & 0x0f) << 4) : px[i];
+            }
+        }
+        return o;
+    }
+
+    out[o++] = 0;
+    out[o++] = (uint8_t)n;
+    size_t start = o;
+    if(1 == period) {
+        memcpy(&out[o], px, n);
+        o += n;
+    } else {
+        for(size_t i = 0; i < n; i += 2) { // packed 2 per byte, left most in the high nibble
+            out[o++] = ((px[i] & 0x0f) << 4) | (((i + 1) < n) ? (px[i + 1] & 0x0f) : 0);
+        }
+    }
+    if((o - start) & 1) {
+        out[o++] = 0; // absolute runs are padded to 16 bits
+    }
+    return o;
+}
+
+/// @brief run length encodes a line of pixels as RLE8 or RLE4, ending it with an end of line
+/// @param out output, at least RLE_LINE_MAX(width) bytes
+/// @param px line of pixels, 1 byte per pixel
+/// @param width pixels in the line
+/// @param period 1 for RLE8, 2 for RLE4 where a run repeats a pair of pixels
+/// @return number of bytes written
+static size_t rle_encode_line(uint8_t *out, const uint8_t *px, uint16_t width, int period) {
+    // shorter runs are no smaller than the same pixels in absolute mode
+    const size_t min_run = (1 == period) ? 3 : 4;
+    size_t o = 0;
+    size_t x = 0;
+    size_t lit = 0; // start of the pixels not yet written
+
+    while(x < width) {
+        size_t avail = width - x;
+        if(avail > 255) avail = 255;
+        size_t run = (avail >= (size_t)period) ? rle_run(&px[x], avail, period) : 1;
+
+        if(run >= min_run) {
+            if(x > lit) {
+                o += rle_literal(&out[o], &px[lit], x - lit, period);
+            }
+            out[o++] = (uint8_t)run;
+            out[o++] = (1 == period) ? px[x] : (((px[x] & 0x0f) << 4) | (px[x + 1] & 0x0f));
+            x += run;
+            lit = x;
+        } else {
+            x++;
+            if(255 == (x - lit)) {
+                o += rle_literal(&out[o], &px[lit], x - lit, period);
+                lit = x;
+            }
+        }
+    }
+    if(x > lit) {
+        o += rle_literal(&out[o], &px[lit], x - lit, period);
+    }
+    out[o++] = 0; // end of line
+    out[o++] = 0;
+    return o;
+}
+
+/// @brief saves 1 byte per pixel image data as a run length encoded BMP
+/// @param bpp bits per pixel, 8 for RLE8 or 4 for RLE4
+static int save_bmp_rle(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height,
+                        uint16_t bpp, pal_entry_t *xpal) {
+    int rval = 0;
+    FILE *fp = NULL;
+    uint8_t *buf = NULL; // encoded line buffer
+    uint32_t compression = (8 == bpp) ? BMP_RLE8 : BMP_RLE4;
+    uint32_t bmp_img_sz = 0;
+
+    // do some basic error checking on the inputs
+    if((NULL == fn) || (NULL == src) || (NULL == src->data) || (NULL == xpal)) {
+        rval = -1;  // NULL pointer error
+        goto bmp_cleanup;
+    }
+    if(src->len < ((size_t)width * height)) {
+        rval = -1;  // not enough image data
+        goto bmp_cleanup;
+    }
+
+    // try to open/create output file
+    if(NULL == (fp = fopen(fn,"wb"))) {
+        rval = -2;  // can't open/create output file
+        goto bmp_cleanup;
+    }
+
+    // allocate a buffer to hold a single encoded line
+    if(NULL == (buf = ssi_alloc(ctx, RLE_LINE_MAX(width)))) {
+        rval = -3;  // unable to allocate mem
+        goto bmp_cleanup;
+    }
+
+    // the size of the pixel data isn't known until it has been encoded,
+    // so the header is written again once it is
+    rval = write_bmp_header(fp, width, height, bpp, compression, 0, xpal);
+    if(0 != rval) {
+        goto bmp_cleanup;
+    }
+
+    // RLE images are always stored bottom to top
+    for(int y = height - 1; y >= 0; y--) {
+        size_t n = rle_encode_line(buf, &src->data[(size_t)width * y], width, (8 == bpp) ? 1 : 2);
+        if(0 == y) {
+            buf[n - 1] = 1; // the last end of line becomes the end of bitmap
+        }
+        if(1 != fwrite(buf, n, 1, fp)) {
+            rval = -4;  // unable to write file
+            goto bmp_cleanup;
+        }
+        bmp_img_sz += n;
+    }
+
+    if(0 != fseek(fp, 0, SEEK_SET)) {
+        rval = -4;  // unable to write file
+        goto bmp_cleanup;
+    }
+    rval = write_bmp_header(fp, width, height, bpp, compression, bmp_img_sz, xpal);
+
+bmp_cleanup:
+    fclose_s(fp);
+    ssi_release(ctx, buf);
+    return rval;
+}
+
+int save_bmp8_rle(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal) {
+    return save_bmp_rle(NULL, fn, src, width, height, 8, xpal);
+}
+
+int save_bmp8_rle_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal) {
+    return save_bmp_rle(ctx, fn, src, width, height, 8, xpal);
+}
+
+int save_bmp4_rle(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal) {
+    uint64_t t0 = TRACE_BEGIN();
+    int rval = save_bmp_rle(NULL, fn, src, width, height, 4, xpal);
+    TRACE_END(TRACE_SAVE_BMP4, t0);
+    return rval;
+}
+
+int save_bmp4_rle_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, pal_entry_t *xpal) {
+    uint64_t t0 = TRACE_BEGIN();
+    int rval = save_bmp_rle(ctx, fn, src, width, height, 4, xpal);
+    TRACE_END(TRACE_SAVE_BMP4, t0);
+    return rval;
+}
+
+int bmp4_create(bmp4_writer_t *wr, const char *fn, uint16_t width, uint16_t height, bool topdown, pal_entry_t *xpal) {
+    int rval = 0;
+
+    // do some basic error checking on the inputs
+    if((NULL == wr) || (NULL == fn) || (NULL == xpal)) {
+        return -1;  // NULL pointer error
+    }
+    memset(wr, 0, sizeof(bmp4_writer_t));
+    wr->width = width;
+    wr->height = height;
+    wr->topdown = topdown;
+
+    // stride is the bytes per line in the BMP file, which are padded
+    // out to 32 bit boundaries
+    wr->stride = ((((width + 1) / 2) + 3) & (~0x0003)); // we get 2 pixels per byte for being 16 colour
+
+    // try to open/create output file
+    if(NULL == (wr->fp = fopen(fn,"wb"))) {
+        rval = -2;  // can't open/create output file
+        goto bmp_cleanup;
+    }
+
+    // a negative height tells readers the lines are stored top to bottom
+    rval = write_bmp_header(wr->fp, width, topdown ? -height : height, 4, BMP_RGB, wr->stride * height, xpal);
+
+bmp_cleanup:
+    if(0 != rval) {
+        fclose_s(wr->fp);
+    }
+    return rval;
+}
+
+int bmp4_write_line(bmp4_writer_t *wr, const uint8_t *line) {
+    static const uint8_t pad[4] = {0};
+    uint32_t len = (wr->width + 1) / 2;
+
+    if((NULL == wr->fp) || (NULL == line)) {
+        return -1;  // NULL pointer error
+    }
+    if(wr->lines >= wr->height) {
+        return -5;  // all lines already written
+    }
+
+    // write out the line, then pad it out to the stride
+    if(1 != fwrite(line, len, 1, wr->fp)) {
+        return -4;  // unable to write file
+    }
+    if((wr->stride > len) && (1 != fwrite(pad, wr->stride - len, 1, wr->fp))) {
+        return -4;  // unable to write file
+    }
+    wr->lines++;
+    return 0;
+}
+
+int bmp4_finish(bmp4_writer_t *wr) {
+    int rval = 0;
+    if(NULL == wr) {
+        return -1;  // NULL pointer error
+    }
+    if(NULL != wr->fp) {
+        if(wr->lines != wr->height) {
+            rval = -5;  // not all lines were written
+        }
+        if(0 != fclose(wr->fp)) {
+            rval = -4;  // unable to write file
+        }
+        wr->fp = NULL;
+    }
+    return rval;
+}
+
+/// @brief decodes the next line of an RLE8 or RLE4 image, pixels skipped over by a delta
+///        or missing from the end of the line are left as colour 0
+/// @param rd pointer to an open reader of a compressed image
+/// @param px output, width bytes, 1 byte per pixel
+/// @return 0 on success, -3 if the compressed data runs out, -7 if an RLE8 image uses a
+///         colour past the first 16
+static int rle_decode_line(bmp4_reader_t *rd, uint8_t *px) {
+    const uint8_t *d = rd->rle;
+    const size_t len = rd->rle_len;
+    const size_t w = rd->width;
+    const bool rle4 = (BMP_RLE4 == rd->compression);
+    size_t pos = rd->rle_pos;
+
+    memset(px, 0, w);
+    if(rd->rle_done) {
+        return 0;   // past the end of bitmap
+    }
+    if(rd->rle_skip) {
+        rd->rle_skip--;
+        return 0;   // a line jumped over by a delta
+    }
+    size_t x = rd->rle_x;
+    rd->rle_x = 0;
+
+    for(;;) {
+        if((pos + 2) > len) {
+            return -3;  // unable to read file, it's too short
+        }
+        uint8_t n = d[pos];
+        uint8_t c = d[pos + 1];
+        pos += 2;
+
+        if(n) { // a run of n pixels, clipped to the line
+            if(!rle4 && (c > 0x0f)) {
+                return -7;  // only the first 16 colours can be used
+            }
+            size_t end = ((x + n) < w) ? (x + n) : w;
+            uint8_t hi = rle4 ? (c >> 4) : c;
+            uint8_t lo = rle4 ? (c & 0x0f) : c;
+            if((hi == lo) && (x < end)) {
+                memset(&px[x], hi, end - x);
+            } else {
+                for(size_t i = x; i < end; i++) {
+                    px[i] = ((i - x) & 1) ? lo : hi;
+                }
+            }
+            x += n;
+        } else if(0 == c) { // end of line
+            break;
+        } else if(1 == c) { // end of bitmap
+            rd->rle_done = true;
+            break;
+        } else if(2 == c) { // delta, move right and down
+            if((pos + 2) > len) {
+                return -3;  // unable to read file, it's too short
+            }
+            x += d[pos];
+            uint8_t dy = d[pos + 1];
+            pos += 2;
+            if(dy) {
+                rd->rle_skip = dy - 1;
+                rd->rle_x = (x < w) ? x : w;
+                break;
+            }
+        } else { // absolute mode, c pixels follow padded to 16 bits
+            size_t bytes = rle4 ? ((c + 1) / 2) : c;
+            if((pos + bytes) > len) {
+                return -3;  // unable to read file, it's too short
+            }
+            const uint8_t *p = &d[pos];
+            size_t end = ((x + c) < w) ? (x + c) : w;
+            if(!rle4) {
+                for(size_t k = 0; k < c; k++) {
+                    if(p[k] > 0x0f) {
+                        return -7;  // only the first 16 colours can be used
+                    }
+                }
+                if(x < end) memcpy(&px[x], p, end - x);
+            } else {
+                for(size_t i = x; i < end; i++) {
+                    size_t k = i - x;
+                    px[i] = (k & 1) ? (p[k / 2] & 0x0f) : (p[k / 2] >> 4);
+                }
+            }
+            x += c;
+            pos += bytes + (bytes & 1);
+        }
+    }
+    rd->rle_pos = pos;
+    return 0;
+}
+
+int bmp4_open(bmp4_reader_t *rd, const char *fn) {
+    return bmp4_open_ctx(NULL, rd, fn);
+}
+
+int bmp4_open_ctx(ssi_ctx_t *ctx, bmp4_reader_t *rd, const char *fn) {
+    int rval = 0;
+    bmp_signature_t sig = 0;
+    bmp_header_t bmp;
+
+    // do some basic error checking on the inputs
+    if((NULL == fn) || (NULL == rd)) {
+        return -1;  // NULL pointer error
+    }
+    memset(rd, 0, sizeof(bmp4_reader_t));
+    rd->ctx = ctx;
+
+    // map the input file if we can, lines can then be handed out without copying
+    if(0 == map_file(&rd->map, fn, false)) {
+        if(rd->map.buf.len < HDRBUFSZ) {
+            rval = -3;  // unable to read file
+            goto bmp_cleanup;
+        }
+        memcpy(&sig, rd->map.buf.data, sizeof(bmp_signature_t));
+        memcpy(&bmp, &rd->map.buf.data[sizeof(bmp_signature_t)], sizeof(bmp_header_t));
+    } else {
+        // otherwise fall back to reading it a line at a time
+        if(NULL == (rd->fp = fopen(fn,"rb"))) {
+            rval = -2;  // can't open input file
+            goto bmp_cleanup;
+        }
+        int nr = fread(&sig, sizeof(bmp_signature_t), 1, rd->fp);
+        if(1 == nr) {
+            nr = fread(&bmp, sizeof(bmp_header_t), 1, rd->fp);
+        }
+        if(1 != nr) {
+            rval = -3;  // unable to read file
+            goto bmp_cleanup;
+        }
+    }
+    if(BMPFILESIG != sig) {
+        rval = -4; // not a BMP file
         goto bmp_cleanup;
     }
 
     // check some basic header vitals to make sure it's in a format we can work with
-    if((1 != bmp->bmi.num_planes) || 
-       (sizeof(bmi_header_t) != bmp->bmi.header_size) || 
-       (0 != bmp->dib.RES)) {
+    if((1 != bmp.bmi.num_planes) || 
+       (sizeof(bmi_header_t) != bmp.bmi.header_size) || 
+       (0 != bmp.dib.RES)) {
         rval = -6;  // invalid header
         goto bmp_cleanup;
     }
-    if((4 != bmp->bmi.bits_per_pixel) || 
-       (16 != bmp->bmi.num_colors) || 
-       (0 != bmp->bmi.compression)) {
+    uint16_t bpp = bmp.bmi.bits_per_pixel;
+    rd->compression = bmp.bmi.compression;
+    bool is_bmp4 = (4 == bpp) && (16 == bmp.bmi.num_colors) &&
+                   ((BMP_RGB == rd->compression) || (BMP_RLE4 == rd->compression));
+    bool is_rle8 = (8 == bpp) && (256 >= bmp.bmi.num_colors) && (BMP_RLE8 == rd->compression);
+    if(!is_bmp4 && !is_rle8) {
         rval = -7;  // unsupported BMP format
         goto bmp_cleanup;
     }
-    
-    // seek to the start of the image data, as we don't use the palette data
+    if((BMP_RGB != rd->compression) && (bmp.bmi.image_height < 0)) {
+        rval = -7;  // compressed images are always bottom up
+        goto bmp_cleanup;
+    }
+
+    // if height is negative, the lines are stored top to bottom
+    rd->topdown = (bmp.bmi.image_height < 0); 
+    rd->width = bmp.bmi.image_width;
+    rd->height = abs(bmp.bmi.image_height);
+
+    // stride is the bytes per line in the BMP file, which are padded
+    // out to 32 bit boundaries, we get 2 pixels per byte for being 16 colour
+    rd->stride = ((((rd->width + 1) / 2) + 3) & (~0x0003)); 
+
+    // find the start of the image data, as we don't use the palette data
     // we assume the standard CGA/EGA/VGA 16 colour palette
-    fseek(fp, bmp->dib.image_offset, SEEK_SET);
+    if(BMP_RGB != rd->compression) {
+        // the compressed data is decoded a line at a time, into an unpacked line then packed
+        size_t fsz = rd->map.mapped ? rd->map.buf.len : filesize(rd->fp);
+        if(bmp.dib.image_offset > fsz) {
+            rval = -3;  // unable to read file, it's too short
+            goto bmp_cleanup;
+        }
+        rd->rle_len = bmp.bmi.bitmap_size ? bmp.bmi.bitmap_size : (fsz - bmp.dib.image_offset);
+        if(((size_t)bmp.dib.image_offset + rd->rle_len) > fsz) {
+            rval = -3;  // unable to read file, it's too short
+            goto bmp_cleanup;
+        }
+        if((NULL == (rd->buf = ssi_zalloc(ctx, rd->stride))) || (NULL == (rd->lin = ssi_alloc(ctx, rd->width)))) {
+            rval = -5;  // unable to allocate mem
+            goto bmp_cleanup;
+        }
+        if(rd->map.mapped) {
+            rd->rle = &rd->map.buf.data[bmp.dib.image_offset];
+        } else {
+            if(NULL == (rd->rle_buf = ssi_alloc(ctx, rd->rle_len ? rd->rle_len : 1))) {
+                rval = -5;  // unable to allocate mem
+                goto bmp_cleanup;
+            }
+            fseek(rd->fp, bmp.dib.image_offset, SEEK_SET);
+            if(rd->rle_len && (1 != fread(rd->rle_buf, rd->rle_len, 1, rd->fp))) {
+                rval = -3;  // unable to read file
+                goto bmp_cleanup;
+            }
+            rd->rle = rd->rle_buf;
+        }
+    } else if(rd->map.mapped) {
+        if(((size_t)bmp.dib.image_offset + ((size_t)rd->stride * rd->height)) > rd->map.buf.len) {
+            rval = -3;  // unable to read file, it's too short
+            goto bmp_cleanup;
+        }
+        rd->map.buf.pos = bmp.dib.image_offset;
+    } else {
+        fseek(rd->fp, bmp.dib.image_offset, SEEK_SET);
+
+        // allocate our line buffer
+        if(NULL == (rd->buf = ssi_alloc(ctx, rd->stride))) {
+            rval = -5;  // unable to allocate mem
+            goto bmp_cleanup;
+        }
+    }
+
+bmp_cleanup:
+    if(0 != rval) {
+        bmp4_close(rd);
+    }
+    return rval;
+}
+
+int bmp4_read_line(bmp4_reader_t *rd, uint8_t **line, uint16_t *y) {
+    if((NULL == rd) || ((NULL == rd->fp) && !rd->map.mapped) || (NULL == line) || (NULL == y)) {
+        return -1;  // NULL pointer error
+    }
+    if(rd->lines >= rd->height) {
+        return -3;  // no more lines to read
+    }
+
+    if(BMP_RGB != rd->compression) { // decode, then pack 2 pixels per byte
+        int err = rle_decode_line(rd, rd->lin);
+        if(0 != err) {
+            return err; // unable to read file, or a colour past the first 16
+        }
+        for(int x = 0; x < rd->width; x += 2) {
+            uint8_t sp = (rd->lin[x] & 0x0f) << 4;
+            if((x + 1) < rd->width) {
+                sp |= rd->lin[x + 1] & 0x0f;
+            }
+            rd->buf[x / 2] = sp;
+        }
+        *line = rd->buf;
+    } else if(rd->map.mapped) { // point straight at the line in the mapping
+        *line = &rd->map.buf.data[rd->map.buf.pos];
+        rd->map.buf.pos += rd->stride;
+    } else {
+        uint64_t t0 = TRACE_BEGIN();
+        int nr = fread(rd->buf, rd->stride, 1, rd->fp); // read a line
+        TRACE_END(TRACE_FREAD, t0);
+        if(1 != nr) {
+            return -3;  // unable to read file
+        }
+        *line = rd->buf;
+    }
+
+    // lines are normally stored from the bottom up
+    *y = rd->topdown ? rd->lines : (rd->height - 1 - rd->lines);
+    rd->lines++;
+    return 0;
+}
+
+void bmp4_close(bmp4_reader_t *rd) {
+    if(NULL == rd) return;
+    fclose_s(rd->fp);
+    ssi_release(rd->ctx, rd->buf);
+    rd->buf = NULL;
+    ssi_release(rd->ctx, rd->lin);
+    rd->lin = NULL;
+    ssi_release(rd->ctx, rd->rle_buf);
+    rd->rle_buf = NULL;
+    rd->rle = NULL;
+    unmap_file(&rd->map);
+}
+
+int load_bmp4(memstream_buf_t *dst, const char *fn, uint16_t *width, uint16_t *height) {
+    return load_bmp4_ctx(NULL, dst, fn, width, height);
+}
+
+int load_bmp4_ctx(ssi_ctx_t *ctx, memstream_buf_t *dst, const char *fn, uint16_t *width, uint16_t *height) {
+    int rval = 0;
+    bmp4_reader_t rd = {0};
+    uint64_t t0 = TRACE_BEGIN();
+
+    // do some basic error checking on the inputs
+    if((NULL == fn) || (NULL == dst) || (NULL == width) || (NULL == height)) {
+        rval = -1;  // NULL pointer error
+        goto bmp_cleanup;
+    }
+
+    rval = bmp4_open_ctx(ctx, &rd, fn);
+    if(0 != rval) {
+        goto bmp_cleanup;
+    }
 
     // check if the destination buffer is null, if not, free it
-    // we will allocate it ourselves momentarily
+    // we will allocate it ourselves momentarily. memory from a
+    // context is only reclaimed when the context is reset
     if(NULL != dst->data) {
-        free(dst->data);
+        ssi_release(ctx, dst->data);
         dst->data = NULL;
     }
 
-    // if height is negative, flip the render order
-    bool flip = (bmp->bmi.image_height < 0); 
-    bmp->bmi.image_height = abs(bmp->bmi.image_height);
-
-    uint16_t lw = bmp->bmi.image_width;
-    uint16_t lh = bmp->bmi.image_height;
-
-    // stride is the bytes per line in the BMP file, which are padded
-    // we get 2 pixels per byte for being 16 colour
-    uint32_t stride = ((lw + 3) & (~0x0003)) / 2; 
+    uint16_t lw = rd.width;
+    uint16_t lh = rd.height;
 
-    // allocate our line and output buffers
-    if(NULL == (dst->data = calloc(1, lw * lh))) {
+    // allocate our output buffer, not zeroed as every line is read into it
+    if(NULL == (dst->data = ssi_alloc(ctx, lw * lh))) {
         rval = -5;  // unable to allocate mem
         goto bmp_cleanup;
     }
     dst->len = lw * lh;
     dst->pos = 0;
 
-    if(NULL == (buf = calloc(1, stride))) {
-        rval = -5;  // unable to allocate mem
-        goto bmp_cleanup;
+    // compressed lines are decoded straight into their place in the image, bottom up
+    if(BMP_RGB != rd.compression) {
+        for(int y = lh - 1; y >= 0; y--) {
+            rval = rle_decode_line(&rd, &dst->data[(size_t)y * lw]);
+            if(0 != rval) {
+                goto bmp_cleanup; // unable to read file, or a colour past the first 16
+            }
+        }
+        rd.lines = lh;
     }
 
     // now we need to read the image scanlines. 
-    // start by pointing to start of last line of data
-    uint8_t *px = &dst->data[dst->len - lw]; 
-    if(flip) px = dst->data; // if flipped, start at beginning
     // loop through the lines
-    for(int y = 0; y < lh; y++) {
-        nr = fread(buf, stride, 1, fp); // read a line
-        if(1 != nr) {
-            rval = -3;  // unable to read file
+    for(int l = rd.lines; l < lh; l++) {
+        uint8_t *buf;
+        uint16_t y;
+        rval = bmp4_read_line(&rd, &buf, &y); // read a line
+        if(0 != rval) {
             goto bmp_cleanup;
         }
 
         // loop through all the pixels for a line
         // we are packing 2 pixels per byte, so width is half
+        uint8_t *px = &dst->data[y * lw];
         for(int x = 0; x < ((lw + 1) / 2); x++) {
             uint8_t sp = buf[x];      // get the pixel pair
             *px++ = (sp >> 4) & 0x0f; // write the 1st pixel
@@ -350,17 +929,13 @@ int load_bmp4(memstream_buf_t *dst, const char *fn, uint16_t *width, uint16_t *h
                 *px++ = sp & 0x0f;    // write the 2nd pixel
             }
         }
-        if(!flip) { // if not flipped, wehave to walk backwards
-            px -= (lw * 2); // move back to start of previous line
-        }
     }
 
     *width = lw;
     *height = lh;
 
 bmp_cleanup:
-    fclose_s(fp);
-    free_s(buf);
-    free_s(bmp);
+    bmp4_close(&rd);
+    TRACE_END(TRACE_LOAD_BMP4, t0);
     return rval;
-}
\ No newline at end of file
+}
@@ -26,6 +26,11 @@ typedef struct {
 	uint32_t  image_offset;  // File offset to image raster data
 } dib_header_t;
 
+// values of the compression field
+#define BMP_RGB (0)   // uncompressed
+#define BMP_RLE8 (1)  // run length encoded, 8 bits per pixel
+#define BMP_RLE4 (2)  // run length encoded, 4 bits per pixel
+
 #define BMP72DPI (2835) // 72 DPI converted to PPM
 #define BMP96DPI (3780) // 96 DPI converted to PPM
 typedef struct {
@@ -34,7 +39,7 @@ typedef struct {
 	int32_t   image_height;      // bitmap height (can be -ive to flip scan order)
 	uint16_t  num_planes;        // Number of planes (must be 1)
 	uint16_t  bits_per_pixel;    // 1,4,8,18,24 (some versions support 2 and 32)
-	uint32_t  compression;       // 0 = uncompressed
+	uint32_t  compression;       // 0 = uncompressed, see BMP_RLE8/BMP_RLE4
 	uint32_t  bitmap_size;       // Size of image or can be left at 0
 	uint32_t  horiz_res;         // horizontal Pixels per meter (PPM)
 	uint32_t  vert_res;          // vertical pixels per meter (PPM)
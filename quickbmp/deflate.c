@@ -0,0 +1,1008 @@
+#include <string.h>
+#include "deflate.h"
+#include "ssi-once.h"
+
+// The compressor follows the same plan as zlib. Input is appended to a window twice
+// the size of the LZ77 distance limit, and each position is indexed by a hash of its
+// first 3 bytes, with the positions sharing a hash chained together so earlier strings
+// can be searched for the longest match. When the window fills the upper half is slid
+// down. Matches and literals are buffered as symbols, and each block goes out with
+// whichever of dynamic Huffman codes, the fixed codes or stored bytes is smallest.
+
+#define WSIZE (DEFLATE_WSIZE)
+#define WMASK (WSIZE - 1)
+#define HASH_BITS (15)
+#define MIN_MATCH (3)
+#define MAX_MATCH (DEFLATE_MAX_MATCH)
+#define MIN_LOOKAHEAD (MAX_MATCH + MIN_MATCH + 1)  // enough to always find a full length match
+#define MAX_DIST (WSIZE - MIN_LOOKAHEAD)           // so a match never runs past the window
+#define TOO_FAR (4096)   // a minimum length match further away than this costs more than its literals
+#define STORED_MAX (65535)
+
+#define LIT_CODES (286)
+#define DIST_CODES (30)
+#define CLEN_CODES (19)
+#define END_BLOCK (256)
+
+// match settings per level, as zlib's
+static const struct {
+    uint8_t     lazy;
+    uint16_t    max_lazy;
+    uint16_t    nice_len;
+    uint16_t    max_chain;
+} levels[10] = {
+    {0,   0,   0,    0}, // stored
+    {0,   4,   8,    4}, // greedy
+    {0,   5,  16,    8},
+    {0,   6,  32,   32},
+    {1,   4,  16,   16}, // lazy
+    {1,  16,  32,   32},
+    {1,  16, 128,  128},
+    {1,  32, 128,  256},
+    {1, 128, 258, 1024},
+    {1, 258, 258, 4096},
+};
+
+static const uint16_t len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[DIST_CODES] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[DIST_CODES] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// order the code length code lengths are sent in
+static const uint8_t clen_order[CLEN_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// length code for each match length less 3
+static uint8_t len_code[256];
+
+// distance code for distances less 1 below 256, then for (distance - 1) >> 7
+static uint8_t dist_code[512];
+
+// the fixed Huffman codes, bit reversed ready to write
+static uint16_t fixed_lit[288];
+static uint8_t fixed_lit_len[288];
+static uint16_t fixed_dist[DIST_CODES];
+static uint8_t fixed_dist_len[DIST_CODES];
+
+static ssi_once_t tables_once = SSI_ONCE_INIT;
+
+static void huff_codes(const uint8_t *lens, int n, uint16_t *codes);
+
+static void build_tables(void) {
+    for(int c = 0; c < 29; c++) {
+        for(int l = 0; l < (1 << len_extra[c]); l++) {
+            len_code[len_base[c] - MIN_MATCH + l] = c; // 258 comes last, so gets its own code
+        }
+    }
+    for(int c = 0; c < DIST_CODES; c++) {
+        for(int d = 0; d < (1 << dist_extra[c]); d++) {
+            int v = dist_base[c] - 1 + d;
+            if(v < 256) {
+                dist_code[v] = c;
+            } else {
+                dist_code[256 + (v >> 7)] = c;
+            }
+        }
+    }
+
+    for(int i = 0; i < 288; i++) {
+        fixed_lit_len[i] = (i < 144) ? 8 : (i < 256) ? 9 : (i < 280) ? 7 : 8;
+    }
+    huff_codes(fixed_lit_len, 288, fixed_lit);
+    memset(fixed_dist_len, 5, sizeof(fixed_dist_len));
+    huff_codes(fixed_dist_len, DIST_CODES, fixed_dist);
+}
+
+static void tables_init(void) {
+    ssi_once(&tables_once, build_tables); // the tables are shared by the threads compressing
+}
+
+static inline int dist_to_code(size_t dist) {
+    dist--;
+    return (dist < 256) ? dist_code[dist] : dist_code[256 + (dist >> 7)];
+}
+
+/// @brief works out Huffman code lengths no longer than limit. If the tree comes out too
+///        deep the frequencies are halved, flattening it, until it fits
+/// @param freq how often each symbol occurs
+/// @param n number of symbols
+/// @param limit longest code allowed
+/// @param lens output, code length per symbol, 0 for those that don't occur
+static void huff_lengths(const uint32_t *freq, int n, int limit, uint8_t *lens) {
+    int sym[288];       // the symbols that occur, by ascending frequency
+    uint32_t f[288];    // working frequencies
+    uint32_t w[576];    // weights, leaves then the internal nodes as they are made
+    uint16_t parent[576];
+    uint8_t depth[576];
+    int used = 0;
+
+    for(int i = 0; i < n; i++) {
+        lens[i] = 0;
+        f[i] = freq[i];
+        if(freq[i]) sym[used++] = i;
+    }
+    if(used < 2) {
+        // a lone code still needs a partner for the code to be complete
+        int s = used ? sym[0] : 0;
+        lens[s] = 1;
+        lens[s ? 0 : 1] = 1;
+        return;
+    }
+
+    for(;;) {
+        for(int i = 1; i < used; i++) { // insertion sort, the alphabets are small
+            int s = sym[i];
+            int j = i;
+            for(; (j > 0) && (f[sym[j - 1]] > f[s]); j--) {
+                sym[j] = sym[j - 1];
+            }
+            sym[j] = s;
+        }
+        for(int i = 0; i < used; i++) {
+            w[i] = f[sym[i]];
+        }
+
+        // leaves and internal nodes are both made in ascending weight order, so the two
+        // lightest are always at the front of one queue or the other
+        int leaf = 0;
+        int node = used;
+        int nodes = used;
+        while(nodes < (used * 2) - 1) {
+            int pick[2];
+            for(int k = 0; k < 2; k++) {
+                if((leaf < used) && ((node >= nodes) || (w[leaf] <= w[node]))) {
+                    pick[k] = leaf++;
+                } else {
+                    pick[k] = node++;
+                }
+            }
+            w[nodes] = w[pick[0]] + w[pick[1]];
+            parent[pick[0]] = nodes;
+            parent[pick[1]] = nodes;
+            nodes++;
+        }
+
+        // parents always come after their children
+        int max = 0;
+        depth[nodes - 1] = 0;
+        for(int i = nodes - 2; i >= 0; i--) {
+            depth[i] = depth[parent[i]] + 1;
+            if(depth[i] > max) max = depth[i];
+        }
+        if(max <= limit) {
+            for(int i = 0; i < used; i++) {
+                lens[sym[i]] = depth[i];
+            }
+            return;
+        }
+        for(int i = 0; i < used; i++) {
+            f[sym[i]] = (f[sym[i]] >> 1) | 1;
+        }
+    }
+}
+
+/// @brief assigns canonical codes from the code lengths, bit reversed as deflate sends them
+static void huff_codes(const uint8_t *lens, int n, uint16_t *codes) {
+    uint16_t count[16] = {0};
+    uint16_t next[16];
+
+    for(int i = 0; i < n; i++) {
+        count[lens[i]]++;
+    }
+    count[0] = 0;
+    uint16_t code = 0;
+    for(int b = 1; b < 16; b++) {
+        code = (code + count[b - 1]) << 1;
+        next[b] = code;
+    }
+    for(int i = 0; i < n; i++) {
+        if(0 == lens[i]) continue;
+        uint16_t c = next[lens[i]]++;
+        uint16_t r = 0;
+        for(int b = 0; b < lens[i]; b++) {
+            r = (r << 1) | (c & 1);
+            c >>= 1;
+        }
+        codes[i] = r;
+    }
+}
+
+static void flush_out(deflate_t *z) {
+    if((0 == z->err) && (z->out_len)) {
+        z->err = z->emit(z->arg, z->out, z->out_len);
+    }
+    z->out_len = 0;
+}
+
+static inline void put_bits(deflate_t *z, uint32_t value, int count) {
+    z->bits |= (uint64_t)value << z->bit_count;
+    z->bit_count += count;
+    if(z->bit_count >= 32) {
+        for(int i = 0; i < 4; i++) {
+            z->out[z->out_len++] = (uint8_t)(z->bits >> (i * 8));
+        }
+        z->bits >>= 32;
+        z->bit_count -= 32;
+        if(z->out_len >= DEFLATE_OUT_SZ) {
+            flush_out(z);
+        }
+    }
+}
+
+/// @brief pads to a byte boundary and moves the whole bytes to the output buffer
+static void align_bits(deflate_t *z) {
+    put_bits(z, 0, (8 - (z->bit_count & 7)) & 7);
+    while(z->bit_count) {
+        z->out[z->out_len++] = (uint8_t)z->bits;
+        z->bits >>= 8;
+        z->bit_count -= 8;
+    }
+}
+
+static void put_bytes(deflate_t *z, const uint8_t *data, size_t len) {
+    while(len) {
+        size_t n = DEFLATE_OUT_SZ - z->out_len;
+        if(n > len) n = len;
+        memcpy(&z->out[z->out_len], data, n);
+        z->out_len += n;
+        data += n;
+        len -= n;
+        if(z->out_len >= DEFLATE_OUT_SZ) {
+            flush_out(z);
+        }
+    }
+}
+
+/// @brief run length codes the literal/length and distance code lengths, as a dynamic block header sends them
+/// @param lens code lengths, the literal/length ones followed by the distance ones
+/// @param n number of code lengths
+/// @param tok output, code length code per token
+/// @param extra output, value of the extra bits for codes 16-18
+/// @return number of tokens
+static int rle_lengths(const uint8_t *lens, int n, uint8_t *tok, uint8_t *extra) {
+    int t = 0;
+    for(int i = 0; i < n;) {
+        uint8_t cur = lens[i];
+        int run = 1;
+        while((i + run < n) && (lens[i + run] == cur)) run++;
+        i += run;
+
+        if(0 == cur) {
+            while(run >= 11) {
+                int r = (run > 138) ? 138 : run;
+                tok[t] = 18; extra[t++] = r - 11;
+                run -= r;
+            }
+            if(run >= 3) {
+                tok[t] = 17; extra[t++] = run - 3;
+                run = 0;
+            }
+        } else {
+            tok[t] = cur; extra[t++] = 0;
+            run--;
+            while(run >= 3) {
+                int r = (run > 6) ? 6 : run;
+                tok[t] = 16; extra[t++] = r - 3;
+                run -= r;
+            }
+        }
+        while(run-- > 0) {
+            tok[t] = cur; extra[t++] = 0;
+        }
+    }
+    return t;
+}
+
+static void put_symbols(deflate_t *z, const uint16_t *lit, const uint8_t *lit_len,
+                        const uint16_t *dist, const uint8_t *dist_len) {
+    for(size_t i = 0; i < z->sym_count; i++) {
+        uint16_t d = z->sym_dist[i];
+        if(0 == d) {
+            uint8_t c = (uint8_t)z->sym_lit[i];
+            put_bits(z, lit[c], lit_len[c]);
+            continue;
+        }
+        int len = z->sym_lit[i];
+        int lc = len_code[len - MIN_MATCH];
+        put_bits(z, lit[257 + lc], lit_len[257 + lc]);
+        put_bits(z, len - len_base[lc], len_extra[lc]);
+        int dc = dist_to_code(d);
+        put_bits(z, dist[dc], dist_len[dc]);
+        put_bits(z, d - dist_base[dc], dist_extra[dc]);
+    }
+    put_bits(z, lit[END_BLOCK], lit_len[END_BLOCK]);
+}
+
+/// @brief writes out the buffered symbols as a block, in whichever form is smallest
+/// @param z pointer to the compressor
+/// @param end window position the block's data ends at
+/// @param last true for the final block
+static void flush_block(deflate_t *z, size_t end, int last) {
+    uint8_t lit_len[LIT_CODES];
+    uint8_t dist_len[DIST_CODES];
+    uint16_t lit[LIT_CODES];
+    uint16_t dist[DIST_CODES];
+    size_t stored_len = end - z->block_start;
+
+    z->lit_freq[END_BLOCK] = 1;
+
+    // the extra bits are the same whichever codes are used
+    uint64_t extra_bits = 0;
+    for(int c = 0; c < 29; c++) {
+        extra_bits += (uint64_t)z->lit_freq[257 + c] * len_extra[c];
+    }
+    for(int c = 0; c < DIST_CODES; c++) {
+        extra_bits += (uint64_t)z->dist_freq[c] * dist_extra[c];
+    }
+
+    // dynamic codes, and their header
+    huff_lengths(z->lit_freq, LIT_CODES, 15, lit_len);
+    huff_lengths(z->dist_freq, DIST_CODES, 15, dist_len);
+    int hlit = LIT_CODES;
+    while((hlit > 257) && (0 == lit_len[hlit - 1])) hlit--;
+    int hdist = DIST_CODES;
+    while((hdist > 1) && (0 == dist_len[hdist - 1])) hdist--;
+
+    uint8_t lens[LIT_CODES + DIST_CODES];
+    uint8_t tok[LIT_CODES + DIST_CODES];
+    uint8_t tok_extra[LIT_CODES + DIST_CODES];
+    memcpy(lens, lit_len, hlit);
+    memcpy(&lens[hlit], dist_len, hdist);
+    int ntok = rle_lengths(lens, hlit + hdist, tok, tok_extra);
+
+    uint32_t clen_freq[CLEN_CODES] = {0};
+    uint8_t clen_len[CLEN_CODES];
+    uint16_t clen[CLEN_CODES];
+    for(int i = 0; i < ntok; i++) {
+        clen_freq[tok[i]]++;
+    }
+    huff_lengths(clen_freq, CLEN_CODES, 7, clen_len);
+    int hclen = CLEN_CODES;
+    while((hclen > 4) && (0 == clen_len[clen_order[hclen - 1]])) hclen--;
+
+    uint64_t dyn_bits = 3 + 5 + 5 + 4 + (3 * hclen) + extra_bits;
+    for(int c = 0; c < CLEN_CODES; c++) {
+        dyn_bits += (uint64_t)clen_freq[c] * clen_len[c];
+    }
+    dyn_bits += (2 * clen_freq[16]) + (3 * clen_freq[17]) + (7 * clen_freq[18]);
+    uint64_t fixed_bits = 3 + extra_bits;
+    for(int c = 0; c < LIT_CODES; c++) {
+        dyn_bits += (uint64_t)z->lit_freq[c] * lit_len[c];
+        fixed_bits += (uint64_t)z->lit_freq[c] * fixed_lit_len[c];
+    }
+    for(int c = 0; c < DIST_CODES; c++) {
+        dyn_bits += (uint64_t)z->dist_freq[c] * dist_len[c];
+        fixed_bits += (uint64_t)z->dist_freq[c] * 5;
+    }
+    size_t chunks = (stored_len + STORED_MAX - 1) / STORED_MAX;
+    if(0 == chunks) chunks = 1;
+    uint64_t stored_bits = (chunks * (3 + 7 + 32)) + ((uint64_t)stored_len * 8);
+
+    if((0 == z->level) || ((stored_bits <= dyn_bits) && (stored_bits <= fixed_bits))) {
+        const uint8_t *p = &z->window[z->block_start];
+        do {
+            size_t n = (stored_len > STORED_MAX) ? STORED_MAX : stored_len;
+            stored_len -= n;
+            put_bits(z, (last && (0 == stored_len)) ? 1 : 0, 3); // stored block type is 0
+            align_bits(z);
+            put_bits(z, (uint32_t)n, 16);
+            put_bits(z, (uint32_t)n ^ 0xffff, 16);
+            align_bits(z);
+            put_bytes(z, p, n);
+            p += n;
+        } while(stored_len);
+    } else if(fixed_bits <= dyn_bits) {
+        put_bits(z, (last ? 1 : 0) | (1 << 1), 3);
+        put_symbols(z, fixed_lit, fixed_lit_len, fixed_dist, fixed_dist_len);
+    } else {
+        huff_codes(lit_len, LIT_CODES, lit);
+        huff_codes(dist_len, DIST_CODES, dist);
+        huff_codes(clen_len, CLEN_CODES, clen);
+        put_bits(z, (last ? 1 : 0) | (2 << 1), 3);
+        put_bits(z, hlit - 257, 5);
+        put_bits(z, hdist - 1, 5);
+        put_bits(z, hclen - 4, 4);
+        for(int i = 0; i < hclen; i++) {
+            put_bits(z, clen_len[clen_order[i]], 3);
+        }
+        for(int i = 0; i < ntok; i++) {
+            put_bits(z, clen[tok[i]], clen_len[tok[i]]);
+            if(16 == tok[i]) put_bits(z, tok_extra[i], 2);
+            else if(17 == tok[i]) put_bits(z, tok_extra[i], 3);
+            else if(18 == tok[i]) put_bits(z, tok_extra[i], 7);
+        }
+        put_symbols(z, lit, lit_len, dist, dist_len);
+    }
+
+    z->sym_count = 0;
+    memset(z->lit_freq, 0, sizeof(z->lit_freq));
+    memset(z->dist_freq, 0, sizeof(z->dist_freq));
+    z->block_start = end;
+}
+
+static inline void tally_lit(deflate_t *z, uint8_t c) {
+    z->sym_lit[z->sym_count] = c;
+    z->sym_dist[z->sym_count++] = 0;
+    z->lit_freq[c]++;
+}
+
+static inline void tally_match(deflate_t *z, size_t len, size_t dist) {
+    z->sym_lit[z->sym_count] = (uint16_t)len;
+    z->sym_dist[z->sym_count++] = (uint16_t)dist;
+    z->lit_freq[257 + len_code[len - MIN_MATCH]]++;
+    z->dist_freq[dist_to_code(dist)]++;
+}
+
+/// @brief indexes the string at pos
+/// @return the previous position with the same hash, 0 if none
+static inline size_t insert_string(deflate_t *z, size_t pos) {
+    const uint8_t *p = &z->window[pos];
+    uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    uint32_t h = (v * 2654435761u) >> (32 - HASH_BITS);
+    size_t cand = z->head[h];
+    z->prev[pos & WMASK] = (uint16_t)cand;
+    z->head[h] = (uint16_t)pos;
+    return cand;
+}
+
+/// @brief follows the hash chain from cand looking for the longest match at strstart
+/// @param best only matches longer than this are of interest
+/// @return the longest match length found, match_start is set if it's longer than best
+static size_t longest_match(deflate_t *z, size_t cand, size_t best) {
+    const uint8_t *scan = &z->window[z->strstart];
+    size_t max_len = (z->lookahead < MAX_MATCH) ? z->lookahead : MAX_MATCH;
+    size_t limit = (z->strstart > MAX_DIST) ? z->strstart - MAX_DIST : 0;
+    int chain = z->max_chain;
+
+    if(best >= max_len) {
+        return best;
+    }
+    do {
+        const uint8_t *m = &z->window[cand];
+        // check the byte that would make it longer first, it's the most likely to differ
+        if((m[best] != scan[best]) || (m[0] != scan[0]) || (m[1] != scan[1])) {
+            continue;
+        }
+        // 8 bytes at a time while they agree, the window has slack for reading past the end
+        size_t len = 2;
+        while(len < max_len) {
+            uint64_t a, b;
+            memcpy(&a, &scan[len], sizeof(a));
+            memcpy(&b, &m[len], sizeof(b));
+            if(a != b) break;
+            len += 8;
+        }
+        while((len < max_len) && (scan[len] == m[len])) len++;
+        if(len > max_len) len = max_len;
+
+        if(len > best) {
+            best = len;
+            z->match_start = cand;
+            if(len >= (size_t)z->nice_len || len >= max_len) break;
+        }
+    } while((--chain > 0) && ((cand = z->prev[cand & WMASK]) > limit));
+    return best;
+}
+
+/// @brief takes the longest match at each position, the faster levels
+static void compress_greedy(deflate_t *z, int flush) {
+    const size_t end = z->strstart + z->lookahead;
+
+    while((z->lookahead >= MIN_LOOKAHEAD) || (flush && z->lookahead)) {
+        size_t len = 0;
+        if(z->lookahead >= MIN_MATCH) {
+            size_t cand = insert_string(z, z->strstart);
+            if(cand && (z->strstart - cand <= MAX_DIST)) {
+                len = longest_match(z, cand, MIN_MATCH - 1);
+            }
+        }
+
+        if(len >= MIN_MATCH) {
+            tally_match(z, len, z->strstart - z->match_start);
+            z->lookahead -= len;
+            if(len <= (size_t)z->max_lazy) { // short enough to index the strings within it too
+                for(size_t p = z->strstart + 1; p < z->strstart + len; p++) {
+                    if(p + MIN_MATCH <= end) insert_string(z, p);
+                }
+            }
+            z->strstart += len;
+        } else {
+            tally_lit(z, z->window[z->strstart]);
+            z->strstart++;
+            z->lookahead--;
+        }
+        if(DEFLATE_SYMS == z->sym_count) {
+            flush_block(z, z->strstart, 0);
+        }
+    }
+}
+
+/// @brief only takes a match if the next position doesn't have a longer one, the slower levels
+static void compress_lazy(deflate_t *z, int flush) {
+    const size_t end = z->strstart + z->lookahead;
+
+    while((z->lookahead >= MIN_LOOKAHEAD) || (flush && z->lookahead)) {
+        size_t cand = 0;
+        if(z->lookahead >= MIN_MATCH) {
+            cand = insert_string(z, z->strstart);
+        }
+
+        // the match found at the previous position, if any
+        size_t prev_len = z->match_len;
+        size_t prev_start = z->match_start;
+        z->match_len = MIN_MATCH - 1;
+        if(cand && (prev_len < (size_t)z->max_lazy) && (z->strstart - cand <= MAX_DIST)) {
+            z->match_len = longest_match(z, cand, prev_len);
+            if((z->match_len == MIN_MATCH) && (z->strstart - z->match_start > TOO_FAR)) {
+                z->match_len = MIN_MATCH - 1;
+            }
+        }
+
+        if((prev_len >= MIN_MATCH) && (z->match_len <= prev_len)) {
+            // the previous match wins, it started one position back
+            tally_match(z, prev_len, z->strstart - 1 - prev_start);
+            for(size_t p = z->strstart + 1; p < z->strstart - 1 + prev_len; p++) {
+                if(p + MIN_MATCH <= end) insert_string(z, p);
+            }
+            z->strstart += prev_len - 1;
+            z->lookahead -= prev_len - 1;
+            z->match_available = 0;
+            z->match_len = MIN_MATCH - 1;
+            if(DEFLATE_SYMS == z->sym_count) {
+                flush_block(z, z->strstart, 0);
+            }
+        } else if(z->match_available) {
+            // no match, or a better one here, the previous position goes as a literal
+            tally_lit(z, z->window[z->strstart - 1]);
+            if(DEFLATE_SYMS == z->sym_count) {
+                flush_block(z, z->strstart, 0);
+            }
+            z->strstart++;
+            z->lookahead--;
+        } else {
+            z->match_available = 1;
+            z->strstart++;
+            z->lookahead--;
+        }
+    }
+    if(flush && z->match_available) {
+        tally_lit(z, z->window[z->strstart - 1]);
+        z->match_available = 0;
+    }
+}
+
+static void compress(deflate_t *z, int flush) {
+    if(0 == z->level) {
+        z->strstart += z->lookahead; // stored, nothing to match
+        z->lookahead = 0;
+    } else if(z->lazy) {
+        compress_lazy(z, flush);
+    } else {
+        compress_greedy(z, flush);
+    }
+}
+
+/// @brief slides the upper half of the window down to make room for more input
+static void slide_window(deflate_t *z) {
+    // a block's data has to stay in the window, so the one in progress goes out first
+    flush_block(z, z->strstart - z->match_available, 0);
+
+    memcpy(z->window, &z->window[WSIZE], WSIZE);
+    z->strstart -= WSIZE;
+    z->block_start -= WSIZE;
+    z->match_start = (z->match_start >= WSIZE) ? z->match_start - WSIZE : 0;
+    for(int i = 0; i < DEFLATE_HASH_SIZE; i++) {
+        z->head[i] = (z->head[i] >= WSIZE) ? z->head[i] - WSIZE : 0;
+    }
+    for(int i = 0; i < WSIZE; i++) {
+        z->prev[i] = (z->prev[i] >= WSIZE) ? z->prev[i] - WSIZE : 0;
+    }
+}
+
+static uint32_t adler32(uint32_t adler, const uint8_t *data, size_t len) {
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while(len) {
+        size_t n = (len > 5552) ? 5552 : len; // the most that can't overflow before the modulo
+        len -= n;
+        while(n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+void deflate_init(deflate_t *z, int level, deflate_emit_fn emit, void *arg) {
+    tables_init();
+    memset(z, 0, sizeof(*z));
+
+    if((level < 0) || (level > 9)) {
+        level = 6;
+    }
+    z->level = level;
+    z->lazy = levels[level].lazy;
+    z->max_lazy = levels[level].max_lazy;
+    z->nice_len = levels[level].nice_len;
+    z->max_chain = levels[level].max_chain;
+    z->match_len = MIN_MATCH - 1;
+    z->adler = 1;
+    z->emit = emit;
+    z->arg = arg;
+
+    // zlib header, a 32K window and the level as a hint
+    z->out[z->out_len++] = 0x78;
+    z->out[z->out_len++] = (level < 2) ? 0x01 : (level < 6) ? 0x5e : (6 == level) ? 0x9c : 0xda;
+}
+
+int deflate_write(deflate_t *z, const uint8_t *data, size_t len) {
+    z->adler = adler32(z->adler, data, len);
+    while(len && (0 == z->err)) {
+        size_t room = (WSIZE * 2) - (z->strstart + z->lookahead);
+        if(0 == room) {
+            slide_window(z);
+            continue;
+        }
+        size_t n = (len < room) ? len : room;
+        memcpy(&z->window[z->strstart + z->lookahead], data, n);
+        z->lookahead += n;
+        data += n;
+        len -= n;
+        compress(z, 0);
+    }
+    return z->err;
+}
+
+int deflate_finish(deflate_t *z) {
+    compress(z, 1);
+    flush_block(z, z->strstart, 1);
+    align_bits(z);
+    for(int i = 3; i >= 0; i--) { // big endian
+        z->out[z->out_len++] = (uint8_t)(z->adler >> (i * 8));
+    }
+    flush_out(z);
+    return z->err;
+}
+
+// Decompression. Huffman codes are decoded with a table indexed by the next
+// FAST_BITS bits, which covers all but the rarest symbols, the rest fall back to
+// walking the canonical code a bit at a time.
+
+#define FAST_BITS (9)
+
+typedef struct {
+    uint16_t    count[16];              // number of codes of each length
+    uint16_t    symbol[288];            // symbols in canonical code order
+    uint16_t    fast[1 << FAST_BITS];   // symbol << 4 | length for the short codes, 0 for the rest
+} huff_t;
+
+typedef struct {
+    const uint8_t   *src;
+    size_t          src_len;
+    size_t          pos;        // next byte of src to load
+    uint64_t        bits;       // loaded bits, LSB first
+    int             bit_count;
+    uint8_t         *dst;
+    size_t          dst_len;
+    size_t          out;        // bytes decompressed so far
+} inflater_t;
+
+static inline void refill(inflater_t *s) {
+    while((s->bit_count <= 56) && (s->pos < s->src_len)) {
+        s->bits |= (uint64_t)s->src[s->pos++] << s->bit_count;
+        s->bit_count += 8;
+    }
+}
+
+/// @return the next count bits, or -1 if the stream has run out
+static inline int get_bits(inflater_t *s, int count) {
+    refill(s);
+    if(s->bit_count < count) {
+        return -1;
+    }
+    int v = (int)(s->bits & ((1u << count) - 1));
+    s->bits >>= count;
+    s->bit_count -= count;
+    return v;
+}
+
+/// @brief sets up a decoding table from code lengths
+/// @return 0 on success, -1 if the lengths describe too many codes
+static int huff_build(huff_t *h, const uint8_t *lens, int n) {
+    uint16_t offs[16];
+
+    memset(h->count, 0, sizeof(h->count));
+    for(int i = 0; i < n; i++) {
+        h->count[lens[i]]++;
+    }
+    h->count[0] = 0;
+    int left = 1;
+    for(int len = 1; len < 16; len++) {
+        left = (left << 1) - h->count[len];
+        if(left < 0) {
+            return -1;  // over subscribed, incomplete codes are allowed though
+        }
+    }
+
+    offs[1] = 0;
+    for(int len = 1; len < 15; len++) {
+        offs[len + 1] = offs[len] + h->count[len];
+    }
+    for(int i = 0; i < n; i++) {
+        if(lens[i]) h->symbol[offs[lens[i]]++] = i;
+    }
+
+    memset(h->fast, 0, sizeof(h->fast));
+    int code = 0;
+    int index = 0;
+    for(int len = 1; len <= FAST_BITS; len++) {
+        for(int k = 0; k < h->count[len]; k++) {
+            int r = 0;
+            for(int b = 0; b < len; b++) { // codes arrive bit reversed
+                r |= ((code >> b) & 1) << (len - 1 - b);
+            }
+            for(int j = r; j < (1 << FAST_BITS); j += 1 << len) {
+                h->fast[j] = (h->symbol[index] << 4) | len;
+            }
+            code++;
+            index++;
+        }
+        code <<= 1;
+    }
+    return 0;
+}
+
+/// @return the next symbol, or -1 if the stream is corrupt or has run out
+static inline int huff_decode(inflater_t *s, const huff_t *h) {
+    refill(s);
+    uint16_t e = h->fast[s->bits & ((1 << FAST_BITS) - 1)];
+    if(e && ((e & 15) <= s->bit_count)) {
+        s->bits >>= e & 15;
+        s->bit_count -= e & 15;
+        return e >> 4;
+    }
+
+    // a long code, a bit at a time
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for(int len = 1; len < 16; len++) {
+        if(0 == s->bit_count) {
+            return -1;
+        }
+        code |= (int)(s->bits & 1);
+        s->bits >>= 1;
+        s->bit_count--;
+        int count = h->count[len];
+        if(code - first < count) {
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+/// @brief decodes the symbols of a compressed block up to its end code
+/// @return 0 on success, -1 if corrupt, -2 if out of room
+static int inflate_codes(inflater_t *s, const huff_t *lit, const huff_t *dist) {
+    for(;;) {
+        int sym = huff_decode(s, lit);
+        if(sym < 0) {
+            return -1;
+        }
+        if(sym < 256) {
+            if(s->out >= s->dst_len) {
+                return -2;
+            }
+            s->dst[s->out++] = (uint8_t)sym;
+            continue;
+        }
+        if(END_BLOCK == sym) {
+            return 0;
+        }
+
+        sym -= 257;
+        if(sym >= 29) {
+            return -1;
+        }
+        int extra = get_bits(s, len_extra[sym]);
+        if(extra < 0) {
+            return -1;
+        }
+        size_t len = len_base[sym] + extra;
+        int dsym = huff_decode(s, dist);
+        if((dsym < 0) || (dsym >= DIST_CODES)) {
+            return -1;
+        }
+        if((extra = get_bits(s, dist_extra[dsym])) < 0) {
+            return -1;
+        }
+        size_t d = dist_base[dsym] + extra;
+        if(d > s->out) {
+            return -1;  // reaches back before the start
+        }
+        if(len > (s->dst_len - s->out)) {
+            return -2;
+        }
+        // byte by byte, the copy can overlap what it's producing
+        uint8_t *o = &s->dst[s->out];
+        const uint8_t *from = o - d;
+        for(size_t i = 0; i < len; i++) {
+            o[i] = from[i];
+        }
+        s->out += len;
+    }
+}
+
+/// @brief reads the code lengths of a dynamic block and sets up its tables
+/// @return 0 on success, -1 if corrupt
+static int inflate_dynamic(inflater_t *s, huff_t *lit, huff_t *dist) {
+    uint8_t lens[LIT_CODES + DIST_CODES];
+    uint8_t clen_lens[CLEN_CODES] = {0};
+    huff_t clen;
+
+    int hlit = get_bits(s, 5);
+    int hdist = get_bits(s, 5);
+    int hclen = get_bits(s, 4);
+    if((hlit < 0) || (hdist < 0) || (hclen < 0)) {
+        return -1;
+    }
+    hlit += 257;
+    hdist += 1;
+    hclen += 4;
+    if((hlit > LIT_CODES) || (hdist > DIST_CODES)) {
+        return -1;
+    }
+    for(int i = 0; i < hclen; i++) {
+        int v = get_bits(s, 3);
+        if(v < 0) {
+            return -1;
+        }
+        clen_lens[clen_order[i]] = v;
+    }
+    if(0 != huff_build(&clen, clen_lens, CLEN_CODES)) {
+        return -1;
+    }
+
+    for(int i = 0; i < hlit + hdist;) {
+        int sym = huff_decode(s, &clen);
+        if(sym < 0) {
+            return -1;
+        }
+        if(sym < 16) {
+            lens[i++] = sym;
+            continue;
+        }
+        int rep;
+        uint8_t v = 0;
+        if(16 == sym) {
+            if(0 == i) {
+                return -1;  // nothing to repeat
+            }
+            v = lens[i - 1];
+            rep = get_bits(s, 2) + 3;
+        } else if(17 == sym) {
+            rep = get_bits(s, 3) + 3;
+        } else {
+            rep = get_bits(s, 7) + 11;
+        }
+        if((rep < 3) || ((i + rep) > (hlit + hdist))) {
+            return -1;
+        }
+        while(rep--) {
+            lens[i++] = v;
+        }
+    }
+    if(0 == lens[END_BLOCK]) {
+        return -1;  // a block has to be able to end
+    }
+    if((0 != huff_build(lit, lens, hlit)) || (0 != huff_build(dist, &lens[hlit], hdist))) {
+        return -1;
+    }
+    return 0;
+}
+
+int inflate_zlib(uint8_t *dst, size_t dst_len, const uint8_t *src, size_t src_len, size_t *out) {
+    inflater_t s = {src, src_len, 0, 0, 0, dst, dst_len, 0};
+    huff_t lit;
+    huff_t dist;
+    int rval = 0;
+    int last = 0;
+
+    tables_init();
+    if(NULL != out) *out = 0;
+    if((NULL == src) || ((NULL == dst) && dst_len)) {
+        return -1;
+    }
+
+    // zlib header, deflate with at most a 32K window and no preset dictionary
+    if((src_len < 6) || (8 != (src[0] & 0x0f)) || ((src[0] >> 4) > 7) ||
+       (0 != (((src[0] << 8) | src[1]) % 31)) || (src[1] & 0x20)) {
+        return -1;
+    }
+    s.pos = 2;
+
+    while(!last && (0 == rval)) {
+        int hdr = get_bits(&s, 3);
+        if(hdr < 0) {
+            return -1;
+        }
+        last = hdr & 1;
+        switch(hdr >> 1) {
+            case 0: { // stored, byte aligned with its length and the complement
+                // hand the whole bytes still loaded back to the source
+                s.bits >>= s.bit_count & 7;
+                s.bit_count -= s.bit_count & 7;
+                s.pos -= s.bit_count / 8;
+                s.bits = 0;
+                s.bit_count = 0;
+                if((s.pos + 4) > src_len) {
+                    return -1;
+                }
+                size_t n = src[s.pos] | (src[s.pos + 1] << 8);
+                if((n ^ 0xffff) != (size_t)(src[s.pos + 2] | (src[s.pos + 3] << 8))) {
+                    return -1;
+                }
+                s.pos += 4;
+                if((s.pos + n) > src_len) {
+                    return -1;
+                }
+                if(n > (dst_len - s.out)) {
+                    return -2;
+                }
+                memcpy(&dst[s.out], &src[s.pos], n);
+                s.pos += n;
+                s.out += n;
+                break;
+            }
+            case 1: // fixed codes
+                huff_build(&lit, fixed_lit_len, 288);
+                huff_build(&dist, fixed_dist_len, DIST_CODES);
+                rval = inflate_codes(&s, &lit, &dist);
+                break;
+            case 2: // dynamic codes
+                rval = inflate_dynamic(&s, &lit, &dist);
+                if(0 == rval) {
+                    rval = inflate_codes(&s, &lit, &dist);
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+    if(0 != rval) {
+        return rval;
+    }
+
+    // the checksum follows on the next byte boundary
+    s.bits >>= s.bit_count & 7;
+    s.bit_count -= s.bit_count & 7;
+    s.pos -= s.bit_count / 8;
+    if((s.pos + 4) > src_len) {
+        return -1;
+    }
+    uint32_t adler = ((uint32_t)src[s.pos] << 24) | ((uint32_t)src[s.pos + 1] << 16) |
+                     ((uint32_t)src[s.pos + 2] << 8) | src[s.pos + 3];
+    if(adler != adler32(1, dst, s.out)) {
+        return -1;
+    }
+    if(NULL != out) *out = s.out;
+    return 0;
+}
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "deflate.h"
+#include "png.h"
+#include "util.h"
+#include "ssi-once.h"
+
+static const uint8_t png_sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+#define PNG_COLOUR_INDEXED (3)
+
+static uint32_t crc_table[256];
+static ssi_once_t crc_once = SSI_ONCE_INIT;
+
+static void build_crc(void) {
+    for(uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for(int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xedb88320 ^ (c >> 1) : (c >> 1);
+        }
+        crc_table[n] = c;
+    }
+}
+
+static void crc_init(void) {
+    ssi_once(&crc_once, build_crc); // the table is shared by the threads writing PNGs
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len) {
+    for(size_t i = 0; i < len; i++) {
+        crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static inline void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/// @brief writes a chunk, its length, type, data and CRC
+/// @param fp file to write to
+/// @param type 4 character chunk type
+/// @param data chunk data, may be NULL if len is 0
+/// @param len size of the data
+/// @return 0 on success, -4 on a write error
+static int write_chunk(FILE *fp, const char *type, const uint8_t *data, size_t len) {
+    uint8_t hdr[8];
+    uint8_t crc[4];
+
+    put_be32(hdr, (uint32_t)len);
+    memcpy(&hdr[4], type, 4);
+    // the CRC covers the type and the data, but not the length
+    put_be32(crc, crc32_update(crc32_update(0xffffffff, &hdr[4], 4), data, len) ^ 0xffffffff);
+
+    if(1 != fwrite(hdr, sizeof(hdr), 1, fp)) {
+        return -4;  // unable to write file
+    }
+    if(len && (1 != fwrite(data, len, 1, fp))) {
+        return -4;  // unable to write file
+    }
+    if(1 != fwrite(crc, sizeof(crc), 1, fp)) {
+        return -4;  // unable to write file
+    }
+    return 0;
+}
+
+// each run of compressed data becomes an IDAT chunk
+static int emit_idat(void *arg, const uint8_t *data, size_t len) {
+    return write_chunk((FILE *)arg, "IDAT", data, len);
+}
+
+int png_create(png_writer_t *wr, const char *fn, uint16_t width, uint16_t height, uint8_t bits, pal_entry_t *xpal, int level) {
+    return png_create_ctx(NULL, wr, fn, width, height, bits, xpal, level);
+}
+
+int png_create_ctx(ssi_ctx_t *ctx, png_writer_t *wr, const char *fn, uint16_t width, uint16_t height, uint8_t bits, pal_entry_t *xpal, int level) {
+    int rval = 0;
+
+    // do some basic error checking on the inputs
+    if((NULL == wr) || (NULL == fn) || (NULL == xpal)) {
+        return -1;  // NULL pointer error
+    }
+    if(((1 != bits) && (2 != bits) && (4 != bits)) || (0 == width) || (0 == height)) {
+        return -1;  // nothing we can write
+    }
+    memset(wr, 0, sizeof(png_writer_t));
+    wr->width = width;
+    wr->height = height;
+    wr->bits = bits;
+    wr->stride = ((uint32_t)width * bits + 7) / 8;
+    wr->ctx = ctx;
+    crc_init();
+
+    if(NULL == (wr->z = ssi_alloc(ctx, sizeof(deflate_t)))) {
+        rval = -3;  // unable to allocate mem
+        goto png_cleanup;
+    }
+
+    // try to open/create output file
+    if(NULL == (wr->fp = fopen(fn,"wb"))) {
+        rval = -2;  // can't open/create output file
+        goto png_cleanup;
+    }
+
+    if(1 != fwrite(png_sig, sizeof(png_sig), 1, wr->fp)) {
+        rval = -4;  // unable to write file
+        goto png_cleanup;
+    }
+
+    uint8_t ihdr[13];
+    put_be32(&ihdr[0], width);
+    put_be32(&ihdr[4], height);
+    ihdr[8] = bits;
+    ihdr[9] = PNG_COLOUR_INDEXED;
+    ihdr[10] = 0;   // deflate compression
+    ihdr[11] = 0;   // adaptive filtering, though only the none filter is used
+    ihdr[12] = 0;   // not interlaced
+    if(0 != (rval = write_chunk(wr->fp, "IHDR", ihdr, sizeof(ihdr)))) {
+        goto png_cleanup;
+    }
+
+    uint8_t plte[16 * 3];
+    int colours = 1 << bits;
+    for(int i = 0; i < colours; i++) {
+        plte[i * 3 + 0] = xpal[i].r;
+        plte[i * 3 + 1] = xpal[i].g;
+        plte[i * 3 + 2] = xpal[i].b;
+    }
+    if(0 != (rval = write_chunk(wr->fp, "PLTE", plte, colours * 3))) {
+        goto png_cleanup;
+    }
+
+    deflate_init(wr->z, level, emit_idat, wr->fp);
+
+png_cleanup:
+    if(0 != rval) {
+        fclose_s(wr->fp);
+        ssi_release(ctx, wr->z);
+        wr->z = NULL;
+    }
+    return rval;
+}
+
+int png_write_line(png_writer_t *wr, const uint8_t *line) {
+    // indexed images do best unfiltered, so each line is just prefixed with the none filter type
+    static const uint8_t filter = 0;
+
+    if((NULL == wr->fp) || (NULL == line)) {
+        return -1;  // NULL pointer error
+    }
+    if(wr->lines >= wr->height) {
+        return -5;  // all lines already written
+    }
+
+    if((0 != deflate_write(wr->z, &filter, 1)) || (0 != deflate_write(wr->z, line, wr->stride))) {
+        return -4;  // unable to write file
+    }
+    wr->lines++;
+    return 0;
+}
+
+int png_finish(png_writer_t *wr) {
+    int rval = 0;
+    if(NULL == wr) {
+        return -1;  // NULL pointer error
+    }
+    if(NULL != wr->fp) {
+        if(wr->lines != wr->height) {
+            rval = -5;  // not all lines were written
+        } else if((0 != deflate_finish(wr->z)) || (0 != write_chunk(wr->fp, "IEND", NULL, 0))) {
+            rval = -4;  // unable to write file
+        }
+        if(0 != fclose(wr->fp)) {
+            rval = -4;  // unable to write file
+        }
+        wr->fp = NULL;
+    }
+    ssi_release(wr->ctx, wr->z);
+    wr->z = NULL;
+    return rval;
+}
+
+int save_png(const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, uint8_t bits, pal_entry_t *xpal, int level) {
+    return save_png_ctx(NULL, fn, src, width, height, bits, xpal, level);
+}
+
+int save_png_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, uint16_t width, uint16_t height, uint8_t bits, pal_entry_t *xpal, int level) {
+    int rval = 0;
+    png_writer_t wr = {0};
+    uint8_t *buf = NULL; // line buffer
+
+    // do some basic error checking on the inputs
+    if((NULL == fn) || (NULL == src) || (NULL == src->data)) {
+        rval = -1;  // NULL pointer error
+        goto png_cleanup;
+    }
+    if(src->len < ((size_t)width * height)) {
+        rval = -1;  // not enough image data
+        goto png_cleanup;
+    }
+
+    if(0 != (rval = png_create_ctx(ctx, &wr, fn, width, height, bits, xpal, level))) {
+        goto png_cleanup;
+    }
+
+    // allocate a buffer to hold a single packed line
+    if(NULL == (buf = ssi_alloc(ctx, wr.stride))) {
+        rval = -3;  // unable to allocate mem
+        goto png_cleanup;
+    }
+
+    // pack each line, left most pixel in the high bits, and compress it
+    const uint8_t mask = (1 << bits) - 1;
+    const uint8_t *px = src->data;
+    for(int y = 0; y < height; y++) {
+        memset(buf, 0, wr.stride);
+        for(int x = 0; x < width; x++) {
+            int shift = 8 - (((x * bits) & 7) + bits);
+            buf[(x * bits) / 8] |= (*px++ & mask) << shift;
+        }
+        if(0 != (rval = png_write_line(&wr, buf))) {
+            goto png_cleanup;
+        }
+    }
+    rval = png_finish(&wr);
+
+png_cleanup:
+    if(0 != rval) {
+        png_finish(&wr);
+    }
+    ssi_release(ctx, buf);
+    return rval;
+}
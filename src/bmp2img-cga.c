@@ -19,72 +19,94 @@
 #include "ssi-img.h"
 #include "bmp.h"
 #include "util.h"
+#include "ssi-trace.h"
 
 int main(int argc, char *argv[]) {
     int rval = -1;
+    ssi_ctx_t ctx = {0};                // owns all our buffers
     FILE *fo = NULL;
     char *fi_name = NULL;
     char *fo_name = NULL;
-    memstream_buf_t img = {0, 0, NULL}; // planar data from file
-    memstream_buf_t src = {0, 0, NULL}; // de-planed data
+    memstream_buf_t img = {0, 0, NULL}; // planar data from file (from the context)
+    bmp4_reader_t bmp = {0};            // BMP file being read
     char resolution[10];
     uint16_t width;
     uint16_t height;
 
     printf("BMP to SSI-IMG image converter\n");
 
+    if(0 != trace_args(&argc, argv)) { // --stats and --trace can go anywhere
+        return -1;
+    }
+
     if((argc < 2) || (argc > 3)) {
         printf("USAGE: %s [infile] <outfile>\n", filename(argv[0]));
         printf("[infile] is the name of the input file\n");
         printf("<outfile> is optional and the name of the output file\n");
         printf("if omitted, outfile will be named the same as infile with a .IMG extension\n");
+        printf("--stats and --trace <file> can be given anywhere, to report the time taken by each stage\n");
+        printf("   and to append a Chrome trace of this run to <file> (view it with Perfetto)\n");
         return -1;
     }
     argv++; argc--; // consume the first arg (program name)
 
     // get the filename strings from command line
-    int namelen = strlen(argv[0]);
-    if(NULL == (fi_name = calloc(1, namelen+1))) {
+    if(NULL == (fi_name = ssi_strdup(&ctx, argv[0], 0))) {
         printf("Unable to allocate memory\n");
         goto CLEANUP;
     }
-    strncpy(fi_name, argv[0], namelen);
     argv++; argc--; // consume the arg (input file)
 
     if(argc) { // output file name was provided
-        int namelen = strlen(argv[0]);
-        if(NULL == (fo_name = calloc(1, namelen+1))) {
+        if(NULL == (fo_name = ssi_strdup(&ctx, argv[0], 0))) {
             printf("Unable to allocate memory\n");
             goto CLEANUP;
         }
-        strncpy(fo_name, argv[0], namelen);
         argv++; argc--; // consume the arg (input file)
     } else { // no name was provded, so make one
-        if(NULL == (fo_name = calloc(1, namelen+5))) {
+        if(NULL == (fo_name = ssi_strdup(&ctx, fi_name, 4))) {
             printf("Unable to allocate memory\n");
             goto CLEANUP;
         }
-        strncpy(fo_name, fi_name, namelen);
         drop_extension(fo_name); // remove exisiting extension
-        strncat(fo_name,".IMG", namelen+4); // add bmp extension
+        strcat(fo_name,".IMG"); // add bmp extension
     }
 
     printf("Loading BMP File: '%s'\n", fi_name);
-    rval = load_bmp4(&src, fi_name, &width, &height);
+    rval = bmp4_open_ctx(&ctx, &bmp, fi_name);
     if(0 != rval) {
         printf("BMP Load Error (%d)\n", rval);
         goto CLEANUP;
     }
+    width = bmp.width;
+    height = bmp.height;
 
     printf("Resolution: %d x %d\n", width, height);
 
-    if(NULL == (img.data = calloc(1, 16384))) {
+    if(NULL == (img.data = ssi_zalloc(&ctx, 16384))) {
         printf("Unable to allocate memory\n");
         goto CLEANUP;
     }
     img.len = 16384; // CGA image is always 16K
 
-    lin2lace(&img, &src, width, height);
+    // pack each line straight from the BMP into its place in the image
+    uint64_t t0 = TRACE_BEGIN();
+    for(int l = 0; l < height; l++) {
+        uint8_t *line;
+        uint16_t y;
+        rval = bmp4_read_line(&bmp, &line, &y);
+        if(0 != rval) {
+            printf("BMP Load Error (%d)\n", rval);
+            goto CLEANUP;
+        }
+        if(0 != bmp42lace(&img, line, y, width, height)) {
+            printf("Invalid image size\n");
+            rval = -1;
+            goto CLEANUP;
+        }
+    }
+    TRACE_END(TRACE_BMP42IMG, t0);
+    bmp4_close(&bmp);
 
     // create/open the output file
     printf("Creating IMG File: '%s'\n", fo_name);
@@ -92,7 +114,9 @@ int main(int argc, char *argv[]) {
         printf("Error: Unable to open output file\n");
         goto CLEANUP;
     }
+    t0 = TRACE_BEGIN();
     int nr = fwrite(img.data, img.len, 1, fo);
+    TRACE_END(TRACE_FWRITE, t0);
     if(1 != nr) {
         printf("Error Unable write file\n");
         goto CLEANUP;
@@ -102,9 +126,8 @@ int main(int argc, char *argv[]) {
     rval = 0; // clean exit
 CLEANUP:
     fclose_s(fo);
-    free_s(fi_name);
-    free_s(fo_name);
-    free_s(img.data);
-    free_s(src.data);
+    bmp4_close(&bmp);
+    ssi_ctx_free(&ctx); // releases the names and image buffer in one go
+    trace_report();
     return rval;
 }
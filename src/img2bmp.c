@@ -15,64 +15,177 @@
 #include "ssi-img.h"
 #include "bmp.h"
 #include "util.h"
+#include "convert.h"
 
-// EGA's 64 palette table entries
-static pal_entry_t ega_table[64] = { 
-  {0x00,0x00,0x00}, {0x00,0x00,0xaa}, {0x00,0xaa,0x00}, {0x00,0xaa,0xaa}, // 0x00-0x03
-  {0xaa,0x00,0x00}, {0xaa,0x00,0xaa}, {0xaa,0xaa,0x00}, {0xaa,0xaa,0xaa}, // 0x04-0x07
-  {0x00,0x00,0x55}, {0x00,0x00,0xff}, {0x00,0xaa,0x55}, {0x00,0xaa,0xff}, // 0x08-0x0b
-  {0xAA,0x00,0x55}, {0xAA,0x00,0xFF}, {0xAA,0xAA,0x55}, {0xAA,0xAA,0xFF}, // 0x0c-0x0f
-  {0x00,0x55,0x00}, {0x00,0x55,0xAA}, {0x00,0xFF,0x00}, {0x00,0xFF,0xAA}, // 0x10-0x13
-  {0xAA,0x55,0x00}, {0xAA,0x55,0xAA}, {0xAA,0xFF,0x00}, {0xAA,0xFF,0xAA}, // 0x14-0x17
-  {0x00,0x55,0x55}, {0x00,0x55,0xFF}, {0x00,0xFF,0x55}, {0x00,0xFF,0xFF}, // 0x18-0x1b
-  {0xAA,0x55,0x55}, {0xAA,0x55,0xFF}, {0xAA,0xFF,0x55}, {0xAA,0xFF,0xFF}, // 0x1c-0x1f
-  {0x55,0x00,0x00}, {0x55,0x00,0xAA}, {0x55,0xAA,0x00}, {0x55,0xAA,0xAA}, // 0x20-0x23
-  {0xFF,0x00,0x00}, {0xFF,0x00,0xAA}, {0xFF,0xAA,0x00}, {0xFF,0xAA,0xAA}, // 0x24-0x27
-  {0x55,0x00,0x55}, {0x55,0x00,0xFF}, {0x55,0xAA,0x55}, {0x55,0xAA,0xFF}, // 0x28-0x2b
-  {0xFF,0x00,0x55}, {0xFF,0x00,0xFF}, {0xFF,0xAA,0x55}, {0xFF,0xAA,0xFF}, // 0x2c-0x2f
-  {0x55,0x55,0x00}, {0x55,0x55,0xAA}, {0x55,0xFF,0x00}, {0x55,0xFF,0xAA}, // 0x30-0x33
-  {0xFF,0x55,0x00}, {0xFF,0x55,0xAA}, {0xFF,0xFF,0x00}, {0xFF,0xFF,0xAA}, // 0x34-0x37
-  {0x55,0x55,0x55}, {0x55,0x55,0xFF}, {0x55,0xFF,0x55}, {0x55,0xFF,0xFF}, // 0x38-0x3b
-  {0xFF,0x55,0x55}, {0xFF,0x55,0xFF}, {0xFF,0xFF,0x55}, {0xFF,0xFF,0xFF}  // 0x3c-0x3f
-};
+// the image being converted and the BMP it goes to
+typedef struct {
+    img_format_t    format;     // image data layout
+    uint16_t        width;      // image width
+    uint16_t        height;     // image height
+    pal_entry_t     *pal;       // palette to write, for Amiga images read from the file
+    const char      *fo_name;   // name of the BMP file to create
+    bool            rle;        // write a run length encoded (RLE4) BMP
+} job_t;
 
-// default 16 ega colours (mapping in ega_table)
-uint8_t ega_pal[16] = {
-     0,  1,  2,  3, 
-     4,  5, 20,  7, 
-    56, 57, 58, 59, 
-    60, 61, 62, 63    
-};
+/// @brief writes 1 byte per pixel data to a 16 colour BMP, RLE4 if asked for
+/// @return 0 on success, otherwise the BMP error code
+static int write_bmp4(ssi_ctx_t *ctx, const job_t *job, memstream_buf_t *bmp, uint16_t width, uint16_t height) {
+    printf("Creating %d x %d %sBMP File: '%s'\n", width, height, job->rle ? "RLE4 " : "", job->fo_name);
+    int rval = job->rle ? save_bmp4_rle_ctx(ctx, job->fo_name, bmp, width, height, job->pal) :
+                          save_bmp4_ctx(ctx, job->fo_name, bmp, width, height, job->pal);
+    if(0 != rval) {
+        printf("BMP Save Error (%d)\n", rval);
+    }
+    return rval;
+}
 
-// SSI "Western Front" Title image palette
-/*
-uint8_t ega_pal[16] = { 
-   0,  0, 60, 37, 
-  31, 59, 35, 10,
-  56,  4, 46, 46, 
-  39, 20, 62, 63
-};
-*/
+/// @brief writes a thumbnail, decoded straight from the image data
+/// @param thumb shift for the thumbnail size, 1 to 3 for 1/2 to 1/8
+static int convert_thumb(ssi_ctx_t *ctx, const job_t *job, const memstream_buf_t *img,
+                         int thumb, thumb_filter_t filter) {
+    uint16_t tw = job->width >> thumb;
+    uint16_t th = job->height >> thumb;
+    memstream_buf_t bmp = {img_decoded_size(tw, th), 0, NULL};
+    if((0 == bmp.len) || (NULL == (bmp.data = ssi_alloc(ctx, bmp.len)))) {
+        printf((0 == bmp.len) ? "Image too small for the scale\n" : "Unable to allocate memory\n");
+        return -1;
+    }
+    if(0 != img_decode_thumb(ctx, job->format, &bmp, img, job->width, job->height, thumb, filter, NULL)) {
+        printf("Invalid resolution for the format\n");
+        return -1;
+    }
+    return write_bmp4(ctx, job, &bmp, tw, th);
+}
+
+/// @brief writes a rectangle of the image, only the parts of the image data covering it are decoded
+static int convert_rect(ssi_ctx_t *ctx, const job_t *job, const memstream_buf_t *img,
+                        uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+    memstream_buf_t bmp = {img_decoded_size(w, h), 0, NULL};
+    if(NULL == (bmp.data = ssi_alloc(ctx, bmp.len))) {
+        printf("Unable to allocate memory\n");
+        return -1;
+    }
+    if(0 != img_decode_rect(job->format, &bmp, img, job->width, job->height, x, y, w, h, NULL)) {
+        printf("Rectangle %d,%d %d x %d doesn't fit the image\n", x, y, w, h);
+        return -1;
+    }
+    return write_bmp4(ctx, job, &bmp, w, h);
+}
+
+/// @brief writes the whole image as an RLE4 BMP, the encoder finds its runs in 1 byte per pixel data
+static int convert_rle(ssi_ctx_t *ctx, const job_t *job, const memstream_buf_t *img) {
+    memstream_buf_t bmp = {img_decoded_size(job->width, job->height), 0, NULL};
+    if(NULL == (bmp.data = ssi_alloc(ctx, bmp.len))) {
+        printf("Unable to allocate memory\n");
+        return -1;
+    }
+    if(0 != img_decode(job->format, &bmp, img, job->width, job->height, NULL)) {
+        printf("Invalid resolution for the format\n");
+        return -1;
+    }
+    return write_bmp4(ctx, job, &bmp, job->width, job->height);
+}
+
+/// @brief writes a true colour BMP, straight from the image data to BMP ordered pixels
+/// @param bits 24 or 32 bits per pixel
+static int convert_rgb(ssi_ctx_t *ctx, const job_t *job, const memstream_buf_t *img, int bits) {
+    rgb_format_t rgb = (32 == bits) ? RGB_BGRA32 : RGB_BGR24;
+    memstream_buf_t bmp = {img_rgb_size(rgb, job->width, job->height), 0, NULL};
+    if(NULL == (bmp.data = ssi_alloc(ctx, bmp.len))) {
+        printf("Unable to allocate memory\n");
+        return -1;
+    }
+    if(0 != img_decode_rgb(job->format, rgb, &bmp, img, job->width, job->height, job->pal)) {
+        printf("Invalid resolution for the format\n");
+        return -1;
+    }
+
+    printf("Creating %d bit BMP File: '%s'\n", bits, job->fo_name);
+    int rval = (32 == bits) ? save_bmp32(job->fo_name, &bmp, job->width, job->height) :
+                              save_bmp24(job->fo_name, &bmp, job->width, job->height);
+    if(0 != rval) {
+        printf("BMP Save Error (%d)\n", rval);
+    }
+    return rval;
+}
+
+/// @brief writes a top down BMP a line at a time as each line is read, stretching the lines
+///        for display if asked, so only a line of the image is held in memory
+static int convert_stream(ssi_ctx_t *ctx, const job_t *job, img_reader_t *rd, line_scale_t scale) {
+    int rval = 0;
+    bmp4_writer_t wr = {0};
+    uint8_t *line = NULL;
+
+    if(NULL == (line = ssi_alloc(ctx, (job->width + 1) / 2))) {
+        printf("Unable to allocate memory\n");
+        return -1;
+    }
+
+    line_scaler_t ls;
+    uint16_t out_height = line_scaler_init(&ls, scale, job->width, job->height);
+    if(0 == out_height) {
+        printf("Image too large to stretch\n");
+        return -1;
+    }
 
-// remaps the CGA colour indicies to the EGA equivalents for each of the palettes
-// background is assumed to be black, though in reality it can be programmed to
-// any of the 16 colours
-uint8_t cga2ega[6][4] = {
-    {0,2,4,6},     // mode 4 palette 0 low intensity  [black, dark green, dark red, brown]
-    {0,10,12,14},  // mode 4 palette 0 high intensity [black, light green, light red, yellow]
-    {0,3,5,7},     // mode 4 palette 1 low intensity  [black, dark cyan, dark magenta, light grey]
-    {0,11,13,15},  // mode 4 palette 1 high intensity [black, light cyan, light magenta, white]
-    {0,3,4,7},     // mode 5 low intensity            [black, dark cyan, dark red, light gray]
-    {0,11,12,15}   // mode 5 high intensity           [black, light cyan, light red, white]
-};
+    printf("Creating BMP File: '%s'\n", job->fo_name);
+    if(out_height != job->height) {
+        printf("Stretching to %d x %d\n", job->width, out_height);
+    }
+    rval = bmp4_create(&wr, job->fo_name, job->width, out_height, true, job->pal);
+    // lines go out top to bottom as soon as they are decoded, a line that is
+    // repeated is decoded just the once
+    int last = -1;
+    for(int y = 0; (0 == rval) && (y < out_height); y++) {
+        int src_y = line_scaler_src(&ls, y);
+        if((src_y != last) && (0 != img_read_line(rd, src_y, line))) {
+            printf("Error Unable read file\n");
+            rval = -1;
+            goto CLEANUP;
+        }
+        last = src_y;
+        rval = bmp4_write_line(&wr, line);
+    }
+    if(0 == rval) {
+        rval = bmp4_finish(&wr);
+    }
+    if(0 != rval) {
+        printf("BMP Save Error (%d)\n", rval);
+    }
+CLEANUP:
+    bmp4_finish(&wr);
+    return rval;
+}
+
+/// @brief writes the whole image, unpacked straight to BMP pixel data (2 pixels per byte)
+static int convert_whole(ssi_ctx_t *ctx, const job_t *job, memstream_buf_t *img) {
+    memstream_buf_t bmp = {bmp4_size(job->width, job->height), 0, NULL};
+    if(NULL == (bmp.data = ssi_alloc(ctx, bmp.len))) {
+        printf("Unable to allocate memory\n");
+        return -1;
+    }
+
+    if(IMG_CGA == job->format) {
+        lace2bmp4(&bmp, img, job->width, job->height); // de-interlace the image
+    } else if(IMG_BIN == job->format) {
+        ipln2bmp4(&bmp, img, job->width, job->height); // deplane (interleaved) the image
+    } else { // EGA, and the Amiga framebuffer
+        pln2bmp4(&bmp, img, job->width, job->height); // deplane the image
+    }
+    printf("Creating BMP File: '%s'\n", job->fo_name);
+    int rval = save_bmp4_packed(job->fo_name, &bmp, job->width, job->height, job->pal);
+    if(0 != rval) {
+        printf("BMP Save Error (%d)\n", rval);
+    }
+    return rval;
+}
 
 int main(int argc, char *argv[]) {
     int rval = -1;
-    FILE *fi = NULL;
+    ssi_ctx_t ctx = {0};    // owns all our buffers
+    mapped_file_t fi = {0};
     char *fi_name = NULL;
     char *fo_name = NULL;
-    memstream_buf_t img = {0, 0, NULL}; // planar data from file
-    memstream_buf_t src = {0, 0, NULL}; // de-planed data
     char resolution[10];
     uint16_t width;
     uint16_t height;
@@ -80,13 +193,76 @@ int main(int argc, char *argv[]) {
     bool is_cga = false; // flag to indicate to use CGA mode
     bool is_amiga = false; // flag to indicate Amiga mode
     bool is_interleaved = false; // flag to indicate interleaved mode
-    pal_entry_t *img_pal = NULL; // the dynamically allocated CGA palette
-    pal_entry_t *pal = NULL; // set to point to which palette used (not allocted)
+    pal_entry_t *img_pal = NULL; // the palette to write (from the context)
+    bool streaming = false; // convert a line at a time rather than the whole image
+    img_reader_t rd = {0};  // image file being streamed
+    int truecolour = 0;     // bits per pixel for a true colour BMP, 0 for 16 colour
+    bool rle = false;       // write a run length encoded (RLE4) BMP
+    bool crop = false;      // only convert a rectangle of the image
+    uint16_t cx = 0, cy = 0, cw = 0, ch = 0; // the rectangle to convert
+    int thumb = 0;          // shift for a thumbnail at 1/2, 1/4 or 1/8 scale, 0 for full size
+    thumb_filter_t filter = THUMB_NEAREST;
+    line_scale_t scale = SCALE_NONE; // how the lines are stretched for display
 
     printf("SSI-IMG to BMP image converter\n");
 
+    if(0 != trace_args(&argc, argv)) { // --stats and --trace can go anywhere
+        return -1;
+    }
+
+    // pull out any options, they come ahead of the other parameters
+    char *prog = argv[0];
+    while((argc > 1) && ('-' == argv[1][0])) {
+        if(0 == strcmp(argv[1], "-s")) {
+            streaming = true;
+        } else if(0 == strcmp(argv[1], "-24")) {
+            truecolour = 24;
+        } else if(0 == strcmp(argv[1], "-32")) {
+            truecolour = 32;
+        } else if(0 == strcmp(argv[1], "-r")) {
+            rle = true;
+        } else if(0 == strcmp(argv[1], "-d")) {
+            scale = SCALE_DOUBLE;
+        } else if(0 == strcmp(argv[1], "-a")) {
+            scale = SCALE_ASPECT;
+        } else if((0 == strcmp(argv[1], "-c")) && (argc > 2)) {
+            if(4 != sscanf(argv[2], "%hu,%hu,%hu,%hu", &cx, &cy, &cw, &ch)) {
+                printf("Invalid rectangle '%s'\n", argv[2]);
+                return -1;
+            }
+            crop = true;
+            argv++; argc--; // consume the rectangle
+        } else if((0 == strcmp(argv[1], "-t")) && (argc > 2)) {
+            char *scale = argv[2];
+            thumb = ('2' == scale[0]) ? 1 : ('4' == scale[0]) ? 2 : ('8' == scale[0]) ? 3 : 0;
+            if('m' == tolower(scale[1])) {
+                filter = THUMB_MAJORITY;
+            }
+            if((0 == thumb) || (scale[1] && ((THUMB_MAJORITY != filter) || scale[2]))) {
+                printf("Invalid thumbnail scale '%s'\n", scale);
+                return -1;
+            }
+            argv++; argc--; // consume the scale
+        } else {
+            printf("Unknown option '%s'\n", argv[1]);
+            return -1;
+        }
+        argv++; argc--; // consume the option
+        argv[0] = prog;
+    }
+
     if((argc < 3) || (argc > 4)) {
-        printf("USAGE: %s [resolution]<adapter><palette> [infile] <outfile>\n", filename(argv[0]));
+        printf("USAGE: %s <-s> <-24|-32|-r> <-d|-a> <-c x,y,w,h|-t scale> [resolution]<adapter><palette> [infile] <outfile>\n", filename(argv[0]));
+        printf("-s is optional and streams the conversion a line at a time, producing a top down BMP\n");
+        printf("   memory use is then independant of the image height\n");
+        printf("-24 or -32 is optional and writes a 24 or 32 bit true colour BMP rather than 16 colour\n");
+        printf("-r is optional and writes a run length encoded (RLE4) 16 colour BMP, usually much smaller\n");
+        printf("-d or -a is optional and stretches the lines as the image was displayed, -d doubles\n");
+        printf("   each line eg 640x200 to 640x400, -a stretches them to a 4:3 frame eg 320x200 to 320x240\n");
+        printf("-c x,y,w,h is optional and converts just the w x h rectangle at x,y eg a single tile,\n");
+        printf("   only the parts of the file covering it are decoded\n");
+        printf("-t 2, 4 or 8 is optional and writes a thumbnail at 1/2, 1/4 or 1/8 the size, taking the\n");
+        printf("   top left pixel of each box. With an 'm' suffix eg '-t 4m' it takes the most common colour\n");
         printf("where [resolution] is in the form width x height eg '320x200'\n");
         printf("The resolution paramter can have a number of optional suffixes to\n");
         printf("change the interpretation. (EGA is default)\n");
@@ -107,6 +283,8 @@ int main(int argc, char *argv[]) {
         printf("[infile] is the name of the input file\n");
         printf("<outfile> is optional and the name of the output file\n");
         printf("if omitted, outfile will be named the same as infile with a .BMP extension\n");
+        printf("--stats and --trace <file> can be given anywhere, to report the time taken by each stage\n");
+        printf("   and to append a Chrome trace of this run to <file> (view it with Perfetto)\n");
         return -1;
     }
     argv++; argc--; // consume the first arg (program name)
@@ -115,30 +293,25 @@ int main(int argc, char *argv[]) {
     strncpy(resolution, argv[0], 10);
     argv++; argc--; // consume the arg (resolution)
 
-    int namelen = strlen(argv[0]);
-    if(NULL == (fi_name = calloc(1, namelen+1))) {
+    if(NULL == (fi_name = ssi_strdup(&ctx, argv[0], 0))) {
         printf("Unable to allocate memory\n");
         goto CLEANUP;
     }
-    strncpy(fi_name, argv[0], namelen);
     argv++; argc--; // consume the arg (input file)
 
     if(argc) { // output file name was provided
-        int namelen = strlen(argv[0]);
-        if(NULL == (fo_name = calloc(1, namelen+1))) {
+        if(NULL == (fo_name = ssi_strdup(&ctx, argv[0], 0))) {
             printf("Unable to allocate memory\n");
             goto CLEANUP;
         }
-        strncpy(fo_name, argv[0], namelen);
         argv++; argc--; // consume the arg (input file)
     } else { // no name was provded, so make one
-        if(NULL == (fo_name = calloc(1, namelen+5))) {
+        if(NULL == (fo_name = ssi_strdup(&ctx, fi_name, 4))) {
             printf("Unable to allocate memory\n");
             goto CLEANUP;
         }
-        strncpy(fo_name, fi_name, namelen);
         drop_extension(fo_name); // remove exisiting extension
-        strncat(fo_name,".BMP", namelen+4); // add bmp extension
+        strcat(fo_name,".BMP"); // add bmp extension
     }
 
     // parse the resolution string
@@ -177,137 +350,94 @@ int main(int argc, char *argv[]) {
     }
     printf("Resolution: %d x %d %s\n", width, height, is_cga?"CGA":is_amiga?"Amiga":is_interleaved?"EGA interleaved":"EGA");
 
-    // allocate buffer based on resolution
-    // allocate the deplaned/unpaced image buffer (width * height)
-    if(NULL == (src.data = calloc(height, width))) {
-        printf("Unable to allocate memory\n");
+    img_format_t format = is_cga ? IMG_CGA : is_amiga ? IMG_AMIGA : is_interleaved ? IMG_BIN : IMG_EGA;
+    const char *format_name = is_cga ? "CGA" : is_amiga ? "Amiga" : is_interleaved ? "EGA Interleaved" : "EGA";
+
+    // only some of the options go together
+    if(SCALE_NONE != scale) {
+        if(rle || truecolour || crop || thumb) {
+            printf("Stretched lines can only be written as a 16 colour BMP\n");
+            goto CLEANUP;
+        }
+        streaming = true; // each output line is written as soon as its line is decoded
+    }
+    if(thumb && (streaming || truecolour || crop)) {
+        printf("A thumbnail can't be streamed, true colour or a rectangle\n");
         goto CLEANUP;
     }
-    src.len = (width * height);
-
-    // open the input file
-    printf("Opening IMG File: '%s'", fi_name);
-    if(NULL == (fi = fopen(fi_name,"rb"))) {
-        printf("Error: Unable to open input file\n");
+    if(crop && (streaming || truecolour)) {
+        printf("A rectangle can't be streamed or true colour\n");
+        goto CLEANUP;
+    }
+    if(rle && (streaming || truecolour)) {
+        printf("RLE output can't be streamed or true colour\n");
+        goto CLEANUP;
+    }
+    if(truecolour && streaming) {
+        printf("True colour output can't be streamed\n");
         goto CLEANUP;
     }
 
-    // determine size of image file
-    size_t fsz = filesize(fi);
-    printf("\tFile Size: %zu\n", fsz);
-
-    // allocate the packed image buffer based on the file size
-    if(NULL == (img.data = calloc(1, fsz))) {
+    // create our palette
+    if(NULL == (img_pal = ssi_zalloc(&ctx, 16 * sizeof(pal_entry_t)))) {
         printf("Unable to allocate memory\n");
         goto CLEANUP;
     }
-    img.len = fsz;
-
-    // do some basic checking based on filesize
-    if(is_cga) {
-        if(fsz != 16384) {
-            printf("File image and Specified image size mismatch for CGA\n");
-            goto CLEANUP;
-        }
-    } else if(is_amiga) {
-        if(fsz != ((width * height) / 2) + 64) {
-            printf("File image and Specified image size mismatch for Amiga\n");
-            goto CLEANUP;
-        }
-    } else if(is_interleaved) {
-        if(fsz != ((width * height) / 2)) {
-            printf("File image and Specified image size mismatch for EGA Interleaved\n");
-            goto CLEANUP;
-        }
-    } else { // must be ega
-        if(fsz != ((width * height) / 2)) {
-            printf("File image and Specified image size mismatch for EGA\n");
-            goto CLEANUP;
-        }
+    if(!is_amiga) { // the amiga palette comes from the file
+        make_palette(img_pal, is_cga, pal_sel);
     }
 
-    // read in the file
-    int nr = fread(img.data, img.len, 1, fi);
-    if(1 != nr) {
-        printf("Error Unable read file\n");
+    // open the input, and check it is the size the format and resolution give
+    printf("Opening IMG File: '%s'", fi_name);
+    if(streaming) {
+        rval = img_open_ctx(&ctx, &rd, fi_name, format, width, height);
+    } else if(thumb || crop) { // only the bytes that contribute are touched
+        rval = map_file_random(&fi, fi_name, true);
+    } else { // map the input file, this avoids copying it unless mapping isn't possible
+        rval = map_file(&fi, fi_name, true);
+    }
+    if(!streaming && (0 == rval)) {
+        printf("\tFile Size: %zu", fi.buf.len);
+        rval = (fi.buf.len != img_file_size(format, width, height)) ? -3 : 0;
+    }
+    printf("\n");
+    if(0 != rval) {
+        printf((-3 == rval) ? "File image and Specified image size mismatch for %s\n" :
+               "Error: Unable to open input file\n", format_name);
+        rval = -1;
         goto CLEANUP;
     }
-
-    if(is_cga) {
-        lace2lin(&src, &img, width, height); // de-interlace the image
-        // create our palette 
-        if(NULL == (img_pal = calloc(16, sizeof(pal_entry_t)))) {
-            printf("Unable to allocate memory\n");
-            goto CLEANUP;
-        }
-        // copy the EGA palette entries over to their CGA locations
-        // for the selected palette
-        for(int p = 0; p < 4; p++) {
-            img_pal[p] = ega_table[ega_pal[cga2ega[pal_sel][p]]];
+    if(is_amiga) {
+        if(!streaming) { // the palette follows the framebuffer
+            read_amiga_pal(rd.pal, &fi.buf.data[fi.buf.len - AMIGA_PAL_SZ]);
         }
-        pal = img_pal;
-    } else if(is_amiga) {
-        size_t realsize = img.len;
-        img.len -= 64;
-        pln2lin(&src, &img); // deplane the image
-        if(NULL == (img_pal = calloc(16, sizeof(pal_entry_t)))) {
-            printf("Unable to allocate memory\n");
-            goto CLEANUP;
-        }
-        img.pos = img.len; // point to the end of the framebuffer / start of palette
-        img.len = realsize;
-        
-        // read in the palette, 2 bytes per entry, 4 bits per colour
-        for(int p = 0; p < 16; p++) {
-            uint16_t entry = img.data[img.pos++];
-            entry <<= 8;
-            entry |= img.data[img.pos++];
-            img_pal[p].b = entry & 0x0f;
-            entry >>= 4;
-            img_pal[p].g = entry & 0x0f;
-            entry >>= 4;
-            img_pal[p].r = entry & 0x0f;
-        }
-        pal4_to_pal8(img_pal, img_pal, 16);
-        pal = img_pal;
-    } else if(is_interleaved) {
-        ipln2lin(&src, &img, width, height); // deplane (interleaved) the image
-        if(NULL == (img_pal = calloc(16, sizeof(pal_entry_t)))) {
-            printf("Unable to allocate memory\n");
-            goto CLEANUP;
-        }
-        for(int p = 0; p < 16; p++) {
-            img_pal[p] = ega_table[ega_pal[p]];
-        }
-        pal = img_pal;
-    } else { // must be ega
-        pln2lin(&src, &img); // deplane the image
-        if(NULL == (img_pal = calloc(16, sizeof(pal_entry_t)))) {
-            printf("Unable to allocate memory\n");
-            goto CLEANUP;
-        }
-        for(int p = 0; p < 16; p++) {
-            img_pal[p] = ega_table[ega_pal[p]];
-        }
-        pal = img_pal;
+        pal4_to_pal8(rd.pal, img_pal, 16);
     }
-    src.pos = 0; // reset the src position
 
-    printf("Creating BMP File: '%s'\n", fo_name);
-    rval = save_bmp4(fo_name, &src, width, height, pal);
+    job_t job = {format, width, height, img_pal, fo_name, rle};
+    if(thumb) {
+        rval = convert_thumb(&ctx, &job, &fi.buf, thumb, filter);
+    } else if(crop) {
+        rval = convert_rect(&ctx, &job, &fi.buf, cx, cy, cw, ch);
+    } else if(rle) {
+        rval = convert_rle(&ctx, &job, &fi.buf);
+    } else if(truecolour) {
+        rval = convert_rgb(&ctx, &job, &fi.buf, truecolour);
+    } else if(streaming) {
+        rval = convert_stream(&ctx, &job, &rd, scale);
+    } else {
+        rval = convert_whole(&ctx, &job, &fi.buf);
+    }
     if(0 != rval) {
-        printf("BMP Save Error (%d)\n", rval);
         goto CLEANUP;
     }
 
     printf("Done\n");
     rval = 0; // clean exit
 CLEANUP:
-    fclose_s(fi);
-    free_s(fi_name);
-    free_s(fo_name);
-    free_s(img_pal);
-    free_s(img.data);
-    free_s(src.data);
+    unmap_file(&fi);
+    img_close(&rd);
+    ssi_ctx_free(&ctx); // releases the names, palette and buffers in one go
+    trace_report();
     return rval;
 }
@@ -0,0 +1,197 @@
+/*
+ * img2png.c
+ * Converts a given SSI-IMG to an indexed colour PNG file
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "ssi-img.h"
+#include "png.h"
+#include "util.h"
+#include "convert.h"
+
+/// @brief repacks a line of 4 bit pixels as 2 bit pixels, in place
+/// @param line 2 pixels per byte left most in the high nibble, on return 4 pixels per byte
+/// @param width width of the line in pixels
+static void nib_to_2bit(uint8_t *line, uint16_t width) {
+    for(int x = 0; x < width; x += 4) {
+        uint8_t b = 0;
+        for(int k = 0; k < 4; k++) {
+            uint8_t px = 0;
+            if(x + k < width) {
+                px = line[(x + k) / 2] >> (((x + k) & 1) ? 0 : 4);
+            }
+            b |= (px & 0x03) << (6 - (k * 2));
+        }
+        line[x / 4] = b; // only ever overwrites bytes already read
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int rval = -1;
+    ssi_ctx_t ctx = {0};    // owns all our buffers
+    char *fi_name = NULL;
+    char *fo_name = NULL;
+    conv_spec_t spec;
+    pal_entry_t *pal = NULL; // the palette (from the context)
+    img_reader_t rd = {0};  // image file being streamed
+    png_writer_t wr = {0};  // PNG file being streamed
+    uint8_t *line = NULL;   // line buffer (from the context)
+    int level = PNG_LEVEL_DEFAULT;
+    line_scale_t scale = SCALE_NONE; // how the lines are stretched for display
+
+    printf("SSI-IMG to PNG image converter\n");
+
+    if(0 != trace_args(&argc, argv)) { // --stats and --trace can go anywhere
+        return -1;
+    }
+
+    // pull out any options, they come ahead of the other parameters
+    char *prog = argv[0];
+    while((argc > 1) && ('-' == argv[1][0])) {
+        if(isdigit(argv[1][1]) && ('\0' == argv[1][2])) {
+            level = argv[1][1] - '0';
+        } else if(0 == strcmp(argv[1], "-d")) {
+            scale = SCALE_DOUBLE;
+        } else if(0 == strcmp(argv[1], "-a")) {
+            scale = SCALE_ASPECT;
+        } else {
+            printf("Unknown option '%s'\n", argv[1]);
+            return -1;
+        }
+        argv++; argc--; // consume the option
+        argv[0] = prog;
+    }
+
+    if((argc < 3) || (argc > 4)) {
+        printf("USAGE: %s <-0..-9> <-d|-a> [resolution]<adapter><palette> [infile] <outfile>\n", filename(argv[0]));
+        printf("-0 to -9 is optional and sets the compression level, -1 is fastest and -9 smallest\n");
+        printf("   -0 stores the image data uncompressed, -%d is the default\n", PNG_LEVEL_DEFAULT);
+        printf("-d or -a is optional and stretches the lines as the image was displayed, -d doubles\n");
+        printf("   each line eg 640x200 to 640x400, -a stretches them to a 4:3 frame eg 320x200 to 320x240\n");
+        printf("where [resolution] is in the form width x height eg '320x200', with the same\n");
+        printf("optional suffixes as img2bmp to select CGA and its palette, Amiga or interleaved\n");
+        printf("CGA images are written with 4 colours, the others with 16\n");
+        printf("[infile] is the name of the input file\n");
+        printf("<outfile> is optional and the name of the output file\n");
+        printf("if omitted, outfile will be named the same as infile with a .PNG extension\n");
+        printf("The image is converted a line at a time, so memory use is independant of its size\n");
+        printf("--stats and --trace <file> can be given anywhere, to report the time taken by each stage\n");
+        printf("   and to append a Chrome trace of this run to <file> (view it with Perfetto)\n");
+        return -1;
+    }
+    argv++; argc--; // consume the first arg (program name)
+
+    if((0 != parse_spec(&spec, argv[0])) || !spec.to_bmp) {
+        printf("Invalid resolution specificaton\n");
+        goto CLEANUP;
+    }
+    argv++; argc--; // consume the arg (resolution)
+
+    if(NULL == (fi_name = ssi_strdup(&ctx, argv[0], 0))) {
+        printf("Unable to allocate memory\n");
+        goto CLEANUP;
+    }
+    argv++; argc--; // consume the arg (input file)
+
+    if(argc) { // output file name was provided
+        if(NULL == (fo_name = ssi_strdup(&ctx, argv[0], 0))) {
+            printf("Unable to allocate memory\n");
+            goto CLEANUP;
+        }
+        argv++; argc--; // consume the arg (output file)
+    } else { // no name was provded, so make one
+        if(NULL == (fo_name = ssi_strdup(&ctx, fi_name, 4))) {
+            printf("Unable to allocate memory\n");
+            goto CLEANUP;
+        }
+        drop_extension(fo_name); // remove exisiting extension
+        strcat(fo_name,".PNG"); // add png extension
+    }
+
+    bool is_cga = (IMG_CGA == spec.format);
+    const char *fmt_name = is_cga ? "CGA" : (IMG_AMIGA == spec.format) ? "Amiga" :
+                           (IMG_BIN == spec.format) ? "EGA interleaved" : "EGA";
+    printf("Resolution: %d x %d %s\n", spec.width, spec.height, fmt_name);
+
+    // create our palette
+    if(NULL == (pal = ssi_zalloc(&ctx, 16 * sizeof(pal_entry_t)))) {
+        printf("Unable to allocate memory\n");
+        goto CLEANUP;
+    }
+    make_palette(pal, is_cga, spec.pal_sel);
+
+    printf("Opening IMG File: '%s'\n", fi_name);
+    rval = img_open_ctx(&ctx, &rd, fi_name, spec.format, spec.width, spec.height);
+    if(-3 == rval) {
+        printf("File image and Specified image size mismatch for %s\n", fmt_name);
+        goto CLEANUP;
+    } else if(0 != rval) {
+        printf("Error: Unable to read input file\n");
+        goto CLEANUP;
+    }
+    if(IMG_AMIGA == spec.format) { // the amiga palette comes from the file
+        pal4_to_pal8(rd.pal, pal, 16);
+    }
+
+    if(NULL == (line = ssi_alloc(&ctx, (spec.width + 1) / 2))) {
+        printf("Unable to allocate memory\n");
+        rval = -1;
+        goto CLEANUP;
+    }
+
+    line_scaler_t ls;
+    uint16_t out_height = line_scaler_init(&ls, scale, spec.width, spec.height);
+    if(0 == out_height) {
+        printf("Image too large to stretch\n");
+        rval = -1;
+        goto CLEANUP;
+    }
+
+    printf("Creating PNG File: '%s'\n", fo_name);
+    if(out_height != spec.height) {
+        printf("Stretching to %d x %d\n", spec.width, out_height);
+    }
+    rval = png_create_ctx(&ctx, &wr, fo_name, spec.width, out_height, is_cga ? 2 : 4, pal, level);
+    // lines are compressed as soon as they are decoded, the whole image is never held,
+    // and a line that is repeated is decoded just the once
+    int last = -1;
+    for(int y = 0; (0 == rval) && (y < out_height); y++) {
+        int src_y = line_scaler_src(&ls, y);
+        if(src_y != last) {
+            if(0 != img_read_line(&rd, src_y, line)) {
+                printf("Error Unable read file\n");
+                rval = -1;
+                goto CLEANUP;
+            }
+            if(is_cga) {
+                nib_to_2bit(line, spec.width);
+            }
+            last = src_y;
+        }
+        rval = png_write_line(&wr, line);
+    }
+    if(0 == rval) {
+        rval = png_finish(&wr);
+    }
+    if(0 != rval) {
+        printf("PNG Save Error (%d)\n", rval);
+        goto CLEANUP;
+    }
+
+    printf("Done\n");
+    rval = 0; // clean exit
+CLEANUP:
+    img_close(&rd);
+    png_finish(&wr);
+    ssi_ctx_free(&ctx); // releases the names, palette and buffers in one go
+    trace_report();
+    return rval;
+}
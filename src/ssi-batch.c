@@ -0,0 +1,444 @@
+/*
+ * ssi-batch.c
+ * Converts many files between SSI-IMG and Windows BMP in a single process,
+ * spreading the work over a pool of threads
+ *
+ * Each thread starts with an even share of the files, and once it runs out
+ * steals half of what is left from another thread, so a few slow files
+ * don't hold up the batch. Every thread converts out of its own context, so
+ * after the first few files no memory is allocated per file.
+ *
+ * With a cache, each output is kept under a hash of its input and conversion,
+ * so files that haven't changed since an earlier batch are just copied or
+ * linked from the cache rather than converted again.
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "ssi-img.h"
+#include "ssi-ctx.h"
+#include "convert.h"
+#include "cache.h"
+#include "util.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <glob.h>
+#define HAVE_GLOB
+#endif
+
+#define MAX_LINE (4096)
+#define MAX_THREADS (256)
+#define WORKER_RESERVE (256 * 1024) // enough for a 640x480 image without growing
+
+// a single file to convert
+typedef struct {
+    conv_spec_t     spec;        // conversion to perform
+    char            *fi_name;    // input file
+    char            *fo_name;    // output file
+    int             rval;        // result of the conversion
+    size_t          bytes;       // size of the input file
+    bool            cached;      // true if the output came from the cache
+} job_t;
+
+struct batch;
+
+// a thread in the pool, with the range of jobs it still has to do
+typedef struct {
+    struct batch    *batch;      // the batch the worker belongs to
+    pthread_t       thread;
+    int             id;          // index in the pool
+    pthread_mutex_t lock;        // guards head and tail
+    size_t          head;        // next job to do
+    size_t          tail;        // one past the last job to do
+    ssi_ctx_t       ctx;         // scratch memory, reset after every file
+    size_t          done;        // files converted
+    size_t          steals;      // times work was taken from another worker
+} worker_t;
+
+// all the work to be done
+typedef struct batch {
+    ssi_ctx_t       ctx;         // owns the file names
+    job_t           *jobs;
+    size_t          count;       // jobs in use
+    size_t          size;        // jobs allocated
+    worker_t        *workers;
+    int             nworkers;
+    conv_cache_t    cache;       // outputs of earlier batches, unused if cache.dir is NULL
+} batch_t;
+
+/// @brief adds a file to the batch, making up the output name if none was given
+/// @param outdir directory for made up output names, NULL to put them next to the input
+/// @return 0 on success, -1 if out of memory
+static int add_job(batch_t *b, const conv_spec_t *spec, const char *fi, const char *fo, const char *outdir) {
+    if(b->count == b->size) {
+        size_t size = b->size ? (b->size * 2) : 1024;
+        job_t *jobs = realloc(b->jobs, size * sizeof(job_t));
+        if(NULL == jobs) {
+            return -1;
+        }
+        b->jobs = jobs;
+        b->size = size;
+    }
+
+    job_t *job = &b->jobs[b->count];
+    memset(job, 0, sizeof(job_t));
+    job->spec = *spec;
+    if(NULL == (job->fi_name = ssi_strdup(&b->ctx, fi, 0))) {
+        return -1;
+    }
+
+    if(NULL != fo) { // output file name was provided
+        job->fo_name = ssi_strdup(&b->ctx, fo, 0);
+    } else if(NULL != outdir) { // same name as the input, in the output directory
+        char *name = filename(job->fi_name);
+        size_t len = strlen(outdir) + 1 + strlen(name) + 4;
+        if(NULL != (job->fo_name = ssi_alloc(&b->ctx, len + 1))) {
+            snprintf(job->fo_name, len + 1, "%s/%s", outdir, name);
+            drop_extension(filename(job->fo_name)); // remove exisiting extension
+            strcat(job->fo_name, spec_extension(spec));
+        }
+    } else { // no name was provded, so make one
+        if(NULL != (job->fo_name = ssi_strdup(&b->ctx, fi, 4))) {
+            drop_extension(filename(job->fo_name)); // remove exisiting extension
+            strcat(job->fo_name, spec_extension(spec));
+        }
+    }
+    if(NULL == job->fo_name) {
+        return -1;
+    }
+    b->count++;
+    return 0;
+}
+
+/// @brief adds the files matching a pattern, or the name itself if it isn't a pattern
+/// @return 0 on success, -1 if out of memory, -2 if nothing matched
+static int add_files(batch_t *b, const conv_spec_t *spec, const char *pattern, const char *outdir) {
+#ifdef HAVE_GLOB
+    if(NULL != strpbrk(pattern, "*?[")) {
+        glob_t g;
+        int err = glob(pattern, 0, NULL, &g);
+        if(0 != err) {
+            return (GLOB_NOMATCH == err) ? -2 : -1;
+        }
+        int rval = 0;
+        for(size_t i = 0; (0 == rval) && (i < g.gl_pathc); i++) {
+            rval = add_job(b, spec, g.gl_pathv[i], NULL, outdir);
+        }
+        globfree(&g);
+        return rval;
+    }
+#endif
+    return add_job(b, spec, pattern, NULL, outdir);
+}
+
+/// @brief reads a file list or manifest. Blank lines and lines starting with '#' are skipped.
+///        In a file list each line is a file name or pattern, converted as spec. In a manifest
+///        (spec is NULL) each line is '<spec> <infile> [outfile]'
+/// @return 0 on success, -1 if out of memory, -2 if the file can't be read, -3 on a bad line
+static int read_list(batch_t *b, const char *fn, const conv_spec_t *spec, const char *outdir) {
+    int rval = 0;
+    FILE *fp = NULL;
+    char line[MAX_LINE];
+    int num = 0;
+
+    if(NULL == (fp = fopen(fn, "r"))) {
+        return -2;
+    }
+    while((0 == rval) && (NULL != fgets(line, sizeof(line), fp))) {
+        num++;
+        line[strcspn(line, "\r\n")] = 0;
+        char *word = line + strspn(line, " \t");
+        if((0 == *word) || ('#' == *word)) {
+            continue;
+        }
+
+        if(NULL != spec) { // the whole line is a file name
+            rval = add_files(b, spec, word, outdir);
+            if(-2 == rval) {
+                printf("%s:%d: nothing matches '%s'\n", fn, num, word);
+                rval = 0;
+            }
+            continue;
+        }
+
+        // manifest entries name their own conversion
+        char *fields[4] = {NULL};
+        int n = 0;
+        for(char *tok = strtok(word, " \t"); (NULL != tok) && (n < 4); tok = strtok(NULL, " \t")) {
+            fields[n++] = tok;
+        }
+        conv_spec_t entry;
+        if((n < 2) || (n > 3) || (0 != parse_spec(&entry, fields[0]))) {
+            printf("%s:%d: expected '<spec> <infile> [outfile]'\n", fn, num);
+            rval = -3;
+            break;
+        }
+        rval = add_job(b, &entry, fields[1], fields[2], outdir);
+    }
+    fclose_s(fp);
+    return rval;
+}
+
+/// @brief takes the next job for a worker, stealing from the others once its own run out
+/// @return true if a job was taken, false if there is no work left anywhere
+static bool next_job(worker_t *w, size_t *job) {
+    batch_t *b = w->batch;
+
+    pthread_mutex_lock(&w->lock);
+    if(w->head < w->tail) {
+        *job = w->head++;
+        pthread_mutex_unlock(&w->lock);
+        return true;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    // out of work, take the back half of the next busy worker's jobs
+    for(int i = 1; i < b->nworkers; i++) {
+        worker_t *v = &b->workers[(w->id + i) % b->nworkers];
+        pthread_mutex_lock(&v->lock);
+        size_t left = v->tail - v->head;
+        if(0 == left) {
+            pthread_mutex_unlock(&v->lock);
+            continue;
+        }
+        size_t take = (left + 1) / 2;
+        size_t first = v->tail - take;
+        v->tail = first;
+        pthread_mutex_unlock(&v->lock);
+
+        pthread_mutex_lock(&w->lock);
+        w->head = first + 1; // we do the first one right away
+        w->tail = first + take;
+        pthread_mutex_unlock(&w->lock);
+        w->steals++;
+        *job = first;
+        return true;
+    }
+    return false;
+}
+
+static void *worker(void *arg) {
+    worker_t *w = arg;
+    size_t j;
+
+    while(next_job(w, &j)) {
+        job_t *job = &w->batch->jobs[j];
+        if(NULL != w->batch->cache.dir) {
+            job->rval = convert_file_cached(&w->ctx, &w->batch->cache, &job->spec, job->fi_name,
+                                            job->fo_name, &job->bytes, &job->cached);
+        } else {
+            job->rval = convert_file(&w->ctx, &job->spec, job->fi_name, job->fo_name, &job->bytes);
+        }
+        ssi_ctx_reset(&w->ctx); // everything for this file goes in one go
+        w->done++;
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int rval = -1;
+    batch_t batch = {0};
+    conv_spec_t spec;
+    bool have_spec = false;
+    const char *outdir = NULL;
+    const char *list = NULL;
+    const char *manifest = NULL;
+    const char *cache_dir = NULL;
+    uint64_t cache_cap = CACHE_CAP_DEFAULT;
+    bool cache_link = false;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int started = 0;
+
+    printf("SSI-IMG batch converter\n");
+
+    if(0 != trace_args(&argc, argv)) { // --stats and --trace can go anywhere
+        return -1;
+    }
+
+    // pull out any options, they come ahead of the other parameters
+    char *prog = argv[0];
+    while((argc > 2) && ('-' == argv[1][0])) {
+        int used = 2;
+        if(0 == strcmp(argv[1], "-j")) {
+            threads = atol(argv[2]);
+        } else if(0 == strcmp(argv[1], "-o")) {
+            outdir = argv[2];
+        } else if(0 == strcmp(argv[1], "-l")) {
+            list = argv[2];
+        } else if(0 == strcmp(argv[1], "-m")) {
+            manifest = argv[2];
+        } else if(0 == strcmp(argv[1], "-c")) {
+            cache_dir = argv[2];
+        } else if(0 == strcmp(argv[1], "-C")) {
+            cache_cap = strtoull(argv[2], NULL, 0) << 20;
+        } else if(0 == strcmp(argv[1], "-L")) {
+            cache_link = true;
+            used = 1;
+        } else {
+            printf("Unknown option '%s'\n", argv[1]);
+            return -1;
+        }
+        argv += used; argc -= used; // consume the option and any value
+        argv[0] = prog;
+    }
+
+    if((argc < 2) && (NULL == manifest)) {
+        printf("USAGE: %s <-j threads> <-o outdir> <-l listfile> <-m manifest> <-c cachedir> <-C MiB> <-L>\n", filename(argv[0]));
+        printf("       [spec] <files...>\n");
+        printf("[spec] is the conversion to apply to the files given on the command line or in\n");
+        printf("   the list file, either a resolution as for img2bmp eg '320x200c1' to convert\n");
+        printf("   IMG to BMP, or one of 'ega', 'cga' or 'bin' to convert BMP to that IMG variant\n");
+        printf("<files...> are the names of the input files, quoted wildcard patterns are expanded\n");
+        printf("-j sets the number of threads, by default one per core\n");
+        printf("-o puts the output files in the given directory rather than next to the input,\n");
+        printf("   creating it if need be\n");
+        printf("-l reads input file names or patterns from a file, one per line\n");
+        printf("-m reads a manifest, each line being '<spec> <infile> [outfile]'\n");
+        printf("-c keeps the outputs in a cache directory, and files converted the same way in an\n");
+        printf("   earlier batch are taken from it rather than converted again\n");
+        printf("-C caps the cache at the given size in MiB, evicting the least recently used\n");
+        printf("   outputs once the batch is done, by default %llu, 0 for no limit\n", CACHE_CAP_DEFAULT >> 20);
+        printf("-L hard links outputs from the cache rather than copying them\n");
+        printf("Output files are named the same as the input with the extension for the format\n");
+        printf("--stats and --trace <file> can be given anywhere, to report the time taken by each stage\n");
+        printf("   and to append a Chrome trace of this run to <file> (view it with Perfetto)\n");
+        return -1;
+    }
+    if(threads < 1) threads = 1;
+    if(threads > MAX_THREADS) threads = MAX_THREADS;
+
+    if(argc >= 2) {
+        if(0 != parse_spec(&spec, argv[1])) {
+            printf("Invalid conversion spec '%s'\n", argv[1]);
+            goto CLEANUP;
+        }
+        have_spec = true;
+    }
+    if((NULL != list) && !have_spec) {
+        printf("A spec is needed to convert the list file\n");
+        goto CLEANUP;
+    }
+
+    // gather up all the work
+    if(0 != ssi_ctx_init(&batch.ctx, 0)) {
+        printf("Unable to allocate memory\n");
+        goto CLEANUP;
+    }
+    for(int i = 2; i < argc; i++) {
+        int err = add_files(&batch, &spec, argv[i], outdir);
+        if(-2 == err) {
+            printf("Nothing matches '%s'\n", argv[i]);
+        } else if(0 != err) {
+            printf("Unable to allocate memory\n");
+            goto CLEANUP;
+        }
+    }
+    if((NULL != list) && (0 != read_list(&batch, list, &spec, outdir))) {
+        printf("Error: Unable to read list file '%s'\n", list);
+        goto CLEANUP;
+    }
+    if((NULL != manifest) && (0 != read_list(&batch, manifest, NULL, outdir))) {
+        printf("Error: Unable to read manifest '%s'\n", manifest);
+        goto CLEANUP;
+    }
+    if(0 == batch.count) {
+        printf("No files to convert\n");
+        goto CLEANUP;
+    }
+    if(threads > (long)batch.count) threads = batch.count;
+    if((NULL != outdir) && (0 != make_dir(outdir))) {
+        printf("Unable to create directory '%s'\n", outdir);
+        goto CLEANUP;
+    }
+
+    if((NULL != cache_dir) && (0 != cache_open(&batch.cache, cache_dir, cache_cap, cache_link))) {
+        printf("Unable to create cache directory '%s'\n", cache_dir);
+        goto CLEANUP;
+    }
+
+    // pick the conversion kernels now, rather than racing to on first use
+    const char *backend = ssi_backend();
+
+    if(NULL == (batch.workers = calloc(threads, sizeof(worker_t)))) {
+        printf("Unable to allocate memory\n");
+        goto CLEANUP;
+    }
+    batch.nworkers = threads;
+
+    // hand out the jobs in even contiguous runs
+    for(int i = 0; i < batch.nworkers; i++) {
+        worker_t *w = &batch.workers[i];
+        w->batch = &batch;
+        w->id = i;
+        w->head = (batch.count * i) / batch.nworkers;
+        w->tail = (batch.count * (i + 1)) / batch.nworkers;
+        pthread_mutex_init(&w->lock, NULL);
+        ssi_ctx_init(&w->ctx, WORKER_RESERVE); // on failure it just grows on first use
+    }
+
+    printf("Converting %zu files on %d threads (%s kernels)\n", batch.count, batch.nworkers, backend);
+    double start = mono_time();
+    for(started = 0; started < batch.nworkers; started++) {
+        if(0 != pthread_create(&batch.workers[started].thread, NULL, worker, &batch.workers[started])) {
+            break; // the threads we have will steal the rest
+        }
+    }
+    if(0 == started) {
+        printf("Error: Unable to start threads\n");
+        goto CLEANUP;
+    }
+    for(int i = 0; i < started; i++) {
+        pthread_join(batch.workers[i].thread, NULL);
+    }
+    double secs = mono_time() - start;
+
+    // report the failures in the order they were given
+    size_t failed = 0;
+    size_t bytes = 0;
+    size_t hits = 0;
+    for(size_t i = 0; i < batch.count; i++) {
+        job_t *job = &batch.jobs[i];
+        bytes += job->bytes;
+        hits += job->cached;
+        if(0 != job->rval) {
+            printf("FAILED '%s': %s\n", job->fi_name, convert_error(job->rval));
+            failed++;
+        }
+    }
+    size_t steals = 0;
+    for(int i = 0; i < batch.nworkers; i++) {
+        steals += batch.workers[i].steals;
+    }
+
+    if(secs <= 0) secs = 1e-9;
+    printf("Converted %zu of %zu files in %.3fs, %.1f files/s, %.2f MB/s, %zu steals\n",
+           batch.count - failed, batch.count, secs, batch.count / secs, (bytes / 1e6) / secs, steals);
+    if(NULL != batch.cache.dir) {
+        uint64_t kept = 0;
+        size_t evicted = 0;
+        cache_trim(&batch.cache, &kept, &evicted);
+        printf("%zu of %zu files from the cache, %.1f MiB cached, %zu evicted\n",
+               hits, batch.count, (double)kept / (1 << 20), evicted);
+    }
+    rval = failed ? -1 : 0;
+
+CLEANUP:
+    for(int i = 0; (NULL != batch.workers) && (i < batch.nworkers); i++) {
+        pthread_mutex_destroy(&batch.workers[i].lock);
+        ssi_ctx_free(&batch.workers[i].ctx);
+    }
+    free_s(batch.workers);
+    free_s(batch.jobs);
+    ssi_ctx_free(&batch.ctx);
+    cache_close(&batch.cache);
+    trace_report();
+    return rval;
+}
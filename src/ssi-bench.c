@@ -0,0 +1,400 @@
+/*
+ * ssi-bench.c
+ * Times the image codecs for each of the kernel backends the host can run,
+ * across the real SSI resolutions and some larger synthetic ones
+ *
+ * Each measurement is warmed up first, then repeated a number of times with
+ * every sample running long enough to swamp the timer resolution. The median
+ * sample is reported, along with the fastest, as ns per pixel, MB/s of input
+ * and (on x86) TSC cycles per input byte. Results can also be written out as
+ * JSON for comparing runs.
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "ssi-img.h"
+#include "bmp.h"
+#include "pal-tools.h"
+#include "util.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define HAVE_TSC
+#endif
+
+#define MAX_REPS (101)
+#define TMP_BMP "ssi-bench.tmp.bmp"
+
+// all the buffers for one resolution, filled with random pixels
+typedef struct {
+    uint16_t        width;
+    uint16_t        height;
+    memstream_buf_t lin;         // 1 byte per pixel
+    memstream_buf_t pln;         // full planes, as EGA
+    memstream_buf_t lace;        // interleaved 2 bit pixels, as CGA
+    memstream_buf_t bmp;         // packed 4 bit BMP pixel data
+    memstream_buf_t rgb;         // 32 bit true colour pixels, or 24 bit
+    pal_entry_t     pal[256];    // palette for the BMP and palette conversions
+} bench_bufs_t;
+
+// a codec to time
+typedef struct {
+    const char      *name;
+    void            (*run)(bench_bufs_t *b);
+    size_t          (*bytes)(bench_bufs_t *b); // input bytes per run
+    bool            portable;    // doesn't depend on the kernel backend, so only timed once
+    bool            pal;         // works on a 256 entry palette rather than the image
+} bench_t;
+
+// the outcome of timing one codec
+typedef struct {
+    const char      *backend;
+    const char      *kernel;
+    uint16_t        width;
+    uint16_t        height;
+    size_t          bytes;       // input bytes per run
+    size_t          iters;       // runs per sample
+    double          ns_px;       // median ns per pixel (or palette entry)
+    double          ns_px_min;   // fastest ns per pixel (or palette entry)
+    double          mb_s;        // MB/s of input at the median
+    double          cyc_b;       // TSC cycles per input byte at the median, 0 if unknown
+} result_t;
+
+/// @brief returns the time stamp counter, 0 where there isn't one
+static uint64_t cycles(void) {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// the codecs, positions are reset each run as the converters stream through the buffers
+static void run_pln2lin(bench_bufs_t *b) { b->lin.pos = 0; pln2lin(&b->lin, &b->pln); }
+static void run_ipln2lin(bench_bufs_t *b) { b->lin.pos = 0; ipln2lin(&b->lin, &b->pln, b->width, b->height); }
+static void run_lace2lin(bench_bufs_t *b) { b->lin.pos = 0; lace2lin(&b->lin, &b->lace, b->width, b->height); }
+static void run_lin2pln(bench_bufs_t *b) { b->lin.pos = 0; lin2pln(&b->pln, &b->lin); }
+static void run_lin2ipln(bench_bufs_t *b) { b->lin.pos = 0; lin2ipln(&b->pln, &b->lin, b->width, b->height); }
+static void run_lin2lace(bench_bufs_t *b) { b->lin.pos = 0; lin2lace(&b->lace, &b->lin, b->width, b->height); }
+static void run_pln2bmp4(bench_bufs_t *b) { pln2bmp4(&b->bmp, &b->pln, b->width, b->height); }
+static void run_ipln2bmp4(bench_bufs_t *b) { ipln2bmp4(&b->bmp, &b->pln, b->width, b->height); }
+static void run_lace2bmp4(bench_bufs_t *b) { lace2bmp4(&b->bmp, &b->lace, b->width, b->height); }
+
+static void run_lin2rgb24(bench_bufs_t *b) { lin2rgb(RGB_BGR24, &b->rgb, &b->lin, b->pal); }
+static void run_lin2rgb32(bench_bufs_t *b) { lin2rgb(RGB_BGRA32, &b->rgb, &b->lin, b->pal); }
+
+static void run_bmp42pln(bench_bufs_t *b) {
+    size_t stride = bmp4_stride(b->width);
+    for(int y = 0; y < b->height; y++) {
+        bmp42pln(&b->pln, &b->bmp.data[stride * (b->height - 1 - y)], y, b->width, b->height);
+    }
+}
+
+static void run_bmp42lace(bench_bufs_t *b) {
+    size_t stride = bmp4_stride(b->width);
+    for(int y = 0; y < b->height; y++) {
+        bmp42lace(&b->lace, &b->bmp.data[stride * (b->height - 1 - y)], y, b->width, b->height);
+    }
+}
+
+static void run_save_bmp4(bench_bufs_t *b) {
+    save_bmp4(TMP_BMP, &b->lin, b->width, b->height, b->pal);
+}
+
+static void run_load_bmp4(bench_bufs_t *b) {
+    (void)b;
+    memstream_buf_t img = {0, 0, NULL};
+    uint16_t width, height;
+    load_bmp4(&img, TMP_BMP, &width, &height);
+    free_s(img.data);
+}
+
+static void run_pal4_to_pal8(bench_bufs_t *b) { pal4_to_pal8(b->pal, b->pal, 256); }
+static void run_pal8_to_pal4(bench_bufs_t *b) { pal8_to_pal4(b->pal, b->pal, 256); }
+
+static size_t pixels(bench_bufs_t *b) { return (size_t)b->width * b->height; }
+static size_t planar_bytes(bench_bufs_t *b) { return pixels(b) / 2; }
+static size_t lace_bytes(bench_bufs_t *b) { return pixels(b) / 4; }
+static size_t bmp_bytes(bench_bufs_t *b) { return bmp4_size(b->width, b->height); }
+static size_t pal_bytes(bench_bufs_t *b) { (void)b; return 256 * sizeof(pal_entry_t); }
+
+static const bench_t benches[] = {
+    {"pln2lin",      run_pln2lin,      planar_bytes, false, false},
+    {"ipln2lin",     run_ipln2lin,     planar_bytes, false, false},
+    {"lace2lin",     run_lace2lin,     lace_bytes,   false, false},
+    {"lin2pln",      run_lin2pln,      pixels,       false, false},
+    {"lin2ipln",     run_lin2ipln,     pixels,       false, false},
+    {"lin2lace",     run_lin2lace,     pixels,       false, false},
+    {"pln2bmp4",     run_pln2bmp4,     planar_bytes, false, false},
+    {"ipln2bmp4",    run_ipln2bmp4,    planar_bytes, false, false},
+    {"lace2bmp4",    run_lace2bmp4,    lace_bytes,   false, false},
+    {"lin2rgb24",    run_lin2rgb24,    pixels,       false, false},
+    {"lin2rgb32",    run_lin2rgb32,    pixels,       false, false},
+    {"bmp42pln",     run_bmp42pln,     bmp_bytes,    false, false},
+    {"bmp42lace",    run_bmp42lace,    bmp_bytes,    false, false},
+    {"save_bmp4",    run_save_bmp4,    pixels,       true,  false},
+    {"load_bmp4",    run_load_bmp4,    bmp_bytes,    true,  false},
+    {"pal4_to_pal8", run_pal4_to_pal8, pal_bytes,    true,  true},
+    {"pal8_to_pal4", run_pal8_to_pal4, pal_bytes,    true,  true},
+    {NULL, NULL, NULL, false, false}
+};
+
+static const char *backend_names[] = {"avx2", "sse2", "lut", "scalar", NULL};
+
+// the real resolutions, followed by larger synthetic ones
+static const uint16_t resolutions[][2] = {
+    {320, 200}, {640, 200}, {640, 350}, {640, 480},
+    {1024, 1024}, {4096, 4096}
+};
+#define NUM_REAL_RES (4)
+#define NUM_RES (sizeof(resolutions) / sizeof(resolutions[0]))
+
+/// @brief returns true if name is in the comma separated list, or the list is NULL
+static bool in_list(const char *list, const char *name) {
+    if(NULL == list) return true;
+    size_t len = strlen(name);
+    for(const char *p = list; NULL != p; p = strchr(p, ',')) {
+        if(',' == *p) p++;
+        if((0 == strncmp(p, name, len)) && ((',' == p[len]) || (0 == p[len]))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// @brief fills a buffer with pseudo random bytes, the same every run
+static void fill_random(memstream_buf_t *buf, uint32_t seed) {
+    for(size_t i = 0; i < buf->len; i++) {
+        seed = (seed * 1103515245) + 12345;
+        buf->data[i] = seed >> 16;
+    }
+}
+
+/// @brief allocates and fills the buffers for a resolution
+/// @return 0 on success, -1 if out of memory
+static int setup_bufs(bench_bufs_t *b, uint16_t width, uint16_t height) {
+    memset(b, 0, sizeof(bench_bufs_t));
+    b->width = width;
+    b->height = height;
+    b->lin.len = pixels(b);
+    b->pln.len = planar_bytes(b);
+    b->lace.len = (lace_bytes(b) > 16384) ? (lace_bytes(b) * 2) : 16384; // CGA is a fixed 16K
+    b->bmp.len = bmp_bytes(b);
+    b->rgb.len = pixels(b) * 4;
+    if((NULL == (b->lin.data = malloc(b->lin.len))) ||
+       (NULL == (b->pln.data = malloc(b->pln.len))) ||
+       (NULL == (b->lace.data = malloc(b->lace.len))) ||
+       (NULL == (b->bmp.data = malloc(b->bmp.len))) ||
+       (NULL == (b->rgb.data = malloc(b->rgb.len)))) {
+        return -1;
+    }
+    fill_random(&b->pln, 1);
+    fill_random(&b->lace, 2);
+    fill_random(&b->bmp, 3);
+    fill_random(&b->lin, 4);
+    for(size_t i = 0; i < b->lin.len; i++) {
+        b->lin.data[i] &= 0x0f; // 16 colours
+    }
+    for(int i = 0; i < 256; i++) {
+        b->pal[i].r = i & 0x0f;
+        b->pal[i].g = (i >> 4) & 0x0f;
+        b->pal[i].b = (i * 7) & 0x0f;
+    }
+    // load_bmp4 needs a file to read
+    return save_bmp4(TMP_BMP, &b->lin, width, height, b->pal) ? -1 : 0;
+}
+
+static void free_bufs(bench_bufs_t *b) {
+    free_s(b->lin.data);
+    free_s(b->pln.data);
+    free_s(b->lace.data);
+    free_s(b->bmp.data);
+    free_s(b->rgb.data);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+/// @brief times a codec, warming up first then taking reps samples of at least sample_s seconds
+static void time_bench(const bench_t *bt, bench_bufs_t *b, int reps, double warm_s, double sample_s, result_t *r) {
+    double ns[MAX_REPS];
+    double cyc[MAX_REPS];
+
+    // warm the caches, branch predictors and clocks up, counting the runs
+    // so we know how many fill a sample
+    size_t runs = 0;
+    double start = mono_time();
+    double elapsed;
+    do {
+        bt->run(b);
+        runs++;
+        elapsed = mono_time() - start;
+    } while(elapsed < warm_s);
+    size_t iters = (size_t)((sample_s * runs) / elapsed) + 1;
+
+    for(int i = 0; i < reps; i++) {
+        uint64_t c0 = cycles();
+        double t0 = mono_time();
+        for(size_t n = 0; n < iters; n++) {
+            bt->run(b);
+        }
+        double t = mono_time() - t0;
+        uint64_t c = cycles() - c0;
+        ns[i] = (t * 1e9) / iters;
+        cyc[i] = (double)c / iters;
+    }
+    qsort(ns, reps, sizeof(double), cmp_double);
+    qsort(cyc, reps, sizeof(double), cmp_double);
+
+    r->kernel = bt->name;
+    r->width = b->width;
+    r->height = b->height;
+    r->bytes = bt->bytes(b);
+    r->iters = iters;
+    double px = bt->pal ? 256 : pixels(b);
+    r->ns_px = ns[reps / 2] / px;
+    r->ns_px_min = ns[0] / px;
+    r->mb_s = (r->bytes / 1e6) / (ns[reps / 2] / 1e9);
+    r->cyc_b = cyc[reps / 2] / r->bytes;
+}
+
+static void write_json(FILE *fp, const result_t *res, size_t count, int reps) {
+    fprintf(fp, "{\n  \"default_backend\": \"%s\",\n  \"repetitions\": %d,\n", ssi_backend(), reps);
+#ifdef HAVE_TSC
+    fprintf(fp, "  \"tsc\": true,\n");
+#else
+    fprintf(fp, "  \"tsc\": false,\n");
+#endif
+    fprintf(fp, "  \"results\": [\n");
+    for(size_t i = 0; i < count; i++) {
+        const result_t *r = &res[i];
+        fprintf(fp, "    {\"backend\": \"%s\", \"kernel\": \"%s\", \"width\": %u, \"height\": %u, "
+                    "\"bytes\": %zu, \"iterations\": %zu, \"ns_per_pixel\": %.4f, \"ns_per_pixel_min\": %.4f, "
+                    "\"mb_per_s\": %.2f, \"cycles_per_byte\": %.4f}%s\n",
+                r->backend, r->kernel, r->width, r->height, r->bytes, r->iters, r->ns_px, r->ns_px_min,
+                r->mb_s, r->cyc_b, (i + 1 < count) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char *argv[]) {
+    int rval = -1;
+    const char *backends = NULL;  // all the host can run
+    const char *kernels = NULL;   // all of them
+    const char *json = NULL;
+    int reps = 11;
+    double warm_s = 0.1;
+    double sample_s = 0.02;
+    bool quick = false;
+    result_t *res = NULL;
+    size_t count = 0;
+    bench_bufs_t bufs = {0};
+
+    printf("SSI-IMG codec benchmark\n");
+
+    // all parameters are options
+    char *prog = argv[0];
+    while((argc > 1) && ('-' == argv[1][0])) {
+        if(0 == strcmp(argv[1], "-q")) {
+            quick = true;
+        } else if((argc > 2) && (0 == strcmp(argv[1], "-b"))) {
+            backends = argv[2];
+        } else if((argc > 2) && (0 == strcmp(argv[1], "-k"))) {
+            kernels = argv[2];
+        } else if((argc > 2) && (0 == strcmp(argv[1], "-o"))) {
+            json = argv[2];
+        } else if((argc > 2) && (0 == strcmp(argv[1], "-r"))) {
+            reps = atoi(argv[2]);
+        } else if((argc > 2) && (0 == strcmp(argv[1], "-w"))) {
+            warm_s = atof(argv[2]) / 1000;
+        } else if((argc > 2) && (0 == strcmp(argv[1], "-t"))) {
+            sample_s = atof(argv[2]) / 1000;
+        } else {
+            printf("USAGE: %s <-b backends> <-k kernels> <-r reps> <-w ms> <-t ms> <-q> <-o json>\n", filename(prog));
+            printf("-b comma separated backends to time eg 'avx2,lut', by default all the host can run\n");
+            printf("-k comma separated codecs to time eg 'pln2lin,lin2pln', by default all of them\n");
+            printf("-r number of samples taken of each codec, the median is reported (default 11)\n");
+            printf("-w milliseconds to warm up each codec before sampling (default 100)\n");
+            printf("-t minimum milliseconds per sample (default 20)\n");
+            printf("-q only time the real SSI resolutions, not the larger synthetic ones\n");
+            printf("-o also write the results as JSON to the given file\n");
+            return -1;
+        }
+        int used = (0 == strcmp(argv[1], "-q")) ? 1 : 2;
+        argv += used; argc -= used; // consume the option
+    }
+    if(reps < 1) reps = 1;
+    if(reps > MAX_REPS) reps = MAX_REPS;
+
+#if defined(__GNUC__) && !defined(__OPTIMIZE__)
+    printf("Warning: built without optimisation, the timings won't be representative\n");
+#endif
+    const char *default_backend = ssi_backend();
+    size_t num_res = quick ? NUM_REAL_RES : NUM_RES;
+    size_t max_results = num_res * (sizeof(benches) / sizeof(benches[0])) * 4;
+    if(NULL == (res = calloc(max_results, sizeof(result_t)))) {
+        printf("Unable to allocate memory\n");
+        goto CLEANUP;
+    }
+
+    printf("%-8s %-13s %11s %10s %10s %10s %10s\n", "backend", "codec", "resolution", "ns/px", "min ns/px", "MB/s", "cyc/B");
+    for(size_t ri = 0; ri < num_res; ri++) {
+        if(0 != setup_bufs(&bufs, resolutions[ri][0], resolutions[ri][1])) {
+            printf("Unable to set up %ux%u\n", resolutions[ri][0], resolutions[ri][1]);
+            goto CLEANUP;
+        }
+        bool first = true;
+        for(int bi = 0; NULL != backend_names[bi]; bi++) {
+            if(!in_list(backends, backend_names[bi]) || (0 != ssi_set_backend(backend_names[bi]))) {
+                continue; // not wanted, or the host can't run it
+            }
+            for(int ki = 0; NULL != benches[ki].name; ki++) {
+                const bench_t *bt = &benches[ki];
+                if(!in_list(kernels, bt->name) || (bt->portable && !first) || (bt->pal && (ri > 0))) {
+                    continue; // portable codecs are timed once, palettes don't vary with resolution
+                }
+                result_t *r = &res[count++];
+                time_bench(bt, &bufs, reps, warm_s, sample_s, r);
+                r->backend = bt->portable ? "portable" : backend_names[bi];
+                char resolution[16];
+                snprintf(resolution, sizeof(resolution), bt->pal ? "256 entries" : "%ux%u", r->width, r->height);
+                printf("%-8s %-13s %11s %10.3f %10.3f %10.1f %10.3f\n", r->backend, r->kernel, resolution,
+                       r->ns_px, r->ns_px_min, r->mb_s, r->cyc_b);
+            }
+            first = false;
+        }
+        free_bufs(&bufs);
+    }
+    ssi_set_backend(default_backend);
+
+    if(NULL != json) {
+        FILE *fp = fopen(json, "w");
+        if(NULL == fp) {
+            printf("Error: Unable to open output file\n");
+            goto CLEANUP;
+        }
+        write_json(fp, res, count, reps);
+        fclose(fp);
+        printf("Results written to '%s'\n", json);
+    }
+
+    rval = 0;
+CLEANUP:
+    free_bufs(&bufs);
+    free_s(res);
+    remove(TMP_BMP);
+    return rval;
+}
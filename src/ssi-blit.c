@@ -0,0 +1,219 @@
+/*
+ * ssi-blit.c
+ * Draws onto an EGA, Amiga or BIN SSI-IMG file without decoding it, copying or
+ * combining a rectangle of another image into it, with or without a transparent
+ * colour, or filling a rectangle with a colour, using the planar raster operations
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "ssi-img.h"
+#include "ssi-raster.h"
+#include "util.h"
+#include "convert.h"
+
+/// @brief parses the name of a raster operation
+/// @return 0 on success, -1 if it isn't one
+static int parse_op(raster_op_t *op, const char *name) {
+    static const char *names[] = {"copy", "and", "or", "xor"};
+    for(int i = 0; i < 4; i++) {
+        if(0 == strcmp(name, names[i])) {
+            *op = (raster_op_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/// @brief loads a planar image into a buffer from the context, and describes it as a surface
+/// @return 0 on success, -1 on a bad spec, -2 if the file can't be read, -3 if it doesn't
+///         match the spec, -4 if out of memory
+static int load_surface(ssi_ctx_t *ctx, pln_surface_t *s, memstream_buf_t *buf, const char *spec_str,
+                        const char *fn) {
+    int rval = 0;
+    conv_spec_t spec;
+    mapped_file_t mf = {0};
+
+    if((0 != parse_spec(&spec, spec_str)) || !spec.to_bmp || (IMG_CGA == spec.format)) {
+        printf("Invalid resolution specificaton '%s', CGA images aren't planar\n", spec_str);
+        return -1;
+    }
+    if(0 != map_file(&mf, fn, true)) {
+        printf("Error: Unable to open input file '%s'\n", fn);
+        return -2;
+    }
+    if(mf.buf.len != img_file_size(spec.format, spec.width, spec.height)) {
+        printf("File image and Specified image size mismatch for '%s'\n", fn);
+        rval = -3;
+        goto CLEANUP;
+    }
+    buf->len = mf.buf.len;
+    buf->pos = 0;
+    if(NULL == (buf->data = ssi_alloc(ctx, buf->len))) {
+        printf("Unable to allocate memory\n");
+        rval = -4;
+        goto CLEANUP;
+    }
+    memcpy(buf->data, mf.buf.data, buf->len);
+    if(0 != pln_surface(s, spec.format, buf, spec.width, spec.height)) {
+        printf("Invalid resolution for the format\n");
+        rval = -1;
+    }
+
+CLEANUP:
+    unmap_file(&mf);
+    return rval;
+}
+
+/// @brief writes the image back out, replacing the file rather than writing over it, as it
+///        could be linked to a cached output
+/// @return 0 on success, -2 if the file can't be written
+static int save_surface(const memstream_buf_t *buf, const char *fn) {
+    remove(fn);
+    FILE *fp = fopen(fn, "wb");
+    if(NULL == fp) {
+        return -2;
+    }
+    int err = (1 != fwrite(buf->data, buf->len, 1, fp));
+    if((0 != fclose(fp)) || err) {
+        return -2;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rval = -1;
+    ssi_ctx_t ctx = {0};    // owns all our buffers
+    pln_surface_t dst, src;
+    memstream_buf_t dst_buf = {0, 0, NULL}; // the image drawn on (from the context)
+    memstream_buf_t src_buf = {0, 0, NULL}; // the image drawn from (from the context)
+    const char *fo_name = NULL;
+    raster_op_t op = ROP_COPY;
+    int key = -1;           // transparent colour, -1 for none
+
+    printf("SSI-IMG raster operations\n");
+
+    if(0 != trace_args(&argc, argv)) { // --stats and --trace can go anywhere
+        return -1;
+    }
+
+    // the command comes first, then any options, then the other parameters
+    if(argc < 2) {
+        goto USAGE;
+    }
+    const char *cmd = argv[1];
+    int arg = 2;
+    while(((arg + 1) < argc) && ('-' == argv[arg][0])) {
+        const char *opt = argv[arg];
+        const char *val = argv[arg + 1];
+        if(0 == strcmp(opt, "-o")) {
+            fo_name = val;
+        } else if(0 == strcmp(opt, "-r")) {
+            if(0 != parse_op(&op, val)) {
+                printf("Invalid raster operation '%s'\n", val);
+                return -1;
+            }
+        } else if(0 == strcmp(opt, "-k")) {
+            key = atoi(val);
+            if((key < 0) || (key > 15)) {
+                printf("Invalid transparent colour '%s'\n", val);
+                return -1;
+            }
+        } else {
+            printf("Unknown option '%s'\n", opt);
+            return -1;
+        }
+        arg += 2; // consume the option and its value
+    }
+
+    bool blit = (0 == strcmp(cmd, "blit")) && (((arg + 5) == argc) || ((arg + 6) == argc));
+    bool fill = (0 == strcmp(cmd, "fill")) && ((arg + 4) == argc);
+    if(!blit && !fill) {
+        goto USAGE;
+    }
+    if((key >= 0) && ((ROP_COPY != op) || fill)) {
+        printf("A transparent colour only applies to copying a rectangle\n");
+        return -1;
+    }
+    if(NULL == fo_name) {
+        fo_name = argv[arg + 1]; // drawn on in place
+    }
+
+    if(0 != load_surface(&ctx, &dst, &dst_buf, argv[arg], argv[arg + 1])) {
+        goto CLEANUP;
+    }
+
+    if(blit) {
+        uint16_t x, y, sx = 0, sy = 0, w, h;
+        if(2 != sscanf(argv[arg + 2], "%hu,%hu", &x, &y)) {
+            printf("Invalid position '%s'\n", argv[arg + 2]);
+            goto CLEANUP;
+        }
+        if(0 != load_surface(&ctx, &src, &src_buf, argv[arg + 3], argv[arg + 4])) {
+            goto CLEANUP;
+        }
+        w = src.width;
+        h = src.height;
+        if(((arg + 6) == argc) && (4 != sscanf(argv[arg + 5], "%hu,%hu,%hu,%hu", &sx, &sy, &w, &h))) {
+            printf("Invalid rectangle '%s'\n", argv[arg + 5]);
+            goto CLEANUP;
+        }
+        printf("Drawing %d x %d from %d,%d of '%s' at %d,%d\n", w, h, sx, sy, argv[arg + 4], x, y);
+        rval = (key >= 0) ? pln_blit_key(&dst, x, y, &src, sx, sy, w, h, (uint8_t)key) :
+                            pln_blit(&dst, x, y, &src, sx, sy, w, h, op);
+    } else {
+        uint16_t x, y, w, h;
+        int colour = atoi(argv[arg + 3]);
+        if(4 != sscanf(argv[arg + 2], "%hu,%hu,%hu,%hu", &x, &y, &w, &h)) {
+            printf("Invalid rectangle '%s'\n", argv[arg + 2]);
+            goto CLEANUP;
+        }
+        if((colour < 0) || (colour > 15)) {
+            printf("Invalid colour '%s'\n", argv[arg + 3]);
+            goto CLEANUP;
+        }
+        printf("Filling %d x %d at %d,%d with %d\n", w, h, x, y, colour);
+        rval = pln_fill(&dst, x, y, w, h, (uint8_t)colour, op);
+    }
+    if(0 != rval) {
+        printf("The rectangle doesn't fit the image\n");
+        rval = -1;
+        goto CLEANUP;
+    }
+
+    printf("Writing IMG File: '%s'\n", fo_name);
+    if(0 != save_surface(&dst_buf, fo_name)) {
+        printf("Error: Unable to write output file\n");
+        rval = -1;
+        goto CLEANUP;
+    }
+    printf("Done\n");
+    rval = 0; // clean exit
+    goto CLEANUP;
+
+USAGE:
+    printf("USAGE: %s blit <-o outfile> <-r op> <-k colour> [resolution] [image] [x,y] [resolution] [source] <sx,sy,w,h>\n",
+           filename(argv[0]));
+    printf("       %s fill <-o outfile> <-r op> [resolution] [image] [x,y,w,h] [colour]\n", filename(argv[0]));
+    printf("blit draws the sx,sy,w,h rectangle of [source], or all of it, onto [image] at x,y\n");
+    printf("fill draws a w x h rectangle of [colour] onto [image] at x,y\n");
+    printf("where [resolution] is in the form width x height eg '640x200', with the same\n");
+    printf("optional suffixes as img2bmp to select Amiga or interleaved. CGA images aren't planar\n");
+    printf("-o writes the result to outfile, by default [image] is drawn on in place\n");
+    printf("-r sets how the pixels are combined with [image], one of copy, and, or and xor,\n");
+    printf("   copy by default\n");
+    printf("-k copies from [source] leaving [image] as it is wherever [source] is this colour\n");
+    printf("The planes are drawn on as they are stored, neither image is decoded\n");
+    printf("--stats and --trace <file> can be given anywhere, to report the time taken by each stage\n");
+    printf("   and to append a Chrome trace of this run to <file> (view it with Perfetto)\n");
+CLEANUP:
+    ssi_ctx_free(&ctx); // releases the images in one go
+    trace_report();
+    return rval;
+}
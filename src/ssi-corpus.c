@@ -0,0 +1,620 @@
+/*
+ * ssi-corpus.c
+ * Generates a synthetic corpus of SSI images and times the whole file
+ * conversions over it, end to end
+ *
+ * 'gen' writes EGA, BIN, CGA and Amiga images made up of a mix of content
+ * that stresses the codecs differently: solid fills, dithered hex maps like
+ * those in the games, and noise. Along with the images it writes a manifest
+ * that 'run' (and ssi-batch -m) reads.
+ *
+ * 'run' converts every image in the manifest to BMP, as img2bmp does, and
+ * converts the BMP back to the original layout, as bmp2img-ega, bmp2img-cga
+ * and bmp2bin do. Each stage is timed per file, once with the files in the
+ * page cache (hot) and once with them dropped from it before being read
+ * (cold), reporting files/s, MB/s and the p50/p99 latency of a file.
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "ssi-img.h"
+#include "ssi-ctx.h"
+#include "convert.h"
+#include "util.h"
+
+#define MAX_LINE (1024)
+#define MANIFEST "corpus.lst"
+
+// the kinds of content an image can be filled with
+typedef enum {
+    CONTENT_SOLID,  // a background colour with solid filled rectangles over it
+    CONTENT_HEX,    // a map of dithered hexes with outlines
+    CONTENT_NOISE,  // every pixel random
+    CONTENT_COUNT
+} content_t;
+
+static const char *content_names[CONTENT_COUNT] = {"solid", "hex", "noise"};
+static const char *format_names[] = {"ega", "bin", "cga", "amiga"};
+
+// the stages 'run' times, and the page cache states they are timed in
+enum { STAGE_TO_BMP, STAGE_TO_IMG, STAGE_COUNT };
+enum { MODE_HOT, MODE_COLD, MODE_COUNT };
+static const char *stage_names[STAGE_COUNT] = {"img2bmp", "bmp2img"};
+static const char *mode_names[MODE_COUNT] = {"hot", "cold"};
+
+// an image from the manifest and the files converting it creates
+typedef struct {
+    conv_spec_t     to_bmp;      // conversion of the image to BMP
+    conv_spec_t     to_img;      // conversion of the BMP back, to_img.to_bmp is set if there is none
+    char            *img;        // original image
+    char            *bmp;        // converted BMP
+    char            *back;       // image converted back from the BMP
+} corpus_file_t;
+
+// timings for one stage in one cache state
+typedef struct {
+    size_t          files;
+    size_t          bytes;       // input bytes converted
+    double          secs;        // total time converting
+    double          *lat;        // per file times, in seconds
+} stage_stats_t;
+
+/// @brief returns the next number from a xorshift generator, so corpora are repeatable
+static uint32_t next_rand(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/// @brief fills the image with a background colour and a number of solid rectangles
+static void fill_solid(uint8_t *pix, uint16_t width, uint16_t height, uint8_t mask, uint32_t *rng) {
+    memset(pix, next_rand(rng) & mask, (size_t)width * height);
+    int rects = 4 + (next_rand(rng) % 12);
+    for(int r = 0; r < rects; r++) {
+        uint16_t x0 = next_rand(rng) % width;
+        uint16_t y0 = next_rand(rng) % height;
+        uint16_t x1 = x0 + 1 + (next_rand(rng) % (width - x0));
+        uint16_t y1 = y0 + 1 + (next_rand(rng) % (height - y0));
+        uint8_t c = next_rand(rng) & mask;
+        for(int y = y0; y < y1; y++) {
+            memset(&pix[(size_t)y * width + x0], c, x1 - x0);
+        }
+    }
+}
+
+/// @brief fills the image with a hex map. The hexes are approximated by rows of cells with
+///        every other row offset by half a cell. Each cell is a checkerboard dither of two
+///        colours picked for its terrain, with an outline in colour 0
+static void fill_hex(uint8_t *pix, uint16_t width, uint16_t height, uint8_t mask, uint32_t *rng) {
+    const int cw = 16; // cell width
+    const int ch = 12; // cell height
+    uint32_t seed = next_rand(rng);
+    uint8_t terrain[8][2];
+    for(int t = 0; t < 8; t++) {
+        terrain[t][0] = next_rand(rng) & mask;
+        terrain[t][1] = next_rand(rng) & mask;
+    }
+
+    for(int y = 0; y < height; y++) {
+        int row = y / ch;
+        int cy = y % ch;
+        int shift = (row & 1) ? (cw / 2) : 0;
+        for(int x = 0; x < width; x++) {
+            int col = (x + shift) / cw;
+            int cx = (x + shift) % cw;
+            // slant the top edge so the cells read as hexes rather than bricks
+            int edge = (cx < cw / 2) ? (cw / 2 - cx) / 2 : (cx - cw / 2) / 2;
+            if((cy < edge) || (0 == cx)) {
+                pix[(size_t)y * width + x] = 0;
+                continue;
+            }
+            uint32_t h = (row * 7919u) ^ (col * 104729u) ^ seed;
+            h ^= h >> 13;
+            h *= 0x5bd1e995u;
+            h ^= h >> 15;
+            pix[(size_t)y * width + x] = terrain[h & 7][(x ^ y) & 1];
+        }
+    }
+}
+
+/// @brief fills every pixel of the image with a random colour
+static void fill_noise(uint8_t *pix, uint16_t width, uint16_t height, uint8_t mask, uint32_t *rng) {
+    size_t len = (size_t)width * height;
+    for(size_t i = 0; i < len; i++) {
+        pix[i] = next_rand(rng) & mask;
+    }
+}
+
+/// @brief looks a name up in a table of names
+/// @return the index of the name, -1 if it isn't there
+static int find_name(const char *name, size_t len, const char **names, int count) {
+    for(int i = 0; i < count; i++) {
+        if((strlen(names[i]) == len) && (0 == strncmp(name, names[i], len))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/// @brief parses a comma separated list of formats, eg 'ega,cga'
+/// @return the number of formats, -1 if the list is invalid
+static int parse_formats(const char *str, img_format_t *formats) {
+    int n = 0;
+    while(*str) {
+        size_t len = strcspn(str, ",");
+        int f = find_name(str, len, format_names, 4);
+        if((f < 0) || (n == 4)) {
+            return -1;
+        }
+        formats[n++] = (img_format_t)f;
+        str += len;
+        if(',' == *str) str++;
+    }
+    return n;
+}
+
+/// @brief parses a content mix of weighted content names, eg 'solid:1,hex:3,noise:1'.
+///        A name without a weight has a weight of 1, names left out have a weight of 0
+/// @return 0 on success, -1 if the mix is invalid
+static int parse_mix(const char *str, unsigned *weights) {
+    unsigned total = 0;
+    memset(weights, 0, CONTENT_COUNT * sizeof(unsigned));
+    while(*str) {
+        size_t len = strcspn(str, ",");
+        size_t name_len = strcspn(str, ":,");
+        int c = find_name(str, name_len, content_names, CONTENT_COUNT);
+        if(c < 0) {
+            return -1;
+        }
+        weights[c] = (name_len < len) ? (unsigned)atoi(str + name_len + 1) : 1;
+        total += weights[c];
+        str += len;
+        if(',' == *str) str++;
+    }
+    return total ? 0 : -1;
+}
+
+/// @brief picks content at random in proportion to the weights
+static content_t pick_content(const unsigned *weights, uint32_t *rng) {
+    unsigned total = 0;
+    for(int c = 0; c < CONTENT_COUNT; c++) {
+        total += weights[c];
+    }
+    unsigned r = next_rand(rng) % total;
+    for(int c = 0; c < CONTENT_COUNT; c++) {
+        if(r < weights[c]) {
+            return (content_t)c;
+        }
+        r -= weights[c];
+    }
+    return CONTENT_NOISE;
+}
+
+/// @brief writes the spec that converts an image of the format to BMP, eg '320x200c1'
+static void format_spec(char *spec, img_format_t format, uint16_t width, uint16_t height) {
+    static const char suffix[] = {'e', 'b', 'c', 'a'};
+    sprintf(spec, "%ux%u%c", width, height, suffix[format]);
+}
+
+/// @brief writes a corpus of images and a manifest for them
+/// @return 0 on success, -1 on bad parameters, -2 if a file can't be written, -4 if out of memory
+static int generate(const char *dir, int count, const img_format_t *formats, int nformats,
+                    const unsigned *weights, uint16_t width, uint16_t height, uint32_t seed) {
+    int rval = 0;
+    ssi_ctx_t ctx = {0};
+    FILE *list = NULL;
+    char fn[MAX_LINE];
+    size_t bytes = 0;
+    uint32_t rng = seed ? seed : 1; // xorshift can't start from 0
+
+    // every format must take the size before anything is written, not stop part way through
+    for(int f = 0; f < nformats; f++) {
+        if(!img_fits(formats[f], width, height)) {
+            printf("%ux%u doesn't fit the %s format\n", width, height, format_names[formats[f]]);
+            return -1;
+        }
+    }
+    if(0 != make_dir(dir)) {
+        printf("Unable to create directory '%s'\n", dir);
+        return -2;
+    }
+    snprintf(fn, sizeof(fn), "%s/%s", dir, MANIFEST);
+    if(NULL == (list = fopen(fn, "w"))) {
+        printf("Unable to create manifest '%s'\n", fn);
+        return -2;
+    }
+    fprintf(list, "# generated by ssi-corpus, %d images, seed %u\n", count, seed);
+
+    size_t max = img_file_size(IMG_AMIGA, width, height); // big enough for any format
+    if(0 != ssi_ctx_init(&ctx, img_decoded_size(width, height) + max + 64)) {
+        rval = -4;
+        goto CLEANUP;
+    }
+
+    for(int i = 0; i < count; i++) {
+        img_format_t format = formats[i % nformats];
+        content_t content = pick_content(weights, &rng);
+        uint8_t mask = (IMG_CGA == format) ? 0x03 : 0x0f;
+        memstream_buf_t pix = {0, 0, NULL};
+        memstream_buf_t img = {0, 0, NULL};
+        pal_entry_t pal[16];
+
+        ssi_ctx_reset(&ctx);
+        pix.len = img_decoded_size(width, height);
+        img.len = img_file_size(format, width, height);
+        pix.data = ssi_alloc(&ctx, pix.len);
+        img.data = ssi_alloc(&ctx, img.len);
+        if((NULL == pix.data) || (NULL == img.data)) {
+            rval = -4;
+            goto CLEANUP;
+        }
+
+        if(CONTENT_SOLID == content) {
+            fill_solid(pix.data, width, height, mask, &rng);
+        } else if(CONTENT_HEX == content) {
+            fill_hex(pix.data, width, height, mask, &rng);
+        } else {
+            fill_noise(pix.data, width, height, mask, &rng);
+        }
+        for(int p = 0; p < 16; p++) { // only Amiga images carry one
+            uint32_t c = next_rand(&rng);
+            pal[p].r = c & 0x0f;
+            pal[p].g = (c >> 4) & 0x0f;
+            pal[p].b = (c >> 8) & 0x0f;
+        }
+        if(0 != img_encode(format, &img, &pix, width, height, pal)) {
+            rval = -1;  // checked up front, so shouldn't happen
+            goto CLEANUP;
+        }
+
+        snprintf(fn, sizeof(fn), "%s/%s-%s-%05d%s", dir, format_names[format], content_names[content], i,
+                 (IMG_BIN == format) ? ".BIN" : ".IMG");
+        FILE *fp = fopen(fn, "wb");
+        if(NULL == fp) {
+            printf("Unable to create '%s'\n", fn);
+            rval = -2;
+            goto CLEANUP;
+        }
+        size_t wrote = fwrite(img.data, 1, img.len, fp);
+        if((0 != fclose(fp)) || (wrote != img.len)) {
+            printf("Unable to write '%s'\n", fn);
+            rval = -2;
+            goto CLEANUP;
+        }
+        bytes += img.len;
+
+        char spec[32];
+        format_spec(spec, format, width, height);
+        fprintf(list, "%s %s\n", spec, fn);
+    }
+    printf("Wrote %d images, %.1f MB, and %s/%s\n", count, bytes / (1024.0 * 1024.0), dir, MANIFEST);
+
+CLEANUP:
+    if((NULL != list) && (0 != fclose(list)) && (0 == rval)) {
+        rval = -2;
+    }
+    ssi_ctx_free(&ctx);
+    return rval;
+}
+
+/// @brief makes the name of a file in the output directory from the input name
+/// @return the name, NULL if out of memory
+static char *out_name(ssi_ctx_t *ctx, const char *outdir, const char *fi, const char *tag, const char *ext) {
+    char *base = ssi_strdup(ctx, fi, 0);
+    if(NULL == base) {
+        return NULL;
+    }
+    drop_extension(base);
+    base = filename(base);
+    char *fo = ssi_alloc(ctx, strlen(outdir) + strlen(base) + strlen(tag) + strlen(ext) + 2);
+    if(NULL != fo) {
+        sprintf(fo, "%s/%s%s%s", outdir, base, tag, ext);
+    }
+    return fo;
+}
+
+/// @brief reads the manifest, each line being '<spec> <infile>' as 'gen' writes them.
+///        Blank lines and lines starting with '#' are skipped, lines converting BMP to IMG too
+/// @return the number of files read, -1 if out of memory, -2 if the file can't be read, -3 on a bad line
+static int read_manifest(ssi_ctx_t *ctx, const char *fn, const char *outdir, corpus_file_t **files) {
+    FILE *fp = NULL;
+    char line[MAX_LINE];
+    int count = 0;
+    int size = 0;
+    int num = 0;
+    *files = NULL;
+
+    if(NULL == (fp = fopen(fn, "r"))) {
+        return -2;
+    }
+    while(NULL != fgets(line, sizeof(line), fp)) {
+        num++;
+        line[strcspn(line, "\r\n")] = 0;
+        char *spec = strtok(line, " \t");
+        char *fi = strtok(NULL, " \t");
+        if((NULL == spec) || ('#' == *spec)) {
+            continue;
+        }
+        conv_spec_t to_bmp;
+        if((NULL == fi) || (0 != parse_spec(&to_bmp, spec))) {
+            printf("%s:%d: expected '<spec> <infile>'\n", fn, num);
+            fclose_s(fp);
+            return -3;
+        }
+        if(!to_bmp.to_bmp) {
+            continue;
+        }
+
+        if(count == size) { // the old list is simply left in the context
+            corpus_file_t *grown = ssi_alloc(ctx, (size ? size * 2 : 256) * sizeof(corpus_file_t));
+            if(NULL == grown) {
+                fclose_s(fp);
+                return -1;
+            }
+            if(count) memcpy(grown, *files, count * sizeof(corpus_file_t));
+            size = size ? size * 2 : 256;
+            *files = grown;
+        }
+        corpus_file_t *f = &(*files)[count];
+        f->to_bmp = to_bmp;
+        f->to_img = to_bmp;
+        f->to_img.to_bmp = (IMG_AMIGA == to_bmp.format); // there's no converting BMP to Amiga
+        f->img = ssi_strdup(ctx, fi, 0);
+        f->bmp = out_name(ctx, outdir, fi, "", spec_extension(&f->to_bmp));
+        f->back = out_name(ctx, outdir, fi, "-rt", spec_extension(&f->to_img));
+        if((NULL == f->img) || (NULL == f->bmp) || (NULL == f->back)) {
+            fclose_s(fp);
+            return -1;
+        }
+        count++;
+    }
+    fclose_s(fp);
+    return count;
+}
+
+/// @brief runs one stage over all the files
+/// @param stats where to record the timings, NULL for an untimed warm-up pass
+/// @param cold if true each input file is dropped from the page cache before it is converted
+/// @return the number of files that failed to convert
+static int run_stage(ssi_ctx_t *ctx, corpus_file_t *files, int count, int stage, bool cold, stage_stats_t *stats) {
+    int failed = 0;
+    for(int i = 0; i < count; i++) {
+        corpus_file_t *f = &files[i];
+        const conv_spec_t *spec = (STAGE_TO_BMP == stage) ? &f->to_bmp : &f->to_img;
+        const char *fi = (STAGE_TO_BMP == stage) ? f->img : f->bmp;
+        const char *fo = (STAGE_TO_BMP == stage) ? f->bmp : f->back;
+        if((STAGE_TO_IMG == stage) && spec->to_bmp) {
+            continue;
+        }
+        if(cold) {
+            drop_cache(fi);
+        }
+
+        size_t bytes = 0;
+        ssi_ctx_reset(ctx);
+        double start = mono_time();
+        int rval = convert_file(ctx, spec, fi, fo, &bytes);
+        double secs = mono_time() - start;
+        if(0 != rval) {
+            if(NULL != stats) {
+                printf("%s: %s\n", fi, convert_error(rval));
+            }
+            failed++;
+            continue;
+        }
+        if(NULL != stats) {
+            stats->lat[stats->files++] = secs;
+            stats->bytes += bytes;
+            stats->secs += secs;
+        }
+    }
+    return failed;
+}
+
+/// @brief compares the images converted back from BMP with the originals
+/// @return the number of images that differ
+static int check_round_trip(corpus_file_t *files, int count) {
+    int differ = 0;
+    for(int i = 0; i < count; i++) {
+        mapped_file_t a = {0};
+        mapped_file_t b = {0};
+        if(files[i].to_img.to_bmp) {
+            continue;
+        }
+        if((0 != map_file(&a, files[i].img, true)) || (0 != map_file(&b, files[i].back, true)) ||
+           (a.buf.len != b.buf.len) || (0 != memcmp(a.buf.data, b.buf.data, a.buf.len))) {
+            printf("%s: doesn't survive the round trip\n", files[i].img);
+            differ++;
+        }
+        unmap_file(&a);
+        unmap_file(&b);
+    }
+    return differ;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/// @brief prints a line of the results table
+static void report(const char *stage, const char *mode, stage_stats_t *s) {
+    if(0 == s->files) {
+        return;
+    }
+    qsort(s->lat, s->files, sizeof(double), cmp_double);
+    double p50 = s->lat[(s->files - 1) / 2];
+    double p99 = s->lat[((s->files - 1) * 99) / 100];
+    printf("%-8s %-5s %7zu %10.1f %9.1f %9.3f %9.3f\n", stage, mode, s->files, s->files / s->secs,
+           s->bytes / (s->secs * 1024.0 * 1024.0), p50 * 1000.0, p99 * 1000.0);
+}
+
+/// @brief converts the corpus, timing each stage hot and cold
+/// @return 0 on success, -1 if any file fails, -2 if the manifest can't be read, -4 if out of memory
+static int run(const char *manifest, const char *outdir, int passes, bool hot, bool cold) {
+    int rval = 0;
+    ssi_ctx_t ctx = {0};    // owns the file list and the timings
+    ssi_ctx_t work = {0};   // reset for each file converted
+    corpus_file_t *files = NULL;
+    stage_stats_t stats[STAGE_COUNT][MODE_COUNT];
+    memset(stats, 0, sizeof(stats));
+
+    if(0 != make_dir(outdir)) {
+        printf("Unable to create directory '%s'\n", outdir);
+        return -2;
+    }
+    int count = read_manifest(&ctx, manifest, outdir, &files);
+    if(count < 0) {
+        printf("Unable to read manifest '%s'\n", manifest);
+        rval = (-1 == count) ? -4 : -2;
+        goto CLEANUP;
+    }
+    if((0 != ssi_ctx_init(&work, 256 * 1024))) {
+        rval = -4;
+        goto CLEANUP;
+    }
+    for(int s = 0; s < STAGE_COUNT; s++) {
+        for(int m = 0; m < MODE_COUNT; m++) {
+            size_t runs = (MODE_HOT == m) ? passes : 1;
+            if(NULL == (stats[s][m].lat = ssi_alloc(&ctx, count * runs * sizeof(double) + 1))) {
+                rval = -4;
+                goto CLEANUP;
+            }
+        }
+    }
+    printf("Converting %d images to '%s'\n", count, outdir);
+
+    // the BMPs the first stage writes are the input to the second, so the stages run in order
+    if(cold && (-2 == drop_cache(manifest))) {
+        printf("Dropping files from the page cache isn't supported, skipping the cold runs\n");
+        cold = false;
+    }
+    for(int s = 0; s < STAGE_COUNT; s++) {
+        int failed = run_stage(&work, files, count, s, false, NULL); // warm-up, also creates the files
+        if(failed) {
+            printf("%d files failed to convert\n", failed);
+            rval = -1;
+            goto CLEANUP;
+        }
+        for(int p = 0; hot && (p < passes); p++) {
+            failed += run_stage(&work, files, count, s, false, &stats[s][MODE_HOT]);
+        }
+        if(cold) {
+            failed += run_stage(&work, files, count, s, true, &stats[s][MODE_COLD]);
+        }
+        if(failed) {
+            rval = -1;
+        }
+    }
+    int differ = check_round_trip(files, count);
+    if(differ) {
+        printf("%d images differ after converting to BMP and back\n", differ);
+        rval = -1;
+    }
+
+    printf("stage    cache   files    files/s      MB/s    p50 ms    p99 ms\n");
+    for(int s = 0; s < STAGE_COUNT; s++) {
+        for(int m = 0; m < MODE_COUNT; m++) {
+            report(stage_names[s], mode_names[m], &stats[s][m]);
+        }
+    }
+
+CLEANUP:
+    ssi_ctx_free(&work);
+    ssi_ctx_free(&ctx);
+    return rval;
+}
+
+int main(int argc, char *argv[]) {
+    int count = 100;
+    img_format_t formats[4] = {IMG_EGA, IMG_BIN, IMG_CGA, IMG_AMIGA};
+    int nformats = 4;
+    unsigned weights[CONTENT_COUNT] = {1, 3, 1};
+    uint16_t width = 320;
+    uint16_t height = 200;
+    uint32_t seed = 1;
+    int passes = 1;
+    bool hot = true;
+    bool cold = true;
+
+    printf("SSI-IMG corpus generator and benchmark\n");
+
+    // the command comes first, then any options, then the other parameters
+    if(argc < 2) {
+        goto USAGE;
+    }
+    const char *cmd = argv[1];
+    int arg = 2;
+    while(((arg + 1) < argc) && ('-' == argv[arg][0])) {
+        const char *opt = argv[arg];
+        const char *val = argv[arg + 1];
+        if(0 == strcmp(opt, "-n")) {
+            count = atoi(val);
+        } else if(0 == strcmp(opt, "-f")) {
+            nformats = parse_formats(val, formats);
+        } else if(0 == strcmp(opt, "-m")) {
+            if(0 != parse_mix(val, weights)) {
+                printf("Invalid content mix '%s'\n", val);
+                return -1;
+            }
+        } else if(0 == strcmp(opt, "-s")) {
+            width = height = 0;
+            sscanf(val, "%hu%*[xX]%hu", &width, &height);
+        } else if(0 == strcmp(opt, "-S")) {
+            seed = strtoul(val, NULL, 0);
+        } else if(0 == strcmp(opt, "-r")) {
+            passes = atoi(val);
+        } else if(0 == strcmp(opt, "-c")) {
+            hot = (0 != strcmp(val, "cold"));
+            cold = (0 != strcmp(val, "hot"));
+        } else {
+            printf("Unknown option '%s'\n", opt);
+            return -1;
+        }
+        arg += 2; // consume the option and its value
+    }
+
+    if((0 == strcmp(cmd, "gen")) && ((arg + 1) == argc)) {
+        if(nformats < 1) {
+            printf("Invalid format list, expected some of %s,%s,%s,%s\n", format_names[0], format_names[1],
+                   format_names[2], format_names[3]);
+            return -1;
+        }
+        if((count < 1) || (0 == width) || (0 == height)) {
+            printf("Invalid image count or size\n");
+            return -1;
+        }
+        return generate(argv[arg], count, formats, nformats, weights, width, height, seed);
+    }
+    if((0 == strcmp(cmd, "run")) && ((arg + 2) == argc)) {
+        if(passes < 1) passes = 1;
+        return run(argv[arg], argv[arg + 1], passes, hot, cold);
+    }
+
+USAGE:
+    printf("USAGE: %s gen <-n count> <-f formats> <-m mix> <-s size> <-S seed> [dir]\n", filename(argv[0]));
+    printf("       %s run <-r passes> <-c cache> [manifest] [outdir]\n", filename(argv[0]));
+    printf("gen writes a corpus of images to [dir] along with a manifest of them, '%s'\n", MANIFEST);
+    printf("-n sets the number of images, 100 by default\n");
+    printf("-f is a comma separated list of the formats to cycle through, any of\n");
+    printf("   ega, bin, cga and amiga, all of them by default\n");
+    printf("-m sets the mix of content as weighted names, any of solid, hex and noise,\n");
+    printf("   by default 'solid:1,hex:3,noise:1'\n");
+    printf("-s sets the image size eg '640x200', 320x200 by default\n");
+    printf("-S seeds the random content, the same seed gives the same corpus\n");
+    printf("run converts each image in [manifest] to BMP and back again into [outdir], timing\n");
+    printf("   each file and reporting the throughput and p50/p99 latency of each stage\n");
+    printf("-r sets the number of timed passes with the files in the page cache\n");
+    printf("-c is one of hot, cold or both (the default), cold drops each file from the page\n");
+    printf("   cache before it is converted\n");
+    return -1;
+}
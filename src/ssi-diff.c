@@ -0,0 +1,138 @@
+/*
+ * ssi-diff.c
+ * Compares two SSI-IMG files of the same format and resolution, reporting how
+ * many pixels differ and where, without decoding either image
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "ssi-img.h"
+#include "ssi-diff.h"
+#include "bmp.h"
+#include "util.h"
+#include "convert.h"
+
+int main(int argc, char *argv[]) {
+    int rval = -1;
+    ssi_ctx_t ctx = {0};    // owns all our buffers
+    mapped_file_t fa = {0};
+    mapped_file_t fb = {0};
+    conv_spec_t spec;
+    memstream_buf_t mask = {0, 0, NULL}; // 1 byte per pixel (from the context)
+    diff_span_t *spans = NULL; // the pixels that differ in each row (from the context)
+    pal_entry_t pal[16];
+    char *mask_name = NULL; // BMP to write the mask to, if any (not allocated)
+    bool rows = false;      // list each row that differs
+    img_diff_t st;
+
+    printf("SSI-IMG image comparison\n");
+
+    if(0 != trace_args(&argc, argv)) { // --stats and --trace can go anywhere
+        return -1;
+    }
+
+    // pull out any options, they come ahead of the other parameters
+    char *prog = argv[0];
+    while((argc > 1) && ('-' == argv[1][0])) {
+        if(0 == strcmp(argv[1], "-r")) {
+            rows = true;
+        } else if((0 == strcmp(argv[1], "-m")) && (argc > 2)) {
+            mask_name = argv[2];
+            argv++; argc--; // consume the mask file name
+        } else {
+            printf("Unknown option '%s'\n", argv[1]);
+            return -1;
+        }
+        argv++; argc--; // consume the option
+        argv[0] = prog;
+    }
+
+    if(4 != argc) {
+        printf("USAGE: %s <-r> <-m mask.bmp> [resolution]<adapter> [file1] [file2]\n", filename(argv[0]));
+        printf("-r is optional and lists the left and right most pixels that differ in each row\n");
+        printf("-m is optional and writes a BMP of the same size, white where the pixels differ\n");
+        printf("where [resolution] is in the form width x height eg '320x200', with the same\n");
+        printf("optional suffixes as img2bmp to select CGA, Amiga or interleaved\n");
+        printf("[file1] and [file2] are the names of the files to compare\n");
+        printf("The files are compared as they are stored, neither is decoded. The Amiga palette\n");
+        printf("isn't compared. Exits with 0 if no pixels differ, 1 if any do\n");
+        printf("--stats and --trace <file> can be given anywhere, to report the time taken by each stage\n");
+        printf("   and to append a Chrome trace of this run to <file> (view it with Perfetto)\n");
+        return -1;
+    }
+    argv++; argc--; // consume the first arg (program name)
+
+    if((0 != parse_spec(&spec, argv[0])) || !spec.to_bmp) {
+        printf("Invalid resolution specificaton\n");
+        goto CLEANUP;
+    }
+    const char *fmt_name = (IMG_CGA == spec.format) ? "CGA" : (IMG_AMIGA == spec.format) ? "Amiga" :
+                           (IMG_BIN == spec.format) ? "EGA interleaved" : "EGA";
+    printf("Resolution: %d x %d %s\n", spec.width, spec.height, fmt_name);
+
+    size_t len = img_file_size(spec.format, spec.width, spec.height);
+    if((0 != map_file(&fa, argv[1], true)) || (0 != map_file(&fb, argv[2], true))) {
+        printf("Error: Unable to open input file\n");
+        goto CLEANUP;
+    }
+    if((fa.buf.len != len) || (fb.buf.len != len)) {
+        printf("File image and Specified image size mismatch for %s\n", fmt_name);
+        goto CLEANUP;
+    }
+
+    if(rows && (NULL == (spans = ssi_alloc(&ctx, spec.height * sizeof(diff_span_t))))) {
+        printf("Unable to allocate memory\n");
+        goto CLEANUP;
+    }
+    if(NULL != mask_name) {
+        mask.len = img_decoded_size(spec.width, spec.height);
+        if(NULL == (mask.data = ssi_alloc(&ctx, mask.len))) {
+            printf("Unable to allocate memory\n");
+            goto CLEANUP;
+        }
+    }
+
+    if(0 != img_diff(spec.format, &fa.buf, &fb.buf, spec.width, spec.height, &st, spans,
+                     (NULL != mask_name) ? &mask : NULL)) {
+        printf("Invalid resolution for the format\n");
+        goto CLEANUP;
+    }
+
+    printf("%llu of %llu pixels differ (%.2f%%)\n", (unsigned long long)st.changed, (unsigned long long)st.pixels,
+           st.pixels ? ((100.0 * st.changed) / st.pixels) : 0.0);
+    if(st.changed) {
+        printf("%d rows differ, within %d,%d to %d,%d (%d x %d)\n", st.rows, st.x0, st.y0, st.x1, st.y1,
+               (st.x1 - st.x0) + 1, (st.y1 - st.y0) + 1);
+    }
+    for(int y = 0; rows && (y < spec.height); y++) {
+        if(spans[y].first <= spans[y].last) {
+            printf("row %d: %d to %d\n", y, spans[y].first, spans[y].last);
+        }
+    }
+
+    if(NULL != mask_name) {
+        make_palette(pal, false, 0);
+        pal[1] = pal[15]; // white where they differ, on black
+        printf("Creating BMP File: '%s'\n", mask_name);
+        rval = save_bmp4_ctx(&ctx, mask_name, &mask, spec.width, spec.height, pal);
+        if(0 != rval) {
+            printf("BMP Save Error (%d)\n", rval);
+            rval = -1;
+            goto CLEANUP;
+        }
+    }
+
+    rval = st.changed ? 1 : 0;
+CLEANUP:
+    unmap_file(&fa);
+    unmap_file(&fb);
+    ssi_ctx_free(&ctx); // releases the mask and spans in one go
+    trace_report();
+    return rval;
+}
@@ -0,0 +1,257 @@
+/*
+ * ssi-hist.c
+ * Counts how often each colour is used across one or many SSI-IMG files,
+ * straight from the stored planes without decoding them, to show which
+ * palette entries a set of images uses and which are free
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "ssi-img.h"
+#include "ssi-hist.h"
+#include "ssi-ctx.h"
+#include "convert.h"
+#include "util.h"
+
+#define MAX_LINE (1024)
+
+// an image to count
+typedef struct {
+    conv_spec_t spec;   // format and resolution
+    char        *path;  // file to count (from the context)
+} item_t;
+
+// the images to count
+typedef struct {
+    item_t      *items; // the images (malloc'd)
+    size_t      count;  // images in the list
+    size_t      size;   // room in the list
+    ssi_ctx_t   ctx;    // holds the file names
+} hist_list_t;
+
+// the counts over a set of images
+typedef struct {
+    uint64_t    counts[HIST_BINS];  // pixels of each colour
+    size_t      used[HIST_BINS];    // images using each colour
+    size_t      images;             // images counted
+} hist_total_t;
+
+/// @brief adds an image to the list
+/// @return 0 on success, -1 if out of memory, -3 if the spec isn't an image resolution
+static int add_item(hist_list_t *l, const conv_spec_t *spec, const char *path) {
+    if(!spec->to_bmp) {
+        return -3;  // 'ega', 'cga' and 'bin' describe BMP conversions, not images
+    }
+    if(l->count == l->size) {
+        size_t size = l->size ? (l->size * 2) : 1024;
+        item_t *items = realloc(l->items, size * sizeof(item_t));
+        if(NULL == items) {
+            return -1;
+        }
+        l->items = items;
+        l->size = size;
+    }
+    item_t *item = &l->items[l->count];
+    item->spec = *spec;
+    if(NULL == (item->path = ssi_strdup(&l->ctx, path, 0))) {
+        return -1;
+    }
+    l->count++;
+    return 0;
+}
+
+/// @brief reads a manifest, each line being '<spec> <file>'. Blank lines and lines starting
+///        with '#' are skipped. ssi-corpus writes its corpus list in this form
+/// @return 0 on success, -1 if out of memory, -2 if the file can't be read, -3 on a bad line
+static int read_manifest(hist_list_t *l, const char *fn) {
+    int rval = 0;
+    FILE *fp = NULL;
+    char line[MAX_LINE];
+    int num = 0;
+
+    if(NULL == (fp = fopen(fn, "r"))) {
+        return -2;
+    }
+    while((0 == rval) && (NULL != fgets(line, sizeof(line), fp))) {
+        num++;
+        line[strcspn(line, "\r\n")] = 0;
+        char *word = line + strspn(line, " \t");
+        if((0 == *word) || ('#' == *word)) {
+            continue;
+        }
+
+        char *fields[3] = {NULL};
+        int n = 0;
+        for(char *tok = strtok(word, " \t"); (NULL != tok) && (n < 3); tok = strtok(NULL, " \t")) {
+            fields[n++] = tok;
+        }
+        conv_spec_t spec;
+        if((2 != n) || (0 != parse_spec(&spec, fields[0]))) {
+            printf("%s:%d: expected '<spec> <file>'\n", fn, num);
+            rval = -3;
+            break;
+        }
+        if(-3 == (rval = add_item(l, &spec, fields[1]))) {
+            printf("%s:%d: '%s' isn't an image resolution\n", fn, num, fields[0]);
+        }
+    }
+    fclose_s(fp);
+    return rval;
+}
+
+/// @brief prints the counts over a set of images, and which colours none of them use
+/// @param bins number of colours the images can use
+static void print_total(const hist_total_t *t, const char *name, int bins) {
+    uint64_t pixels = 0;
+    for(int i = 0; i < bins; i++) {
+        pixels += t->counts[i];
+    }
+
+    printf("%s images: %zu, %llu pixels\n", name, t->images, (unsigned long long)pixels);
+    printf("%6s %14s %8s %8s\n", "colour", "pixels", "share", "images");
+    for(int i = 0; i < bins; i++) {
+        printf("%6d %14llu %7.2f%% %8zu\n", i, (unsigned long long)t->counts[i],
+               pixels ? ((100.0 * t->counts[i]) / pixels) : 0.0, t->used[i]);
+    }
+
+    int unused = 0;
+    for(int i = 0; i < bins; i++) {
+        if(0 == t->used[i]) {
+            printf("%s%d", unused ? ", " : "Unused colours: ", i);
+            unused++;
+        }
+    }
+    printf(unused ? "\n" : "Every colour is used\n");
+}
+
+int main(int argc, char *argv[]) {
+    int rval = -1;
+    hist_list_t list = {0};
+    hist_total_t totals[2] = {0}; // 16 colour images, and CGA images
+    const char *manifest = NULL;
+    bool verbose = false;   // print the counts for each image
+    size_t failed = 0;
+    size_t bytes = 0;
+
+    printf("SSI-IMG colour histogram\n");
+
+    if(0 != trace_args(&argc, argv)) { // --stats and --trace can go anywhere
+        return -1;
+    }
+
+    // pull out any options, they come ahead of the other parameters
+    char *prog = argv[0];
+    while((argc > 1) && ('-' == argv[1][0])) {
+        if(0 == strcmp(argv[1], "-v")) {
+            verbose = true;
+        } else if((0 == strcmp(argv[1], "-m")) && (argc > 2)) {
+            manifest = argv[2];
+            argv++; argc--; // consume the manifest name
+        } else {
+            printf("Unknown option '%s'\n", argv[1]);
+            return -1;
+        }
+        argv++; argc--; // consume the option
+        argv[0] = prog;
+    }
+
+    if((argc < 3) && ((NULL == manifest) || (2 == argc))) {
+        printf("USAGE: %s <-v> <-m manifest> <spec> <files...>\n", filename(argv[0]));
+        printf("<spec> is the resolution of the files given on the command line, as for img2bmp\n");
+        printf("   eg '320x200c'\n");
+        printf("<files...> are the names of the IMG files to count the colours of\n");
+        printf("-m reads a manifest, each line being '<spec> <file>', as ssi-corpus writes\n");
+        printf("-v is optional and prints the counts for each image as well as the totals\n");
+        printf("The counts are taken from the stored planes, none of the images are decoded.\n");
+        printf("CGA images are totalled apart from the others, as their 4 colours are a different palette\n");
+        printf("--stats and --trace <file> can be given anywhere, to report the time taken by each stage\n");
+        printf("   and to append a Chrome trace of this run to <file> (view it with Perfetto)\n");
+        return -1;
+    }
+
+    // gather up all the images
+    if(argc >= 3) {
+        conv_spec_t spec;
+        if((0 != parse_spec(&spec, argv[1])) || !spec.to_bmp) {
+            printf("Invalid resolution specificaton '%s'\n", argv[1]);
+            goto CLEANUP;
+        }
+        for(int i = 2; i < argc; i++) {
+            if(0 != add_item(&list, &spec, argv[i])) {
+                printf("Unable to allocate memory\n");
+                goto CLEANUP;
+            }
+        }
+    }
+    if((NULL != manifest) && (0 != read_manifest(&list, manifest))) {
+        printf("Error: Unable to read manifest '%s'\n", manifest);
+        goto CLEANUP;
+    }
+    if(0 == list.count) {
+        printf("No files to count\n");
+        goto CLEANUP;
+    }
+
+    double start = mono_time();
+    for(size_t i = 0; i < list.count; i++) {
+        item_t *item = &list.items[i];
+        mapped_file_t src = {0};
+        uint64_t counts[HIST_BINS];
+        int err = -2;
+        if(0 == map_file(&src, item->path, true)) {
+            err = -3;
+            if(src.buf.len == img_file_size(item->spec.format, item->spec.width, item->spec.height)) {
+                err = img_histogram(item->spec.format, &src.buf, item->spec.width, item->spec.height, counts);
+            }
+            bytes += src.buf.len;
+        }
+        unmap_file(&src);
+        if(0 != err) {
+            printf("FAILED '%s': %s\n", item->path, (-2 == err) ? "unable to read file" :
+                   "doesn't match the resolution given");
+            failed++;
+            continue;
+        }
+
+        bool is_cga = (IMG_CGA == item->spec.format);
+        hist_total_t *t = &totals[is_cga ? 1 : 0];
+        for(int c = 0; c < HIST_BINS; c++) {
+            t->counts[c] += counts[c];
+            t->used[c] += (0 != counts[c]);
+        }
+        t->images++;
+
+        if(verbose) {
+            printf("%s:", item->path);
+            for(int c = 0; c < (is_cga ? 4 : HIST_BINS); c++) {
+                if(counts[c]) {
+                    printf(" %d:%llu", c, (unsigned long long)counts[c]);
+                }
+            }
+            printf("\n");
+        }
+    }
+    double secs = mono_time() - start;
+
+    if(totals[0].images) {
+        print_total(&totals[0], "16 colour", HIST_BINS);
+    }
+    if(totals[1].images) {
+        print_total(&totals[1], "CGA", 4);
+    }
+    if(secs <= 0) secs = 1e-9;
+    printf("Counted %zu of %zu files in %.3fs, %.1f files/s, %.2f MB/s\n",
+           list.count - failed, list.count, secs, list.count / secs, (bytes / 1e6) / secs);
+    rval = failed ? -1 : 0;
+CLEANUP:
+    free_s(list.items);
+    ssi_ctx_free(&list.ctx);
+    trace_report();
+    return rval;
+}
@@ -0,0 +1,244 @@
+/*
+ * ssi-pack.c
+ * Packs many SSI-IMG files into a single indexed archive, which the other
+ * tools can then read images from without unpacking it
+ *
+ * The index of names, formats and resolutions comes first, and each image
+ * starts on a page boundary so it can be used straight from the mapped
+ * archive. Images can optionally be compressed, at the cost of having to be
+ * decompressed to be read.
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "ssi-img.h"
+#include "ssi-ctx.h"
+#include "convert.h"
+#include "pack.h"
+#include "util.h"
+
+#define MAX_LINE (1024)
+
+// an image to pack
+typedef struct {
+    conv_spec_t spec;   // format and resolution
+    char        *path;  // file to pack (from the context)
+} item_t;
+
+// the images to pack
+typedef struct {
+    item_t      *items; // the images (malloc'd)
+    size_t      count;  // images in the list
+    size_t      size;   // room in the list
+    ssi_ctx_t   ctx;    // holds the file names
+} pack_list_t;
+
+/// @brief adds an image to the list
+/// @return 0 on success, -1 if out of memory, -3 if the spec isn't an image resolution
+static int add_item(pack_list_t *l, const conv_spec_t *spec, const char *path) {
+    if(!spec->to_bmp) {
+        return -3;  // 'ega', 'cga' and 'bin' describe BMP conversions, not images
+    }
+    if(l->count == l->size) {
+        size_t size = l->size ? (l->size * 2) : 1024;
+        item_t *items = realloc(l->items, size * sizeof(item_t));
+        if(NULL == items) {
+            return -1;
+        }
+        l->items = items;
+        l->size = size;
+    }
+    item_t *item = &l->items[l->count];
+    item->spec = *spec;
+    if(NULL == (item->path = ssi_strdup(&l->ctx, path, 0))) {
+        return -1;
+    }
+    l->count++;
+    return 0;
+}
+
+/// @brief reads a manifest, each line being '<spec> <file>'. Blank lines and lines starting
+///        with '#' are skipped. ssi-corpus writes its corpus list in this form
+/// @return 0 on success, -1 if out of memory, -2 if the file can't be read, -3 on a bad line
+static int read_manifest(pack_list_t *l, const char *fn) {
+    int rval = 0;
+    FILE *fp = NULL;
+    char line[MAX_LINE];
+    int num = 0;
+
+    if(NULL == (fp = fopen(fn, "r"))) {
+        return -2;
+    }
+    while((0 == rval) && (NULL != fgets(line, sizeof(line), fp))) {
+        num++;
+        line[strcspn(line, "\r\n")] = 0;
+        char *word = line + strspn(line, " \t");
+        if((0 == *word) || ('#' == *word)) {
+            continue;
+        }
+
+        char *fields[3] = {NULL};
+        int n = 0;
+        for(char *tok = strtok(word, " \t"); (NULL != tok) && (n < 3); tok = strtok(NULL, " \t")) {
+            fields[n++] = tok;
+        }
+        conv_spec_t spec;
+        if((2 != n) || (0 != parse_spec(&spec, fields[0]))) {
+            printf("%s:%d: expected '<spec> <file>'\n", fn, num);
+            rval = -3;
+            break;
+        }
+        if(-3 == (rval = add_item(l, &spec, fields[1]))) {
+            printf("%s:%d: '%s' isn't an image resolution\n", fn, num, fields[0]);
+        }
+    }
+    fclose_s(fp);
+    return rval;
+}
+
+int main(int argc, char *argv[]) {
+    int rval = -1;
+    pack_list_t list = {0};
+    pack_writer_t pw = {0};
+    ssi_ctx_t ctx = {0};    // buffers for the archive writer
+    const char *manifest = NULL;
+    const char *archive = NULL;
+    uint32_t align = PACK_ALIGN_DEFAULT;
+    int level = 0;
+    size_t raw_bytes = 0;
+    bool created = false;   // true once the archive has been created
+
+    printf("SSI-IMG archive packer\n");
+
+    if(0 != trace_args(&argc, argv)) { // --stats and --trace can go anywhere
+        return -1;
+    }
+
+    // pull out any options, they come ahead of the other parameters
+    char *prog = argv[0];
+    while((argc > 2) && ('-' == argv[1][0])) {
+        if(0 == strcmp(argv[1], "-a")) {
+            align = strtoul(argv[2], NULL, 0);
+        } else if(0 == strcmp(argv[1], "-z")) {
+            level = atoi(argv[2]);
+        } else if(0 == strcmp(argv[1], "-m")) {
+            manifest = argv[2];
+        } else {
+            printf("Unknown option '%s'\n", argv[1]);
+            return -1;
+        }
+        argv += 2; argc -= 2; // consume the option and its value
+        argv[0] = prog;
+    }
+
+    if((argc < 2) || ((argc < 4) && (NULL == manifest))) {
+        printf("USAGE: %s <-a align> <-z level> <-m manifest> [archive] <spec> <files...>\n", filename(argv[0]));
+        printf("[archive] is the name of the archive to create\n");
+        printf("<spec> is the resolution of the files given on the command line, as for img2bmp\n");
+        printf("   eg '320x200c'\n");
+        printf("<files...> are the names of the IMG files to pack, they are stored by file name\n");
+        printf("   so the names have to be unique, and shorter than %d characters\n", PACK_NAME_MAX);
+        printf("-a sets the alignment of the images in the archive, a power of 2, by default %d\n", PACK_ALIGN_DEFAULT);
+        printf("-z compresses the images, at a level from 1 fastest to 9 smallest. Compressed\n");
+        printf("   images can't be read in place, by default they are stored uncompressed\n");
+        printf("-m reads a manifest, each line being '<spec> <file>', as ssi-corpus writes\n");
+        printf("--stats and --trace <file> can be given anywhere, to report the time taken by each stage\n");
+        printf("   and to append a Chrome trace of this run to <file> (view it with Perfetto)\n");
+        return -1;
+    }
+    archive = argv[1];
+    if((0 == align) || (0 != (align & (align - 1)))) {
+        printf("Alignment has to be a power of 2\n");
+        return -1;
+    }
+    if((level < 0) || (level > 9)) {
+        printf("Compression level has to be 0 to 9\n");
+        return -1;
+    }
+
+    // gather up all the images
+    if(argc >= 3) {
+        conv_spec_t spec;
+        if((0 != parse_spec(&spec, argv[2])) || !spec.to_bmp) {
+            printf("Invalid resolution specificaton '%s'\n", argv[2]);
+            goto CLEANUP;
+        }
+        for(int i = 3; i < argc; i++) {
+            if(0 != add_item(&list, &spec, argv[i])) {
+                printf("Unable to allocate memory\n");
+                goto CLEANUP;
+            }
+        }
+    }
+    if((NULL != manifest) && (0 != read_manifest(&list, manifest))) {
+        printf("Error: Unable to read manifest '%s'\n", manifest);
+        goto CLEANUP;
+    }
+    if(0 == list.count) {
+        printf("No files to pack\n");
+        goto CLEANUP;
+    }
+
+    // the index is sized up front, so every image has to be added
+    printf("Creating archive: '%s'\n", archive);
+    if(0 != pack_create(&ctx, &pw, archive, list.count, align, level)) {
+        printf("Error: Unable to create archive\n");
+        goto CLEANUP;
+    }
+    created = true;
+    for(size_t i = 0; i < list.count; i++) {
+        item_t *item = &list.items[i];
+        mapped_file_t src = {0};
+        if(0 != map_file(&src, item->path, true)) {
+            printf("Error: Unable to read '%s'\n", item->path);
+            goto CLEANUP;
+        }
+        int err = -3;
+        if(src.buf.len == img_file_size(item->spec.format, item->spec.width, item->spec.height)) {
+            err = pack_add(&pw, filename(item->path), item->spec.format, item->spec.width,
+                           item->spec.height, item->spec.pal_sel, &src.buf);
+        }
+        raw_bytes += src.buf.len;
+        unmap_file(&src);
+        if(-3 == err) {
+            printf("Error: '%s' doesn't match the resolution given\n", item->path);
+            goto CLEANUP;
+        } else if(-1 == err) {
+            printf("Error: Unable to store '%s' by that name\n", item->path);
+            goto CLEANUP;
+        } else if(0 != err) {
+            printf("Error: Unable to write archive\n");
+            goto CLEANUP;
+        }
+    }
+
+    uint64_t archive_bytes = pw.pos;
+    rval = pack_finish(&pw);
+    if(-6 == rval) {
+        printf("Error: Two images have the same file name\n");
+        goto CLEANUP;
+    } else if(0 != rval) {
+        printf("Error: Unable to write archive\n");
+        goto CLEANUP;
+    }
+
+    printf("Packed %zu images, %zu bytes into %llu bytes\n", list.count, raw_bytes,
+           (unsigned long long)archive_bytes);
+    rval = 0; // clean exit
+CLEANUP:
+    if(created && (0 != rval)) { // didn't finish, don't leave a partial archive
+        pack_finish(&pw);
+        remove(archive);
+    }
+    free_s(list.items);
+    ssi_ctx_free(&list.ctx);
+    ssi_ctx_free(&ctx);
+    trace_report();
+    return rval;
+}
@@ -0,0 +1,186 @@
+/*
+ * ssi-unpack.c
+ * Lists or extracts the images in an archive made by ssi-pack, either as the
+ * original IMG files or converted to BMP
+ *
+ * The archive is mapped once, and stored images are converted straight from
+ * the mapping without being copied out first.
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "ssi-img.h"
+#include "ssi-ctx.h"
+#include "convert.h"
+#include "pack.h"
+#include "util.h"
+
+/// @brief writes out an image as it was packed
+/// @return 0 on success, -5 if the file can't be written
+static int write_img(const char *fn, const memstream_buf_t *img) {
+    int rval = 0;
+    FILE *fp = NULL;
+
+    if(NULL == (fp = fopen(fn, "wb"))) {
+        return -5;
+    }
+    if(1 != fwrite(img->data, img->len, 1, fp)) {
+        rval = -5;
+    }
+    if(0 != fclose(fp)) {
+        rval = -5;
+    }
+    return rval;
+}
+
+/// @brief extracts a single image, all memory comes from the context
+/// @param ctx context to allocate from, the caller resets it between images
+/// @param pk the open archive
+/// @param e the image to extract
+/// @param outdir directory to extract to
+/// @param to_bmp true to convert the image to BMP, false to write it out as is
+/// @return 0 on success, otherwise an error code as convert_file()
+static int extract(ssi_ctx_t *ctx, const pack_reader_t *pk, const pack_entry_t *e, const char *outdir, bool to_bmp) {
+    int rval = 0;
+    memstream_buf_t img = {0, 0, NULL};
+    char *fo_name = NULL;
+
+    size_t len = strlen(outdir) + 1 + strlen(e->name) + 4;
+    if(NULL == (fo_name = ssi_alloc(ctx, len + 1))) {
+        return -4;
+    }
+    snprintf(fo_name, len + 1, "%s/%s", outdir, e->name);
+
+    // a view of the mapping if stored, otherwise decompressed
+    if(0 != (rval = pack_load(ctx, pk, e, &img))) {
+        rval = (-3 == rval) ? -3 : -4;
+        goto CLEANUP;
+    }
+    if(to_bmp) {
+        conv_spec_t spec = {0};
+        spec.to_bmp = true;
+        spec.format = e->format;
+        spec.width = e->width;
+        spec.height = e->height;
+        spec.pal_sel = e->pal_sel;
+        drop_extension(filename(fo_name)); // remove exisiting extension
+        strcat(fo_name, spec_extension(&spec));
+        rval = convert_img_buf(ctx, &spec, &img, fo_name);
+    } else {
+        rval = write_img(fo_name, &img);
+    }
+
+CLEANUP:
+    pack_release(ctx, e, &img);
+    return rval;
+}
+
+int main(int argc, char *argv[]) {
+    int rval = -1;
+    pack_reader_t pk = {0};
+    ssi_ctx_t ctx = {0};    // per image buffers, reset after each
+    const char *outdir = ".";
+    bool list = false;
+    bool to_bmp = false;
+    int failed = 0;
+
+    printf("SSI-IMG archive unpacker\n");
+
+    if(0 != trace_args(&argc, argv)) { // --stats and --trace can go anywhere
+        return -1;
+    }
+
+    // pull out any options, they come ahead of the other parameters
+    char *prog = argv[0];
+    while((argc > 1) && ('-' == argv[1][0])) {
+        int used = 1;
+        if(0 == strcmp(argv[1], "-l")) {
+            list = true;
+        } else if(0 == strcmp(argv[1], "-b")) {
+            to_bmp = true;
+        } else if((0 == strcmp(argv[1], "-o")) && (argc > 2)) {
+            outdir = argv[2];
+            used = 2;
+        } else {
+            printf("Unknown option '%s'\n", argv[1]);
+            return -1;
+        }
+        argv += used; argc -= used; // consume the option and any value
+        argv[0] = prog;
+    }
+
+    if(argc < 2) {
+        printf("USAGE: %s <-l> <-b> <-o outdir> [archive] <names...>\n", filename(argv[0]));
+        printf("[archive] is the name of an archive made by ssi-pack\n");
+        printf("<names...> are the images to extract, by default all of them\n");
+        printf("-l lists the images rather than extracting them\n");
+        printf("-b converts the images to BMP, rather than extracting the IMG files as they were packed\n");
+        printf("-o puts the extracted files in the given directory, creating it if need be\n");
+        printf("--stats and --trace <file> can be given anywhere, to report the time taken by each stage\n");
+        printf("   and to append a Chrome trace of this run to <file> (view it with Perfetto)\n");
+        return -1;
+    }
+
+    int err = pack_open(&pk, argv[1]);
+    if(-3 == err) {
+        printf("Error: '%s' isn't a valid archive\n", argv[1]);
+        goto CLEANUP;
+    } else if(0 != err) {
+        printf("Error: Unable to read archive '%s'\n", argv[1]);
+        goto CLEANUP;
+    }
+
+    if(list) {
+        printf("%-40s %-6s %9s %10s %10s\n", "name", "format", "size", "bytes", "stored");
+        for(uint32_t i = 0; i < pk.count; i++) {
+            const pack_entry_t *e = &pk.index[i];
+            char res[16];
+            snprintf(res, sizeof(res), "%ux%u", e->width, e->height);
+            printf("%-40s %-6s %9s %10u %10u%s\n", e->name, pack_format_name(e->format), res,
+                   e->raw_size, e->size, (PACK_STORED == e->method) ? "" : " (zlib)");
+        }
+        printf("%u images\n", pk.count);
+        rval = 0;
+        goto CLEANUP;
+    }
+
+    if(0 != make_dir(outdir)) {
+        printf("Unable to create directory '%s'\n", outdir);
+        goto CLEANUP;
+    }
+
+    // either the images asked for by name, or the whole archive
+    uint32_t count = (argc > 2) ? (uint32_t)(argc - 2) : pk.count;
+    for(uint32_t i = 0; i < count; i++) {
+        const pack_entry_t *e = (argc > 2) ? pack_find(&pk, argv[2 + i]) : &pk.index[i];
+        if(NULL == e) {
+            printf("%s: not in the archive\n", argv[2 + i]);
+            failed++;
+            continue;
+        }
+        err = extract(&ctx, &pk, e, outdir, to_bmp);
+        if(0 != err) {
+            printf("%s: %s\n", e->name, convert_error(err));
+            failed++;
+        }
+        ssi_ctx_reset(&ctx); // the next image reuses the same memory
+    }
+
+    printf("Extracted %u images", count - failed);
+    if(failed) {
+        printf(", %d failed", failed);
+    }
+    printf("\n");
+    rval = failed ? -1 : 0;
+CLEANUP:
+    pack_close(&pk);
+    ssi_ctx_free(&ctx);
+    trace_report();
+    return rval;
+}
@@ -0,0 +1,70 @@
+/*
+ * ssi-ctx.h
+ * a reusable conversion context that owns the scratch, frame and palette
+ * buffers used while converting images, so converting many files costs a
+ * constant number of allocations
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef SSI_CTX
+#define SSI_CTX
+
+// a block of arena memory, allocations are carved from the front
+typedef struct arena_block {
+    struct arena_block *next;   // previously filled block
+    size_t              size;   // usable bytes in this block
+    size_t              used;   // bytes handed out so far
+} arena_block_t;
+
+// conversion context, all memory handed out stays valid until the next reset
+typedef struct {
+    arena_block_t   *head;      // current block, older blocks chained behind it
+    size_t          total;      // bytes in all blocks
+    size_t          used;       // bytes handed out since the last reset
+    size_t          peak;       // most bytes in use at once since init
+} ssi_ctx_t;
+
+/// @brief sets up a conversion context
+/// @param ctx pointer to the context
+/// @param reserve bytes to allocate up front, 0 to allocate on first use
+/// @return 0 on success, -1 if out of memory
+int ssi_ctx_init(ssi_ctx_t *ctx, size_t reserve);
+
+/// @brief releases everything allocated from the context so the memory can be reused for the
+///        next conversion. If the arena had to grow it is merged into one block large enough
+///        for the peak use, so steady state conversions don't allocate at all
+/// @param ctx pointer to the context
+void ssi_ctx_reset(ssi_ctx_t *ctx);
+
+/// @brief frees all memory owned by the context
+/// @param ctx pointer to the context
+void ssi_ctx_free(ssi_ctx_t *ctx);
+
+/// @brief allocates memory, 16 byte aligned and NOT zeroed. If ctx is NULL the memory comes
+///        from malloc and must be given back with ssi_release()
+/// @param ctx pointer to the context, or NULL
+/// @param len number of bytes to allocate
+/// @return pointer to the memory, or NULL if out of memory
+void *ssi_alloc(ssi_ctx_t *ctx, size_t len);
+
+/// @brief as ssi_alloc() but the memory is zeroed
+void *ssi_zalloc(ssi_ctx_t *ctx, size_t len);
+
+/// @brief copies a string into memory allocated as ssi_alloc()
+/// @param ctx pointer to the context, or NULL
+/// @param str string to copy
+/// @param extra additional bytes to reserve after the string, eg for appending an extension
+/// @return pointer to the copy, or NULL if out of memory
+char *ssi_strdup(ssi_ctx_t *ctx, const char *str, size_t extra);
+
+/// @brief gives back memory from ssi_alloc(), this is a no-op for a context as its memory is
+///        only reclaimed by ssi_ctx_reset()
+/// @param ctx pointer to the context the memory came from, or NULL
+/// @param ptr pointer to the memory
+void ssi_release(ssi_ctx_t *ctx, void *ptr);
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * ssi-diff.h
+ * compares two images of the same layout and size without decoding either,
+ * the packed planes or CGA lines are XORed a 64 bit word at a time and the
+ * differing pixels counted from the set bits, giving the number changed, where
+ * each row changed and optionally a mask of them
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include "memstream.h"
+#include "ssi-img.h"
+
+#ifndef SSI_DIFF
+#define SSI_DIFF
+
+// the pixels of a row that differ
+typedef struct {
+    uint16_t    first;      // left most pixel that differs
+    uint16_t    last;       // right most pixel that differs, less than first if none do
+} diff_span_t;
+
+// what differs between two images
+typedef struct {
+    uint64_t    changed;    // number of pixels that differ
+    uint64_t    pixels;     // number of pixels compared, those the layout holds
+    uint16_t    rows;       // number of rows with any pixel that differs
+    uint16_t    x0, y0;     // top left of the box around every pixel that differs
+    uint16_t    x1, y1;     // bottom right, inclusive. All 0 if nothing differs
+} img_diff_t;
+
+/// @brief compares two images, rows are laid out as img_read_line() reads them, so any pixels
+///        the layout doesn't hold are the same in both. nothing is allocated
+/// @param format // image data layout of both images. The Amiga palette isn't compared
+/// @param a memstream buffer holding the first image, at least img_file_size() bytes
+/// @param b memstream buffer holding the second image, at least img_file_size() bytes
+/// @param width  // image width
+/// @param height // image height
+/// @param st filled in with what differs
+/// @param spans filled in with the pixels that differ in each row, height entries, may be NULL
+/// @param mask filled in with 1 byte per pixel, 1 where they differ and 0 where they don't, at
+///        least img_decoded_size() bytes, pos is set to the number of bytes written. may be NULL
+/// @return 0 on success, -1 on bad parameters, -2 if a or b is too small, -3 if mask is too small
+int img_diff(img_format_t format, const memstream_buf_t *a, const memstream_buf_t *b,
+             uint16_t width, uint16_t height, img_diff_t *st, diff_span_t *spans, memstream_buf_t *mask);
+
+#endif
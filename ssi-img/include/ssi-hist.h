@@ -0,0 +1,32 @@
+/*
+ * ssi-hist.h
+ * counts how often each colour is used in an image without decoding it. The
+ * planes are combined a 64 bit word at a time, each colour being the AND of
+ * the planes or their inverses that make it up, and its pixels counted from
+ * the set bits. CGA pixels are counted from each pair of bits
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include "memstream.h"
+#include "ssi-img.h"
+
+#ifndef SSI_HIST
+#define SSI_HIST
+
+#define HIST_BINS (16)  // one for each colour, CGA images only use the first 4
+
+/// @brief counts the pixels of each colour in an image, only the pixels the layout holds are
+///        counted, those img_read_line() fills in as 0 aren't. nothing is allocated
+/// @param format // image data layout
+/// @param src memstream buffer holding the image, at least img_file_size() bytes
+/// @param width  // image width
+/// @param height // image height
+/// @param counts filled in with the number of pixels of each colour, HIST_BINS entries
+/// @return 0 on success, -1 on bad parameters, -2 if src is too small
+int img_histogram(img_format_t format, const memstream_buf_t *src, uint16_t width, uint16_t height,
+                  uint64_t *counts);
+
+#endif
@@ -1,20 +1,80 @@
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include "memstream.h"
+#include "pal.h"
+#include "ssi-ctx.h"
 
+#ifndef SSI_IMG
+#define SSI_IMG
+
+#define AMIGA_PAL_SZ (64) // the palette block following an Amiga framebuffer
+
+// the flavours of SSI image data
+typedef enum {
+    IMG_EGA,    // 16 colour, 4 full planes one after the other
+    IMG_BIN,    // 16 colour, 4 planes interleaved line by line
+    IMG_CGA,    // 4 colour, 2 bits per pixel, even and odd lines in separate blocks
+    IMG_AMIGA   // as IMG_EGA, followed by a 16 entry 12 bit palette
+} img_format_t;
+
+// byte order of true colour pixels
+typedef enum {
+    RGB_RGB24,  // R, G, B
+    RGB_BGR24,  // B, G, R as 24 bit BMP files store them
+    RGB_RGBA32, // R, G, B, A with A always 255
+    RGB_BGRA32  // B, G, R, A as 32 bit BMP files store them, A always 255
+} rgb_format_t;
+
+// how a thumbnail pixel is chosen from the box of image pixels it covers
+typedef enum {
+    THUMB_NEAREST,  // the top left pixel, only those pixels are read
+    THUMB_MAJORITY  // the most common colour in the box
+} thumb_filter_t;
+
+// how lines are stretched for display, the frames were shown on 4:3 monitors
+typedef enum {
+    SCALE_NONE,     // as stored
+    SCALE_DOUBLE,   // every line twice, eg 640x200 to 640x400
+    SCALE_ASPECT    // lines stretched to give a 4:3 frame, eg 320x200 to 320x240
+} line_scale_t;
+
+// maps the lines of a stretched image back to the lines of the image, in 16.16 fixed point
+typedef struct {
+    uint32_t    step;       // image lines per output line
+    uint16_t    height;     // image height in pixels
+    uint16_t    out_height; // stretched height in pixels
+} line_scaler_t;
+
+// state for reading an SSI image file one line at a time
+typedef struct {
+    FILE            *fp;         // the open image file
+    img_format_t    format;      // image data layout
+    uint16_t        width;       // image width in pixels
+    uint16_t        height;      // image height in pixels
+    size_t          size;        // expected file size
+    uint8_t         *buf;        // raw bytes of the current line
+    pal_entry_t     pal[16];     // Amiga palette, 4 bits per component
+    ssi_ctx_t       *ctx;        // context the line buffer came from, NULL if malloc'd
+} img_reader_t;
 
 /// @brief converts a planerized image to a linear one, assumes 16 colour 4 bits per pixel
 /// @param dst memstream buffer pointing to buffer large enough for 1 byte per pixel
 /// @param src memstream buffer pointing to a buffer containing the packed planar image
 void pln2lin(memstream_buf_t *dst, memstream_buf_t *src);
 
-/// @brief converts an interleaved planerized image to a linear one, assumes 16 colour 4 bits per pixel
+/// @brief converts an interleaved planerized image to a linear one, assumes 16 colour 4 bits per pixel.
+///        Each line is width / 2 bytes with plane k at k * (width / 8), and fills its own width
+///        pixels of dst, the pixels past the last whole plane byte being 0
 /// @param dst memstream buffer pointing to buffer large enough for 1 byte per pixel
 /// @param src memstream buffer pointing to a buffer containing the packed planar image
 /// @param width  // image width
 /// @param height // inmage height
 void ipln2lin(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height);
 
-/// @brief converts a interleved image to a linear one, assumes 4 colour 2 bits per pixel
+/// @brief converts a interleved image to a linear one, assumes 4 colour 2 bits per pixel.
+///        Each line is width / 4 bytes and fills its own width pixels of dst, the pixels past
+///        the last whole byte being 0
 /// @param dst memstream buffer pointing to buffer large enough for 1 byte per pixel
 /// @param src memstream buffer pointing to a buffer containing the packed planar image
 void lace2lin(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height);
@@ -24,16 +84,306 @@ void lace2lin(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16
 /// @param src memstream buffer pointing to a buffer containing the unpacked linear image (1 byte per pixel)
 void lin2pln(memstream_buf_t *dst, memstream_buf_t *src);
 
-/// @brief converts a linear image to an interleaved planerized one, assumes 16 colour 4 bits per pixel
+/// @brief converts a linear image to an interleaved planerized one, assumes 16 colour 4 bits per pixel,
+///        laid out a line at a time as ipln2lin() reads it
 /// @param dst memstream buffer pointing to buffer large enough for packed planar image (4 bits per pixel)
 /// @param src memstream buffer pointing to a buffer containing the unpacked linear image (1 byte per pixel)
 /// @param width  // image width
 /// @param height // inmage height
 void lin2ipln(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height);
 
-/// @brief converts the image form a linear one to a interleved and packed one, assumes 2 bits per pixel
+/// @brief converts the image form a linear one to a interleved and packed one, assumes 2 bits per pixel,
+///        laid out a line at a time as lace2lin() reads it
 /// @param dst // destination buffer for the packed image, expected to be 16384 bytes
 /// @param src // buffer containing the unpacked source image, 1 byte per pixel
 /// @param width  // image width
 /// @param height // inmage height
 void lin2lace(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height);
+
+/// @brief returns the number of bytes per line of a 16 colour BMP image, padded to 32 bits
+/// @param width  // image width
+size_t bmp4_stride(uint16_t width);
+
+/// @brief returns the size of the pixel data of a 16 colour BMP image
+/// @param width  // image width
+/// @param height // image height
+size_t bmp4_size(uint16_t width, uint16_t height);
+
+/// @brief converts a planerized image straight to 16 colour BMP pixel data, bottom up with padded lines
+/// @param dst memstream buffer pointing to a buffer of at least bmp4_size() bytes
+/// @param src memstream buffer pointing to a buffer containing the packed planar image
+/// @param width  // image width
+/// @param height // image height
+/// @return 0 on success, -1 if either buffer is too small
+int pln2bmp4(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height);
+
+/// @brief converts an interleaved planerized image straight to 16 colour BMP pixel data, bottom up with padded lines
+/// @param dst memstream buffer pointing to a buffer of at least bmp4_size() bytes
+/// @param src memstream buffer pointing to a buffer containing the packed planar image
+/// @param width  // image width
+/// @param height // image height
+/// @return 0 on success, -1 if either buffer is too small
+int ipln2bmp4(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height);
+
+/// @brief converts a interleved CGA image straight to 16 colour BMP pixel data, bottom up with padded lines
+/// @param dst memstream buffer pointing to a buffer of at least bmp4_size() bytes
+/// @param src memstream buffer pointing to a buffer containing the packed CGA image
+/// @param width  // image width
+/// @param height // image height
+/// @return 0 on success, -1 if either buffer is too small
+int lace2bmp4(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height);
+
+/// @brief packs a line of 16 colour BMP pixel data into its place in a planerized image
+/// @param dst memstream buffer pointing to the packed planar image, (width * height) / 2 bytes
+/// @param line pointer to the BMP pixel data for the line, 2 pixels per byte
+/// @param y      // image line, 0 being the top
+/// @param width  // image width
+/// @param height // image height
+/// @return 0 on success, -1 if the line is outside the image or the buffer is too small
+int bmp42pln(memstream_buf_t *dst, const uint8_t *line, uint16_t y, uint16_t width, uint16_t height);
+
+/// @brief packs a line of 16 colour BMP pixel data into its place in an interleaved planerized image
+/// @param dst memstream buffer pointing to the packed planar image, (width * height) / 2 bytes
+/// @param line pointer to the BMP pixel data for the line, 2 pixels per byte
+/// @param y      // image line, 0 being the top
+/// @param width  // image width
+/// @param height // image height
+/// @return 0 on success, -1 if the line is outside the image or the buffer is too small
+int bmp42ipln(memstream_buf_t *dst, const uint8_t *line, uint16_t y, uint16_t width, uint16_t height);
+
+/// @brief packs a line of 16 colour BMP pixel data into its place in an interleved CGA image
+/// @param dst memstream buffer pointing to the packed CGA image, expected to be 16384 bytes
+/// @param line pointer to the BMP pixel data for the line, 2 pixels per byte
+/// @param y      // image line, 0 being the top
+/// @param width  // image width
+/// @param height // image height
+/// @return 0 on success, -1 if the line is outside the image or the buffer is too small
+int bmp42lace(memstream_buf_t *dst, const uint8_t *line, uint16_t y, uint16_t width, uint16_t height);
+
+/// @brief returns the name of the conversion kernel backend in use (eg "avx2", "sse2", "lut", "scalar")
+///        the backend is selected on first use based on the host CPU, or the SSI_IMG_BACKEND
+///        environment variable if set
+/// @return name of the active backend
+const char *ssi_backend(void);
+
+/// @brief forces the conversion kernels to use a specific backend. The backend is read without
+///        locking, so call this before starting any threads that use the codecs. Without it
+///        the first use, from any thread, picks the backend safely
+/// @param name name of the backend to use
+/// @return 0 on success, -1 if no such backend exists, -2 if the host CPU can't run it
+int ssi_set_backend(const char *name);
+
+/// @brief loads and de-interlaces a CGA image file to 1 byte per pixel
+/// @param ctx context to allocate the frame buffer from, or NULL to use malloc
+/// @param dst memstream buffer for the image, if its data is NULL a buffer of width * height
+///        bytes is allocated, otherwise it must be large enough for the image
+/// @param fn name of file to load
+/// @param width  // image width
+/// @param height // image height
+/// @return 0 on success, -1 if the file can't be read, is the wrong size, or out of memory
+int load_cga_img_ctx(ssi_ctx_t *ctx, memstream_buf_t *dst, const char *fn, int width, int height);
+int load_cga_img(memstream_buf_t *dst, const char *fn, int width, int height);
+
+/// @brief loads and deplanes an EGA image file to 1 byte per pixel
+/// @param ctx context to allocate the frame buffer from, or NULL to use malloc
+/// @param dst memstream buffer for the image, allocated if its data is NULL as load_cga_img_ctx()
+/// @param fn name of file to load
+/// @param width  // image width
+/// @param height // image height
+/// @return 0 on success, -1 if the file can't be read, is the wrong size, or out of memory
+int load_ega_img_ctx(ssi_ctx_t *ctx, memstream_buf_t *dst, const char *fn, int width, int height);
+int load_ega_img(memstream_buf_t *dst, const char *fn, int width, int height);
+
+/// @brief loads and deplanes an Amiga image file to 1 byte per pixel, along with its palette
+/// @param ctx context to allocate the frame buffer from, or NULL to use malloc
+/// @param dst memstream buffer for the image, allocated if its data is NULL as load_cga_img_ctx()
+/// @param fn name of file to load
+/// @param width  // image width
+/// @param height // image height
+/// @param pal 16 entry palette set on return, 4 bits per component
+/// @return 0 on success, -1 if the file can't be read, is the wrong size, or out of memory
+int load_amiga_img_ctx(ssi_ctx_t *ctx, memstream_buf_t *dst, const char *fn, int width, int height, pal_entry_t *pal);
+int load_amiga_img(memstream_buf_t *dst, const char *fn, int width, int height, pal_entry_t *pal);
+
+/// @brief writes a 1 byte per pixel image to a CGA image file
+/// @param ctx context to allocate the packed image from, or NULL to use malloc
+/// @param fn name of the file to create
+/// @param src memstream buffer pointing to the image, at least width * height bytes
+/// @param width  // image width
+/// @param height // image height
+/// @return 0 on success, -1 on bad parameters, -2 if the file can't be created,
+///         -3 if out of memory, -4 if the file can't be written
+int save_cga_img_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, int width, int height);
+int save_cga_img(const char *fn, memstream_buf_t *src, int width, int height);
+
+/// @brief writes a 1 byte per pixel image to an EGA image file, as save_cga_img_ctx()
+int save_ega_img_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, int width, int height);
+int save_ega_img(const char *fn, memstream_buf_t *src, int width, int height);
+
+/// @brief writes a 1 byte per pixel image and its palette to an Amiga image file, as save_cga_img_ctx()
+/// @param pal 16 entry palette, 4 bits per component
+int save_amiga_img_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, int width, int height, pal_entry_t *pal);
+int save_amiga_img(const char *fn, memstream_buf_t *src, int width, int height, pal_entry_t *pal);
+
+/// @brief reads the palette of an Amiga image, 2 bytes per entry, 4 bits per colour
+/// @param pal 16 entry palette to fill in
+/// @param raw pointer to the palette data in the file, AMIGA_PAL_SZ bytes
+void read_amiga_pal(pal_entry_t *pal, const uint8_t *raw);
+
+/// @brief returns the file size of an SSI image with the given layout and resolution, this is
+///        the encoded size img_encode() produces and img_decode() expects
+/// @param format // image data layout
+/// @param width  // image width
+/// @param height // image height
+size_t img_file_size(img_format_t format, uint16_t width, uint16_t height);
+
+/// @brief returns the size of a decoded image, 1 byte per pixel
+/// @param width  // image width
+/// @param height // image height
+size_t img_decoded_size(uint16_t width, uint16_t height);
+
+/// @brief checks an image of the given resolution can be held in the format, CGA images
+///        having to fit their lines into the fixed size file
+/// @param format // image data layout
+/// @param width  // image width
+/// @param height // image height
+/// @return true if img_encode() and img_decode() accept the resolution
+bool img_fits(img_format_t format, uint16_t width, uint16_t height);
+
+/// @brief decodes an SSI image held in memory to 1 byte per pixel, nothing is allocated
+/// @param format // image data layout
+/// @param dst memstream buffer for the image, at least img_decoded_size() bytes, pos is set
+///        to the number of bytes written
+/// @param src memstream buffer holding the encoded image, at least img_file_size() bytes
+/// @param width  // image width
+/// @param height // image height
+/// @param pal for Amiga images the 16 entry palette is read into this, 4 bits per
+///        component, may be NULL. ignored for other formats
+/// @return 0 on success, -1 on bad parameters, -2 if src is too small, -3 if dst is too small
+int img_decode(img_format_t format, memstream_buf_t *dst, const memstream_buf_t *src,
+               uint16_t width, uint16_t height, pal_entry_t *pal);
+
+/// @brief decodes just a rectangle of an SSI image held in memory to 1 byte per pixel, only the
+///        bytes of each plane or line covering the rectangle are read, so the cost follows the
+///        size of the rectangle rather than the image. Lines are laid out as img_read_line()
+///        reads them. nothing is allocated
+/// @param format // image data layout
+/// @param dst memstream buffer for the rectangle, at least img_decoded_size(w, h) bytes, w bytes
+///        per line, pos is set to the number of bytes written
+/// @param src memstream buffer holding the encoded image, at least img_file_size() bytes
+/// @param width  // image width
+/// @param height // image height
+/// @param x // left edge of the rectangle, need not be on a byte boundary
+/// @param y // top edge of the rectangle
+/// @param w // width of the rectangle
+/// @param h // height of the rectangle
+/// @param pal for Amiga images the 16 entry palette is read into this as img_decode(), may be NULL
+/// @return 0 on success, -1 on bad parameters or a rectangle outside the image, -2 if src is
+///         too small, -3 if dst is too small
+int img_decode_rect(img_format_t format, memstream_buf_t *dst, const memstream_buf_t *src,
+                    uint16_t width, uint16_t height, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                    pal_entry_t *pal);
+
+/// @brief decodes an SSI image held in memory to a thumbnail at 1/2, 1/4 or 1/8 scale, 1 byte
+///        per pixel, without decoding the whole image first. Only whole boxes are used, so any
+///        right or bottom edge narrower than a box is left out
+/// @param ctx context for the working buffers of THUMB_MAJORITY, or NULL to use malloc.
+///        THUMB_NEAREST allocates nothing
+/// @param format // image data layout
+/// @param dst memstream buffer for the thumbnail, at least (width >> shift) * (height >> shift)
+///        bytes, pos is set to the number of bytes written
+/// @param src memstream buffer holding the encoded image, at least img_file_size() bytes
+/// @param width  // image width
+/// @param height // image height
+/// @param shift // 1, 2 or 3 for 1/2, 1/4 or 1/8 scale
+/// @param filter // how each thumbnail pixel is chosen
+/// @param pal for Amiga images the 16 entry palette is read into this as img_decode(), may be NULL
+/// @return 0 on success, -1 on bad parameters, -2 if src is too small, -3 if dst is too small,
+///         -4 if out of memory
+int img_decode_thumb(ssi_ctx_t *ctx, img_format_t format, memstream_buf_t *dst, const memstream_buf_t *src,
+                     uint16_t width, uint16_t height, int shift, thumb_filter_t filter, pal_entry_t *pal);
+
+/// @brief encodes a 1 byte per pixel image to an SSI image in memory, nothing is allocated
+/// @param format // image data layout
+/// @param dst memstream buffer for the encoded image, at least img_file_size() bytes, pos is
+///        set to the number of bytes written
+/// @param src memstream buffer holding the image, at least img_decoded_size() bytes
+/// @param width  // image width
+/// @param height // image height
+/// @param pal 16 entry palette for Amiga images, 4 bits per component. ignored for other formats
+/// @return 0 on success, -1 on bad parameters, -2 if src is too small, -3 if dst is too small
+int img_encode(img_format_t format, memstream_buf_t *dst, const memstream_buf_t *src,
+               uint16_t width, uint16_t height, const pal_entry_t *pal);
+
+/// @brief returns the size of a true colour image, lines are not padded
+/// @param rgb // pixel byte order, 3 or 4 bytes per pixel
+/// @param width  // image width
+/// @param height // image height
+size_t img_rgb_size(rgb_format_t rgb, uint16_t width, uint16_t height);
+
+/// @brief expands 1 byte per pixel colour indices to true colour through a 16 entry palette
+/// @param rgb // pixel byte order to produce
+/// @param dst memstream buffer for the pixels, at least 3 or 4 bytes for each index, pos is
+///        set to the number of bytes written
+/// @param src memstream buffer holding src->len colour indices, only the low 4 bits are used.
+///        src may be the end of the dst buffer, the expansion is done in place
+/// @param pal 16 entry palette, 8 bits per component
+/// @return 0 on success, -1 on bad parameters, -3 if dst is too small
+int lin2rgb(rgb_format_t rgb, memstream_buf_t *dst, const memstream_buf_t *src, const pal_entry_t *pal);
+
+/// @brief decodes an SSI image held in memory straight to true colour pixels, top line first,
+///        nothing is allocated
+/// @param format // image data layout
+/// @param rgb // pixel byte order to produce
+/// @param dst memstream buffer for the pixels, at least img_rgb_size() bytes, pos is set to
+///        the number of bytes written
+/// @param src memstream buffer holding the encoded image, at least img_file_size() bytes
+/// @param width  // image width
+/// @param height // image height
+/// @param pal 16 entry palette, 8 bits per component. For Amiga images NULL uses the
+///        palette in the image
+/// @return 0 on success, -1 on bad parameters, -2 if src is too small, -3 if dst is too small
+int img_decode_rgb(img_format_t format, rgb_format_t rgb, memstream_buf_t *dst, const memstream_buf_t *src,
+                   uint16_t width, uint16_t height, const pal_entry_t *pal);
+
+/// @brief opens an SSI image file for reading one line at a time in any order, only a single
+///        line of data is held in memory. For Amiga images the palette is read into rd->pal
+/// @param rd pointer to the reader state to set up
+/// @param fn name of file to open
+/// @param format // image data layout
+/// @param width  // image width
+/// @param height // image height
+/// @return 0 on success, -1 on bad parameters, -2 if the file can't be opened or read,
+///         -3 if the file size doesn't match the format and resolution, -4 if out of memory
+int img_open(img_reader_t *rd, const char *fn, img_format_t format, uint16_t width, uint16_t height);
+
+/// @brief as img_open() with the line buffer allocated from a conversion context
+/// @param ctx context to allocate from, or NULL to use malloc
+int img_open_ctx(ssi_ctx_t *ctx, img_reader_t *rd, const char *fn, img_format_t format, uint16_t width, uint16_t height);
+
+/// @brief reads an image line and converts it to 16 colour BMP pixel data, 2 pixels per byte
+/// @param rd pointer to an open reader
+/// @param y image line to read, 0 being the top
+/// @param line output buffer, at least (width + 1) / 2 bytes
+/// @return 0 on success, -1 if the line is outside the image, -2 if the file can't be read
+int img_read_line(img_reader_t *rd, uint16_t y, uint8_t *line);
+
+/// @brief sets up the mapping of stretched output lines back to image lines, so each output
+///        line can be written as soon as its image line is decoded, with no stretched frame
+/// @param ls pointer to the scaler to set up
+/// @param scale // how the lines are stretched
+/// @param width  // image width
+/// @param height // image height
+/// @return the stretched height, 0 if it won't fit in 16 bits or the parameters are bad
+uint16_t line_scaler_init(line_scaler_t *ls, line_scale_t scale, uint16_t width, uint16_t height);
+
+/// @brief returns the image line an output line is taken from, the one under its centre
+/// @param ls pointer to the scaler
+/// @param y output line, 0 being the top
+uint16_t line_scaler_src(const line_scaler_t *ls, uint16_t y);
+
+/// @brief closes the image file and releases the reader resources
+/// @param rd pointer to the reader
+void img_close(img_reader_t *rd);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * ssi-once.h
+ * runs a set up function just the once, however many threads reach it at the same
+ * time, for the tables and backend choice made on first use. Threads that lose the
+ * race wait for the one running it to finish, so none see a half built table
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdbool.h>
+
+#ifndef SSI_ONCE
+#define SSI_ONCE
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ONCE_LOAD(p) _InterlockedCompareExchange((p), 0, 0)
+#define ONCE_CLAIM(p) (0 == _InterlockedCompareExchange((p), 1, 0))
+#define ONCE_DONE(p) _InterlockedExchange((p), 2)
+#else
+#define ONCE_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ONCE_CLAIM(p) __atomic_compare_exchange_n((p), &(long){0}, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define ONCE_DONE(p) __atomic_store_n((p), 2, __ATOMIC_RELEASE)
+#endif
+
+// 0 until the function is run, 1 while it runs, 2 once it has
+typedef volatile long ssi_once_t;
+#define SSI_ONCE_INIT (0)
+
+/// @brief runs fn if no call on this once has yet, otherwise waits until it has finished
+/// @param once state shared by every caller, set to SSI_ONCE_INIT to start with
+/// @param fn the set up to run
+static inline void ssi_once(ssi_once_t *once, void (*fn)(void)) {
+    if(2 == ONCE_LOAD(once)) {
+        return; // long done, the usual case
+    }
+    if(ONCE_CLAIM(once)) {
+        fn();
+        ONCE_DONE(once);
+        return;
+    }
+    while(2 != ONCE_LOAD(once)) {
+        // another thread is running it, and only ever for a moment
+    }
+}
+
+#endif
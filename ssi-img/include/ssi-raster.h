@@ -0,0 +1,81 @@
+/*
+ * ssi-raster.h
+ * raster operations, rectangle copies, transparent blits, AND/OR/XOR masks and
+ * fills, done directly on the 4 plane layouts of EGA, Amiga and BIN images, so
+ * sprites can be composed onto a background without deplaning the frame.
+ * The planes are worked on 64 pixels at a time, with the bits outside the
+ * rectangle masked off at either edge
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include "memstream.h"
+#include "ssi-img.h"
+
+#ifndef SSI_RASTER
+#define SSI_RASTER
+
+// how source pixels are combined with the destination, plane by plane
+typedef enum {
+    ROP_COPY,   // replace
+    ROP_AND,
+    ROP_OR,
+    ROP_XOR
+} raster_op_t;
+
+// a planar image to draw on or from, describes the data, nothing is allocated
+typedef struct {
+    uint8_t         *data;      // the image data, as stored in the file
+    uint16_t        width;      // image width in pixels
+    uint16_t        height;     // image height in pixels
+    size_t          plane[4];   // offset of each plane in the data
+    size_t          pitch;      // bits from one line to the next within a plane
+    size_t          line_px;    // pixels each line holds, the rest read as 0 and aren't written
+    size_t          plane_px;   // pixels each plane holds
+} pln_surface_t;
+
+/// @brief describes planar image data as a surface
+/// @param s pointer to the surface to set up
+/// @param format // IMG_EGA, IMG_AMIGA or IMG_BIN, CGA images aren't planar
+/// @param buf memstream buffer holding the image, at least img_file_size() bytes
+/// @param width  // image width
+/// @param height // image height
+/// @return 0 on success, -1 on bad parameters, -2 if buf is too small
+int pln_surface(pln_surface_t *s, img_format_t format, const memstream_buf_t *buf, uint16_t width, uint16_t height);
+
+/// @brief combines a rectangle of one surface into another
+/// @param dst surface drawn on
+/// @param x // left edge of the rectangle in dst, need not be on a byte boundary
+/// @param y // top edge of the rectangle in dst
+/// @param src surface drawn from, it must not share data with dst
+/// @param sx // left edge of the rectangle in src
+/// @param sy // top edge of the rectangle in src
+/// @param w // width of the rectangle
+/// @param h // height of the rectangle
+/// @param op // how the pixels are combined
+/// @return 0 on success, -1 on bad parameters or a rectangle outside either surface
+int pln_blit(pln_surface_t *dst, uint16_t x, uint16_t y, const pln_surface_t *src,
+             uint16_t sx, uint16_t sy, uint16_t w, uint16_t h, raster_op_t op);
+
+/// @brief copies a rectangle of one surface into another, leaving the destination as it
+///        is wherever the source is the transparent colour, as pln_blit()
+/// @param key // the transparent colour, 0-15
+/// @return 0 on success, -1 on bad parameters or a rectangle outside either surface
+int pln_blit_key(pln_surface_t *dst, uint16_t x, uint16_t y, const pln_surface_t *src,
+                 uint16_t sx, uint16_t sy, uint16_t w, uint16_t h, uint8_t key);
+
+/// @brief combines a rectangle of a surface with a single colour, ROP_COPY fills it
+/// @param dst surface drawn on
+/// @param x // left edge of the rectangle, need not be on a byte boundary
+/// @param y // top edge of the rectangle
+/// @param w // width of the rectangle
+/// @param h // height of the rectangle
+/// @param colour // colour to combine, 0-15
+/// @param op // how the colour is combined
+/// @return 0 on success, -1 on bad parameters or a rectangle outside the surface
+int pln_fill(pln_surface_t *dst, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+             uint8_t colour, raster_op_t op);
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * ssi-trace.h
+ * lightweight timing spans around the stages of a conversion, the file IO,
+ * the planar conversions, palette work and BMP reading and writing, to show
+ * where the time goes. Collected per thread, and summarised or exported as a
+ * Chrome trace (viewable in Perfetto or chrome://tracing)
+ *
+ * The spans are only built in with SSI_TRACE defined, and even then cost no
+ * more than a flag check until tracing is enabled
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifndef SSI_TRACE_H
+#define SSI_TRACE_H
+
+#define TRACE_MAX_THREADS (256)         // threads beyond this aren't traced
+#define TRACE_MAX_EVENTS (1u << 20)     // events kept per thread for the trace export
+
+// the stages that are timed
+typedef enum {
+    TRACE_LOAD,         // reading a whole file in, mapped or read
+    TRACE_FREAD,
+    TRACE_FWRITE,
+    TRACE_PLN2LIN,
+    TRACE_IPLN2LIN,
+    TRACE_LACE2LIN,
+    TRACE_LIN2PLN,
+    TRACE_LIN2IPLN,
+    TRACE_LIN2LACE,
+    TRACE_PLN2BMP4,
+    TRACE_IPLN2BMP4,
+    TRACE_LACE2BMP4,
+    TRACE_BMP42IMG,     // packing a whole BMP, line by line, into an IMG
+    TRACE_PALETTE,      // building a palette
+    TRACE_SAVE_BMP4,
+    TRACE_LOAD_BMP4,
+    TRACE_DIFF,         // comparing two images
+    TRACE_HISTOGRAM,    // counting the colours of an image
+    TRACE_STAGES        // number of stages
+} trace_stage_t;
+
+// totals for a stage
+typedef struct {
+    uint64_t    calls;
+    uint64_t    total_ns;   // including any stages nested inside
+    uint64_t    max_ns;
+} trace_stat_t;
+
+extern volatile bool ssi_trace_on; // true while collecting, read by the spans
+
+#ifdef SSI_TRACE
+#define TRACE_BEGIN() (ssi_trace_on ? ssi_trace_now() : 0)
+#define TRACE_END(stage, t0) do { if(t0) ssi_trace_end((stage), (t0)); } while(0)
+#else
+#define TRACE_BEGIN() ((uint64_t)0)
+#define TRACE_END(stage, t0) ((void)(t0))
+#endif
+
+/// @brief returns true if the spans were built in, false if tracing will find nothing
+bool ssi_trace_available(void);
+
+/// @brief starts collecting, from every thread
+/// @param events true to keep each span for ssi_trace_write(), false for just the totals
+void ssi_trace_enable(bool events);
+
+/// @brief stops collecting, what was collected is kept
+void ssi_trace_disable(void);
+
+/// @brief returns a monotonic time in nanoseconds, the same clock across processes
+uint64_t ssi_trace_now(void);
+
+/// @brief records a span, called by TRACE_END
+/// @param stage the stage timed
+/// @param t0 time the span started, from ssi_trace_now()
+void ssi_trace_end(trace_stage_t stage, uint64_t t0);
+
+/// @brief returns the name of a stage, eg "pln2lin"
+const char *ssi_trace_name(trace_stage_t stage);
+
+/// @brief sums up what every thread has collected. Only call once the other threads are done
+/// @param stats filled in with TRACE_STAGES totals
+void ssi_trace_stats(trace_stat_t *stats);
+
+/// @brief prints a table of the totals for each stage that ran
+/// @param fp where to print it
+/// @param wall_ns time the whole run took, for each stage's share of it, 0 to leave it out
+void ssi_trace_print(FILE *fp, uint64_t wall_ns);
+
+/// @brief appends the spans kept by every thread to a Chrome trace in JSON array form, each
+///        run as its own process, so the traces of many runs can be gathered in the one file.
+///        Only call once the other threads are done
+/// @param fn name of the trace file, created if need be
+/// @param process name to show for this run, eg the program name
+/// @return 0 on success, -2 if the file can't be written
+int ssi_trace_write(const char *fn, const char *process);
+
+/// @brief releases everything collected
+void ssi_trace_free(void);
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * bits.h
+ * internal helpers for working on packed pixels a 64 bit word at a time, the
+ * left most pixel always being the top bit of the word
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef SSI_BITS
+#define SSI_BITS
+
+/// @brief loads n bytes, 8 at most, as the high bytes of a word, so the left most pixel is
+///        the top bit whatever the byte order of the host
+static inline uint64_t load_bits(const uint8_t *p, size_t n) {
+    uint64_t v = 0;
+#if defined(__GNUC__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    if(8 == n) {
+        memcpy(&v, p, 8);
+        return __builtin_bswap64(v);
+    }
+#endif
+    for(size_t i = 0; i < n; i++) {
+        v |= (uint64_t)p[i] << (56 - (i * 8));
+    }
+    return v;
+}
+
+/// @brief stores the high n bytes of a word, 8 at most, the reverse of load_bits()
+static inline void store_bits(uint8_t *p, uint64_t v, size_t n) {
+#if defined(__GNUC__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    if(8 == n) {
+        v = __builtin_bswap64(v);
+        memcpy(p, &v, 8);
+        return;
+    }
+#endif
+    for(size_t i = 0; i < n; i++) {
+        p[i] = v >> (56 - (i * 8));
+    }
+}
+
+/// @brief fetches n pixels, 64 at most, of a plane starting at any bit, into the top of a
+///        word with the bits below them clear. Only the bytes holding them are read
+static inline uint64_t fetch_bits(const uint8_t *p, size_t bit, size_t n) {
+    size_t b = bit / 8;
+    int sh = bit % 8;
+    size_t nb = (sh + n + 7) / 8; // 9 when 64 pixels straddle a byte boundary
+    uint64_t v = load_bits(&p[b], (nb > 8) ? 8 : nb) << sh;
+    if(nb > 8) {
+        v |= p[b + 8] >> (8 - sh);
+    }
+    return (n < 64) ? (v & ~(~0ull >> n)) : v;
+}
+
+/// @brief returns the number of set bits
+static inline int count_bits(uint64_t v) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(v);
+#else
+    v = v - ((v >> 1) & 0x5555555555555555ull);
+    v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (int)((v * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+/// @brief returns the position of the highest set bit counting from the top, v must not be 0
+static inline int lead_bits(uint64_t v) {
+#if defined(__GNUC__)
+    return __builtin_clzll(v);
+#else
+    int n = 0;
+    while(!(v & 0x8000000000000000ull)) {
+        v <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/// @brief returns the position of the lowest set bit counting from the bottom, v must not be 0
+static inline int trail_bits(uint64_t v) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int n = 0;
+    while(!(v & 1)) {
+        v >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+#endif
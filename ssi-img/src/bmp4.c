@@ -0,0 +1,156 @@
+#include "ssi-img.h"
+#include "kernels.h"
+#include "ssi-trace.h"
+#include "cga.h"
+#include <string.h>
+
+size_t bmp4_stride(uint16_t width) {
+    return (((width + 1) / 2) + 3) & (~0x0003); // 2 pixels per byte, padded to 32 bits
+}
+
+size_t bmp4_size(uint16_t width, uint16_t height) {
+    return bmp4_stride(width) * height;
+}
+
+/// @brief returns a pointer to the start of image line y in a bottom up BMP pixel buffer
+static uint8_t *bmp4_line(memstream_buf_t *dst, uint16_t width, uint16_t height, int y) {
+    return &dst->data[(size_t)(height - 1 - y) * bmp4_stride(width)];
+}
+
+int pln2bmp4(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height) {
+    size_t stride = bmp4_stride(width);
+    size_t ofs2 = ((size_t)width * height) / 4; // 1/2
+    size_t ofs1 = ofs2 / 2;                      // 1/4
+    size_t ofs3 = ofs1 + ofs2;                   // 3/4
+
+    if((dst->len < bmp4_size(width, height)) || (src->len < ofs3 + ofs1)) {
+        return -1; // buffers too small for the image
+    }
+    uint64_t t0 = TRACE_BEGIN();
+
+    const uint8_t *p0 = &src->data[0];
+    const uint8_t *p1 = &src->data[ofs1];
+    const uint8_t *p2 = &src->data[ofs2];
+    const uint8_t *p3 = &src->data[ofs3];
+
+    for(int y = 0; y < height; y++) {
+        uint8_t *line = bmp4_line(dst, width, height, y);
+        memset(line, 0, stride);
+        if(0 == (width % 8)) { // lines start on a plane byte, the common case
+            size_t ofs = (size_t)y * (width / 8);
+            kernels()->pln2nib(line, &p0[ofs], &p1[ofs], &p2[ofs], &p3[ofs], width / 8);
+        } else { // lines straddle plane bytes, so go pixel by pixel
+            size_t first = (size_t)y * width;
+            size_t last = first + width;
+            if(last > (ofs1 * 8)) last = ofs1 * 8; // only whole plane bytes hold pixels
+            if(first < last) pln2nib_bits(line, p0, p1, p2, p3, first, last - first);
+        }
+    }
+    dst->pos = bmp4_size(width, height);
+    TRACE_END(TRACE_PLN2BMP4, t0);
+    return 0;
+}
+
+int ipln2bmp4(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height) {
+    size_t stride = bmp4_stride(width);
+    size_t step = width / 2;  // bytes per line
+    size_t ofs1 = width / 8;  // bytes per plane per line
+
+    if((dst->len < bmp4_size(width, height)) || (src->len < step * height)) {
+        return -1; // buffers too small for the image
+    }
+    uint64_t t0 = TRACE_BEGIN();
+
+    for(int y = 0; y < height; y++) {
+        uint8_t *line = bmp4_line(dst, width, height, y);
+        const uint8_t *pln = &src->data[step * y];
+        memset(line, 0, stride);
+        kernels()->pln2nib(line, &pln[0], &pln[ofs1], &pln[ofs1 * 2], &pln[ofs1 * 3], ofs1);
+    }
+    dst->pos = bmp4_size(width, height);
+    TRACE_END(TRACE_IPLN2BMP4, t0);
+    return 0;
+}
+
+int lace2bmp4(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height) {
+    size_t stride = bmp4_stride(width);
+    size_t step = width / 4; // 4 pixels per byte
+
+    if((dst->len < bmp4_size(width, height)) || !cga_fits(width, height, src->len)) {
+        return -1; // buffers too small for the image
+    }
+    uint64_t t0 = TRACE_BEGIN();
+
+    for(int y = 0; y < height; y++) {
+        uint8_t *line = bmp4_line(dst, width, height, y);
+        memset(line, 0, stride);
+        if(y < (height & ~1)) { // lines always come in interleved pairs
+            size_t ofs = cga_line_ofs(y, width, src->len);
+            kernels()->lace2nib(line, &src->data[ofs], step);
+        }
+    }
+    dst->pos = bmp4_size(width, height);
+    TRACE_END(TRACE_LACE2BMP4, t0);
+    return 0;
+}
+
+int bmp42pln(memstream_buf_t *dst, const uint8_t *line, uint16_t y, uint16_t width, uint16_t height) {
+    size_t ofs2 = ((size_t)width * height) / 4; // 1/2
+    size_t ofs1 = ofs2 / 2;                      // 1/4
+    size_t ofs3 = ofs1 + ofs2;                   // 3/4
+
+    if((y >= height) || (dst->len < ofs3 + ofs1)) {
+        return -1; // line outside the image, or buffer too small
+    }
+
+    uint8_t *p0 = &dst->data[0];
+    uint8_t *p1 = &dst->data[ofs1];
+    uint8_t *p2 = &dst->data[ofs2];
+    uint8_t *p3 = &dst->data[ofs3];
+
+    if(0 == (width % 8)) { // lines start on a plane byte, the common case
+        size_t ofs = (size_t)y * (width / 8);
+        kernels()->nib2pln(&p0[ofs], &p1[ofs], &p2[ofs], &p3[ofs], line, width / 8);
+    } else { // lines straddle plane bytes, so go pixel by pixel
+        for(int x = 0; x < width; x++) {
+            size_t i = ((size_t)y * width) + x;
+            uint8_t bit = 0x80 >> (i % 8);
+            i /= 8;
+            if(i >= ofs1) break; // only whole plane bytes hold pixels
+            uint8_t px = (x & 1) ? line[x / 2] : (line[x / 2] >> 4);
+            p0[i] = (px & 0x01) ? (p0[i] | bit) : (p0[i] & ~bit);
+            p1[i] = (px & 0x02) ? (p1[i] | bit) : (p1[i] & ~bit);
+            p2[i] = (px & 0x04) ? (p2[i] | bit) : (p2[i] & ~bit);
+            p3[i] = (px & 0x08) ? (p3[i] | bit) : (p3[i] & ~bit);
+        }
+    }
+    return 0;
+}
+
+int bmp42ipln(memstream_buf_t *dst, const uint8_t *line, uint16_t y, uint16_t width, uint16_t height) {
+    size_t step = width / 2;  // bytes per line
+    size_t ofs1 = width / 8;  // bytes per plane per line
+
+    if((y >= height) || (dst->len < step * height)) {
+        return -1; // line outside the image, or buffer too small
+    }
+
+    uint8_t *pln = &dst->data[step * y];
+    kernels()->nib2pln(&pln[0], &pln[ofs1], &pln[ofs1 * 2], &pln[ofs1 * 3], line, ofs1);
+    return 0;
+}
+
+int bmp42lace(memstream_buf_t *dst, const uint8_t *line, uint16_t y, uint16_t width, uint16_t height) {
+    size_t step = width / 4; // 4 pixels per byte
+
+    if((y >= height) || !cga_fits(width, height, dst->len)) {
+        return -1; // line outside the image, or buffer too small
+    }
+    if(y >= (height & ~1)) {
+        return 0; // lines always come in interleved pairs, an odd last line is dropped
+    }
+
+    size_t ofs = cga_line_ofs(y, width, dst->len);
+    kernels()->nib2lace(&dst->data[ofs], line, step);
+    return 0;
+}
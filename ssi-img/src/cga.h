@@ -0,0 +1,36 @@
+/*
+ * cga.h
+ * internal helpers for the layout of CGA images, 4 pixels to a byte with the even
+ * lines in the first half of the file and the odd lines in the second
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifndef SSI_CGA
+#define SSI_CGA
+
+// CGA imags have a fixed size, with the odd lines starting half way in
+#define CGA_IMG_SZ (16384)
+
+/// @brief checks that both halves of a CGA image hold half of the lines
+/// @param width  // image width
+/// @param height // image height
+/// @param len size of the image data, CGA_IMG_SZ for an image file
+static inline bool cga_fits(uint16_t width, uint16_t height, size_t len) {
+    return ((size_t)(width / 4) * (height / 2)) <= (len / 2);
+}
+
+/// @brief returns the offset of a line in a CGA image, even lines are in the first half,
+///        odd lines in the second, each width / 4 bytes
+/// @param y line of the image
+/// @param width  // image width
+/// @param len size of the image data, CGA_IMG_SZ for an image file
+static inline size_t cga_line_ofs(size_t y, uint16_t width, size_t len) {
+    return ((y & 1) ? (len / 2) : 0) + ((size_t)(width / 4) * (y / 2));
+}
+
+#endif
@@ -0,0 +1,136 @@
+#include "ssi-diff.h"
+#include "ssi-raster.h"
+#include "ssi-trace.h"
+#include "bits.h"
+#include "cga.h"
+#include <string.h>
+
+// what is gathered for the row being compared
+typedef struct {
+    uint64_t    changed;    // pixels that differ
+    size_t      first;      // left most pixel that differs
+    size_t      last;       // right most pixel that differs
+    uint8_t     *mask;      // the row of the mask, NULL if not wanted
+} diff_row_t;
+
+/// @brief adds a word of flags, a set bit for each pixel that differs, to the row
+/// @param f the flags, the top bit for the left most pixel
+/// @param x the pixel the top bit is for
+/// @param shift 0 for a flag in every bit, 1 for a flag in every other bit
+static inline void diff_word(diff_row_t *r, uint64_t f, size_t x, int shift) {
+    if(0 == f) return;
+    if(0 == r->changed) {
+        r->first = x + (lead_bits(f) >> shift);
+    }
+    r->last = x + ((63 - trail_bits(f)) >> shift);
+    r->changed += count_bits(f);
+    if(NULL != r->mask) {
+        while(f) {
+            int z = lead_bits(f);
+            r->mask[x + (z >> shift)] = 1;
+            f &= ~(0x8000000000000000ull >> z);
+        }
+    }
+}
+
+/// @brief compares a row of all 4 planes, a word at a time
+/// @param bit first pixel of the row in the planes
+/// @param n number of pixels the row holds
+static void diff_planes(diff_row_t *r, const pln_surface_t *a, const pln_surface_t *b, size_t bit, size_t n) {
+    for(size_t x = 0; x < n; x += 64) {
+        size_t cn = ((n - x) > 64) ? 64 : (n - x);
+        uint64_t f = 0;
+        for(int k = 0; k < 4; k++) {
+            f |= fetch_bits(&a->data[a->plane[k]], bit + x, cn) ^ fetch_bits(&b->data[b->plane[k]], bit + x, cn);
+        }
+        diff_word(r, f, x, 0);
+    }
+}
+
+/// @brief compares a CGA line, 32 pixels a word at a time
+/// @param len number of bytes in the line
+static void diff_lace(diff_row_t *r, const uint8_t *a, const uint8_t *b, size_t len) {
+    for(size_t i = 0; i < len; i += 8) {
+        size_t nb = ((len - i) > 8) ? 8 : (len - i);
+        uint64_t v = load_bits(&a[i], nb) ^ load_bits(&b[i], nb);
+        // a flag in the high bit of each pixel if either of its bits differ
+        diff_word(r, (v | (v << 1)) & 0xaaaaaaaaaaaaaaaaull, i * 4, 1);
+    }
+}
+
+int img_diff(img_format_t format, const memstream_buf_t *a, const memstream_buf_t *b,
+             uint16_t width, uint16_t height, img_diff_t *st, diff_span_t *spans, memstream_buf_t *mask) {
+    pln_surface_t sa, sb;
+    img_diff_t d = {0};
+
+    if((NULL == a) || (NULL == b) || (NULL == a->data) || (NULL == b->data) || (NULL == st)) {
+        return -1;  // NULL pointer error
+    }
+    if((0 == width) || (0 == height) || (format > IMG_AMIGA)) {
+        return -1;
+    }
+    if((IMG_CGA == format) && !cga_fits(width, height, CGA_IMG_SZ)) {
+        return -1;
+    }
+    size_t len = img_file_size(format, width, height);
+    if((a->len < len) || (b->len < len)) {
+        return -2;  // not enough image data
+    }
+    if(NULL != mask) {
+        size_t need = img_decoded_size(width, height);
+        if((NULL == mask->data) || (mask->len < need)) {
+            return -3;  // no room for the mask
+        }
+        memset(mask->data, 0, need);
+        mask->pos = need;
+    }
+    if((IMG_CGA != format) &&
+       ((0 != pln_surface(&sa, format, a, width, height)) || (0 != pln_surface(&sb, format, b, width, height)))) {
+        return -1;
+    }
+
+    uint64_t t0 = TRACE_BEGIN();
+    for(uint16_t y = 0; y < height; y++) {
+        diff_row_t r = {0, 0, 0, (NULL != mask) ? &mask->data[(size_t)y * width] : NULL};
+        size_t n; // pixels the row holds
+        if(IMG_CGA == format) {
+            size_t step = width / 4; // 4 pixels per byte
+            n = (y < (height & ~1)) ? (step * 4) : 0; // lines always come in interleved pairs
+            if(n) {
+                size_t ofs = cga_line_ofs(y, width, CGA_IMG_SZ);
+                diff_lace(&r, &a->data[ofs], &b->data[ofs], step);
+            }
+        } else {
+            size_t bit = (size_t)y * sa.pitch;
+            n = 0;
+            if(bit < sa.plane_px) { // only whole plane bytes hold pixels
+                n = ((bit + sa.line_px) > sa.plane_px) ? (sa.plane_px - bit) : sa.line_px;
+            }
+            if(n) {
+                diff_planes(&r, &sa, &sb, bit, n);
+            }
+        }
+        d.pixels += n;
+
+        if(NULL != spans) {
+            spans[y].first = r.changed ? (uint16_t)r.first : 1;
+            spans[y].last = r.changed ? (uint16_t)r.last : 0;
+        }
+        if(0 == r.changed) continue;
+
+        if(0 == d.changed) { // the first row that differs
+            d.x0 = r.first;
+            d.x1 = r.last;
+            d.y0 = y;
+        }
+        if(r.first < d.x0) d.x0 = r.first;
+        if(r.last > d.x1) d.x1 = r.last;
+        d.y1 = y;
+        d.rows++;
+        d.changed += r.changed;
+    }
+    TRACE_END(TRACE_DIFF, t0);
+
+    *st = d;
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "ssi-hist.h"
+#include "ssi-raster.h"
+#include "ssi-trace.h"
+#include "bits.h"
+#include "cga.h"
+#include <string.h>
+
+/// @brief counts the colours of a run of pixels of all 4 planes, a word at a time
+/// @param bit first pixel of the run in the planes
+/// @param n number of pixels
+static void hist_planes(uint64_t *counts, const pln_surface_t *s, size_t bit, size_t n) {
+    for(size_t x = 0; x < n; x += 64) {
+        size_t cn = ((n - x) > 64) ? 64 : (n - x);
+        uint64_t m = (64 == cn) ? ~0ull : ~(~0ull >> cn); // just the pixels of the run
+        // each level splits the pixels by the next plane, so level k holds the 2^k colours
+        // made from the planes so far, 30 ANDs in all rather than 64
+        uint64_t c[HIST_BINS];
+        c[0] = m;
+        for(int k = 0; k < 4; k++) {
+            uint64_t p = fetch_bits(&s->data[s->plane[k]], bit + x, cn);
+            for(int i = (1 << k) - 1; i >= 0; i--) {
+                c[i + (1 << k)] = c[i] & p;
+                c[i] &= ~p;
+            }
+        }
+        for(int i = 0; i < HIST_BINS; i++) {
+            counts[i] += count_bits(c[i]);
+        }
+    }
+}
+
+/// @brief counts the colours of a CGA line, 32 pixels a word at a time
+/// @param len number of bytes in the line
+static void hist_lace(uint64_t *counts, const uint8_t *line, size_t len) {
+    for(size_t i = 0; i < len; i += 8) {
+        size_t nb = ((len - i) > 8) ? 8 : (len - i);
+        uint64_t v = load_bits(&line[i], nb);
+        uint64_t hi = v & 0xaaaaaaaaaaaaaaaaull;        // high bit of each pixel
+        uint64_t lo = (v << 1) & 0xaaaaaaaaaaaaaaaaull; // low bit, moved up alongside it
+        int c3 = count_bits(hi & lo);
+        int c2 = count_bits(hi) - c3;
+        int c1 = count_bits(lo) - c3;
+        counts[3] += c3;
+        counts[2] += c2;
+        counts[1] += c1;
+        counts[0] += (nb * 4) - c3 - c2 - c1;
+    }
+}
+
+int img_histogram(img_format_t format, const memstream_buf_t *src, uint16_t width, uint16_t height,
+                  uint64_t *counts) {
+    pln_surface_t s;
+
+    if((NULL == src) || (NULL == src->data) || (NULL == counts)) {
+        return -1;  // NULL pointer error
+    }
+    if((0 == width) || (0 == height) || (format > IMG_AMIGA)) {
+        return -1;
+    }
+    if((IMG_CGA == format) && !cga_fits(width, height, CGA_IMG_SZ)) {
+        return -1;
+    }
+    if(src->len < img_file_size(format, width, height)) {
+        return -2;  // not enough image data
+    }
+    if((IMG_CGA != format) && (0 != pln_surface(&s, format, src, width, height))) {
+        return -1;
+    }
+
+    uint64_t t0 = TRACE_BEGIN();
+    memset(counts, 0, HIST_BINS * sizeof(uint64_t));
+    if(IMG_CGA == format) {
+        size_t step = width / 4; // 4 pixels per byte
+        for(uint16_t y = 0; y < (height & ~1); y++) { // lines always come in interleved pairs
+            hist_lace(counts, &src->data[cga_line_ofs(y, width, CGA_IMG_SZ)], step);
+        }
+    } else if(IMG_BIN == format) { // each line holds its 4 planes in turn
+        for(uint16_t y = 0; (y < height) && s.line_px; y++) {
+            hist_planes(counts, &s, (size_t)y * s.pitch, s.line_px);
+        }
+    } else { // the lines follow on without any padding, so each plane is one run
+        hist_planes(counts, &s, 0, s.plane_px);
+    }
+    TRACE_END(TRACE_HISTOGRAM, t0);
+    return 0;
+}
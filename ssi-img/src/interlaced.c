@@ -1,60 +1,74 @@
 #include "ssi-img.h"
+#include "kernels.h"
+#include "ssi-trace.h"
+#include "cga.h"
 
-void lace2lin(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height) {
-    width /= 4;  // we expect 4 pixels per byte
-    height /= 2; // we always expect lines to be in interleved pairs
-
-    int even_pos = 0;
-    int odd_pos = src->len / 2; // 1/2
-
-    for(int y = 0; y < height; y++) {
-        // even line
-        for(int x = 0; x < width; x++) {
-            uint16_t pbuf = src->data[even_pos++];
-            for(int b = 0; b < 4; b++) { // 4 pixels per byte
-                pbuf <<= 2; // shift in the pixel
-                uint8_t px = (pbuf >> 8) & 0x03; // move it to position and mask
-                if(dst->pos < dst->len) dst->data[dst->pos++] = px; 
-            }
-        }
-        // odd line
-        for(int x = 0; x < width; x++) {
-            uint16_t pbuf = src->data[odd_pos++];
-            for(int b = 0; b < 4; b++) { // 4 pixels per byte
-                pbuf <<= 2; // shift in the pixel
-                uint8_t px = (pbuf >> 8) & 0x03; // move it to position and mask
-                if(dst->pos < dst->len) dst->data[dst->pos++] = px; 
-            }
+/// @brief unpacks n CGA bytes into dst, clipping to the space left in dst
+static void unlace(memstream_buf_t *dst, const uint8_t *src, size_t n) {
+    size_t room = (dst->pos < dst->len) ? (dst->len - dst->pos) : 0;
+    size_t bulk = (n < (room / 4)) ? n : (room / 4); // whole bytes that fit
+
+    kernels()->lace2lin(&dst->data[dst->pos], src, bulk);
+    dst->pos += bulk * 4;
+
+    // a partial byte worth of pixels may still fit at the very end
+    if((bulk < n) && (dst->pos < dst->len)) {
+        uint8_t px[4];
+        lace2lin_scalar(px, &src[bulk], 1);
+        for(int b = 0; (b < 4) && (dst->pos < dst->len); b++) {
+            dst->data[dst->pos++] = px[b];
         }
     }
 }
 
+/// @brief packs n CGA bytes from src, padding with 0 once src runs out
+static void lace(uint8_t *dst, memstream_buf_t *src, size_t n) {
+    size_t avail = (src->pos < src->len) ? (src->len - src->pos) : 0;
+    size_t bulk = (n < (avail / 4)) ? n : (avail / 4); // whole bytes available
 
-void lin2lace(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height) {
-    width /= 4;  // we expect 4 pixels per byte
-    height /= 2; // we always expect lines to be in interleved pairs
-
-    int even_pos = 0;
-    int odd_pos = dst->len / 2; // 1/2
-
-    for(int y = 0; y < height; y++) {
-        // even line
-        for(int x = 0; x < width; x++) {
-            uint8_t px = 0;
-            for(int b = 0; b < 4; b++) { // 4 pixels per byte
-                px <<= 2; // make room for the next pixel
-                px |= src->data[src->pos++] & 0x03;
-            }
-            dst->data[even_pos++] = px;
+    kernels()->lin2lace(dst, &src->data[src->pos], bulk);
+    src->pos += bulk * 4;
+
+    for(size_t i = bulk; i < n; i++) { // source exhausted, pad out the remainder
+        uint8_t px[4] = {0};
+        for(int b = 0; (b < 4) && (src->pos < src->len); b++) {
+            px[b] = src->data[src->pos++];
         }
-        // odd line
-        for(int x = 0; x < width; x++) {
-            uint8_t px = 0;
-            for(int b = 0; b < 4; b++) { // 4 pixels per byte
-                px <<= 2; // make room for the next pixel
-                px |= src->data[src->pos++] & 0x03;
-            }
-            dst->data[odd_pos++] = px;
+        lin2lace_scalar(&dst[i], px, 1);
+    }
+}
+
+void lace2lin(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height) {
+    uint64_t t0 = TRACE_BEGIN();
+    size_t step = width / 4; // 4 pixels per byte
+    size_t start = dst->pos;
+
+    // lines always come in interleved pairs, an odd last line isn't stored
+    for(int y = 0; y < (height & ~1); y++) {
+        size_t ofs = cga_line_ofs(y, width, src->len);
+        size_t end = start + ((size_t)width * (y + 1));
+        // each line is width pixels, those past its last whole byte aren't stored
+        dst->pos = end - width;
+        unlace(dst, &src->data[ofs], step);
+        while((dst->pos < end) && (dst->pos < dst->len)) {
+            dst->data[dst->pos++] = 0;
         }
     }
+    TRACE_END(TRACE_LACE2LIN, t0);
+}
+
+void lin2lace(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height) {
+    uint64_t t0 = TRACE_BEGIN();
+    size_t step = width / 4; // 4 pixels per byte
+    size_t start = src->pos;
+
+    // lines always come in interleved pairs, an odd last line is dropped
+    for(int y = 0; y < (height & ~1); y++) {
+        size_t ofs = cga_line_ofs(y, width, dst->len);
+        // each line is width pixels, those past its last whole byte aren't stored
+        src->pos = start + ((size_t)width * y);
+        lace(&dst->data[ofs], src, step);
+    }
+    src->pos = start + ((size_t)width * height);
+    TRACE_END(TRACE_LIN2LACE, t0);
 }
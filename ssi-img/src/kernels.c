@@ -0,0 +1,245 @@
+#include "ssi-img.h"
+#include "kernels.h"
+#include "ssi-once.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(SSI_X86_KERNELS) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+void pln2lin_scalar(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                    const uint8_t *p2, const uint8_t *p3, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        uint8_t b0 = p0[i];
+        uint8_t b1 = p1[i];
+        uint8_t b2 = p2[i];
+        uint8_t b3 = p3[i];
+
+        for(int b = 0; b < 8; b++) { // 8 pixels packed per byte
+            uint8_t px = 0;
+            px |= b0 & 0x80; px >>= 1;
+            px |= b1 & 0x80; px >>= 1;
+            px |= b2 & 0x80; px >>= 1;
+            px |= b3 & 0x80; px >>= 4; // final shift
+            *dst++ = px;
+            b0 <<= 1; b1 <<= 1; b2 <<= 1; b3 <<= 1; // shift in the next pixel
+        }
+    }
+}
+
+void lin2pln_scalar(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                    const uint8_t *src, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        uint8_t b0 = 0;
+        uint8_t b1 = 0;
+        uint8_t b2 = 0;
+        uint8_t b3 = 0;
+        for(int b = 0; b < 8; b++) { // 8 pixels packed per byte
+            b0 <<= 1; b1 <<= 1; b2 <<= 1; b3 <<= 1; // make room for the next pixel
+            uint8_t px = *src++;
+            b0 |= px & 0x01; px >>= 1;
+            b1 |= px & 0x01; px >>= 1;
+            b2 |= px & 0x01; px >>= 1;
+            b3 |= px & 0x01; px >>= 1; // final shift
+        }
+        p0[i] = b0;
+        p1[i] = b1;
+        p2[i] = b2;
+        p3[i] = b3;
+    }
+}
+
+void lace2lin_scalar(uint8_t *dst, const uint8_t *src, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        uint16_t pbuf = src[i];
+        for(int b = 0; b < 4; b++) { // 4 pixels per byte
+            pbuf <<= 2; // shift in the pixel
+            *dst++ = (pbuf >> 8) & 0x03; // move it to position and mask
+        }
+    }
+}
+
+void lin2lace_scalar(uint8_t *dst, const uint8_t *src, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        uint8_t px = 0;
+        for(int b = 0; b < 4; b++) { // 4 pixels per byte
+            px <<= 2; // make room for the next pixel
+            px |= *src++ & 0x03;
+        }
+        dst[i] = px;
+    }
+}
+
+void pln2nib_scalar(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                    const uint8_t *p2, const uint8_t *p3, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        uint8_t px[8];
+        pln2lin_scalar(px, &p0[i], &p1[i], &p2[i], &p3[i], 1);
+        for(int b = 0; b < 4; b++) { // 2 pixels per byte, left most in the high nibble
+            *dst++ = (px[b * 2] << 4) | px[b * 2 + 1];
+        }
+    }
+}
+
+void lace2nib_scalar(uint8_t *dst, const uint8_t *src, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        uint8_t px[4];
+        lace2lin_scalar(px, &src[i], 1);
+        *dst++ = (px[0] << 4) | px[1];
+        *dst++ = (px[2] << 4) | px[3];
+    }
+}
+
+void nib2pln_scalar(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                    const uint8_t *src, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        uint8_t px[8];
+        for(int b = 0; b < 4; b++) { // 2 pixels per byte, left most in the high nibble
+            px[b * 2] = src[b] >> 4;
+            px[b * 2 + 1] = src[b] & 0x0f;
+        }
+        lin2pln_scalar(&p0[i], &p1[i], &p2[i], &p3[i], px, 1);
+        src += 4;
+    }
+}
+
+void nib2lace_scalar(uint8_t *dst, const uint8_t *src, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        uint8_t px[4] = {src[0] >> 4, src[0] & 0x0f, src[1] >> 4, src[1] & 0x0f};
+        lin2lace_scalar(&dst[i], px, 1);
+        src += 2;
+    }
+}
+
+void lin2rgb24_scalar(uint8_t *dst, const uint8_t *src, const pal16_t *pal, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        uint8_t c = src[i] & 0x0f;
+        dst[0] = pal->chan[0][c];
+        dst[1] = pal->chan[1][c];
+        dst[2] = pal->chan[2][c];
+        dst += 3;
+    }
+}
+
+void lin2rgb32_scalar(uint8_t *dst, const uint8_t *src, const pal16_t *pal, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        uint8_t c = src[i] & 0x0f;
+        dst[0] = pal->chan[0][c];
+        dst[1] = pal->chan[1][c];
+        dst[2] = pal->chan[2][c];
+        dst[3] = pal->chan[3][c];
+        dst += 4;
+    }
+}
+
+void pln2nib_bits(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                  const uint8_t *p2, const uint8_t *p3, size_t first, size_t count) {
+    for(size_t x = 0; x < count; x++) {
+        size_t i = first + x;
+        int bit = 7 - (i % 8);
+        i /= 8;
+        uint8_t px = (((p0[i] >> bit) & 0x01) << 0) | (((p1[i] >> bit) & 0x01) << 1) |
+                     (((p2[i] >> bit) & 0x01) << 2) | (((p3[i] >> bit) & 0x01) << 3);
+        if(x & 1) {
+            dst[x / 2] |= px;       // 2nd pixel in the low nibble
+        } else {
+            dst[x / 2] = px << 4;   // 1st pixel in the high nibble
+        }
+    }
+}
+
+static const kernels_t scalar_kernels = {
+    "scalar", pln2lin_scalar, lin2pln_scalar, lace2lin_scalar, lin2lace_scalar,
+    pln2nib_scalar, lace2nib_scalar, nib2pln_scalar, nib2lace_scalar,
+    lin2rgb24_scalar, lin2rgb32_scalar
+};
+
+// all the backends built into this library, in order of preference
+static const kernels_t *backends[] = {
+#ifdef SSI_X86_KERNELS
+    &avx2_kernels,
+    &sse2_kernels,
+#endif
+    &lut_kernels,
+    &scalar_kernels,
+    NULL
+};
+
+static const kernels_t *active = NULL;
+
+/// @brief checks if the host CPU is able to run the given backend
+/// @param k pointer to the backend kernel table
+/// @return true if the backend can be used
+static int backend_supported(const kernels_t *k) {
+#ifdef SSI_X86_KERNELS
+#if defined(_MSC_VER)
+    int info[4];
+    if(k == &avx2_kernels) {
+        __cpuidex(info, 7, 0);
+        if(0 == (info[1] & (1 << 5))) return 0; // no AVX2
+        __cpuid(info, 1);
+        if(0 == (info[2] & (1 << 27))) return 0; // no OSXSAVE
+        return (_xgetbv(0) & 0x06) == 0x06;      // OS saves the YMM state
+    }
+    if(k == &sse2_kernels) {
+        __cpuid(info, 1);
+        return 0 != (info[3] & (1 << 26));
+    }
+#else
+    __builtin_cpu_init();
+    if(k == &avx2_kernels) return __builtin_cpu_supports("avx2");
+    if(k == &sse2_kernels) return __builtin_cpu_supports("sse2");
+#endif
+#endif
+    return (k == &scalar_kernels) || (k == &lut_kernels);
+}
+
+/// @brief makes the named backend the active one
+/// @return 0 on success, -1 if no such backend exists, -2 if the host CPU can't run it
+static int select_backend(const char *name) {
+    for(int i = 0; NULL != backends[i]; i++) {
+        if(0 == strcmp(name, backends[i]->name)) {
+            if(!backend_supported(backends[i])) {
+                return -2; // backend exists but this CPU can't run it
+            }
+            active = backends[i];
+            return 0;
+        }
+    }
+    return -1; // no such backend
+}
+
+/// @brief builds the tables and picks the backend, run just the once by kernels()
+static void kernels_init(void) {
+    lut_init(); // the tables must be ready before any backend is activated
+    // allow the backend to be forced from the environment, mostly for testing
+    const char *name = getenv("SSI_IMG_BACKEND");
+    if((NULL == name) || (0 != select_backend(name))) {
+        for(int i = 0; NULL != backends[i]; i++) {
+            if(backend_supported(backends[i])) {
+                active = backends[i];
+                break;
+            }
+        }
+    }
+}
+
+static ssi_once_t kernels_once = SSI_ONCE_INIT;
+
+const kernels_t *kernels(void) {
+    ssi_once(&kernels_once, kernels_init); // threads starting together all see the same choice
+    return active;
+}
+
+const char *ssi_backend(void) {
+    return kernels()->name;
+}
+
+int ssi_set_backend(const char *name) {
+    if(NULL == name) {
+        return -1;
+    }
+    kernels(); // the default choice is made first, so it can't later replace this one
+    return select_backend(name);
+}
@@ -0,0 +1,172 @@
+/*
+ * kernels.h
+ * internal definitions for the pixel conversion kernels and the runtime
+ * selection of the best implementation for the host CPU
+ *
+ * This code is offered without warranty under the MIT License. Use it as you will
+ * personally or commercially, just give credit if you do.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef SSI_KERNELS
+#define SSI_KERNELS
+
+/// @brief deplanes a span of 4 bit planes, 8 pixels per plane byte, 1 byte per pixel output
+/// @param dst pointer to the output, must have room for n * 8 pixels
+/// @param p0 pointer to the plane 0 bytes (bit 0 of each pixel)
+/// @param p1 pointer to the plane 1 bytes (bit 1 of each pixel)
+/// @param p2 pointer to the plane 2 bytes (bit 2 of each pixel)
+/// @param p3 pointer to the plane 3 bytes (bit 3 of each pixel)
+/// @param n number of bytes per plane to convert
+typedef void (*pln2lin_fn)(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                           const uint8_t *p2, const uint8_t *p3, size_t n);
+
+/// @brief planes a span of 1 byte per pixel data into 4 bit planes, 8 pixels per plane byte
+/// @param p0 pointer to the plane 0 output bytes (bit 0 of each pixel)
+/// @param p1 pointer to the plane 1 output bytes (bit 1 of each pixel)
+/// @param p2 pointer to the plane 2 output bytes (bit 2 of each pixel)
+/// @param p3 pointer to the plane 3 output bytes (bit 3 of each pixel)
+/// @param src pointer to the input pixels, must hold n * 8 pixels
+/// @param n number of bytes per plane to produce
+typedef void (*lin2pln_fn)(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                           const uint8_t *src, size_t n);
+
+/// @brief unpacks a span of CGA bytes, 4 pixels of 2 bits per byte, 1 byte per pixel output
+/// @param dst pointer to the output, must have room for n * 4 pixels
+/// @param src pointer to the packed bytes
+/// @param n number of packed bytes to convert
+typedef void (*lace2lin_fn)(uint8_t *dst, const uint8_t *src, size_t n);
+
+/// @brief packs a span of 1 byte per pixel data into CGA bytes, 4 pixels of 2 bits per byte
+/// @param dst pointer to the packed output bytes
+/// @param src pointer to the input pixels, must hold n * 4 pixels
+/// @param n number of packed bytes to produce
+typedef void (*lin2lace_fn)(uint8_t *dst, const uint8_t *src, size_t n);
+
+/// @brief deplanes a span of 4 bit planes straight to packed 4 bit pixels, 2 per byte,
+///        left most pixel in the high nibble as used by 16 colour BMP files
+/// @param dst pointer to the output, must have room for n * 4 bytes
+/// @param p0 pointer to the plane 0 bytes (bit 0 of each pixel)
+/// @param p1 pointer to the plane 1 bytes (bit 1 of each pixel)
+/// @param p2 pointer to the plane 2 bytes (bit 2 of each pixel)
+/// @param p3 pointer to the plane 3 bytes (bit 3 of each pixel)
+/// @param n number of bytes per plane to convert
+typedef void (*pln2nib_fn)(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                           const uint8_t *p2, const uint8_t *p3, size_t n);
+
+/// @brief unpacks a span of CGA bytes straight to packed 4 bit pixels, 2 per byte
+/// @param dst pointer to the output, must have room for n * 2 bytes
+/// @param src pointer to the CGA bytes
+/// @param n number of CGA bytes to convert
+typedef void (*lace2nib_fn)(uint8_t *dst, const uint8_t *src, size_t n);
+
+/// @brief planes a span of packed 4 bit pixels, 2 per byte left most in the high nibble
+/// @param p0 pointer to the plane 0 output bytes (bit 0 of each pixel)
+/// @param p1 pointer to the plane 1 output bytes (bit 1 of each pixel)
+/// @param p2 pointer to the plane 2 output bytes (bit 2 of each pixel)
+/// @param p3 pointer to the plane 3 output bytes (bit 3 of each pixel)
+/// @param src pointer to the packed pixels, must hold n * 4 bytes
+/// @param n number of bytes per plane to produce
+typedef void (*nib2pln_fn)(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                           const uint8_t *src, size_t n);
+
+/// @brief packs a span of packed 4 bit pixels, 2 per byte, into CGA bytes
+/// @param dst pointer to the CGA output bytes
+/// @param src pointer to the packed pixels, must hold n * 2 bytes
+/// @param n number of CGA bytes to produce
+typedef void (*nib2lace_fn)(uint8_t *dst, const uint8_t *src, size_t n);
+
+// a 16 entry palette split into one table per output byte, so a SIMD kernel can
+// look up a whole channel with a single byte shuffle
+typedef struct {
+    uint8_t     chan[4][16]; // byte k of each pixel for each of the 16 colours
+} pal16_t;
+
+/// @brief expands a span of 1 byte per pixel colour indices to true colour pixels
+///        through a 16 entry palette. Pixels are expanded in order, each index being read
+///        before its pixel is written, so src may be the last n bytes of dst
+/// @param dst pointer to the output, must have room for n pixels of 3 or 4 bytes
+/// @param src pointer to the colour indices, only the low 4 bits are used
+/// @param pal palette to expand through, 3 or 4 bytes per pixel
+/// @param n number of pixels to convert
+typedef void (*lin2rgb_fn)(uint8_t *dst, const uint8_t *src, const pal16_t *pal, size_t n);
+
+// table of kernel implementations for a given backend
+typedef struct {
+    const char  *name;       // backend name, as accepted by ssi_set_backend()
+    pln2lin_fn  pln2lin;     // planar to linear span converter
+    lin2pln_fn  lin2pln;     // linear to planar span converter
+    lace2lin_fn lace2lin;    // CGA packed to linear span converter
+    lin2lace_fn lin2lace;    // linear to CGA packed span converter
+    pln2nib_fn  pln2nib;     // planar to packed 4 bit span converter
+    lace2nib_fn lace2nib;    // CGA packed to packed 4 bit span converter
+    nib2pln_fn  nib2pln;     // packed 4 bit to planar span converter
+    nib2lace_fn nib2lace;    // packed 4 bit to CGA packed span converter
+    lin2rgb_fn  lin2rgb24;   // linear to 24 bit true colour span converter
+    lin2rgb_fn  lin2rgb32;   // linear to 32 bit true colour span converter
+} kernels_t;
+
+/// @brief returns the kernel table selected for this host, selecting it on first use
+/// @return pointer to the active kernel table
+const kernels_t *kernels(void);
+
+// the portable reference kernels
+void pln2lin_scalar(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                    const uint8_t *p2, const uint8_t *p3, size_t n);
+void lin2pln_scalar(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                    const uint8_t *src, size_t n);
+void lace2lin_scalar(uint8_t *dst, const uint8_t *src, size_t n);
+void lin2lace_scalar(uint8_t *dst, const uint8_t *src, size_t n);
+void pln2nib_scalar(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                    const uint8_t *p2, const uint8_t *p3, size_t n);
+void lace2nib_scalar(uint8_t *dst, const uint8_t *src, size_t n);
+void nib2pln_scalar(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                    const uint8_t *src, size_t n);
+void nib2lace_scalar(uint8_t *dst, const uint8_t *src, size_t n);
+void lin2rgb24_scalar(uint8_t *dst, const uint8_t *src, const pal16_t *pal, size_t n);
+void lin2rgb32_scalar(uint8_t *dst, const uint8_t *src, const pal16_t *pal, size_t n);
+
+/// @brief deplanes a run of pixels that need not start on a plane byte straight to packed
+///        4 bit pixels, 2 per byte, for lines that straddle plane bytes
+/// @param dst pointer to the output, must have room for (count + 1) / 2 bytes, which are overwritten
+/// @param p0 pointer to the plane 0 bytes (bit 0 of each pixel)
+/// @param p1 pointer to the plane 1 bytes (bit 1 of each pixel)
+/// @param p2 pointer to the plane 2 bytes (bit 2 of each pixel)
+/// @param p3 pointer to the plane 3 bytes (bit 3 of each pixel)
+/// @param first index of the first pixel within the planes
+/// @param count number of pixels to convert
+void pln2nib_bits(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                  const uint8_t *p2, const uint8_t *p3, size_t first, size_t count);
+
+// the table driven portable kernels, the default where no SIMD backend applies
+extern const kernels_t lut_kernels;
+
+/// @brief builds the lookup tables used by the table driven kernels, called by kernels()
+///        before any backend is selected. Only the first call builds them, any others
+///        racing it wait until they are ready
+void lut_init(void);
+// also used by the SIMD kernels for any tail bytes, which on short lines can be
+// a good part of each line
+void pln2lin_lut(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                 const uint8_t *p2, const uint8_t *p3, size_t n);
+void lin2pln_lut(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                 const uint8_t *src, size_t n);
+void lace2lin_lut(uint8_t *dst, const uint8_t *src, size_t n);
+void lin2lace_lut(uint8_t *dst, const uint8_t *src, size_t n);
+void pln2nib_lut(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                 const uint8_t *p2, const uint8_t *p3, size_t n);
+void lace2nib_lut(uint8_t *dst, const uint8_t *src, size_t n);
+void nib2pln_lut(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                 const uint8_t *src, size_t n);
+void nib2lace_lut(uint8_t *dst, const uint8_t *src, size_t n);
+void lin2rgb24_lut(uint8_t *dst, const uint8_t *src, const pal16_t *pal, size_t n);
+void lin2rgb32_lut(uint8_t *dst, const uint8_t *src, const pal16_t *pal, size_t n);
+
+#ifdef SSI_X86_KERNELS
+// x86 SIMD kernel tables, each built in its own unit with the matching compiler flags
+extern const kernels_t sse2_kernels;
+extern const kernels_t avx2_kernels;
+#endif
+
+#endif
@@ -0,0 +1,224 @@
+#include "kernels.h"
+#include <immintrin.h>
+#include <string.h>
+
+// each plane byte holds 8 pixels, left most pixel in the most significant bit.
+// spreading a byte across 8 lanes and testing against this mask yields one
+// lane per pixel
+#define PIXEL_BITS _mm256_set1_epi64x(0x0102040810204080LL)
+
+// broadcasts plane bytes 0,1 into the low lane and 2,3 into the high lane,
+// each repeated 8 times
+#define SPREAD_IDX _mm256_setr_epi8( \
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, \
+    2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3)
+
+// reverses the pixel order within each group of 8
+#define REVERSE_IDX _mm256_setr_epi8( \
+    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, \
+    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8)
+
+/// @brief deplanes 4 bytes from each plane, 32 pixels
+/// @return 32 pixels, 1 byte per pixel
+static inline __m256i deplane32(const uint8_t *p0, const uint8_t *p1,
+                                const uint8_t *p2, const uint8_t *p3) {
+    const __m256i bits = PIXEL_BITS;
+    const __m256i idx = SPREAD_IDX;
+    const uint8_t *planes[4] = {p0, p1, p2, p3};
+    __m256i px = _mm256_setzero_si256();
+
+    for(int p = 0; p < 4; p++) {
+        int32_t word;
+        memcpy(&word, planes[p], sizeof(word));
+        __m256i r = _mm256_shuffle_epi8(_mm256_set1_epi32(word), idx);
+        __m256i set = _mm256_cmpeq_epi8(_mm256_and_si256(r, bits), bits);
+        px = _mm256_or_si256(px, _mm256_and_si256(set, _mm256_set1_epi8((char)(1 << p))));
+    }
+    return px;
+}
+
+static void pln2lin_avx2(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                         const uint8_t *p2, const uint8_t *p3, size_t n) {
+    size_t i = 0;
+
+    // 32 bytes per plane, 256 pixels per iteration
+    for(; i + 32 <= n; i += 32) {
+        for(int j = 0; j < 8; j++) { // 4 plane bytes, 32 pixels at a time
+            size_t o = i + j * 4;
+            _mm256_storeu_si256((__m256i *)&dst[o * 8], deplane32(&p0[o], &p1[o], &p2[o], &p3[o]));
+        }
+    }
+    pln2lin_lut(&dst[i * 8], &p0[i], &p1[i], &p2[i], &p3[i], n - i);
+}
+
+/// @brief packs pairs of pixels into nibbles, left most pixel in the high nibble
+/// @return 32 packed bytes holding the 64 pixels of a and b
+static inline __m256i nibbles(__m256i a, __m256i b) {
+    const __m256i low = _mm256_set1_epi16(0x00ff);
+    a = _mm256_and_si256(_mm256_or_si256(_mm256_slli_epi16(a, 4), _mm256_srli_epi16(a, 8)), low);
+    b = _mm256_and_si256(_mm256_or_si256(_mm256_slli_epi16(b, 4), _mm256_srli_epi16(b, 8)), low);
+    // the pack works within each 128 bit lane, so put the quarters back in order
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+static void pln2nib_avx2(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                         const uint8_t *p2, const uint8_t *p3, size_t n) {
+    size_t i = 0;
+
+    // 32 bytes per plane, 256 pixels, 128 packed bytes per iteration
+    for(; i + 32 <= n; i += 32) {
+        for(int j = 0; j < 8; j += 2) { // 8 plane bytes, 64 pixels at a time
+            size_t o = i + j * 4;
+            __m256i a = deplane32(&p0[o], &p1[o], &p2[o], &p3[o]);
+            __m256i b = deplane32(&p0[o + 4], &p1[o + 4], &p2[o + 4], &p3[o + 4]);
+            _mm256_storeu_si256((__m256i *)&dst[o * 4], nibbles(a, b));
+        }
+    }
+    pln2nib_lut(&dst[i * 4], &p0[i], &p1[i], &p2[i], &p3[i], n - i);
+}
+
+/// @brief planes 32 pixels, 1 byte per pixel, into 4 bytes for each of the 4 planes
+/// @param o offset of the first output byte in each plane
+static inline void plane32(__m256i v, uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3, size_t o) {
+    // reverse the pixels within each group of 8 so the left most pixel
+    // lands in the most significant bit of the movemask result
+    v = _mm256_shuffle_epi8(v, REVERSE_IDX);
+    // move each plane bit to the top of its byte and collect them
+    uint32_t m0 = _mm256_movemask_epi8(_mm256_slli_epi16(v, 7));
+    uint32_t m1 = _mm256_movemask_epi8(_mm256_slli_epi16(v, 6));
+    uint32_t m2 = _mm256_movemask_epi8(_mm256_slli_epi16(v, 5));
+    uint32_t m3 = _mm256_movemask_epi8(_mm256_slli_epi16(v, 4));
+    for(int b = 0; b < 4; b++) {
+        p0[o + b] = m0 >> (b * 8);
+        p1[o + b] = m1 >> (b * 8);
+        p2[o + b] = m2 >> (b * 8);
+        p3[o + b] = m3 >> (b * 8);
+    }
+}
+
+static void lin2pln_avx2(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                         const uint8_t *src, size_t n) {
+    size_t i = 0;
+
+    // 256 pixels per iteration, 32 bytes per plane
+    for(; i + 32 <= n; i += 32) {
+        for(int j = 0; j < 8; j++) {
+            plane32(_mm256_loadu_si256((const __m256i *)&src[i * 8 + j * 32]), p0, p1, p2, p3, i + j * 4);
+        }
+    }
+    lin2pln_lut(&p0[i], &p1[i], &p2[i], &p3[i], &src[i * 8], n - i);
+}
+
+static void nib2pln_avx2(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                         const uint8_t *src, size_t n) {
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+
+    // 128 packed bytes, 256 pixels per iteration, 32 bytes per plane
+    for(; i + 32 <= n; i += 32) {
+        for(int j = 0; j < 4; j++) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)&src[i * 4 + j * 32]);
+            // split the nibbles back out to 1 byte per pixel, left most pixel first
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+            __m256i lo = _mm256_and_si256(v, low);
+            __m256i a = _mm256_unpacklo_epi8(hi, lo);
+            __m256i b = _mm256_unpackhi_epi8(hi, lo);
+            // the unpacks work within each 128 bit lane, so put the halves back in order
+            plane32(_mm256_permute2x128_si256(a, b, 0x20), p0, p1, p2, p3, i + j * 8);
+            plane32(_mm256_permute2x128_si256(a, b, 0x31), p0, p1, p2, p3, i + j * 8 + 4);
+        }
+    }
+    nib2pln_lut(&p0[i], &p1[i], &p2[i], &p3[i], &src[i * 4], n - i);
+}
+
+// places the channels of 16 pixels, looked up a byte per pixel, into the 48 bytes of
+// their 24 bit pixels. Row j gives output bytes j * 16 to j * 16 + 15, one mask for
+// each channel, -1 leaving the byte for another channel
+static const int8_t rgb24_spread[3][3][16] = {
+    {{ 0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1,  5},
+     {-1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1},
+     {-1, -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1}},
+    {{-1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10, -1},
+     { 5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10},
+     {-1,  5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1}},
+    {{-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1},
+     {-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1},
+     {10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15}}
+};
+
+/// @brief loads 16 bytes into both 128 bit lanes, byte shuffles only look within a lane
+static inline __m256i both_lanes(const void *p) {
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)p));
+}
+
+static void lin2rgb24_avx2(uint8_t *dst, const uint8_t *src, const pal16_t *pal, size_t n) {
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i table[3];
+    __m256i spread[3][3];
+    for(int c = 0; c < 3; c++) {
+        table[c] = both_lanes(pal->chan[c]);
+        for(int j = 0; j < 3; j++) {
+            spread[j][c] = both_lanes(rgb24_spread[j][c]);
+        }
+    }
+    size_t i = 0;
+
+    // 32 pixels, 96 bytes per iteration, 16 pixels in each lane
+    for(; i + 32 <= n; i += 32) {
+        __m256i idx = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&src[i]), low);
+        __m256i c0 = _mm256_shuffle_epi8(table[0], idx);
+        __m256i c1 = _mm256_shuffle_epi8(table[1], idx);
+        __m256i c2 = _mm256_shuffle_epi8(table[2], idx);
+        __m256i o[3];
+        for(int j = 0; j < 3; j++) {
+            o[j] = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(c0, spread[j][0]),
+                                                   _mm256_shuffle_epi8(c1, spread[j][1])),
+                                   _mm256_shuffle_epi8(c2, spread[j][2]));
+        }
+        // each lane holds 48 bytes spread over the 3 vectors, the low lane's come first
+        uint8_t *out = &dst[i * 3];
+        _mm256_storeu_si256((__m256i *)&out[0], _mm256_permute2x128_si256(o[0], o[1], 0x20));
+        _mm256_storeu_si256((__m256i *)&out[32], _mm256_permute2x128_si256(o[2], o[0], 0x30));
+        _mm256_storeu_si256((__m256i *)&out[64], _mm256_permute2x128_si256(o[1], o[2], 0x31));
+    }
+    lin2rgb24_lut(&dst[i * 3], &src[i], pal, n - i);
+}
+
+static void lin2rgb32_avx2(uint8_t *dst, const uint8_t *src, const pal16_t *pal, size_t n) {
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i table[4];
+    for(int c = 0; c < 4; c++) {
+        table[c] = both_lanes(pal->chan[c]);
+    }
+    size_t i = 0;
+
+    // 32 pixels, 128 bytes per iteration
+    for(; i + 32 <= n; i += 32) {
+        __m256i idx = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&src[i]), low);
+        __m256i c0 = _mm256_shuffle_epi8(table[0], idx);
+        __m256i c1 = _mm256_shuffle_epi8(table[1], idx);
+        __m256i c2 = _mm256_shuffle_epi8(table[2], idx);
+        __m256i c3 = _mm256_shuffle_epi8(table[3], idx);
+        // interleave the channels, the unpacks work within each 128 bit lane
+        __m256i lo01 = _mm256_unpacklo_epi8(c0, c1);
+        __m256i hi01 = _mm256_unpackhi_epi8(c0, c1);
+        __m256i lo23 = _mm256_unpacklo_epi8(c2, c3);
+        __m256i hi23 = _mm256_unpackhi_epi8(c2, c3);
+        __m256i a = _mm256_unpacklo_epi16(lo01, lo23); // pixels 0-3 and 16-19
+        __m256i b = _mm256_unpackhi_epi16(lo01, lo23); // pixels 4-7 and 20-23
+        __m256i c = _mm256_unpacklo_epi16(hi01, hi23); // pixels 8-11 and 24-27
+        __m256i d = _mm256_unpackhi_epi16(hi01, hi23); // pixels 12-15 and 28-31
+        uint8_t *out = &dst[i * 4];
+        _mm256_storeu_si256((__m256i *)&out[0], _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i *)&out[32], _mm256_permute2x128_si256(c, d, 0x20));
+        _mm256_storeu_si256((__m256i *)&out[64], _mm256_permute2x128_si256(a, b, 0x31));
+        _mm256_storeu_si256((__m256i *)&out[96], _mm256_permute2x128_si256(c, d, 0x31));
+    }
+    lin2rgb32_lut(&dst[i * 4], &src[i], pal, n - i);
+}
+
+const kernels_t avx2_kernels = {
+    "avx2", pln2lin_avx2, lin2pln_avx2, lace2lin_lut, lin2lace_lut,
+    pln2nib_avx2, lace2nib_lut, nib2pln_avx2, nib2lace_lut,
+    lin2rgb24_avx2, lin2rgb32_avx2
+};
@@ -0,0 +1,201 @@
+#include "kernels.h"
+#include "ssi-once.h"
+#include <string.h>
+
+// spreads a plane byte into 8 pixels, one bit per pixel byte, left most pixel first in memory
+static uint64_t pln_spread[256];
+
+// gathers bits 0-3 of a pixel into bit 0 of bytes 0-3, one byte per plane
+static uint32_t pln_gather[16];
+
+// spreads a CGA byte into its 4 pixels, one pixel per byte, left most pixel first in memory
+static uint32_t lace_spread[256];
+
+// spreads a plane byte into 8 pixels packed 2 per byte, one bit per nibble, left most pixel first
+static uint32_t nib_spread[256];
+
+// spreads a CGA byte into its 4 pixels packed 2 per byte, left most pixel first
+static uint16_t lace_nib[256];
+
+// gathers bits 0-3 of a pair of packed pixels into bits 1 (high nibble) and 0 (low nibble)
+// of bytes 0-3, one byte per plane
+static uint32_t nib_gather[256];
+
+// packs a pair of packed 4 bit pixels into 4 bits of a CGA byte
+static uint8_t nib_lace[256];
+
+static ssi_once_t lut_once = SSI_ONCE_INIT;
+
+static void build_luts(void) {
+    for(int v = 0; v < 256; v++) {
+        uint8_t px[8];
+        for(int b = 0; b < 8; b++) { // 8 pixels packed per byte
+            px[b] = (v >> (7 - b)) & 0x01;
+        }
+        memcpy(&pln_spread[v], px, sizeof(px)); // native byte order, so stores can be plain copies
+
+        for(int b = 0; b < 4; b++) { // 4 pixels per byte
+            px[b] = (v >> (6 - (b * 2))) & 0x03;
+        }
+        memcpy(&lace_spread[v], px, 4);
+
+        uint8_t nib[4];
+        for(int b = 0; b < 4; b++) { // 2 pixels per output byte
+            nib[b] = (((v >> (7 - (b * 2))) & 0x01) << 4) | ((v >> (6 - (b * 2))) & 0x01);
+        }
+        memcpy(&nib_spread[v], nib, 4);
+
+        nib[0] = (px[0] << 4) | px[1];
+        nib[1] = (px[2] << 4) | px[3];
+        memcpy(&lace_nib[v], nib, 2);
+
+        nib_gather[v] = 0;
+        for(int k = 0; k < 4; k++) { // one byte per plane
+            uint32_t bits = (((v >> (4 + k)) & 0x01) << 1) | ((v >> k) & 0x01);
+            nib_gather[v] |= bits << (k * 8);
+        }
+        nib_lace[v] = (((v >> 4) & 0x03) << 2) | (v & 0x03);
+    }
+
+    for(int v = 0; v < 16; v++) {
+        pln_gather[v] = ((uint32_t)((v >> 0) & 0x01) <<  0) |
+                        ((uint32_t)((v >> 1) & 0x01) <<  8) |
+                        ((uint32_t)((v >> 2) & 0x01) << 16) |
+                        ((uint32_t)((v >> 3) & 0x01) << 24);
+    }
+}
+
+void lut_init(void) {
+    ssi_once(&lut_once, build_luts);
+}
+
+void pln2lin_lut(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                 const uint8_t *p2, const uint8_t *p3, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        // each plane contributes one bit to all 8 pixels at once
+        uint64_t px = pln_spread[p0[i]]        |
+                      (pln_spread[p1[i]] << 1) |
+                      (pln_spread[p2[i]] << 2) |
+                      (pln_spread[p3[i]] << 3);
+        memcpy(dst, &px, sizeof(px));
+        dst += 8;
+    }
+}
+
+void lin2pln_lut(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                 const uint8_t *src, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        // byte k of the word collects the plane k bits of all 8 pixels
+        uint32_t w = (pln_gather[src[0] & 0x0f] << 7) |
+                     (pln_gather[src[1] & 0x0f] << 6) |
+                     (pln_gather[src[2] & 0x0f] << 5) |
+                     (pln_gather[src[3] & 0x0f] << 4) |
+                     (pln_gather[src[4] & 0x0f] << 3) |
+                     (pln_gather[src[5] & 0x0f] << 2) |
+                     (pln_gather[src[6] & 0x0f] << 1) |
+                     (pln_gather[src[7] & 0x0f]);
+        p0[i] = w;
+        p1[i] = w >> 8;
+        p2[i] = w >> 16;
+        p3[i] = w >> 24;
+        src += 8;
+    }
+}
+
+void lace2lin_lut(uint8_t *dst, const uint8_t *src, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        memcpy(dst, &lace_spread[src[i]], 4);
+        dst += 4;
+    }
+}
+
+void lin2lace_lut(uint8_t *dst, const uint8_t *src, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        // assemble the 4 pixels little endian, then a single multiply moves
+        // each 2 bit pixel to its place in the top byte without collisions
+        uint32_t w = ((uint32_t)src[0]) | ((uint32_t)src[1] << 8) |
+                     ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+        w &= 0x03030303;
+        dst[i] = (w * 0x40100401) >> 24;
+        src += 4;
+    }
+}
+
+void pln2nib_lut(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                 const uint8_t *p2, const uint8_t *p3, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        uint32_t px = nib_spread[p0[i]]        |
+                      (nib_spread[p1[i]] << 1) |
+                      (nib_spread[p2[i]] << 2) |
+                      (nib_spread[p3[i]] << 3);
+        memcpy(dst, &px, sizeof(px));
+        dst += 4;
+    }
+}
+
+void lace2nib_lut(uint8_t *dst, const uint8_t *src, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        memcpy(dst, &lace_nib[src[i]], 2);
+        dst += 2;
+    }
+}
+
+void nib2pln_lut(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                 const uint8_t *src, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        // byte k of the word collects the plane k bits of all 8 pixels
+        uint32_t w = (nib_gather[src[0]] << 6) |
+                     (nib_gather[src[1]] << 4) |
+                     (nib_gather[src[2]] << 2) |
+                     (nib_gather[src[3]]);
+        p0[i] = w;
+        p1[i] = w >> 8;
+        p2[i] = w >> 16;
+        p3[i] = w >> 24;
+        src += 4;
+    }
+}
+
+void nib2lace_lut(uint8_t *dst, const uint8_t *src, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+        dst[i] = (nib_lace[src[0]] << 4) | nib_lace[src[1]];
+        src += 2;
+    }
+}
+
+/// @brief gathers the palette into one word per colour, byte k of the word being byte k of the pixel
+static void pal_words(uint32_t *words, const pal16_t *pal) {
+    for(int c = 0; c < 16; c++) {
+        uint8_t px[4] = {pal->chan[0][c], pal->chan[1][c], pal->chan[2][c], pal->chan[3][c]};
+        memcpy(&words[c], px, sizeof(px));
+    }
+}
+
+void lin2rgb24_lut(uint8_t *dst, const uint8_t *src, const pal16_t *pal, size_t n) {
+    uint32_t words[16];
+    pal_words(words, pal);
+    if(0 == n) return;
+
+    // whole words are stored 3 bytes apart, the 4th byte being overwritten by the next
+    // pixel. It only ever lands on an index that has already been read
+    for(size_t i = 0; i < n - 1; i++) {
+        memcpy(dst, &words[src[i] & 0x0f], 4);
+        dst += 3;
+    }
+    memcpy(dst, &words[src[n - 1] & 0x0f], 3); // the last can't spill past the end
+}
+
+void lin2rgb32_lut(uint8_t *dst, const uint8_t *src, const pal16_t *pal, size_t n) {
+    uint32_t words[16];
+    pal_words(words, pal);
+    for(size_t i = 0; i < n; i++) {
+        memcpy(dst, &words[src[i] & 0x0f], 4);
+        dst += 4;
+    }
+}
+
+const kernels_t lut_kernels = {
+    "lut", pln2lin_lut, lin2pln_lut, lace2lin_lut, lin2lace_lut,
+    pln2nib_lut, lace2nib_lut, nib2pln_lut, nib2lace_lut,
+    lin2rgb24_lut, lin2rgb32_lut
+};
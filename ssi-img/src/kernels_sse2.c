@@ -0,0 +1,142 @@
+#include "kernels.h"
+#include <emmintrin.h>
+
+// each plane byte holds 8 pixels, left most pixel in the most significant bit.
+// spreading a byte across 8 lanes and testing against this mask yields one
+// lane per pixel
+#define PIXEL_BITS _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128)
+
+/// @brief replicates each of the 16 bytes in v 8 times, across 8 vectors
+/// @param v 16 plane bytes
+/// @param r output, r[i] holds bytes 2i and 2i+1 of v, each repeated 8 times
+static inline void spread16(__m128i v, __m128i r[8]) {
+    __m128i lo = _mm_unpacklo_epi8(v, v);
+    __m128i hi = _mm_unpackhi_epi8(v, v);
+    __m128i q0 = _mm_unpacklo_epi16(lo, lo);
+    __m128i q1 = _mm_unpackhi_epi16(lo, lo);
+    __m128i q2 = _mm_unpacklo_epi16(hi, hi);
+    __m128i q3 = _mm_unpackhi_epi16(hi, hi);
+    r[0] = _mm_unpacklo_epi32(q0, q0);
+    r[1] = _mm_unpackhi_epi32(q0, q0);
+    r[2] = _mm_unpacklo_epi32(q1, q1);
+    r[3] = _mm_unpackhi_epi32(q1, q1);
+    r[4] = _mm_unpacklo_epi32(q2, q2);
+    r[5] = _mm_unpackhi_epi32(q2, q2);
+    r[6] = _mm_unpacklo_epi32(q3, q3);
+    r[7] = _mm_unpackhi_epi32(q3, q3);
+}
+
+/// @brief deplanes 16 bytes from each plane, 128 pixels
+/// @param px output, 8 vectors of 16 pixels, 1 byte per pixel
+static inline void deplane128(const uint8_t *p0, const uint8_t *p1,
+                              const uint8_t *p2, const uint8_t *p3, __m128i px[8]) {
+    const __m128i bits = PIXEL_BITS;
+    const uint8_t *planes[4] = {p0, p1, p2, p3};
+    __m128i r[8];
+
+    for(int j = 0; j < 8; j++) px[j] = _mm_setzero_si128();
+    for(int p = 0; p < 4; p++) {
+        const __m128i weight = _mm_set1_epi8((char)(1 << p));
+        spread16(_mm_loadu_si128((const __m128i *)planes[p]), r);
+        for(int j = 0; j < 8; j++) {
+            __m128i set = _mm_cmpeq_epi8(_mm_and_si128(r[j], bits), bits);
+            px[j] = _mm_or_si128(px[j], _mm_and_si128(set, weight));
+        }
+    }
+}
+
+static void pln2lin_sse2(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                         const uint8_t *p2, const uint8_t *p3, size_t n) {
+    size_t i = 0;
+
+    // 16 bytes per plane, 128 pixels per iteration
+    for(; i + 16 <= n; i += 16) {
+        __m128i px[8];
+        deplane128(&p0[i], &p1[i], &p2[i], &p3[i], px);
+        for(int j = 0; j < 8; j++) {
+            _mm_storeu_si128((__m128i *)&dst[i * 8 + j * 16], px[j]);
+        }
+    }
+    pln2lin_lut(&dst[i * 8], &p0[i], &p1[i], &p2[i], &p3[i], n - i);
+}
+
+/// @brief packs pairs of pixels into nibbles, left most pixel in the high nibble
+/// @return 16 packed bytes holding the 32 pixels of a and b
+static inline __m128i nibbles(__m128i a, __m128i b) {
+    const __m128i low = _mm_set1_epi16(0x00ff);
+    a = _mm_and_si128(_mm_or_si128(_mm_slli_epi16(a, 4), _mm_srli_epi16(a, 8)), low);
+    b = _mm_and_si128(_mm_or_si128(_mm_slli_epi16(b, 4), _mm_srli_epi16(b, 8)), low);
+    return _mm_packus_epi16(a, b);
+}
+
+static void pln2nib_sse2(uint8_t *dst, const uint8_t *p0, const uint8_t *p1,
+                         const uint8_t *p2, const uint8_t *p3, size_t n) {
+    size_t i = 0;
+
+    // 16 bytes per plane, 128 pixels, 64 packed bytes per iteration
+    for(; i + 16 <= n; i += 16) {
+        __m128i px[8];
+        deplane128(&p0[i], &p1[i], &p2[i], &p3[i], px);
+        for(int j = 0; j < 4; j++) {
+            _mm_storeu_si128((__m128i *)&dst[i * 4 + j * 16], nibbles(px[j * 2], px[j * 2 + 1]));
+        }
+    }
+    pln2nib_lut(&dst[i * 4], &p0[i], &p1[i], &p2[i], &p3[i], n - i);
+}
+
+/// @brief planes 16 pixels, 1 byte per pixel, into 2 bytes for each of the 4 planes
+/// @param o offset of the first output byte in each plane
+static inline void plane16(__m128i v, uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3, size_t o) {
+    // reverse the pixels within each group of 8 so the left most pixel
+    // lands in the most significant bit of the movemask result
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    // move each plane bit to the top of its byte and collect them
+    int m0 = _mm_movemask_epi8(_mm_slli_epi16(v, 7));
+    int m1 = _mm_movemask_epi8(_mm_slli_epi16(v, 6));
+    int m2 = _mm_movemask_epi8(_mm_slli_epi16(v, 5));
+    int m3 = _mm_movemask_epi8(_mm_slli_epi16(v, 4));
+    p0[o] = m0; p0[o + 1] = m0 >> 8;
+    p1[o] = m1; p1[o + 1] = m1 >> 8;
+    p2[o] = m2; p2[o + 1] = m2 >> 8;
+    p3[o] = m3; p3[o + 1] = m3 >> 8;
+}
+
+static void lin2pln_sse2(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                         const uint8_t *src, size_t n) {
+    size_t i = 0;
+
+    // 128 pixels per iteration, 16 bytes per plane
+    for(; i + 16 <= n; i += 16) {
+        for(int j = 0; j < 8; j++) {
+            plane16(_mm_loadu_si128((const __m128i *)&src[i * 8 + j * 16]), p0, p1, p2, p3, i + j * 2);
+        }
+    }
+    lin2pln_lut(&p0[i], &p1[i], &p2[i], &p3[i], &src[i * 8], n - i);
+}
+
+static void nib2pln_sse2(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                         const uint8_t *src, size_t n) {
+    const __m128i low = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    // 64 packed bytes, 128 pixels per iteration, 16 bytes per plane
+    for(; i + 16 <= n; i += 16) {
+        for(int j = 0; j < 4; j++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)&src[i * 4 + j * 16]);
+            // split the nibbles back out to 1 byte per pixel, left most pixel first
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low);
+            __m128i lo = _mm_and_si128(v, low);
+            plane16(_mm_unpacklo_epi8(hi, lo), p0, p1, p2, p3, i + j * 4);
+            plane16(_mm_unpackhi_epi8(hi, lo), p0, p1, p2, p3, i + j * 4 + 2);
+        }
+    }
+    nib2pln_lut(&p0[i], &p1[i], &p2[i], &p3[i], &src[i * 4], n - i);
+}
+
+const kernels_t sse2_kernels = {
+    "sse2", pln2lin_sse2, lin2pln_sse2, lace2lin_lut, lin2lace_lut,
+    pln2nib_sse2, lace2nib_lut, nib2pln_sse2, nib2lace_lut,
+    lin2rgb24_lut, lin2rgb32_lut // SSE2 has no byte shuffle to look the colours up with
+};
@@ -1,111 +1,93 @@
 #include "ssi-img.h"
+#include "kernels.h"
+#include "ssi-trace.h"
 
-void pln2lin(memstream_buf_t *dst, memstream_buf_t *src) {
-    int ofs2 = src->len / 2;  // 1/2
-    int ofs1 = ofs2 / 2;      // 1/4
-    int ofs3 = ofs1 + ofs2;   // 3/4
+/// @brief deplanes n bytes from each of the 4 planes into dst, clipping to the space left in dst
+static void deplane(memstream_buf_t *dst, const uint8_t *p0, const uint8_t *p1,
+                    const uint8_t *p2, const uint8_t *p3, size_t n) {
+    size_t room = (dst->pos < dst->len) ? (dst->len - dst->pos) : 0;
+    size_t bulk = (n < (room / 8)) ? n : (room / 8); // whole plane bytes that fit
 
-    for(int i = 0; i < ofs1; i++) {
-        uint8_t p0 = src->data[       i];
-        uint8_t p1 = src->data[ofs1 + i];
-        uint8_t p2 = src->data[ofs2 + i];
-        uint8_t p3 = src->data[ofs3 + i];
+    kernels()->pln2lin(&dst->data[dst->pos], p0, p1, p2, p3, bulk);
+    dst->pos += bulk * 8;
 
-        for(int b = 0; b < 8; b++) { // 8 pixels packed per byte
-            uint8_t px = 0;
-            px |= p0 & 0x80; px >>= 1;
-            px |= p1 & 0x80; px >>= 1;
-            px |= p2 & 0x80; px >>= 1;
-            px |= p3 & 0x80; px >>= 4; // final shift
-            if(dst->pos < dst->len) dst->data[dst->pos++] = px;
-            p0 <<= 1; p1 <<= 1; p2 <<= 1; p3 <<= 1; // shift in the next pixel
+    // a partial byte worth of pixels may still fit at the very end
+    if((bulk < n) && (dst->pos < dst->len)) {
+        uint8_t px[8];
+        pln2lin_scalar(px, &p0[bulk], &p1[bulk], &p2[bulk], &p3[bulk], 1);
+        for(int b = 0; (b < 8) && (dst->pos < dst->len); b++) {
+            dst->data[dst->pos++] = px[b];
         }
     }
 }
 
-void ipln2lin(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height) {
-    int step = width / 2; // bytes per line
-    int ofs2 = step / 2;      // 1/2
-    int ofs1 = ofs2 / 2;      // 1/4
-    int ofs3 = ofs1 + ofs2;   // 3/4
-    int base = 0;
-    for(int y = 0; y < height; y++) {
-        for(int x = 0; x < (width / 8); x++) {
-            uint8_t p0 = src->data[base + x];
-            uint8_t p1 = src->data[base + ofs1 + x];
-            uint8_t p2 = src->data[base + ofs2 + x];
-            uint8_t p3 = src->data[base + ofs3 + x];
+/// @brief planes n bytes for each of the 4 planes from src, padding with 0 once src runs out
+static void plane(uint8_t *p0, uint8_t *p1, uint8_t *p2, uint8_t *p3,
+                  memstream_buf_t *src, size_t n) {
+    size_t avail = (src->pos < src->len) ? (src->len - src->pos) : 0;
+    size_t bulk = (n < (avail / 8)) ? n : (avail / 8); // whole plane bytes available
+
+    kernels()->lin2pln(p0, p1, p2, p3, &src->data[src->pos], bulk);
+    src->pos += bulk * 8;
 
-            for(int b = 0; b < 8; b++) { // 8 pixels packed per byte
-                uint8_t px = 0;
-                px |= p0 & 0x80; px >>= 1;
-                px |= p1 & 0x80; px >>= 1;
-                px |= p2 & 0x80; px >>= 1;
-                px |= p3 & 0x80; px >>= 4; // final shift
-                if(dst->pos < dst->len) dst->data[dst->pos++] = px;
-                p0 <<= 1; p1 <<= 1; p2 <<= 1; p3 <<= 1; // shift in the next pixel
-            }
+    for(size_t i = bulk; i < n; i++) { // source exhausted, pad out the remainder
+        uint8_t px[8] = {0};
+        for(int b = 0; (b < 8) && (src->pos < src->len); b++) {
+            px[b] = src->data[src->pos++];
         }
-        base += step;
+        lin2pln_scalar(&p0[i], &p1[i], &p2[i], &p3[i], px, 1);
     }
 }
 
+void pln2lin(memstream_buf_t *dst, memstream_buf_t *src) {
+    uint64_t t0 = TRACE_BEGIN();
+    size_t ofs2 = src->len / 2;  // 1/2
+    size_t ofs1 = ofs2 / 2;      // 1/4
+    size_t ofs3 = ofs1 + ofs2;   // 3/4
 
-void lin2pln(memstream_buf_t *dst, memstream_buf_t *src) {
-    int ofs2 = dst->len / 2;  // 1/2
-    int ofs1 = ofs2 / 2;      // 1/4
-    int ofs3 = ofs1 + ofs2;   // 3/4
-    uint8_t p0 = 0;
-    uint8_t p1 = 0;
-    uint8_t p2 = 0;
-    uint8_t p3 = 0;
+    deplane(dst, &src->data[0], &src->data[ofs1], &src->data[ofs2], &src->data[ofs3], ofs1);
+    TRACE_END(TRACE_PLN2LIN, t0);
+}
 
-    for(int i = 0; i < ofs1; i++) {
-        for(int b = 0; b < 8; b++) { // 8 pixels packed per byte
-            p0 <<= 1; p1 <<= 1; p2 <<= 1; p3 <<= 1; // make room for the next pixel
-            uint8_t px = 0;
-            if(src->pos < src->len) px = src->data[src->pos++];
-            p0 |= px & 0x01; px >>= 1;
-            p1 |= px & 0x01; px >>= 1;
-            p2 |= px & 0x01; px >>= 1;
-            p3 |= px & 0x01; px >>= 1; // final shift
+void ipln2lin(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height) {
+    uint64_t t0 = TRACE_BEGIN();
+    size_t step = width / 2;  // bytes per line
+    size_t ofs1 = width / 8;  // bytes per plane per line, as ipln2bmp4() finds them
+    size_t start = dst->pos;
+    for(int y = 0; y < height; y++) {
+        const uint8_t *line = &src->data[step * y];
+        size_t end = start + ((size_t)width * (y + 1));
+        // each line is width pixels, those past its last whole plane byte aren't stored
+        dst->pos = end - width;
+        deplane(dst, &line[0], &line[ofs1], &line[ofs1 * 2], &line[ofs1 * 3], ofs1);
+        while((dst->pos < end) && (dst->pos < dst->len)) {
+            dst->data[dst->pos++] = 0;
         }
-
-        dst->data[       i] = p0;
-        dst->data[ofs1 + i] = p1;
-        dst->data[ofs2 + i] = p2;
-        dst->data[ofs3 + i] = p3;
     }
+    TRACE_END(TRACE_IPLN2LIN, t0);
 }
 
-void lin2ipln(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height) {
-    int step = width / 2; // bytes per line
-    int ofs2 = step / 2;      // 1/2
-    int ofs1 = ofs2 / 2;      // 1/4
-    int ofs3 = ofs1 + ofs2;   // 3/4
+void lin2pln(memstream_buf_t *dst, memstream_buf_t *src) {
+    uint64_t t0 = TRACE_BEGIN();
+    size_t ofs2 = dst->len / 2;  // 1/2
+    size_t ofs1 = ofs2 / 2;      // 1/4
+    size_t ofs3 = ofs1 + ofs2;   // 3/4
 
-    int base = 0;
+    plane(&dst->data[0], &dst->data[ofs1], &dst->data[ofs2], &dst->data[ofs3], src, ofs1);
+    TRACE_END(TRACE_LIN2PLN, t0);
+}
+
+void lin2ipln(memstream_buf_t *dst, memstream_buf_t *src, uint16_t width, uint16_t height) {
+    uint64_t t0 = TRACE_BEGIN();
+    size_t step = width / 2;  // bytes per line
+    size_t ofs1 = width / 8;  // bytes per plane per line, as bmp42ipln() writes them
+    size_t start = src->pos;
     for(int y = 0; y < height; y++) {
-        for(int x = 0; x< (width / 8); x++) {
-            uint8_t p0 = 0;
-            uint8_t p1 = 0;
-            uint8_t p2 = 0;
-            uint8_t p3 = 0;
-            for(int b = 0; b < 8; b++) { // 8 pixels packed per byte
-                p0 <<= 1; p1 <<= 1; p2 <<= 1; p3 <<= 1; // make room for the next pixel
-                uint8_t px = 0;
-                if(src->pos < src->len) px = src->data[src->pos++];
-                p0 |= px & 0x01; px >>= 1;
-                p1 |= px & 0x01; px >>= 1;
-                p2 |= px & 0x01; px >>= 1;
-                p3 |= px & 0x01; px >>= 1; // final shift
-            }
-            // write it to the output
-            dst->data[base +        x] = p0;
-            dst->data[base + ofs1 + x] = p1;
-            dst->data[base + ofs2 + x] = p2;
-            dst->data[base + ofs3 + x] = p3;
-        }
-        base += step;
+        uint8_t *line = &dst->data[step * y];
+        // each line is width pixels, those past its last whole plane byte aren't stored
+        src->pos = start + ((size_t)width * y);
+        plane(&line[0], &line[ofs1], &line[ofs1 * 2], &line[ofs1 * 3], src, ofs1);
     }
+    src->pos = start + ((size_t)width * height);
+    TRACE_END(TRACE_LIN2IPLN, t0);
 }
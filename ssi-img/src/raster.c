@@ -0,0 +1,160 @@
+#include "ssi-raster.h"
+#include "bits.h"
+#include <stdbool.h>
+#include <string.h>
+
+// what is done to each row
+typedef enum {
+    ROW_BLIT,   // combine with a source
+    ROW_KEY,    // copy from a source, but not its transparent colour
+    ROW_FILL    // combine with a colour
+} row_mode_t;
+
+typedef struct {
+    row_mode_t  mode;
+    raster_op_t op;
+    uint8_t     colour;     // the fill colour, or the transparent colour
+} row_op_t;
+
+/// @brief works along a row of all 4 planes, a word at a time. The first word ends on a
+///        byte boundary of dst, so every other word but the last covers 8 whole bytes
+/// @param dbit first pixel in the dst planes
+/// @param sbit first pixel in the src planes, unused for fills
+/// @param n number of pixels
+static void raster_row(pln_surface_t *dst, size_t dbit, const pln_surface_t *src, size_t sbit,
+                       size_t n, const row_op_t *ro) {
+    uint64_t colour[4]; // the fill colour, or transparent colour, across a whole word
+    for(int k = 0; k < 4; k++) {
+        colour[k] = ((ro->colour >> k) & 1) ? ~0ull : 0;
+    }
+
+    while(n) {
+        size_t b = dbit / 8;
+        int dsh = dbit % 8;
+        size_t cn = 64 - dsh;   // pixels in this word
+        if(cn > n) cn = n;
+        size_t nb = (dsh + cn + 7) / 8;
+        // edge mask, just the bits of the rectangle
+        uint64_t m = (64 == cn) ? ~0ull : ((((1ull << cn) - 1)) << (64 - dsh - cn));
+
+        uint64_t d[4], s[4];
+        for(int k = 0; k < 4; k++) {
+            d[k] = load_bits(&dst->data[dst->plane[k] + b], nb);
+            s[k] = (ROW_FILL == ro->mode) ? colour[k] : (fetch_bits(&src->data[src->plane[k]], sbit, cn) >> dsh);
+        }
+
+        if(ROW_KEY == ro->mode) {
+            // a pixel is drawn if any of its bits differ from the transparent colour
+            m &= (s[0] ^ colour[0]) | (s[1] ^ colour[1]) | (s[2] ^ colour[2]) | (s[3] ^ colour[3]);
+        } else if(ROP_AND == ro->op) {
+            for(int k = 0; k < 4; k++) s[k] &= d[k];
+        } else if(ROP_OR == ro->op) {
+            for(int k = 0; k < 4; k++) s[k] |= d[k];
+        } else if(ROP_XOR == ro->op) {
+            for(int k = 0; k < 4; k++) s[k] ^= d[k];
+        }
+
+        for(int k = 0; k < 4; k++) {
+            store_bits(&dst->data[dst->plane[k] + b], (d[k] & ~m) | (s[k] & m), nb);
+        }
+        dbit += cn;
+        sbit += cn;
+        n -= cn;
+    }
+}
+
+/// @brief works out how many pixels of a row of a rectangle the surface holds, as the last
+///        pixels of a line or of a plane may not be stored
+/// @param bit set on return to the first pixel of the row in the planes
+/// @return number of pixels, which may be 0
+static size_t row_span(const pln_surface_t *s, uint16_t x, uint16_t y, uint16_t w, size_t *bit) {
+    *bit = ((size_t)y * s->pitch) + x;
+    if(x >= s->line_px) return 0;
+    size_t n = ((x + w) > s->line_px) ? (s->line_px - x) : w;
+    if(*bit >= s->plane_px) return 0;
+    return ((*bit + n) > s->plane_px) ? (s->plane_px - *bit) : n;
+}
+
+int pln_surface(pln_surface_t *s, img_format_t format, const memstream_buf_t *buf, uint16_t width, uint16_t height) {
+    if((NULL == s) || (NULL == buf) || (NULL == buf->data) || (0 == width) || (0 == height)) {
+        return -1;  // NULL pointer error
+    }
+    if((IMG_EGA != format) && (IMG_AMIGA != format) && (IMG_BIN != format)) {
+        return -1;  // CGA pixels are packed, not planar
+    }
+    if(buf->len < img_file_size(format, width, height)) {
+        return -2;  // not enough image data
+    }
+
+    s->data = buf->data;
+    s->width = width;
+    s->height = height;
+    if(IMG_BIN == format) { // each line holds its 4 planes in turn
+        size_t ofs1 = width / 8;
+        for(int k = 0; k < 4; k++) {
+            s->plane[k] = ofs1 * k;
+        }
+        s->pitch = (size_t)(width / 2) * 8;
+        s->line_px = ofs1 * 8;
+        s->plane_px = s->pitch * height;
+    } else { // 4 full planes, the lines following on without any padding
+        size_t ofs2 = ((size_t)width * height) / 4; // as pln2lin() finds them
+        size_t ofs1 = ofs2 / 2;
+        s->plane[0] = 0;
+        s->plane[1] = ofs1;
+        s->plane[2] = ofs2;
+        s->plane[3] = ofs1 + ofs2;
+        s->pitch = width;
+        s->line_px = width;
+        s->plane_px = ofs1 * 8;
+    }
+    return 0;
+}
+
+/// @brief checks a rectangle lies within a surface
+static bool rect_fits(const pln_surface_t *s, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+    return (NULL != s) && (NULL != s->data) && (0 != w) && (0 != h) &&
+           (((size_t)x + w) <= s->width) && (((size_t)y + h) <= s->height);
+}
+
+/// @brief applies a row operation to each row of a rectangle
+static int raster_rect(pln_surface_t *dst, uint16_t x, uint16_t y, const pln_surface_t *src,
+                       uint16_t sx, uint16_t sy, uint16_t w, uint16_t h, const row_op_t *ro) {
+    if(!rect_fits(dst, x, y, w, h) || (ro->op > ROP_XOR) || (ro->colour > 15)) {
+        return -1;
+    }
+    if((ROW_FILL != ro->mode) && (!rect_fits(src, sx, sy, w, h) || (src->data == dst->data))) {
+        return -1;
+    }
+
+    for(uint16_t r = 0; r < h; r++) {
+        size_t dbit, sbit = 0;
+        size_t n = row_span(dst, x, y + r, w, &dbit);
+        if(ROW_FILL != ro->mode) {
+            size_t sn = row_span(src, sx, sy + r, w, &sbit);
+            if(sn < n) n = sn;
+        }
+        if(n) {
+            raster_row(dst, dbit, src, sbit, n, ro);
+        }
+    }
+    return 0;
+}
+
+int pln_blit(pln_surface_t *dst, uint16_t x, uint16_t y, const pln_surface_t *src,
+             uint16_t sx, uint16_t sy, uint16_t w, uint16_t h, raster_op_t op) {
+    row_op_t ro = {ROW_BLIT, op, 0};
+    return raster_rect(dst, x, y, src, sx, sy, w, h, &ro);
+}
+
+int pln_blit_key(pln_surface_t *dst, uint16_t x, uint16_t y, const pln_surface_t *src,
+                 uint16_t sx, uint16_t sy, uint16_t w, uint16_t h, uint8_t key) {
+    row_op_t ro = {ROW_KEY, ROP_COPY, key};
+    return raster_rect(dst, x, y, src, sx, sy, w, h, &ro);
+}
+
+int pln_fill(pln_surface_t *dst, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+             uint8_t colour, raster_op_t op) {
+    row_op_t ro = {ROW_FILL, op, colour};
+    return raster_rect(dst, x, y, NULL, 0, 0, w, h, &ro);
+}
@@ -0,0 +1,173 @@
+#include "ssi-img.h"
+#include "kernels.h"
+#include "ssi-trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "cga.h"
+
+size_t img_file_size(img_format_t format, uint16_t width, uint16_t height) {
+    switch(format) {
+        case IMG_CGA:   return CGA_IMG_SZ;
+        case IMG_AMIGA: return (((size_t)width * height) / 2) + AMIGA_PAL_SZ;
+        default:        return ((size_t)width * height) / 2;
+    }
+}
+
+/// @brief reads len bytes from the given offset in the file
+/// @return 0 on success, -2 if the file can't be read
+static int read_at(FILE *fp, size_t ofs, uint8_t *buf, size_t len) {
+    if(0 == len) return 0;
+    if(0 != fseek(fp, ofs, SEEK_SET)) return -2;
+    uint64_t t0 = TRACE_BEGIN();
+    int nr = fread(buf, len, 1, fp);
+    TRACE_END(TRACE_FREAD, t0);
+    return (1 == nr) ? 0 : -2;
+}
+
+int img_open(img_reader_t *rd, const char *fn, img_format_t format, uint16_t width, uint16_t height) {
+    return img_open_ctx(NULL, rd, fn, format, width, height);
+}
+
+int img_open_ctx(ssi_ctx_t *ctx, img_reader_t *rd, const char *fn, img_format_t format, uint16_t width, uint16_t height) {
+    int rval = 0;
+
+    if((NULL == rd) || (NULL == fn) || (0 == width) || (0 == height)) {
+        return -1;
+    }
+    memset(rd, 0, sizeof(img_reader_t));
+    rd->format = format;
+    rd->width = width;
+    rd->height = height;
+    rd->size = img_file_size(format, width, height);
+    rd->ctx = ctx;
+
+    if(NULL == (rd->fp = fopen(fn, "rb"))) {
+        rval = -2;
+        goto CLEANUP;
+    }
+
+    // check size
+    if(filesize(rd->fp) != rd->size) {
+        rval = -3;
+        goto CLEANUP;
+    }
+
+    // room for a line of raw bytes, planar lines that straddle plane bytes
+    // need an extra byte per plane
+    if(NULL == (rd->buf = ssi_alloc(ctx, ((width / 8) + 2) * 4))) {
+        rval = -4;
+        goto CLEANUP;
+    }
+
+    if(IMG_AMIGA == format) {
+        // read in the palette, it follows the framebuffer
+        uint8_t raw[AMIGA_PAL_SZ];
+        rval = read_at(rd->fp, rd->size - AMIGA_PAL_SZ, raw, AMIGA_PAL_SZ);
+        if(0 != rval) {
+            goto CLEANUP;
+        }
+        read_amiga_pal(rd->pal, raw);
+    }
+
+CLEANUP:
+    if(0 != rval) {
+        img_close(rd);
+    }
+    return rval;
+}
+
+int img_read_line(img_reader_t *rd, uint16_t y, uint8_t *line) {
+    int rval = 0;
+    uint16_t width = rd->width;
+
+    if((NULL == rd->fp) || (y >= rd->height)) {
+        return -1;
+    }
+
+    switch(rd->format) {
+        case IMG_BIN: {
+            size_t step = width / 2;  // bytes per line
+            size_t ofs1 = width / 8;  // bytes per plane per line
+            rval = read_at(rd->fp, step * y, rd->buf, step);
+            if(0 == rval) {
+                memset(line, 0, (width + 1) / 2);
+                kernels()->pln2nib(line, &rd->buf[0], &rd->buf[ofs1], &rd->buf[ofs1 * 2], &rd->buf[ofs1 * 3], ofs1);
+            }
+            break;
+        }
+        case IMG_CGA: {
+            size_t step = width / 4; // 4 pixels per byte
+            memset(line, 0, (width + 1) / 2);
+            if(y < (rd->height & ~1)) { // lines always come in interleved pairs
+                size_t ofs = cga_line_ofs(y, width, CGA_IMG_SZ);
+                rval = read_at(rd->fp, ofs, rd->buf, step);
+                if(0 == rval) {
+                    kernels()->lace2nib(line, rd->buf, step);
+                }
+            }
+            break;
+        }
+        default: { // EGA and Amiga, 4 full planes
+            size_t ofs2 = ((size_t)width * rd->height) / 4; // 1/2
+            size_t ofs1 = ofs2 / 2;                          // 1/4
+            size_t first = (size_t)y * width;                // first pixel of the line
+            size_t last = first + width;
+            if(last > (ofs1 * 8)) last = ofs1 * 8;           // only whole plane bytes hold pixels
+            memset(line, 0, (width + 1) / 2);
+            if(first >= last) break;
+
+            // gather the bytes covering the line from each of the planes
+            size_t plane[4] = {0, ofs1, ofs2, ofs1 + ofs2};
+            size_t b0 = first / 8;
+            size_t len = ((last + 7) / 8) - b0;
+            uint8_t *p[4];
+            for(int k = 0; (k < 4) && (0 == rval); k++) {
+                p[k] = &rd->buf[len * k];
+                rval = read_at(rd->fp, plane[k] + b0, p[k], len);
+            }
+            if(0 != rval) break;
+
+            if(0 == (first % 8) && (0 == (width % 8))) {
+                kernels()->pln2nib(line, p[0], p[1], p[2], p[3], width / 8);
+            } else { // line straddles plane bytes
+                pln2nib_bits(line, p[0], p[1], p[2], p[3], first % 8, last - first);
+            }
+            break;
+        }
+    }
+    return rval;
+}
+
+uint16_t line_scaler_init(line_scaler_t *ls, line_scale_t scale, uint16_t width, uint16_t height) {
+    uint32_t out;
+
+    if((NULL == ls) || (0 == width) || (0 == height)) {
+        return 0;
+    }
+    switch(scale) {
+        case SCALE_NONE:    out = height; break;
+        case SCALE_DOUBLE:  out = (uint32_t)height * 2; break;
+        case SCALE_ASPECT:  out = ((uint32_t)width * 3) / 4; break; // square pixels in a 4:3 frame
+        default:            return 0;
+    }
+    if((0 == out) || (out > UINT16_MAX)) {
+        return 0;
+    }
+    ls->step = (uint32_t)(((uint64_t)height << 16) / out);
+    ls->height = height;
+    ls->out_height = out;
+    return out;
+}
+
+uint16_t line_scaler_src(const line_scaler_t *ls, uint16_t y) {
+    uint32_t src = (uint32_t)((((uint64_t)y * ls->step) + (ls->step >> 1)) >> 16);
+    return (src < (uint32_t)ls->height) ? (uint16_t)src : (uint16_t)(ls->height - 1);
+}
+
+void img_close(img_reader_t *rd) {
+    if(NULL == rd) return;
+    fclose_s(rd->fp);
+    ssi_release(rd->ctx, rd->buf);
+    rd->buf = NULL;
+}
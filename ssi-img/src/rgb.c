@@ -0,0 +1,82 @@
+#include "ssi-img.h"
+#include "kernels.h"
+#include <string.h>
+
+/// @brief returns the bytes per pixel of a true colour format
+static size_t rgb_bytes(rgb_format_t rgb) {
+    return ((RGB_RGBA32 == rgb) || (RGB_BGRA32 == rgb)) ? 4 : 3;
+}
+
+/// @brief splits a palette into a table per output byte, in the order the format wants
+static void split_pal(pal16_t *split, rgb_format_t rgb, const pal_entry_t *pal) {
+    int bgr = (RGB_BGR24 == rgb) || (RGB_BGRA32 == rgb);
+    for(int c = 0; c < 16; c++) {
+        split->chan[0][c] = bgr ? pal[c].b : pal[c].r;
+        split->chan[1][c] = pal[c].g;
+        split->chan[2][c] = bgr ? pal[c].r : pal[c].b;
+        split->chan[3][c] = 0xff; // opaque
+    }
+}
+
+size_t img_rgb_size(rgb_format_t rgb, uint16_t width, uint16_t height) {
+    return rgb_bytes(rgb) * width * height;
+}
+
+int lin2rgb(rgb_format_t rgb, memstream_buf_t *dst, const memstream_buf_t *src, const pal_entry_t *pal) {
+    if((NULL == dst) || (NULL == src) || (NULL == dst->data) || (NULL == src->data) || (NULL == pal)) {
+        return -1;  // NULL pointer error
+    }
+    if(rgb > RGB_BGRA32) {
+        return -1;
+    }
+    size_t bpp = rgb_bytes(rgb);
+    if(dst->len < (src->len * bpp)) {
+        return -3;  // no room for the pixels
+    }
+
+    pal16_t split;
+    split_pal(&split, rgb, pal);
+    if(4 == bpp) {
+        kernels()->lin2rgb32(dst->data, src->data, &split, src->len);
+    } else {
+        kernels()->lin2rgb24(dst->data, src->data, &split, src->len);
+    }
+    dst->pos = src->len * bpp;
+    return 0;
+}
+
+int img_decode_rgb(img_format_t format, rgb_format_t rgb, memstream_buf_t *dst, const memstream_buf_t *src,
+                   uint16_t width, uint16_t height, const pal_entry_t *pal) {
+    if((NULL == dst) || (NULL == dst->data) || (rgb > RGB_BGRA32)) {
+        return -1;
+    }
+    if((NULL == pal) && (IMG_AMIGA != format)) {
+        return -1;  // only Amiga images carry a palette
+    }
+    size_t len = img_rgb_size(rgb, width, height);
+    size_t need = img_decoded_size(width, height);
+    if(dst->len < len) {
+        return -3;  // no room for the image
+    }
+
+    // decode the colour indices into the end of the output, then expand them in place
+    pal_entry_t own[16];
+    memstream_buf_t lin = {need, 0, &dst->data[len - need]};
+    int rval = img_decode(format, &lin, src, width, height, own);
+    if(0 != rval) {
+        return rval;
+    }
+    if(NULL == pal) {
+        for(int c = 0; c < 16; c++) { // 4 bits per component up to 8
+            own[c].r *= 17;
+            own[c].g *= 17;
+            own[c].b *= 17;
+        }
+        pal = own;
+    }
+
+    memstream_buf_t out = {len, 0, dst->data};
+    lin2rgb(rgb, &out, &lin, pal);
+    dst->pos = len;
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "ssi-ctx.h"
+#include <stdlib.h>
+#include <string.h>
+
+// alignment of everything handed out, enough for any of the SIMD kernels
+#define ARENA_ALIGN (16)
+#define ARENA_MIN_BLOCK (64 * 1024)
+
+// the block header is padded so the data that follows it stays aligned
+#define BLOCK_HDR_SZ ((sizeof(arena_block_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define BLOCK_DATA(B) (((uint8_t *)(B)) + BLOCK_HDR_SZ)
+
+/// @brief adds a new empty block of at least size bytes to the front of the chain
+/// @return 0 on success, -1 if out of memory
+static int add_block(ssi_ctx_t *ctx, size_t size) {
+    arena_block_t *blk = malloc(BLOCK_HDR_SZ + size);
+    if(NULL == blk) {
+        return -1;
+    }
+    blk->next = ctx->head;
+    blk->size = size;
+    blk->used = 0;
+    ctx->head = blk;
+    ctx->total += size;
+    return 0;
+}
+
+int ssi_ctx_init(ssi_ctx_t *ctx, size_t reserve) {
+    memset(ctx, 0, sizeof(ssi_ctx_t));
+    if(reserve) {
+        return add_block(ctx, reserve);
+    }
+    return 0;
+}
+
+void ssi_ctx_reset(ssi_ctx_t *ctx) {
+    ctx->used = 0;
+    if(NULL == ctx->head) {
+        return;
+    }
+    if(NULL == ctx->head->next) { // just the one block, nothing to merge
+        ctx->head->used = 0;
+        return;
+    }
+
+    // the arena grew, replace the chain with one block big enough for all of it
+    size_t size = ctx->total;
+    ssi_ctx_free(ctx);
+    add_block(ctx, size); // on failure we simply start over from empty
+}
+
+void ssi_ctx_free(ssi_ctx_t *ctx) {
+    size_t peak = ctx->peak;
+    while(NULL != ctx->head) {
+        arena_block_t *blk = ctx->head;
+        ctx->head = blk->next;
+        free(blk);
+    }
+    memset(ctx, 0, sizeof(ssi_ctx_t));
+    ctx->peak = peak;
+}
+
+void *ssi_alloc(ssi_ctx_t *ctx, size_t len) {
+    if(NULL == ctx) {
+        return malloc(len ? len : 1);
+    }
+
+    len = (len + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    arena_block_t *blk = ctx->head;
+    if((NULL == blk) || ((blk->size - blk->used) < len)) {
+        // grow geometrically so a run of allocations only adds a few blocks
+        size_t size = (NULL == blk) ? ARENA_MIN_BLOCK : (blk->size * 2);
+        if(size < len) size = len;
+        if(0 != add_block(ctx, size)) {
+            return NULL;
+        }
+        blk = ctx->head;
+    }
+
+    void *ptr = BLOCK_DATA(blk) + blk->used;
+    blk->used += len;
+    ctx->used += len;
+    if(ctx->used > ctx->peak) ctx->peak = ctx->used;
+    return ptr;
+}
+
+void *ssi_zalloc(ssi_ctx_t *ctx, size_t len) {
+    void *ptr = ssi_alloc(ctx, len);
+    if(NULL != ptr) {
+        memset(ptr, 0, len);
+    }
+    return ptr;
+}
+
+char *ssi_strdup(ssi_ctx_t *ctx, const char *str, size_t extra) {
+    size_t len = strlen(str);
+    char *dup = ssi_alloc(ctx, len + extra + 1);
+    if(NULL != dup) {
+        memcpy(dup, str, len + 1);
+    }
+    return dup;
+}
+
+void ssi_release(ssi_ctx_t *ctx, void *ptr) {
+    if(NULL == ctx) {
+        free(ptr);
+    }
+}
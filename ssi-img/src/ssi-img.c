@@ -1,132 +1,603 @@
 #include "ssi-img.h"
+#include "ssi-ctx.h"
 #include "pal.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "util.h"
+#include "kernels.h"
+#include "ssi-trace.h"
+#include "cga.h"
 
-int load_file(memstream_buf_t *buf, const char *fn) {
-    int rval = -1;
-    FILE *fi = NULL;
-    memstream_buf_t src = {0, 0, NULL};
+void read_amiga_pal(pal_entry_t *pal, const uint8_t *raw) {
+    for(int p = 0; p < 16; p++) {
+        uint16_t entry = raw[p * 2];
+        entry <<= 8;
+        entry |= raw[p * 2 + 1];
+        pal[p].b = entry & 0x0f;
+        entry >>= 4;
+        pal[p].g = entry & 0x0f;
+        entry >>= 4;
+        pal[p].r = entry & 0x0f;
+    }
+}
 
-    // open the input file
-    if(NULL == (fi = fopen(fn,"rb"))) {
-        goto CLEANUP;
+/// @brief writes the Amiga palette, 2 bytes per entry, 4 bits per colour
+/// @param raw pointer to where the palette goes in the file
+/// @param pal 16 entry palette, 4 bits per component
+static void write_amiga_pal(uint8_t *raw, const pal_entry_t *pal) {
+    for(int p = 0; p < 16; p++) {
+        uint16_t entry = pal[p].r & 0x0f;
+        entry <<= 4;
+        entry |= pal[p].g & 0x0f;
+        entry <<= 4;
+        entry |= pal[p].b & 0x0f;
+        raw[p * 2] = entry >> 8;
+        raw[p * 2 + 1] = entry & 0xff;
     }
+}
 
-    // determine size of image file
-    size_t fsz = filesize(fi);
+/// @brief maps the image file, checking it is the expected size
+/// @param mf pointer to the mapped file to set up
+/// @param fn name of the file to map
+/// @param len expected size of the file
+/// @return 0 on success, otherwise an error code
+static int load_file(mapped_file_t *mf, const char *fn, size_t len) {
+    // map the input file, or read it in if mapping isn't possible
+    if(0 != map_file(mf, fn, true)) {
+        return -1;
+    }
 
     // check size
-    if(fsz != buf->len) {
-        goto CLEANUP;
+    if(mf->buf.len != len) {
+        unmap_file(mf);
+        return -1;
     }
+    return 0;
+}
 
-    // read in the file
-    int nr = fread(buf->data, buf->len, 1, fi);
-    if(1 != nr) {
+/// @brief allocates the frame buffer, 1 byte per pixel, if the caller didn't provide one
+/// @param ctx context to allocate from, or NULL to use malloc
+/// @param dst memstream buffer for the frame
+/// @return 1 if the buffer was allocated, 0 if one was provided, -1 if out of memory
+static int alloc_frame(ssi_ctx_t *ctx, memstream_buf_t *dst, int width, int height) {
+    if(NULL != dst->data) {
+        return 0;
+    }
+    // not zeroed, the decoders write nearly every pixel and clear_tail() does the rest
+    dst->len = (size_t)width * height;
+    dst->pos = 0;
+    if(NULL == (dst->data = ssi_alloc(ctx, dst->len))) {
+        dst->len = 0;
+        return -1;
+    }
+    return 1;
+}
+
+/// @brief zeroes any part of a frame from alloc_frame() the image data didn't reach
+static void clear_tail(memstream_buf_t *dst, int allocated) {
+    if((1 == allocated) && (dst->pos < dst->len)) {
+        memset(&dst->data[dst->pos], 0, dst->len - dst->pos);
+    }
+}
+
+/// @brief undoes alloc_frame() when the load fails
+static void release_frame(ssi_ctx_t *ctx, memstream_buf_t *dst, int allocated) {
+    if(1 == allocated) {
+        ssi_release(ctx, dst->data);
+        dst->data = NULL;
+        dst->len = 0;
+    }
+}
+
+int load_cga_img_ctx(ssi_ctx_t *ctx, memstream_buf_t *dst, const char *fn, int width, int height) {
+    int rval = -1;
+    mapped_file_t src = {0};
+    int allocated = 0;
+
+    // map the packed image, it must be the expected size
+    if(0 != load_file(&src, fn, CGA_IMG_SZ)) {
         goto CLEANUP;
     }
+    if(0 > (allocated = alloc_frame(ctx, dst, width, height))) {
+        goto CLEANUP;
+    }
+
+    lace2lin(dst, &src.buf, width, height); // de-interlace the image
+    clear_tail(dst, allocated);
 
     rval = 0;
 CLEANUP:
-    fclose_s(fi);
+    if(0 != rval) {
+        release_frame(ctx, dst, allocated);
+    }
+    unmap_file(&src);
     return rval;
 }
 
-// CGA imags have a fixed size
-#define CGA_IMG_SZ (16384)
 int load_cga_img(memstream_buf_t *dst, const char *fn, int width, int height) {
-    int rval = -1;
-    memstream_buf_t src = {0, 0, NULL};
+    return load_cga_img_ctx(NULL, dst, fn, width, height);
+}
 
-    // allocate the packed image buffer based on the expected size
-    src.len = CGA_IMG_SZ;
-    if(NULL == (src.data = calloc(1, src.len))) {
+int load_ega_img_ctx(ssi_ctx_t *ctx, memstream_buf_t *dst, const char *fn, int width, int height) {
+    int rval = -1;
+    mapped_file_t src = {0};
+    int allocated = 0;
+    
+    // map the packed image, it must be the expected size
+    if(0 != load_file(&src, fn, ((width * height) / 2))) {
         goto CLEANUP;
     }
-
-    if(0 != load_file(&src, fn)) {
+    if(0 > (allocated = alloc_frame(ctx, dst, width, height))) {
         goto CLEANUP;
     }
 
-    lace2lin(dst, &src, width, height); // de-interlace the image
+    pln2lin(dst, &src.buf); // deplane the image
+    clear_tail(dst, allocated);
 
     rval = 0;
 CLEANUP:
-    free_s(src.data);
+    if(0 != rval) {
+        release_frame(ctx, dst, allocated);
+    }
+    unmap_file(&src);
     return rval;
 }
 
 int load_ega_img(memstream_buf_t *dst, const char *fn, int width, int height) {
+    return load_ega_img_ctx(NULL, dst, fn, width, height);
+}
+
+int load_amiga_img_ctx(ssi_ctx_t *ctx, memstream_buf_t *dst, const char *fn, int width, int height, pal_entry_t *pal) {
     int rval = -1;
-    memstream_buf_t src = {0, 0, NULL};
+    mapped_file_t src = {0};
+    int allocated = 0;
     
-    // allocate the packed image buffer based on the expected size
-    src.len = ((width * height) / 2);
-    if(NULL == (src.data = calloc(1, src.len))) {
+    // map the packed image, it must be the expected size
+    if(0 != load_file(&src, fn, ((width * height) / 2) + AMIGA_PAL_SZ)) {
         goto CLEANUP;
     }
-
-    if(0 != load_file(&src, fn)) {
+    if(0 > (allocated = alloc_frame(ctx, dst, width, height))) {
         goto CLEANUP;
     }
 
-    pln2lin(dst, &src); // deplane the image
+    // the framebuffer is followed by the palette
+    memstream_buf_t img = src.buf;
+    img.len -= AMIGA_PAL_SZ;
+    pln2lin(dst, &img); // deplane the image
+    clear_tail(dst, allocated);
+
+    read_amiga_pal(pal, &img.data[img.len]); // the palette follows the framebuffer
 
     rval = 0;
 CLEANUP:
-    free_s(src.data);
+    if(0 != rval) {
+        release_frame(ctx, dst, allocated);
+    }
+    unmap_file(&src);
     return rval;
 }
 
 int load_amiga_img(memstream_buf_t *dst, const char *fn, int width, int height, pal_entry_t *pal) {
-    int rval = -1;
-    memstream_buf_t src = {0, 0, NULL};
-    
-    // allocate the packed image buffer based on the expected size
-    src.len = ((width * height) / 2) + 64;
-    if(NULL == (src.data = calloc(1, src.len))) {
-        goto CLEANUP;
+    return load_amiga_img_ctx(NULL, dst, fn, width, height, pal);
+}
+
+size_t img_decoded_size(uint16_t width, uint16_t height) {
+    return (size_t)width * height;
+}
+
+bool img_fits(img_format_t format, uint16_t width, uint16_t height) {
+    if((0 == width) || (0 == height) || (format > IMG_AMIGA)) {
+        return false;
     }
+    return (IMG_CGA != format) || cga_fits(width, height, CGA_IMG_SZ);
+}
 
-    if(0 != load_file(&src, fn)) {
-        goto CLEANUP;
+/// @brief checks the image parameters common to decoding and encoding
+/// @return 0 if they are usable, -1 if not
+static int check_params(img_format_t format, const memstream_buf_t *dst, const memstream_buf_t *src,
+                        uint16_t width, uint16_t height) {
+    if((NULL == dst) || (NULL == src) || (NULL == dst->data) || (NULL == src->data)) {
+        return -1;  // NULL pointer error
+    }
+    return img_fits(format, width, height) ? 0 : -1;
+}
+
+int img_decode(img_format_t format, memstream_buf_t *dst, const memstream_buf_t *src,
+               uint16_t width, uint16_t height, pal_entry_t *pal) {
+    if(0 != check_params(format, dst, src, width, height)) {
+        return -1;
+    }
+
+    size_t len = img_file_size(format, width, height);
+    size_t need = img_decoded_size(width, height);
+    if(src->len < len) {
+        return -2;  // not enough image data
+    }
+    if(dst->len < need) {
+        return -3;  // no room for the image
     }
 
-    size_t realsize = src.len;
-    src.len -= 64;
-    pln2lin(dst, &src); // deplane the image
+    // work on views of exactly the image, the codecs find the planes
+    // and CGA line blocks from the buffer lengths
+    memstream_buf_t in = {len, 0, src->data};
+    memstream_buf_t out = {need, 0, dst->data};
+    if(IMG_AMIGA == format) {
+        if(NULL != pal) {
+            read_amiga_pal(pal, &in.data[len - AMIGA_PAL_SZ]); // the palette follows the framebuffer
+        }
+        in.len -= AMIGA_PAL_SZ; // the framebuffer is as EGA
+    }
 
-    src.pos = src.len; // point to the end of the framebuffer / start of palette
-    src.len = realsize;
+    if(IMG_CGA == format) {
+        lace2lin(&out, &in, width, height); // de-interlace the image
+    } else if(IMG_BIN == format) {
+        ipln2lin(&out, &in, width, height); // deplane (interleaved) the image
+    } else {
+        pln2lin(&out, &in); // deplane the image
+    }
 
-    // read in the palette, 2 bytes per entry, 4 bits per colour
-    for(int p = 0; p < 16; p++) {
-        uint16_t entry = src.data[src.pos++];
-        entry <<= 8;
-        entry |= src.data[src.pos++];
-        pal[p].b = entry & 0x0f;
-        entry >>= 4;
-        pal[p].g = entry & 0x0f;
-        entry >>= 4;
-        pal[p].r = entry & 0x0f;
+    // lines the image data didn't reach, eg an odd last CGA line, are left blank
+    if(out.pos < need) {
+        memset(&out.data[out.pos], 0, need - out.pos);
     }
+    dst->pos = need;
+    return 0;
+}
+
+/// @brief deplanes a run of pixels that need not start or end on a plane byte, only the
+///        plane bytes covering the run are read
+/// @param dst pointer to the output, 1 byte per pixel
+/// @param plane pointers to the start of each of the 4 planes
+/// @param first index of the first pixel within the planes
+/// @param count number of pixels to convert
+static void deplane_run(uint8_t *dst, const uint8_t *const plane[4], size_t first, size_t count) {
+    size_t b = first / 8;
+    size_t skip = first % 8;
+    uint8_t px[8];
+
+    if(skip) { // leading edge, only the low bits of the first byte are wanted
+        pln2lin_scalar(px, &plane[0][b], &plane[1][b], &plane[2][b], &plane[3][b], 1);
+        size_t n = ((8 - skip) < count) ? (8 - skip) : count;
+        memcpy(dst, &px[skip], n);
+        dst += n;
+        count -= n;
+        b++;
+    }
+    size_t bulk = count / 8;
+    if(bulk) {
+        kernels()->pln2lin(dst, &plane[0][b], &plane[1][b], &plane[2][b], &plane[3][b], bulk);
+        dst += bulk * 8;
+        b += bulk;
+    }
+    if(count % 8) { // trailing edge, only the high bits of the last byte
+        pln2lin_scalar(px, &plane[0][b], &plane[1][b], &plane[2][b], &plane[3][b], 1);
+        memcpy(dst, px, count % 8);
+    }
+}
+
+/// @brief unpacks a run of CGA pixels that need not start or end on a byte, only the bytes
+///        covering the run are read
+/// @param dst pointer to the output, 1 byte per pixel
+/// @param src pointer to the start of the line
+/// @param first index of the first pixel within the line
+/// @param count number of pixels to convert
+static void unlace_run(uint8_t *dst, const uint8_t *src, size_t first, size_t count) {
+    size_t b = first / 4;
+    size_t skip = first % 4;
+    uint8_t px[4];
+
+    if(skip) {
+        lace2lin_scalar(px, &src[b], 1);
+        size_t n = ((4 - skip) < count) ? (4 - skip) : count;
+        memcpy(dst, &px[skip], n);
+        dst += n;
+        count -= n;
+        b++;
+    }
+    size_t bulk = count / 4;
+    if(bulk) {
+        kernels()->lace2lin(dst, &src[b], bulk);
+        dst += bulk * 4;
+        b += bulk;
+    }
+    if(count % 4) {
+        lace2lin_scalar(px, &src[b], 1);
+        memcpy(dst, px, count % 4);
+    }
+}
+
+int img_decode_rect(img_format_t format, memstream_buf_t *dst, const memstream_buf_t *src,
+                    uint16_t width, uint16_t height, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                    pal_entry_t *pal) {
+    if(0 != check_params(format, dst, src, width, height)) {
+        return -1;
+    }
+    if((0 == w) || (0 == h) || (((size_t)x + w) > width) || (((size_t)y + h) > height)) {
+        return -1;  // the rectangle must lie within the image
+    }
+
+    size_t len = img_file_size(format, width, height);
+    size_t need = img_decoded_size(w, h);
+    if(src->len < len) {
+        return -2;  // not enough image data
+    }
+    if(dst->len < need) {
+        return -3;  // no room for the rectangle
+    }
+    if(IMG_AMIGA == format) {
+        if(NULL != pal) {
+            read_amiga_pal(pal, &src->data[len - AMIGA_PAL_SZ]);
+        }
+        len -= AMIGA_PAL_SZ;
+    }
+
+    // pixels the image data doesn't reach come out as 0, as they do from img_decode()
+    memset(dst->data, 0, need);
+    for(int r = 0; r < h; r++) {
+        uint8_t *out = &dst->data[(size_t)r * w];
+        size_t line = y + r;
+
+        if(IMG_CGA == format) {
+            size_t step = width / 4; // 4 pixels per byte
+            if(line >= (size_t)(height & ~1)) continue; // lines always come in interleved pairs
+            size_t avail = step * 4; // pixels each line holds
+            if(x >= avail) continue;
+            const uint8_t *data = &src->data[cga_line_ofs(line, width, len)];
+            unlace_run(out, data, x, ((x + w) > avail) ? (avail - x) : w);
+        } else if(IMG_BIN == format) {
+            size_t ofs1 = width / 8; // bytes per plane per line
+            size_t avail = ofs1 * 8;
+            if(x >= avail) continue;
+            const uint8_t *data = &src->data[line * (width / 2)];
+            const uint8_t *plane[4] = {&data[0], &data[ofs1], &data[ofs1 * 2], &data[ofs1 * 3]};
+            deplane_run(out, plane, x, ((x + w) > avail) ? (avail - x) : w);
+        } else { // EGA and the Amiga framebuffer, 4 full planes
+            size_t ofs2 = len / 2;
+            size_t ofs1 = ofs2 / 2;
+            size_t avail = ofs1 * 8; // only whole plane bytes hold pixels
+            size_t first = (line * width) + x;
+            if(first >= avail) continue;
+            const uint8_t *plane[4] = {&src->data[0], &src->data[ofs1], &src->data[ofs2], &src->data[ofs1 + ofs2]};
+            deplane_run(out, plane, first, ((first + w) > avail) ? (avail - first) : w);
+        }
+    }
+    dst->pos = need;
+    return 0;
+}
+
+/// @brief reads a single pixel of an SSI image, only the bytes holding it are touched. Lines
+///        are laid out as img_read_line() reads them, pixels the data doesn't reach are 0
+/// @param data the framebuffer, without any Amiga palette
+/// @param len size of the framebuffer
+static uint8_t pixel_at(img_format_t format, const uint8_t *data, size_t len,
+                        uint16_t width, uint16_t height, size_t x, size_t y) {
+    if(IMG_CGA == format) {
+        size_t step = width / 4; // 4 pixels per byte
+        if((y >= (size_t)(height & ~1)) || (x >= (step * 4))) return 0;
+        uint8_t b = data[cga_line_ofs(y, width, len) + (x / 4)];
+        return (b >> (6 - ((x % 4) * 2))) & 0x03;
+    }
+
+    const uint8_t *p0;
+    size_t ofs1, ofs2, b;
+    if(IMG_BIN == format) { // the planes of each line sit together
+        ofs1 = width / 8;
+        ofs2 = ofs1 * 2;
+        if(x >= (ofs1 * 8)) return 0;
+        p0 = &data[y * (width / 2)];
+        b = x / 8;
+    } else { // EGA and the Amiga framebuffer, 4 full planes
+        ofs2 = len / 2;
+        ofs1 = ofs2 / 2;
+        size_t i = (y * width) + x;
+        if(i >= (ofs1 * 8)) return 0;
+        p0 = data;
+        b = i / 8;
+        x = i;
+    }
+    int bit = 7 - (x % 8); // left most pixel in the most significant bit
+    return (((p0[b] >> bit) & 1)) | (((p0[ofs1 + b] >> bit) & 1) << 1) |
+           (((p0[ofs2 + b] >> bit) & 1) << 2) | (((p0[ofs1 + ofs2 + b] >> bit) & 1) << 3);
+}
+
+int img_decode_thumb(ssi_ctx_t *ctx, img_format_t format, memstream_buf_t *dst, const memstream_buf_t *src,
+                     uint16_t width, uint16_t height, int shift, thumb_filter_t filter, pal_entry_t *pal) {
+    int rval = 0;
+    uint8_t *line = NULL;   // a source line, THUMB_MAJORITY only
+    uint8_t *counts = NULL; // how often each colour appears in each box of a row, THUMB_MAJORITY only
+
+    if(0 != check_params(format, dst, src, width, height)) {
+        return -1;
+    }
+    if((shift < 1) || (shift > 3) || (filter > THUMB_MAJORITY)) {
+        return -1;
+    }
+    size_t step = (size_t)1 << shift;   // source pixels per thumbnail pixel, each way
+    size_t tw = width >> shift;         // only whole boxes are used
+    size_t th = height >> shift;
+    if((0 == tw) || (0 == th)) {
+        return -1;  // image smaller than a single box
+    }
+
+    size_t len = img_file_size(format, width, height);
+    if(src->len < len) {
+        return -2;  // not enough image data
+    }
+    if(dst->len < (tw * th)) {
+        return -3;  // no room for the thumbnail
+    }
+    if(IMG_AMIGA == format) {
+        if(NULL != pal) {
+            read_amiga_pal(pal, &src->data[len - AMIGA_PAL_SZ]);
+        }
+        len -= AMIGA_PAL_SZ;
+    }
+
+    if(THUMB_NEAREST == filter) { // just the top left pixel of each box
+        for(size_t ty = 0; ty < th; ty++) {
+            uint8_t *out = &dst->data[ty * tw];
+            for(size_t tx = 0; tx < tw; tx++) {
+                out[tx] = pixel_at(format, src->data, len, width, height, tx * step, ty * step);
+            }
+        }
+        dst->pos = tw * th;
+        return 0;
+    }
+
+    // the most common colour in each box, ties going to the top left pixel. Boxes are at
+    // most 8x8, so the counts fit a byte
+    size_t used = tw * step; // pixels of each line that fall in a box
+    line = ssi_alloc(ctx, used);
+    counts = ssi_alloc(ctx, tw * 16);
+    if((NULL == line) || (NULL == counts)) {
+        rval = -4;  // unable to allocate mem
+        goto CLEANUP;
+    }
+    memstream_buf_t lb = {used, 0, line};
+    memstream_buf_t in = {src->len, 0, src->data};
+    for(size_t ty = 0; ty < th; ty++) {
+        uint8_t *out = &dst->data[ty * tw];
+        memset(counts, 0, tw * 16);
+        for(size_t r = 0; r < step; r++) {
+            img_decode_rect(format, &lb, &in, width, height, 0, (ty * step) + r, used, 1, NULL);
+            for(size_t x = 0; x < used; x++) {
+                counts[((x >> shift) * 16) + (line[x] & 0x0f)]++;
+            }
+            if(0 == r) {
+                for(size_t tx = 0; tx < tw; tx++) {
+                    out[tx] = line[tx * step];
+                }
+            }
+        }
+        for(size_t tx = 0; tx < tw; tx++) {
+            const uint8_t *c = &counts[tx * 16];
+            uint8_t best = out[tx];
+            for(int i = 0; i < 16; i++) {
+                if(c[i] > c[best]) best = i;
+            }
+            out[tx] = best;
+        }
+    }
+    dst->pos = tw * th;
 
-    rval = 0;
 CLEANUP:
-    free_s(src.data);
+    ssi_release(ctx, line);
+    ssi_release(ctx, counts);
     return rval;
 }
 
-int save_cga_img(const char fn, memstream_buf_t src, int width, int height) {
+int img_encode(img_format_t format, memstream_buf_t *dst, const memstream_buf_t *src,
+               uint16_t width, uint16_t height, const pal_entry_t *pal) {
+    if(0 != check_params(format, dst, src, width, height)) {
+        return -1;
+    }
+    if((IMG_AMIGA == format) && (NULL == pal)) {
+        return -1;  // Amiga images carry their palette
+    }
+
+    size_t len = img_file_size(format, width, height);
+    size_t have = img_decoded_size(width, height);
+    if(src->len < have) {
+        return -2;  // not enough image data
+    }
+    if(dst->len < len) {
+        return -3;  // no room for the image
+    }
+
+    memstream_buf_t in = {have, 0, src->data};
+    memstream_buf_t out = {len, 0, dst->data};
+    if(IMG_AMIGA == format) {
+        // the 16 entries only fill the first half of the palette block
+        out.len -= AMIGA_PAL_SZ;
+        memset(&out.data[out.len], 0, AMIGA_PAL_SZ);
+        write_amiga_pal(&out.data[out.len], pal);
+    }
+
+    if(IMG_CGA == format) {
+        memset(out.data, 0, len); // the lines need not fill either half
+        lin2lace(&out, &in, width, height);
+    } else if(IMG_BIN == format) {
+        if(width % 8) { // the planes don't fill their lines
+            memset(out.data, 0, len);
+        }
+        lin2ipln(&out, &in, width, height);
+    } else { // EGA, and the Amiga framebuffer
+        if(out.len % 4) { // the planes then leave gaps between them
+            memset(out.data, 0, out.len);
+        }
+        lin2pln(&out, &in);
+    }
+    dst->pos = len;
     return 0;
 }
 
-int save_ega_img(const char fn, memstream_buf_t src, int width, int height) {
-    return 0;
+/// @brief encodes the image and writes it to a file
+/// @return 0 on success, -1 on bad parameters, -2 if the file can't be created,
+///         -3 if out of memory, -4 if the file can't be written
+static int save_img(ssi_ctx_t *ctx, img_format_t format, const char *fn, memstream_buf_t *src,
+                    int width, int height, const pal_entry_t *pal) {
+    int rval = 0;
+    FILE *fp = NULL;
+    memstream_buf_t img = {0, 0, NULL};
+
+    if((NULL == fn) || (width <= 0) || (height <= 0) || (width > UINT16_MAX) || (height > UINT16_MAX)) {
+        return -1;
+    }
+
+    img.len = img_file_size(format, width, height);
+    if(NULL == (img.data = ssi_alloc(ctx, img.len))) {
+        rval = -3;  // unable to allocate mem
+        goto CLEANUP;
+    }
+    if(0 != img_encode(format, &img, src, width, height, pal)) {
+        rval = -1;
+        goto CLEANUP;
+    }
+
+    if(NULL == (fp = fopen(fn, "wb"))) {
+        rval = -2;  // can't open/create output file
+        goto CLEANUP;
+    }
+    uint64_t t0 = TRACE_BEGIN();
+    int nr = fwrite(img.data, img.len, 1, fp);
+    TRACE_END(TRACE_FWRITE, t0);
+    if(1 != nr) {
+        rval = -4;  // unable to write file
+        goto CLEANUP;
+    }
+    int err = fclose(fp);
+    fp = NULL;
+    if(0 != err) {
+        rval = -4;  // unable to write file
+    }
+
+CLEANUP:
+    fclose_s(fp);
+    ssi_release(ctx, img.data);
+    return rval;
 }
 
-int save_amiga_img(const char fn, memstream_buf_t src, int width, int height, pal_entry_t *pal) {
-    return 0;
+int save_cga_img_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, int width, int height) {
+    return save_img(ctx, IMG_CGA, fn, src, width, height, NULL);
+}
+
+int save_cga_img(const char *fn, memstream_buf_t *src, int width, int height) {
+    return save_img(NULL, IMG_CGA, fn, src, width, height, NULL);
+}
+
+int save_ega_img_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, int width, int height) {
+    return save_img(ctx, IMG_EGA, fn, src, width, height, NULL);
+}
+
+int save_ega_img(const char *fn, memstream_buf_t *src, int width, int height) {
+    return save_img(NULL, IMG_EGA, fn, src, width, height, NULL);
+}
+
+int save_amiga_img_ctx(ssi_ctx_t *ctx, const char *fn, memstream_buf_t *src, int width, int height, pal_entry_t *pal) {
+    return save_img(ctx, IMG_AMIGA, fn, src, width, height, pal);
+}
+
+int save_amiga_img(const char *fn, memstream_buf_t *src, int width, int height, pal_entry_t *pal) {
+    return save_img(NULL, IMG_AMIGA, fn, src, width, height, pal);
 }
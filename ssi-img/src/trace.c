@@ -0,0 +1,236 @@
+#include "ssi-trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#define ATOMIC_INC(p) (_InterlockedIncrement((volatile long *)(p)) - 1)
+#else
+#define THREAD_LOCAL _Thread_local
+#define ATOMIC_INC(p) __atomic_fetch_add((p), 1, __ATOMIC_RELAXED)
+#endif
+
+// a single span, kept for the trace export
+typedef struct {
+    uint64_t    t0;     // start, ns
+    uint32_t    dur;    // duration, ns, long enough for 4 seconds
+    uint32_t    stage;
+} trace_event_t;
+
+// what a thread has collected, only ever written by that thread
+typedef struct {
+    int             id;         // index in the thread table, shown as the thread id
+    trace_stat_t    stats[TRACE_STAGES];
+    trace_event_t   *events;    // malloc'd, grown as needed
+    uint32_t        count;      // events kept
+    uint32_t        size;       // room for events
+    uint64_t        dropped;    // events that didn't fit
+} trace_thread_t;
+
+static const char *stage_names[TRACE_STAGES] = {
+    "load", "fread", "fwrite",
+    "pln2lin", "ipln2lin", "lace2lin", "lin2pln", "lin2ipln", "lin2lace",
+    "pln2bmp4", "ipln2bmp4", "lace2bmp4", "bmp42img",
+    "palette", "save_bmp4", "load_bmp4", "diff", "histogram"
+};
+
+volatile bool ssi_trace_on = false;
+static bool keep_events = false;
+static trace_thread_t *threads[TRACE_MAX_THREADS];
+static volatile long thread_count = 0; // slots handed out, may pass TRACE_MAX_THREADS
+static THREAD_LOCAL trace_thread_t *self = NULL;
+static THREAD_LOCAL bool untraced = false; // no slot or no memory, so this thread is skipped
+
+bool ssi_trace_available(void) {
+#ifdef SSI_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ssi_trace_enable(bool events) {
+    keep_events = events;
+    ssi_trace_on = true;
+}
+
+void ssi_trace_disable(void) {
+    ssi_trace_on = false;
+}
+
+uint64_t ssi_trace_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER f, c;
+    QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&c);
+    return (uint64_t)((c.QuadPart / f.QuadPart) * 1000000000ull) +
+           (uint64_t)(((c.QuadPart % f.QuadPart) * 1000000000ull) / f.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+#endif
+}
+
+/// @brief finds this thread's collection, setting it up on first use
+static trace_thread_t *this_thread(void) {
+    if((NULL != self) || untraced) {
+        return self;
+    }
+    long slot = ATOMIC_INC(&thread_count);
+    if((slot >= TRACE_MAX_THREADS) || (NULL == (self = calloc(1, sizeof(trace_thread_t))))) {
+        untraced = true;
+        return NULL;
+    }
+    self->id = (int)slot;
+    threads[slot] = self;
+    return self;
+}
+
+void ssi_trace_end(trace_stage_t stage, uint64_t t0) {
+    uint64_t dur = ssi_trace_now() - t0;
+    trace_thread_t *t = this_thread();
+    if((NULL == t) || (stage >= TRACE_STAGES)) {
+        return;
+    }
+
+    trace_stat_t *s = &t->stats[stage];
+    s->calls++;
+    s->total_ns += dur;
+    if(dur > s->max_ns) {
+        s->max_ns = dur;
+    }
+
+    if(!keep_events) {
+        return;
+    }
+    if(t->count == t->size) {
+        uint32_t size = t->size ? (t->size * 2) : 4096;
+        trace_event_t *more = NULL;
+        if(size <= TRACE_MAX_EVENTS) {
+            more = realloc(t->events, size * sizeof(trace_event_t));
+        }
+        if(NULL == more) {
+            t->dropped++;
+            return;
+        }
+        t->events = more;
+        t->size = size;
+    }
+    trace_event_t *e = &t->events[t->count++];
+    e->t0 = t0;
+    e->dur = (dur > UINT32_MAX) ? UINT32_MAX : (uint32_t)dur;
+    e->stage = stage;
+}
+
+const char *ssi_trace_name(trace_stage_t stage) {
+    return (stage < TRACE_STAGES) ? stage_names[stage] : "?";
+}
+
+/// @brief number of thread slots in use
+static int used_slots(void) {
+    return (thread_count < TRACE_MAX_THREADS) ? (int)thread_count : TRACE_MAX_THREADS;
+}
+
+void ssi_trace_stats(trace_stat_t *stats) {
+    memset(stats, 0, TRACE_STAGES * sizeof(trace_stat_t));
+    for(int i = 0; i < used_slots(); i++) {
+        trace_thread_t *t = threads[i];
+        if(NULL == t) continue;
+        for(int s = 0; s < TRACE_STAGES; s++) {
+            stats[s].calls += t->stats[s].calls;
+            stats[s].total_ns += t->stats[s].total_ns;
+            if(t->stats[s].max_ns > stats[s].max_ns) {
+                stats[s].max_ns = t->stats[s].max_ns;
+            }
+        }
+    }
+}
+
+void ssi_trace_print(FILE *fp, uint64_t wall_ns) {
+    trace_stat_t stats[TRACE_STAGES];
+    ssi_trace_stats(stats);
+
+    fprintf(fp, "%-10s %10s %12s %10s %10s", "stage", "calls", "total ms", "mean us", "max us");
+    fprintf(fp, wall_ns ? " %7s\n" : "\n", "of run");
+    for(int s = 0; s < TRACE_STAGES; s++) {
+        if(0 == stats[s].calls) continue;
+        fprintf(fp, "%-10s %10llu %12.3f %10.1f %10.1f", stage_names[s], (unsigned long long)stats[s].calls,
+                stats[s].total_ns / 1e6, (stats[s].total_ns / 1e3) / stats[s].calls, stats[s].max_ns / 1e3);
+        if(wall_ns) {
+            fprintf(fp, " %6.1f%%", (100.0 * stats[s].total_ns) / wall_ns);
+        }
+        fprintf(fp, "\n");
+    }
+    uint64_t dropped = 0;
+    for(int i = 0; i < used_slots(); i++) {
+        if(NULL != threads[i]) dropped += threads[i]->dropped;
+    }
+    if(dropped) {
+        fprintf(fp, "%llu spans weren't kept for the trace\n", (unsigned long long)dropped);
+    }
+}
+
+/// @brief prints a string as the contents of a JSON string, escaping what has to be
+static void print_json(FILE *fp, const char *str) {
+    for(const unsigned char *c = (const unsigned char *)str; *c; c++) {
+        if(('"' == *c) || ('\\' == *c)) {
+            fprintf(fp, "\\%c", *c);
+        } else if(*c < 0x20) {
+            fprintf(fp, "\\u%04x", *c);
+        } else {
+            fputc(*c, fp);
+        }
+    }
+}
+
+int ssi_trace_write(const char *fn, const char *process) {
+    FILE *fp = NULL;
+    int pid = getpid();
+
+    // the JSON array form doesn't need its closing bracket, so runs can keep appending
+    if(NULL == (fp = fopen(fn, "ab"))) {
+        return -2;
+    }
+    if(0 == ftell(fp)) {
+        fprintf(fp, "[\n");
+    }
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"", pid);
+    print_json(fp, (NULL != process) ? process : "ssi"); // a program path may hold anything
+    fprintf(fp, " (%d)\"}},\n", pid);
+    for(int i = 0; i < used_slots(); i++) {
+        trace_thread_t *t = threads[i];
+        if(NULL == t) continue;
+        fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}},\n",
+                pid, t->id, t->id);
+        for(uint32_t e = 0; e < t->count; e++) {
+            const trace_event_t *ev = &t->events[e];
+            // microseconds, with the nanoseconds kept as a fraction
+            fprintf(fp, "{\"name\":\"%s\",\"cat\":\"ssi\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03u,\"dur\":%u.%03u},\n",
+                    stage_names[ev->stage], pid, t->id,
+                    (unsigned long long)(ev->t0 / 1000), (unsigned)(ev->t0 % 1000), ev->dur / 1000, ev->dur % 1000);
+        }
+    }
+    return (0 == fclose(fp)) ? 0 : -2;
+}
+
+void ssi_trace_free(void) {
+    ssi_trace_on = false;
+    for(int i = 0; i < used_slots(); i++) {
+        if(NULL == threads[i]) continue;
+        free(threads[i]->events);
+        free(threads[i]);
+        threads[i] = NULL;
+    }
+    thread_count = 0;
+    self = NULL; // only the calling thread's, the others are expected to be done
+}
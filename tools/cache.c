@@ -0,0 +1,264 @@
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#define HAVE_POSIX_FS
+#endif
+
+#define KEY_LEN (16)    // hex digits in a key
+
+int cache_open(conv_cache_t *c, const char *dir, uint64_t cap, bool link) {
+    if((NULL == c) || (NULL == dir)) {
+        return -1;  // NULL pointer error
+    }
+    memset(c, 0, sizeof(conv_cache_t));
+    if(0 != make_dir(dir)) {
+        return -2;  // can't create cache directory
+    }
+    size_t len = strlen(dir);
+    if(NULL == (c->dir = malloc(len + 1))) {
+        return -1;  // unable to allocate mem
+    }
+    strcpy(c->dir, dir);
+    c->cap = cap;
+    c->link = link;
+    return 0;
+}
+
+void cache_close(conv_cache_t *c) {
+    if(NULL == c) return;
+    free_s(c->dir);
+}
+
+/// @brief works out the key for a conversion, from the input and everything that affects the output
+static uint64_t cache_key(const conv_spec_t *spec, const memstream_buf_t *src) {
+    uint8_t desc[16] = {0};
+    uint64_t h = hash64(src->data, src->len, 0);
+    memcpy(&desc[0], &h, 8);
+    desc[8] = CACHE_VERSION;
+    desc[9] = spec->to_bmp;
+    desc[10] = spec->format;
+    desc[11] = spec->pal_sel;
+    memcpy(&desc[12], &spec->width, 2);
+    memcpy(&desc[14], &spec->height, 2);
+    return hash64(desc, sizeof(desc), 0);
+}
+
+/// @brief copies a file, replacing the destination rather than writing over it, as it could
+///        be a link to a cached output
+/// @return 0 on success, -2 if the source can't be read, -5 if the destination can't be written
+static int copy_file(const char *from, const char *to) {
+    int rval = 0;
+    mapped_file_t src = {0};
+    FILE *fp = NULL;
+
+    if(0 != map_file(&src, from, true)) {
+        return -2;
+    }
+    remove(to);
+    if(NULL == (fp = fopen(to, "wb"))) {
+        rval = -5;
+        goto CLEANUP;
+    }
+    if(src.buf.len && (1 != fwrite(src.buf.data, src.buf.len, 1, fp))) {
+        rval = -5;
+    }
+    if(0 != fclose(fp)) {
+        rval = -5;
+    }
+
+CLEANUP:
+    unmap_file(&src);
+    return rval;
+}
+
+/// @brief puts a file in place by linking it if allowed, otherwise copying it
+/// @return 0 on success, otherwise an error code as copy_file()
+static int place_file(const conv_cache_t *c, const char *from, const char *to) {
+#ifdef HAVE_POSIX_FS
+    if(c->link) {
+        remove(to);
+        if(0 == link(from, to)) {
+            return 0;
+        }
+        // different file systems can't be linked across, so fall back to copying
+    }
+#endif
+    return copy_file(from, to);
+}
+
+int convert_file_cached(ssi_ctx_t *ctx, const conv_cache_t *c, const conv_spec_t *spec,
+                        const char *fi, const char *fo, size_t *bytes, bool *hit) {
+    int rval = 0;
+    mapped_file_t src = {0};
+    char *entry = NULL;
+    char *tmp = NULL;
+
+    if(NULL != hit) *hit = false;
+    if((NULL == c) || (NULL == c->dir) || (NULL == spec) || (NULL == fi) || (NULL == fo)) {
+        return -1;  // NULL pointer error
+    }
+
+    if(0 != map_file(&src, fi, true)) {
+        rval = -2;  // can't read input file
+        goto CLEANUP;
+    }
+    if(NULL != bytes) *bytes = src.buf.len;
+
+    // the entry is named by its key, with the extension of the output
+    size_t len = strlen(c->dir) + 1 + KEY_LEN + 4 + 1 + 8 + 4;
+    entry = ssi_alloc(ctx, len + 1);
+    tmp = ssi_alloc(ctx, len + 1);
+    if((NULL == entry) || (NULL == tmp)) {
+        rval = -4;  // unable to allocate mem
+        goto CLEANUP;
+    }
+    uint64_t key = cache_key(spec, &src.buf);
+    snprintf(entry, len + 1, "%s/%016llx%s", c->dir, (unsigned long long)key, spec_extension(spec));
+    unmap_file(&src);
+
+    if(0 == place_file(c, entry, fo)) {
+#ifdef HAVE_POSIX_FS
+        utime(entry, NULL); // recently used, so last to be evicted
+#endif
+        if(NULL != hit) *hit = true;
+        goto CLEANUP;
+    }
+
+    // not cached, or unreadable, so convert it. The output could be a link to a cached
+    // output, so it is replaced rather than overwritten
+    remove(fo);
+    if(0 != (rval = convert_file(ctx, spec, fi, fo, NULL))) {
+        goto CLEANUP;
+    }
+
+    // add it under a name of its own first, so the entry appears all at once even with
+    // other threads adding the same output
+    snprintf(tmp, len + 1, "%s/%016llx.%08x.tmp", c->dir, (unsigned long long)key,
+             (uint32_t)hash64(fo, strlen(fo), 0));
+    if(0 == place_file(c, fo, tmp)) {
+        if(0 != rename(tmp, entry)) {
+            remove(tmp); // not cached, but the conversion itself went fine
+        }
+    }
+
+CLEANUP:
+    unmap_file(&src);
+    ssi_release(ctx, entry);
+    ssi_release(ctx, tmp);
+    return rval;
+}
+
+#ifdef HAVE_POSIX_FS
+// a cached output, as found when trimming
+typedef struct {
+    char        name[KEY_LEN + 8];
+    uint64_t    used;   // last time it was used, ns
+    uint64_t    size;
+} cache_item_t;
+
+static int used_cmp(const void *a, const void *b) {
+    uint64_t ua = ((const cache_item_t *)a)->used;
+    uint64_t ub = ((const cache_item_t *)b)->used;
+    return (ua > ub) - (ua < ub);
+}
+
+/// @brief returns when a file was last modified in ns, so outputs used within the same
+///        second of each other still evict in the order they were used
+static uint64_t mtime_ns(const struct stat *st) {
+#if defined(__APPLE__)
+    return ((uint64_t)st->st_mtimespec.tv_sec * 1000000000ull) + st->st_mtimespec.tv_nsec;
+#else
+    return ((uint64_t)st->st_mtim.tv_sec * 1000000000ull) + st->st_mtim.tv_nsec;
+#endif
+}
+
+/// @brief true if the name is that of a cached output, a key and an extension
+static bool is_entry(const char *name) {
+    if((strlen(name) != (KEY_LEN + 4)) || (strspn(name, "0123456789abcdef") != KEY_LEN)) {
+        return false;
+    }
+    return '.' == name[KEY_LEN];
+}
+#endif
+
+int cache_trim(const conv_cache_t *c, uint64_t *kept, size_t *evicted) {
+    int rval = 0;
+    uint64_t total = 0;
+    size_t gone = 0;
+
+    if((NULL == c) || (NULL == c->dir)) {
+        return -1;  // NULL pointer error
+    }
+#ifdef HAVE_POSIX_FS
+    DIR *d = NULL;
+    cache_item_t *items = NULL;
+    size_t count = 0;
+    size_t size = 0;
+    char *path = NULL;
+    size_t plen = strlen(c->dir) + 1 + sizeof(items->name);
+
+    if(NULL == (path = malloc(plen))) {
+        return -1;  // unable to allocate mem
+    }
+    if(NULL == (d = opendir(c->dir))) {
+        rval = -2;  // can't read cache directory
+        goto CLEANUP;
+    }
+
+    // gather up the outputs, and when each was last used
+    struct dirent *de;
+    while(NULL != (de = readdir(d))) {
+        struct stat st;
+        if(!is_entry(de->d_name)) {
+            continue;
+        }
+        snprintf(path, plen, "%s/%s", c->dir, de->d_name);
+        if((0 != stat(path, &st)) || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if(count == size) {
+            size_t grow = size ? (size * 2) : 1024;
+            cache_item_t *more = realloc(items, grow * sizeof(cache_item_t));
+            if(NULL == more) {
+                rval = -1;  // unable to allocate mem
+                goto CLEANUP;
+            }
+            items = more;
+            size = grow;
+        }
+        strcpy(items[count].name, de->d_name);
+        items[count].used = mtime_ns(&st);
+        items[count].size = st.st_size;
+        total += st.st_size;
+        count++;
+    }
+
+    // evict from the least recently used on
+    if(c->cap && (total > c->cap)) {
+        qsort(items, count, sizeof(cache_item_t), used_cmp);
+        for(size_t i = 0; (i < count) && (total > c->cap); i++) {
+            snprintf(path, plen, "%s/%s", c->dir, items[i].name);
+            if(0 == remove(path)) {
+                total -= items[i].size;
+                gone++;
+            }
+        }
+    }
+
+CLEANUP:
+    if(NULL != d) closedir(d);
+    free_s(items);
+    free_s(path);
+#endif
+    if(NULL != kept) *kept = total;
+    if(NULL != evicted) *evicted = gone;
+    return rval;
+}
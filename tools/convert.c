@@ -0,0 +1,301 @@
+#include "convert.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "bmp.h"
+#include "pal-tools.h"
+#include "util.h"
+#include "ssi-trace.h"
+
+// EGA's 64 palette table entries
+static pal_entry_t ega_table[64] = { 
+  {0x00,0x00,0x00}, {0x00,0x00,0xaa}, {0x00,0xaa,0x00}, {0x00,0xaa,0xaa}, // 0x00-0x03
+  {0xaa,0x00,0x00}, {0xaa,0x00,0xaa}, {0xaa,0xaa,0x00}, {0xaa,0xaa,0xaa}, // 0x04-0x07
+  {0x00,0x00,0x55}, {0x00,0x00,0xff}, {0x00,0xaa,0x55}, {0x00,0xaa,0xff}, // 0x08-0x0b
+  {0xAA,0x00,0x55}, {0xAA,0x00,0xFF}, {0xAA,0xAA,0x55}, {0xAA,0xAA,0xFF}, // 0x0c-0x0f
+  {0x00,0x55,0x00}, {0x00,0x55,0xAA}, {0x00,0xFF,0x00}, {0x00,0xFF,0xAA}, // 0x10-0x13
+  {0xAA,0x55,0x00}, {0xAA,0x55,0xAA}, {0xAA,0xFF,0x00}, {0xAA,0xFF,0xAA}, // 0x14-0x17
+  {0x00,0x55,0x55}, {0x00,0x55,0xFF}, {0x00,0xFF,0x55}, {0x00,0xFF,0xFF}, // 0x18-0x1b
+  {0xAA,0x55,0x55}, {0xAA,0x55,0xFF}, {0xAA,0xFF,0x55}, {0xAA,0xFF,0xFF}, // 0x1c-0x1f
+  {0x55,0x00,0x00}, {0x55,0x00,0xAA}, {0x55,0xAA,0x00}, {0x55,0xAA,0xAA}, // 0x20-0x23
+  {0xFF,0x00,0x00}, {0xFF,0x00,0xAA}, {0xFF,0xAA,0x00}, {0xFF,0xAA,0xAA}, // 0x24-0x27
+  {0x55,0x00,0x55}, {0x55,0x00,0xFF}, {0x55,0xAA,0x55}, {0x55,0xAA,0xFF}, // 0x28-0x2b
+  {0xFF,0x00,0x55}, {0xFF,0x00,0xFF}, {0xFF,0xAA,0x55}, {0xFF,0xAA,0xFF}, // 0x2c-0x2f
+  {0x55,0x55,0x00}, {0x55,0x55,0xAA}, {0x55,0xFF,0x00}, {0x55,0xFF,0xAA}, // 0x30-0x33
+  {0xFF,0x55,0x00}, {0xFF,0x55,0xAA}, {0xFF,0xFF,0x00}, {0xFF,0xFF,0xAA}, // 0x34-0x37
+  {0x55,0x55,0x55}, {0x55,0x55,0xFF}, {0x55,0xFF,0x55}, {0x55,0xFF,0xFF}, // 0x38-0x3b
+  {0xFF,0x55,0x55}, {0xFF,0x55,0xFF}, {0xFF,0xFF,0x55}, {0xFF,0xFF,0xFF}  // 0x3c-0x3f
+};
+
+// default 16 ega colours (mapping in ega_table)
+static uint8_t ega_pal[16] = {
+     0,  1,  2,  3, 
+     4,  5, 20,  7, 
+    56, 57, 58, 59, 
+    60, 61, 62, 63    
+};
+
+// SSI "Western Front" Title image palette
+/*
+uint8_t ega_pal[16] = { 
+   0,  0, 60, 37, 
+  31, 59, 35, 10,
+  56,  4, 46, 46, 
+  39, 20, 62, 63
+};
+*/
+
+// remaps the CGA colour indicies to the EGA equivalents for each of the palettes
+// background is assumed to be black, though in reality it can be programmed to
+// any of the 16 colours
+static uint8_t cga2ega[6][4] = {
+    {0,2,4,6},     // mode 4 palette 0 low intensity  [black, dark green, dark red, brown]
+    {0,10,12,14},  // mode 4 palette 0 high intensity [black, light green, light red, yellow]
+    {0,3,5,7},     // mode 4 palette 1 low intensity  [black, dark cyan, dark magenta, light grey]
+    {0,11,13,15},  // mode 4 palette 1 high intensity [black, light cyan, light magenta, white]
+    {0,3,4,7},     // mode 5 low intensity            [black, dark cyan, dark red, light gray]
+    {0,11,12,15}   // mode 5 high intensity           [black, light cyan, light red, white]
+};
+
+void make_palette(pal_entry_t *pal, bool is_cga, uint8_t pal_sel) {
+    uint64_t t0 = TRACE_BEGIN();
+    memset(pal, 0, 16 * sizeof(pal_entry_t));
+    if(is_cga) {
+        // copy the EGA palette entries over to their CGA locations
+        // for the selected palette
+        for(int p = 0; p < 4; p++) {
+            pal[p] = ega_table[ega_pal[cga2ega[pal_sel][p]]];
+        }
+    } else {
+        for(int p = 0; p < 16; p++) {
+            pal[p] = ega_table[ega_pal[p]];
+        }
+    }
+    TRACE_END(TRACE_PALETTE, t0);
+}
+
+/// @brief case insensitive string comparison
+/// @return true if the strings match
+static bool same_word(const char *a, const char *b) {
+    while(*a && (tolower((unsigned char)*a) == tolower((unsigned char)*b))) {
+        a++; b++;
+    }
+    return (0 == *a) && (0 == *b);
+}
+
+int parse_spec(conv_spec_t *spec, const char *str) {
+    memset(spec, 0, sizeof(conv_spec_t));
+    spec->pal_sel = 1; // CGA palette 1 is the default
+
+    // BMP to IMG conversions just name the variant
+    if(same_word(str, "ega")) {
+        spec->format = IMG_EGA;
+        return 0;
+    } else if(same_word(str, "cga")) {
+        spec->format = IMG_CGA;
+        return 0;
+    } else if(same_word(str, "bin")) {
+        spec->format = IMG_BIN;
+        return 0;
+    }
+
+    // otherwise it's a resolution with the optional suffixes
+    char charfmt = 0;
+    char charpal = 0;
+    spec->to_bmp = true;
+    if(2 > sscanf(str, "%hu%*[xX]%hu%c%c", &spec->width, &spec->height, &charfmt, &charpal)) {
+        return -1;
+    }
+    if((0 == spec->width) || (0 == spec->height)) {
+        return -1;
+    }
+
+    spec->format = IMG_EGA;
+    if(charfmt) { // format specifier was provided
+        if('c' == tolower(charfmt)) {
+            spec->format = IMG_CGA;
+            if(charpal) {
+                if(!isdigit(charpal) || ((charpal - '0') > 5)) {
+                    return -1;
+                }
+                spec->pal_sel = charpal - '0';
+            }
+        } else if('a' == tolower(charfmt)) {
+            spec->format = IMG_AMIGA;
+        } else if('b' == tolower(charfmt)) {
+            spec->format = IMG_BIN;
+        } else if('e' != tolower(charfmt)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+const char *spec_extension(const conv_spec_t *spec) {
+    if(spec->to_bmp) return ".BMP";
+    return (IMG_BIN == spec->format) ? ".BIN" : ".IMG";
+}
+
+int convert_img_buf(ssi_ctx_t *ctx, const conv_spec_t *spec, memstream_buf_t *src, const char *fo) {
+    int rval = 0;
+    memstream_buf_t bmp = {0, 0, NULL};
+    pal_entry_t pal[16];
+    uint16_t width = spec->width;
+    uint16_t height = spec->height;
+
+    if((NULL == src) || (NULL == src->data) || (NULL == fo) || !spec->to_bmp) {
+        return -1;  // NULL pointer error
+    }
+    if(src->len != img_file_size(spec->format, width, height)) {
+        return -3;  // size doesn't match the format and resolution
+    }
+
+    bmp.len = bmp4_size(width, height);
+    if(NULL == (bmp.data = ssi_alloc(ctx, bmp.len))) {
+        rval = -4;  // unable to allocate mem
+        goto CLEANUP;
+    }
+
+    int err;
+    if(IMG_CGA == spec->format) {
+        err = lace2bmp4(&bmp, src, width, height);
+    } else if(IMG_BIN == spec->format) {
+        err = ipln2bmp4(&bmp, src, width, height);
+    } else { // EGA and Amiga framebuffers are both full planes
+        err = pln2bmp4(&bmp, src, width, height);
+    }
+    if(0 != err) {
+        rval = -3;  // resolution doesn't fit the format
+        goto CLEANUP;
+    }
+
+    if(IMG_AMIGA == spec->format) {
+        uint64_t t0 = TRACE_BEGIN();
+        read_amiga_pal(pal, &src->data[src->len - AMIGA_PAL_SZ]); // the palette follows the framebuffer
+        pal4_to_pal8(pal, pal, 16);
+        TRACE_END(TRACE_PALETTE, t0);
+    } else {
+        make_palette(pal, IMG_CGA == spec->format, spec->pal_sel);
+    }
+
+    if(0 != save_bmp4_packed(fo, &bmp, width, height, pal)) {
+        rval = -5;  // can't write output file
+        goto CLEANUP;
+    }
+
+CLEANUP:
+    ssi_release(ctx, bmp.data);
+    return rval;
+}
+
+/// @brief converts an IMG file to a 16 colour BMP, decoding straight from the mapped file
+static int img_to_bmp(ssi_ctx_t *ctx, const conv_spec_t *spec, const char *fi, const char *fo, size_t *bytes) {
+    mapped_file_t src = {0};
+
+    if(0 != map_file(&src, fi, true)) {
+        return -2;  // can't read input file
+    }
+    *bytes = src.buf.len;
+    int rval = convert_img_buf(ctx, spec, &src.buf, fo);
+    unmap_file(&src);
+    return rval;
+}
+
+/// @brief converts a 16 colour BMP to an IMG file, packing each line straight into the image
+static int bmp_to_img(ssi_ctx_t *ctx, const conv_spec_t *spec, const char *fi, const char *fo, size_t *bytes) {
+    int rval = 0;
+    FILE *fp = NULL;
+    bmp4_reader_t rd = {0};
+    memstream_buf_t img = {0, 0, NULL};
+
+    int err = bmp4_open_ctx(ctx, &rd, fi);
+    if(0 != err) {
+        rval = ((-2 == err) || (-3 == err)) ? -2 : (-5 == err) ? -4 : -3;
+        goto CLEANUP;
+    }
+    *bytes = rd.map.mapped ? rd.map.buf.len : filesize(rd.fp);
+
+    // zeroed, as the layouts don't always fill the whole file
+    img.len = img_file_size(spec->format, rd.width, rd.height);
+    if(NULL == (img.data = ssi_zalloc(ctx, img.len))) {
+        rval = -4;  // unable to allocate mem
+        goto CLEANUP;
+    }
+
+    uint64_t t0 = TRACE_BEGIN();
+    for(int l = 0; l < rd.height; l++) {
+        uint8_t *line;
+        uint16_t y;
+        err = bmp4_read_line(&rd, &line, &y);
+        if(0 != err) {
+            rval = (-7 == err) ? -3 : -2;  // a colour past the first 16, or can't read input file
+            goto CLEANUP;
+        }
+        if(IMG_CGA == spec->format) {
+            err = bmp42lace(&img, line, y, rd.width, rd.height);
+        } else if(IMG_BIN == spec->format) {
+            err = bmp42ipln(&img, line, y, rd.width, rd.height);
+        } else {
+            err = bmp42pln(&img, line, y, rd.width, rd.height);
+        }
+        if(0 != err) {
+            rval = -3;  // image size doesn't fit the format
+            goto CLEANUP;
+        }
+    }
+    TRACE_END(TRACE_BMP42IMG, t0);
+
+    if(NULL == (fp = fopen(fo, "wb"))) {
+        rval = -5;  // can't open/create output file
+        goto CLEANUP;
+    }
+    t0 = TRACE_BEGIN();
+    int nr = fwrite(img.data, img.len, 1, fp);
+    TRACE_END(TRACE_FWRITE, t0);
+    if(1 != nr) {
+        rval = -5;  // unable to write file
+        goto CLEANUP;
+    }
+    err = fclose(fp);
+    fp = NULL;
+    if(0 != err) {
+        rval = -5;  // unable to write file
+    }
+
+CLEANUP:
+    fclose_s(fp);
+    bmp4_close(&rd);
+    ssi_release(ctx, img.data);
+    return rval;
+}
+
+int convert_file(ssi_ctx_t *ctx, const conv_spec_t *spec, const char *fi, const char *fo, size_t *bytes) {
+    size_t nb = 0;
+    int rval;
+
+    if((NULL == spec) || (NULL == fi) || (NULL == fo)) {
+        return -1;  // NULL pointer error
+    }
+    if(spec->to_bmp) {
+        rval = img_to_bmp(ctx, spec, fi, fo, &nb);
+    } else if(IMG_AMIGA == spec->format) {
+        rval = -1;  // Amiga images can only be read
+    } else {
+        rval = bmp_to_img(ctx, spec, fi, fo, &nb);
+    }
+    if(NULL != bytes) *bytes = nb;
+    return rval;
+}
+
+const char *convert_error(int rval) {
+    switch(rval) {
+        case 0:  return "ok";
+        case -1: return "invalid conversion";
+        case -2: return "unable to read input file";
+        case -3: return "input doesn't match the format or resolution";
+        case -4: return "unable to allocate memory";
+        case -5: return "unable to write output file";
+        default: return "unknown error";
+    }
+}
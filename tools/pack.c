@@ -0,0 +1,340 @@
+#include "pack.h"
+#include <stdlib.h>
+#include <string.h>
+#include "deflate.h"
+
+int pack_open(pack_reader_t *pk, const char *fn) {
+    int rval = 0;
+
+    if((NULL == pk) || (NULL == fn)) {
+        return -1;  // NULL pointer error
+    }
+    memset(pk, 0, sizeof(pack_reader_t));
+
+    // only the index and the entries asked for are read, so don't read ahead
+    if(0 != map_file_random(&pk->map, fn, true)) {
+        return -2;  // can't read archive
+    }
+    const uint8_t *base = pk->map.buf.data;
+    uint64_t len = pk->map.buf.len;
+
+    if(len < sizeof(pack_header_t)) {
+        rval = -3;  // too small to be an archive
+        goto CLEANUP;
+    }
+    pk->hdr = (const pack_header_t *)base;
+    if((0 != memcmp(pk->hdr->magic, PACK_MAGIC, 4)) || (PACK_VERSION != pk->hdr->version) ||
+       (sizeof(pack_entry_t) != pk->hdr->entry_size)) {
+        rval = -3;  // not an archive we know
+        goto CLEANUP;
+    }
+    if((0 == pk->hdr->align) || (0 != (pk->hdr->align & (pk->hdr->align - 1)))) {
+        rval = -3;  // alignment isn't a power of 2
+        goto CLEANUP;
+    }
+    uint64_t index_end = sizeof(pack_header_t) + ((uint64_t)pk->hdr->count * sizeof(pack_entry_t));
+    if(index_end > len) {
+        rval = -3;  // truncated index
+        goto CLEANUP;
+    }
+    pk->index = (const pack_entry_t *)&base[sizeof(pack_header_t)];
+    pk->count = pk->hdr->count;
+
+    // check every entry up front, so lookups and views can trust the index
+    for(uint32_t i = 0; i < pk->count; i++) {
+        const pack_entry_t *e = &pk->index[i];
+        if(('\0' == e->name[0]) || ('\0' != e->name[PACK_NAME_MAX - 1])) {
+            rval = -3;  // missing or unterminated name
+            goto CLEANUP;
+        }
+        if((i > 0) && (strcmp(pk->index[i - 1].name, e->name) >= 0)) {
+            rval = -3;  // out of order, lookups would miss entries
+            goto CLEANUP;
+        }
+        if((e->offset < index_end) || (e->offset > len) || (e->size > (len - e->offset))) {
+            rval = -3;  // payload outside the archive
+            goto CLEANUP;
+        }
+        if((e->format > IMG_AMIGA) || (e->pal_sel > 5)) {
+            rval = -3;  // not an image we can decode
+            goto CLEANUP;
+        }
+        if((PACK_STORED == e->method) ? (e->size != e->raw_size) : (PACK_ZLIB != e->method)) {
+            rval = -3;  // unknown compression, or sizes that disagree
+            goto CLEANUP;
+        }
+    }
+
+CLEANUP:
+    if(0 != rval) {
+        pack_close(pk);
+    }
+    return rval;
+}
+
+void pack_close(pack_reader_t *pk) {
+    if(NULL == pk) return;
+    unmap_file(&pk->map);
+    pk->hdr = NULL;
+    pk->index = NULL;
+    pk->count = 0;
+}
+
+static int entry_cmp(const void *key, const void *entry) {
+    return strcmp((const char *)key, ((const pack_entry_t *)entry)->name);
+}
+
+const pack_entry_t *pack_find(const pack_reader_t *pk, const char *name) {
+    if((NULL == pk) || (NULL == pk->index) || (NULL == name)) {
+        return NULL;
+    }
+    return bsearch(name, pk->index, pk->count, sizeof(pack_entry_t), entry_cmp);
+}
+
+int pack_view(const pack_reader_t *pk, const pack_entry_t *e, memstream_buf_t *view) {
+    if((NULL == pk) || (NULL == e) || (NULL == view)) {
+        return -1;  // NULL pointer error
+    }
+    if(PACK_STORED != e->method) {
+        return -1;  // has to be decompressed first
+    }
+    view->len = e->size;
+    view->pos = 0;
+    view->data = &pk->map.buf.data[e->offset];
+    return 0;
+}
+
+int pack_load(ssi_ctx_t *ctx, const pack_reader_t *pk, const pack_entry_t *e, memstream_buf_t *buf) {
+    if((NULL == pk) || (NULL == e) || (NULL == buf)) {
+        return -1;  // NULL pointer error
+    }
+    if(PACK_STORED == e->method) {
+        return pack_view(pk, e, buf);
+    }
+
+    buf->len = e->raw_size;
+    buf->pos = 0;
+    if(NULL == (buf->data = ssi_alloc(ctx, e->raw_size))) {
+        return -4;  // unable to allocate mem
+    }
+    size_t out;
+    if((0 != inflate_zlib(buf->data, buf->len, &pk->map.buf.data[e->offset], e->size, &out)) ||
+       (out != e->raw_size)) {
+        ssi_release(ctx, buf->data);
+        buf->data = NULL;
+        return -3;  // corrupt entry
+    }
+    return 0;
+}
+
+void pack_release(ssi_ctx_t *ctx, const pack_entry_t *e, memstream_buf_t *buf) {
+    if((NULL == e) || (NULL == buf)) return;
+    if(PACK_STORED != e->method) {
+        ssi_release(ctx, buf->data);
+    }
+    buf->data = NULL;
+}
+
+const char *pack_format_name(uint8_t format) {
+    switch(format) {
+        case IMG_EGA:   return "ega";
+        case IMG_BIN:   return "bin";
+        case IMG_CGA:   return "cga";
+        case IMG_AMIGA: return "amiga";
+        default:        return "?";
+    }
+}
+
+/// @brief writes zeros up to the next payload boundary
+/// @return 0 on success, -4 on a write error
+static int pad_to_align(pack_writer_t *pw) {
+    static const uint8_t zeros[256] = {0};
+    uint64_t next = (pw->pos + pw->align - 1) & ~((uint64_t)pw->align - 1);
+    while(pw->pos < next) {
+        size_t n = ((next - pw->pos) < sizeof(zeros)) ? (size_t)(next - pw->pos) : sizeof(zeros);
+        if(1 != fwrite(zeros, n, 1, pw->fp)) {
+            return -4;  // unable to write file
+        }
+        pw->pos += n;
+    }
+    return 0;
+}
+
+int pack_create(ssi_ctx_t *ctx, pack_writer_t *pw, const char *fn, uint32_t count, uint32_t align, int level) {
+    int rval = 0;
+
+    // do some basic error checking on the inputs
+    if((NULL == pw) || (NULL == fn)) {
+        return -1;  // NULL pointer error
+    }
+    if(0 == align) {
+        align = PACK_ALIGN_DEFAULT;
+    }
+    if((0 != (align & (align - 1))) || (level < 0) || (level > 9)) {
+        return -1;  // alignment has to be a power of 2
+    }
+    memset(pw, 0, sizeof(pack_writer_t));
+    pw->count = count;
+    pw->align = align;
+    pw->level = level;
+    pw->ctx = ctx;
+
+    // zeroed, so the unused parts of the names are padded
+    if(count && (NULL == (pw->index = ssi_zalloc(ctx, (size_t)count * sizeof(pack_entry_t))))) {
+        rval = -3;  // unable to allocate mem
+        goto CLEANUP;
+    }
+    if(level && (NULL == (pw->z = ssi_alloc(ctx, sizeof(deflate_t))))) {
+        rval = -3;  // unable to allocate mem
+        goto CLEANUP;
+    }
+
+    // try to open/create output file
+    if(NULL == (pw->fp = fopen(fn, "wb"))) {
+        rval = -2;  // can't open/create output file
+        goto CLEANUP;
+    }
+
+    // leave room for the header and index, they are written last once the index is sorted
+    pack_header_t hdr = {0};
+    if(1 != fwrite(&hdr, sizeof(hdr), 1, pw->fp)) {
+        rval = -4;  // unable to write file
+        goto CLEANUP;
+    }
+    pw->pos = sizeof(hdr);
+    if(count && (1 != fwrite(pw->index, (size_t)count * sizeof(pack_entry_t), 1, pw->fp))) {
+        rval = -4;  // unable to write file
+        goto CLEANUP;
+    }
+    pw->pos += (uint64_t)count * sizeof(pack_entry_t);
+
+CLEANUP:
+    if(0 != rval) {
+        fclose_s(pw->fp);
+        ssi_release(ctx, pw->z);
+        ssi_release(ctx, pw->index);
+        pw->z = NULL;
+        pw->index = NULL;
+    }
+    return rval;
+}
+
+// compressed output goes to the buffer, failing once it is no smaller than the original
+static int emit_zbuf(void *arg, const uint8_t *data, size_t len) {
+    pack_writer_t *pw = arg;
+    if(len > (pw->zcap - pw->zlen)) {
+        return -1;  // not worth compressing
+    }
+    memcpy(&pw->zbuf[pw->zlen], data, len);
+    pw->zlen += len;
+    return 0;
+}
+
+int pack_add(pack_writer_t *pw, const char *name, img_format_t format, uint16_t width, uint16_t height,
+             uint8_t pal_sel, const memstream_buf_t *img) {
+    if((NULL == pw) || (NULL == pw->fp) || (NULL == name) || (NULL == img) || (NULL == img->data)) {
+        return -1;  // NULL pointer error
+    }
+    if((pw->added >= pw->count) || ('\0' == name[0]) || (strlen(name) >= PACK_NAME_MAX) ||
+       (pal_sel > 5) || (0 == img->len) || (img->len > UINT32_MAX)) {
+        return -1;  // archive full, or nothing we can store
+    }
+
+    pack_entry_t *e = &pw->index[pw->added];
+    strcpy(e->name, name);
+    e->format = format;
+    e->width = width;
+    e->height = height;
+    e->pal_sel = pal_sel;
+    e->raw_size = (uint32_t)img->len;
+    e->method = PACK_STORED;
+
+    const uint8_t *payload = img->data;
+    size_t size = img->len;
+    if(pw->level) {
+        // the buffer only has to hold as much as would be stored raw, anything bigger
+        // isn't kept. Images mostly share a few sizes so it rarely needs to grow
+        if(pw->zcap < (img->len - 1)) {
+            ssi_release(pw->ctx, pw->zbuf);
+            pw->zcap = 0;
+            if(NULL != (pw->zbuf = ssi_alloc(pw->ctx, img->len - 1))) {
+                pw->zcap = img->len - 1;
+            }
+        }
+        pw->zlen = 0;
+        if(pw->zcap) {
+            deflate_init(pw->z, pw->level, emit_zbuf, pw);
+            if((0 == deflate_write(pw->z, img->data, img->len)) && (0 == deflate_finish(pw->z))) {
+                e->method = PACK_ZLIB;
+                payload = pw->zbuf;
+                size = pw->zlen;
+            }
+        }
+    }
+    e->size = (uint32_t)size;
+
+    if(0 != pad_to_align(pw)) {
+        return -4;  // unable to write file
+    }
+    e->offset = pw->pos;
+    if(1 != fwrite(payload, size, 1, pw->fp)) {
+        return -4;  // unable to write file
+    }
+    pw->pos += size;
+    pw->added++;
+    return 0;
+}
+
+static int name_cmp(const void *a, const void *b) {
+    return strcmp(((const pack_entry_t *)a)->name, ((const pack_entry_t *)b)->name);
+}
+
+int pack_finish(pack_writer_t *pw) {
+    int rval = 0;
+    if(NULL == pw) {
+        return -1;  // NULL pointer error
+    }
+    if(NULL != pw->fp) {
+        if(pw->added != pw->count) {
+            rval = -5;  // not all the entries were added
+            goto CLEANUP;
+        }
+
+        // sorted so readers can binary search it
+        if(pw->count) {
+            qsort(pw->index, pw->count, sizeof(pack_entry_t), name_cmp);
+        }
+        for(uint32_t i = 1; i < pw->count; i++) {
+            if(0 == strcmp(pw->index[i - 1].name, pw->index[i].name)) {
+                rval = -6;  // lookups couldn't tell them apart
+                goto CLEANUP;
+            }
+        }
+
+        pack_header_t hdr = {0};
+        memcpy(hdr.magic, PACK_MAGIC, 4);
+        hdr.version = PACK_VERSION;
+        hdr.entry_size = sizeof(pack_entry_t);
+        hdr.count = pw->count;
+        hdr.align = pw->align;
+        if((0 != fseek(pw->fp, 0, SEEK_SET)) || (1 != fwrite(&hdr, sizeof(hdr), 1, pw->fp)) ||
+           (pw->count && (1 != fwrite(pw->index, (size_t)pw->count * sizeof(pack_entry_t), 1, pw->fp)))) {
+            rval = -4;  // unable to write file
+            goto CLEANUP;
+        }
+    }
+
+CLEANUP:
+    if((NULL != pw->fp) && (0 != fclose(pw->fp)) && (0 == rval)) {
+        rval = -4;  // unable to write file
+    }
+    pw->fp = NULL;
+    ssi_release(pw->ctx, pw->zbuf);
+    ssi_release(pw->ctx, pw->z);
+    ssi_release(pw->ctx, pw->index);
+    pw->zbuf = NULL;
+    pw->z = NULL;
+    pw->index = NULL;
+    pw->zcap = 0;
+    return rval;
+}
@@ -0,0 +1,284 @@
+#include "patch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bmp.h"
+#include "util.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define HAVE_PWRITE
+#endif
+
+// an IMG opened for writing lines in place
+typedef struct {
+#ifdef HAVE_PWRITE
+    int     fd;
+#else
+    FILE    *fp;
+#endif
+} img_file_t;
+
+/// @brief opens an IMG to write lines into it in place
+/// @return 0 on success, -1 if it can't be opened, 1 if it is hard linked elsewhere, such as
+///         an output ssi-batch -L linked to its cache, and so mustn't be written in place
+static int img_file_open(img_file_t *f, const char *fn) {
+#ifdef HAVE_PWRITE
+    struct stat st;
+    f->fd = open(fn, O_RDWR);
+    if(f->fd < 0) {
+        return -1;
+    }
+    if((0 != fstat(f->fd, &st)) || (st.st_nlink > 1)) {
+        close(f->fd);
+        return 1;
+    }
+    return 0;
+#else
+    f->fp = fopen(fn, "r+b");
+    return (NULL == f->fp) ? -1 : 0;
+#endif
+}
+
+static int img_file_write(img_file_t *f, const uint8_t *data, size_t len, size_t ofs) {
+#ifdef HAVE_PWRITE
+    // positioned writes, no seeking between the scattered plane segments
+    return ((ssize_t)len == pwrite(f->fd, data, len, ofs)) ? 0 : -1;
+#else
+    if((0 != fseek(f->fp, (long)ofs, SEEK_SET)) || (1 != fwrite(data, len, 1, f->fp))) {
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+static int img_file_close(img_file_t *f) {
+#ifdef HAVE_PWRITE
+    int err = close(f->fd);
+#else
+    int err = fclose(f->fp);
+#endif
+    return (0 == err) ? 0 : -1;
+}
+
+/// @brief hashes the whole of an IMG as it is now
+/// @param len set on return to the size of the IMG
+/// @return 0 on success, -1 if the IMG can't be read
+static int hash_img(const char *img, uint64_t *hash, uint64_t *len) {
+    mapped_file_t mf = {0};
+    if(0 != map_file(&mf, img, true)) {
+        return -1;
+    }
+    *hash = hash64(mf.buf.data, mf.buf.len, 0);
+    *len = mf.buf.len;
+    unmap_file(&mf);
+    return 0;
+}
+
+/// @brief reads the hashes from a sidecar, if it describes the IMG as it is now
+/// @param hashes filled in with a hash for each line
+/// @return true if the sidecar is usable
+static bool read_rows(const char *fn, const char *img, img_format_t format, uint16_t width, uint16_t height,
+                      uint64_t *hashes) {
+    bool ok = false;
+    FILE *fp = NULL;
+    rows_header_t hdr;
+    uint64_t img_hash, img_size;
+
+    if(NULL == (fp = fopen(fn, "rb"))) {
+        return false; // never converted, or converted without a sidecar
+    }
+    if(1 != fread(&hdr, sizeof(hdr), 1, fp)) {
+        goto CLEANUP;
+    }
+    if((0 != memcmp(hdr.magic, ROWS_MAGIC, 4)) || (ROWS_VERSION != hdr.version) ||
+       (format != hdr.format) || (width != hdr.width) || (height != hdr.height)) {
+        goto CLEANUP; // made from a different sort of image, so nothing can be kept
+    }
+    // the whole IMG is hashed, as a time stamp can't tell apart two writes close together
+    if((0 != hash_img(img, &img_hash, &img_size)) || (hdr.img_size != img_size) ||
+       (hdr.img_hash != img_hash) || (hdr.img_size != img_file_size(format, width, height))) {
+        goto CLEANUP; // the IMG has been changed some other way since
+    }
+    ok = (1 == fread(hashes, height * sizeof(uint64_t), 1, fp));
+
+CLEANUP:
+    fclose_s(fp);
+    return ok;
+}
+
+/// @brief writes a sidecar for the IMG as it is now
+/// @return 0 on success, -5 if the sidecar can't be written
+static int write_rows(const char *fn, const char *img, img_format_t format, uint16_t width, uint16_t height,
+                      const uint64_t *hashes) {
+    int rval = 0;
+    FILE *fp = NULL;
+    rows_header_t hdr = {0};
+
+    memcpy(hdr.magic, ROWS_MAGIC, 4);
+    hdr.version = ROWS_VERSION;
+    hdr.format = format;
+    hdr.width = width;
+    hdr.height = height;
+    if(0 != hash_img(img, &hdr.img_hash, &hdr.img_size)) {
+        return -5;
+    }
+
+    if(NULL == (fp = fopen(fn, "wb"))) {
+        return -5;
+    }
+    if((1 != fwrite(&hdr, sizeof(hdr), 1, fp)) || (1 != fwrite(hashes, height * sizeof(uint64_t), 1, fp))) {
+        rval = -5;
+    }
+    if(0 != fclose(fp)) {
+        rval = -5;
+    }
+    if(0 != rval) {
+        remove(fn); // a partial sidecar mustn't be trusted next time
+    }
+    return rval;
+}
+
+int patch_img(ssi_ctx_t *ctx, img_format_t format, const char *fi, const char *fo, patch_stats_t *st) {
+    int rval = 0;
+    bmp4_reader_t bmp = {0};
+    memstream_buf_t img = {0, 0, NULL};
+    uint64_t *hashes = NULL;    // hash of each line of the new BMP
+    uint64_t *old = NULL;       // as read from the sidecar
+    char *rows_name = NULL;
+    img_file_t f;
+    bool open = false;
+    patch_stats_t stats = {0};
+
+    if((NULL == fi) || (NULL == fo) || ((IMG_EGA != format) && (IMG_BIN != format))) {
+        return -1;  // only the planar variants are patched
+    }
+
+    int err = bmp4_open_ctx(ctx, &bmp, fi);
+    if(0 != err) {
+        return ((-2 == err) || (-3 == err)) ? -2 : (-5 == err) ? -4 : -3;
+    }
+    uint16_t width = bmp.width;
+    uint16_t height = bmp.height;
+    size_t stride = width / 2;      // bytes per line, all planes
+    size_t plane = stride / 4;      // bytes per line in each plane
+    stats.rows = height;
+
+    hashes = ssi_alloc(ctx, height * sizeof(uint64_t));
+    old = ssi_alloc(ctx, height * sizeof(uint64_t));
+    rows_name = ssi_alloc(ctx, strlen(fo) + sizeof(ROWS_EXTENSION));
+    if((NULL == hashes) || (NULL == old) || (NULL == rows_name)) {
+        rval = -4;  // unable to allocate mem
+        goto CLEANUP;
+    }
+    strcpy(rows_name, fo);
+    strcat(rows_name, ROWS_EXTENSION);
+
+    // lines straddling plane bytes can't be written on their own
+    stats.full = (0 != (width % 8)) || !read_rows(rows_name, fo, format, width, height, old);
+    if(!stats.full) {
+        err = img_file_open(&f, fo);
+        if(err < 0) {
+            rval = -5;  // can't write output file
+            goto CLEANUP;
+        }
+        open = (0 == err);
+        stats.full = !open; // shared with another name, so it is replaced instead
+    }
+    if(stats.full) {
+        // zeroed, as the layouts don't always fill the whole file
+        img.len = img_file_size(format, width, height);
+        img.data = ssi_zalloc(ctx, img.len);
+    } else {
+        // just the one line, which on its own is laid out the same for both variants
+        img.len = stride;
+        img.data = ssi_alloc(ctx, img.len);
+    }
+    if(NULL == img.data) {
+        rval = -4;  // unable to allocate mem
+        goto CLEANUP;
+    }
+
+    for(int l = 0; l < height; l++) {
+        uint8_t *line;
+        uint16_t y;
+        err = bmp4_read_line(&bmp, &line, &y);
+        if(0 != err) {
+            rval = (-7 == err) ? -3 : -2;  // a colour past the first 16, or can't read input file
+            goto CLEANUP;
+        }
+        hashes[y] = hash64(line, (width + 1) / 2, 0);
+
+        if(stats.full) {
+            err = (IMG_BIN == format) ? bmp42ipln(&img, line, y, width, height) :
+                                        bmp42pln(&img, line, y, width, height);
+            if(0 != err) {
+                rval = -3;  // resolution doesn't fit the format
+                goto CLEANUP;
+            }
+            continue;
+        }
+        if(hashes[y] == old[y]) {
+            continue;   // unchanged, the IMG already has it
+        }
+
+        // planerize the line on its own, then write each plane segment in its place
+        bmp42ipln(&img, line, 0, width, 1);
+        if(IMG_BIN == format) { // the planes of a line sit together
+            err = img_file_write(&f, img.data, stride, (size_t)y * stride);
+        } else { // each plane holds the whole image
+            size_t plane_size = (size_t)plane * height;
+            err = 0;
+            for(int p = 0; (0 == err) && (p < 4); p++) {
+                err = img_file_write(&f, &img.data[p * plane], plane, (p * plane_size) + ((size_t)y * plane));
+            }
+        }
+        if(0 != err) {
+            rval = -5;  // can't write output file
+            goto CLEANUP;
+        }
+        stats.changed++;
+    }
+
+    if(stats.full) {
+        // the IMG could be a link to a cached output, so it is replaced rather than overwritten
+        remove(fo);
+        FILE *fp = fopen(fo, "wb");
+        if(NULL == fp) {
+            rval = -5;  // can't write output file
+            goto CLEANUP;
+        }
+        err = (1 != fwrite(img.data, img.len, 1, fp));
+        if((0 != fclose(fp)) || err) {
+            rval = -5;  // can't write output file
+            goto CLEANUP;
+        }
+        stats.changed = height;
+    } else {
+        open = false;
+        if(0 != img_file_close(&f)) {
+            rval = -5;  // can't write output file
+            goto CLEANUP;
+        }
+    }
+
+    // taken after the IMG is closed, so the hash is of it as written
+    rval = write_rows(rows_name, fo, format, width, height, hashes);
+
+CLEANUP:
+    if(open) {
+        img_file_close(&f);
+    }
+    if((0 != rval) && (NULL != rows_name)) {
+        remove(rows_name); // the IMG may be part written, so convert it all next time
+    }
+    bmp4_close(&bmp);
+    ssi_release(ctx, img.data);
+    ssi_release(ctx, hashes);
+    ssi_release(ctx, old);
+    ssi_release(ctx, rows_name);
+    if(NULL != st) *st = stats;
+    return rval;
+}
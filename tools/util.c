@@ -1,5 +1,22 @@
 #include "util.h"
+#include "ssi-trace.h"
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#endif
 
 /// @brief determins the size of the file
 /// @param f handle to an open file
@@ -33,3 +50,287 @@ char *filename(char *path) {
 		return path;
 	return &path[i+1];
 }
+
+/// @brief reads a whole file into a heap buffer
+/// @param mf pointer to the mapped file to fill in
+/// @param fn name of the file to read
+/// @return 0 on success, otherwise an error code as map_file()
+static int read_file(mapped_file_t *mf, const char *fn) {
+    int rval = 0;
+    FILE *fp = NULL;
+
+    if(NULL == (fp = fopen(fn, "rb"))) {
+        rval = -2;
+        goto CLEANUP;
+    }
+    mf->buf.len = filesize(fp);
+    if(0 == mf->buf.len) {
+        goto CLEANUP; // nothing to read
+    }
+    // no need to zero the buffer, it is about to be overwritten
+    if(NULL == (mf->buf.data = malloc(mf->buf.len))) {
+        rval = -4;
+        goto CLEANUP;
+    }
+    uint64_t t0 = TRACE_BEGIN();
+    int nr = fread(mf->buf.data, mf->buf.len, 1, fp);
+    TRACE_END(TRACE_FREAD, t0);
+    if(1 != nr) {
+        rval = -3;
+        goto CLEANUP;
+    }
+
+CLEANUP:
+    fclose_s(fp);
+    return rval;
+}
+
+/// @brief maps a whole file, as map_file() and map_file_random()
+/// @param sequential true if the file will be read front to back, false for random access
+static int map_file_adv(mapped_file_t *mf, const char *fn, bool fallback, bool sequential) {
+    int rval = -5;
+
+    if((NULL == mf) || (NULL == fn)) {
+        return -1;
+    }
+    memset(mf, 0, sizeof(mapped_file_t));
+    uint64_t t0 = TRACE_BEGIN();
+
+#ifdef HAVE_MMAP
+    int fd = open(fn, O_RDONLY);
+    if(fd < 0) {
+        TRACE_END(TRACE_LOAD, t0);
+        return -2;
+    }
+    struct stat st;
+    if((0 == fstat(fd, &st)) && S_ISREG(st.st_mode)) {
+        if(0 == st.st_size) {
+            rval = 0; // empty file, nothing to map
+        } else {
+            void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(MAP_FAILED != map) {
+                if(sequential) {
+                    // the decoders walk through the data front to back, and will
+                    // want all of it, so have it read ahead
+                    madvise(map, st.st_size, MADV_SEQUENTIAL);
+                    madvise(map, st.st_size, MADV_WILLNEED);
+                } else {
+                    // only small parts will be wanted, reading ahead would waste IO
+                    madvise(map, st.st_size, MADV_RANDOM);
+                }
+                mf->buf.data = map;
+                mf->buf.len = st.st_size;
+                mf->mapped = true;
+                rval = 0;
+            }
+        }
+    }
+    close(fd); // the mapping stays valid after the file is closed
+#endif
+
+    if((0 != rval) && fallback) {
+        rval = read_file(mf, fn);
+    }
+    if(0 != rval) {
+        unmap_file(mf);
+    }
+    TRACE_END(TRACE_LOAD, t0);
+    return rval;
+}
+
+int map_file(mapped_file_t *mf, const char *fn, bool fallback) {
+    return map_file_adv(mf, fn, fallback, true);
+}
+
+int map_file_random(mapped_file_t *mf, const char *fn, bool fallback) {
+    return map_file_adv(mf, fn, fallback, false);
+}
+
+void unmap_file(mapped_file_t *mf) {
+    if(NULL == mf) return;
+#ifdef HAVE_MMAP
+    if(mf->mapped) {
+        munmap(mf->buf.data, mf->buf.len);
+        mf->buf.data = NULL;
+    }
+#endif
+    free_s(mf->buf.data);
+    mf->buf.len = 0;
+    mf->buf.pos = 0;
+    mf->mapped = false;
+}
+
+double mono_time(void) {
+#ifdef _WIN32
+    LARGE_INTEGER f, c;
+    QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&c);
+    return (double)c.QuadPart / f.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+#endif
+}
+
+int drop_cache(const char *fn) {
+#if defined(HAVE_MMAP) && defined(POSIX_FADV_DONTNEED)
+    int fd = open(fn, O_RDONLY);
+    if(fd < 0) {
+        return -1;
+    }
+    // only clean pages can be dropped, so write out anything pending first
+    fdatasync(fd);
+    int err = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return err ? -2 : 0;
+#else
+    (void)fn;
+    return -2;
+#endif
+}
+
+int make_dir(const char *path) {
+#ifdef _WIN32
+    int err = _mkdir(path);
+#else
+    int err = mkdir(path, 0777);
+#endif
+    return ((0 == err) || (EEXIST == errno)) ? 0 : -1;
+}
+
+// what was asked for on the command line, for trace_report()
+static bool trace_stats = false;
+static char *trace_file = NULL;
+static char *trace_prog = NULL;
+static uint64_t trace_start = 0;
+
+int trace_args(int *argc, char *argv[]) {
+    int n = 1;
+    for(int i = 1; i < *argc; i++) {
+        if(0 == strcmp(argv[i], "--stats")) {
+            trace_stats = true;
+        } else if(0 == strcmp(argv[i], "--trace")) {
+            if(++i == *argc) {
+                printf("--trace needs a file name\n");
+                return -1;
+            }
+            trace_file = argv[i];
+        } else {
+            argv[n++] = argv[i];
+        }
+    }
+    *argc = n;
+    argv[n] = NULL;
+
+    if(trace_stats || (NULL != trace_file)) {
+        if(!ssi_trace_available()) {
+            printf("Warning: built without SSI_TRACE, there will be nothing to report\n");
+        }
+        trace_prog = filename(argv[0]);
+        trace_start = ssi_trace_now();
+        ssi_trace_enable(NULL != trace_file); // the spans themselves are only kept for the trace
+    }
+    return 0;
+}
+
+void trace_report(void) {
+    if(!trace_stats && (NULL == trace_file)) {
+        return;
+    }
+    uint64_t wall = ssi_trace_now() - trace_start;
+    ssi_trace_disable();
+    if(trace_stats) {
+        printf("\nTimings, %.3f ms in all\n", wall / 1e6);
+        ssi_trace_print(stdout, wall);
+    }
+    if((NULL != trace_file) && (0 != ssi_trace_write(trace_file, trace_prog))) {
+        printf("Unable to write trace file '%s'\n", trace_file);
+    }
+    ssi_trace_free();
+    trace_stats = false;
+    trace_file = NULL;
+}
+
+static const uint64_t P1 = 0x9e3779b185ebca87ull;
+static const uint64_t P2 = 0xc2b2ae3d27d4eb4full;
+static const uint64_t P3 = 0x165667b19e3779f9ull;
+static const uint64_t P4 = 0x85ebca77c2b2ae63ull;
+static const uint64_t P5 = 0x27d4eb2f165667c5ull;
+
+static inline uint64_t rotl64(uint64_t v, int r) {
+    return (v << r) | (v >> (64 - r));
+}
+
+static inline uint64_t rd64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint32_t rd32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * P2;
+    return rotl64(acc, 31) * P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t v) {
+    acc ^= xxh_round(0, v);
+    return (acc * P1) + P4;
+}
+
+uint64_t hash64(const void *data, size_t len, uint64_t seed) {
+    const uint8_t *p = data;
+    const uint8_t *end = p + len;
+    uint64_t h;
+
+    if(len >= 32) {
+        // 4 independent lanes, so the multiplies can overlap
+        uint64_t v1 = seed + P1 + P2;
+        uint64_t v2 = seed + P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - P1;
+        do {
+            v1 = xxh_round(v1, rd64(p));
+            v2 = xxh_round(v2, rd64(p + 8));
+            v3 = xxh_round(v3, rd64(p + 16));
+            v4 = xxh_round(v4, rd64(p + 24));
+            p += 32;
+        } while((size_t)(end - p) >= 32);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = seed + P5;
+    }
+    h += len;
+
+    // the tail, 8 then 4 then 1 byte at a time
+    for(; (end - p) >= 8; p += 8) {
+        h ^= xxh_round(0, rd64(p));
+        h = (rotl64(h, 27) * P1) + P4;
+    }
+    if((end - p) >= 4) {
+        h ^= rd32(p) * P1;
+        h = (rotl64(h, 23) * P2) + P3;
+        p += 4;
+    }
+    for(; p < end; p++) {
+        h ^= *p * P5;
+        h = rotl64(h, 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}